@@ -0,0 +1,219 @@
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "ALTER EXTENSION vector UPDATE TO '0.8.0'" to load this file. \quit
+
+CREATE FUNCTION vector_scan_cache_stats(OUT max_entries int, OUT entries int, OUT hits bigint, OUT misses bigint, OUT invalidations bigint, OUT evictions bigint) RETURNS record
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION vector_scan_cache_reset() RETURNS void
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE STRICT PARALLEL SAFE;
+
+REVOKE ALL ON FUNCTION vector_scan_cache_reset() FROM PUBLIC;
+
+-- recall functions
+
+CREATE FUNCTION vector_recall_stats(OUT indexrelid oid, OUT samples bigint, OUT recall float8, OUT last_sample timestamptz) RETURNS SETOF record
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE STRICT PARALLEL SAFE;
+
+CREATE VIEW vector_recall AS
+	SELECT indexrelid::regclass AS index, samples, recall, last_sample FROM vector_recall_stats();
+
+-- lock functions
+
+CREATE FUNCTION vector_lock_stats(OUT indexrelid oid, OUT lock text, OUT acquisitions bigint, OUT waits bigint, OUT wait_time float8) RETURNS SETOF record
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION vector_lock_stats_reset() RETURNS void
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE STRICT PARALLEL SAFE;
+
+REVOKE ALL ON FUNCTION vector_lock_stats_reset() FROM PUBLIC;
+
+-- hnsw functions
+
+CREATE FUNCTION hnsw_knn_graph(index regclass, k int, OUT tid tid, OUT neighbor tid, OUT distance float8) RETURNS SETOF record
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE STRICT PARALLEL SAFE;
+
+-- k-means functions
+
+CREATE FUNCTION vector_kmeans_accum(internal, vector, integer) RETURNS internal
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE PARALLEL SAFE;
+
+CREATE FUNCTION vector_kmeans_accum(internal, vector, integer, text) RETURNS internal
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE PARALLEL SAFE;
+
+CREATE FUNCTION vector_kmeans_combine(internal, internal) RETURNS internal
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE PARALLEL SAFE;
+
+CREATE FUNCTION vector_kmeans_serialize(internal) RETURNS bytea
+	AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION vector_kmeans_deserialize(bytea, internal) RETURNS internal
+	AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION vector_kmeans_final(internal) RETURNS vector[]
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE PARALLEL SAFE;
+
+CREATE AGGREGATE kmeans(vector, integer) (
+	SFUNC = vector_kmeans_accum,
+	STYPE = internal,
+	FINALFUNC = vector_kmeans_final,
+	COMBINEFUNC = vector_kmeans_combine,
+	SERIALFUNC = vector_kmeans_serialize,
+	DESERIALFUNC = vector_kmeans_deserialize,
+	PARALLEL = SAFE
+);
+
+CREATE AGGREGATE kmeans(vector, integer, text) (
+	SFUNC = vector_kmeans_accum,
+	STYPE = internal,
+	FINALFUNC = vector_kmeans_final,
+	COMBINEFUNC = vector_kmeans_combine,
+	SERIALFUNC = vector_kmeans_serialize,
+	DESERIALFUNC = vector_kmeans_deserialize,
+	PARALLEL = SAFE
+);
+
+-- advisor functions
+
+CREATE FUNCTION vector_index_advisor(tbl regclass, col name, opclass name, sample_rows int DEFAULT 10000, queries int DEFAULT 100, k int DEFAULT 10,
+	OUT method text, OUT options text, OUT search text, OUT recall float8, OUT build_time float8, OUT query_time float8, OUT pareto bool) RETURNS SETOF record
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE STRICT PARALLEL UNSAFE;
+
+-- file functions
+
+CREATE FUNCTION vector_read_file(path text) RETURNS SETOF vector
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE STRICT PARALLEL UNSAFE;
+
+CREATE FUNCTION vector_read_file(path text, format text) RETURNS SETOF vector
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE STRICT PARALLEL UNSAFE;
+
+CREATE FUNCTION halfvec_read_file(path text) RETURNS SETOF halfvec
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE STRICT PARALLEL UNSAFE;
+
+CREATE FUNCTION halfvec_read_file(path text, format text) RETURNS SETOF halfvec
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE STRICT PARALLEL UNSAFE;
+
+CREATE FUNCTION vector_write_file(path text, query text) RETURNS bigint
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE STRICT PARALLEL UNSAFE;
+
+CREATE FUNCTION vector_write_file(path text, query text, format text) RETURNS bigint
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE STRICT PARALLEL UNSAFE;
+
+CREATE FUNCTION halfvec_write_file(path text, query text) RETURNS bigint
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE STRICT PARALLEL UNSAFE;
+
+CREATE FUNCTION halfvec_write_file(path text, query text, format text) RETURNS bigint
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE STRICT PARALLEL UNSAFE;
+
+REVOKE ALL ON FUNCTION vector_read_file(text), vector_read_file(text, text),
+	halfvec_read_file(text), halfvec_read_file(text, text),
+	vector_write_file(text, text), vector_write_file(text, text, text),
+	halfvec_write_file(text, text), halfvec_write_file(text, text, text) FROM PUBLIC;
+
+CREATE FUNCTION vector_project(vector, real[]) RETURNS vector
+	AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION hnsw_hybridvec_support(internal) RETURNS internal
+	AS 'MODULE_PATHNAME' LANGUAGE C;
+
+-- hybridvec type
+
+CREATE TYPE hybridvec;
+
+CREATE FUNCTION hybridvec_in(cstring, oid, integer) RETURNS hybridvec
+	AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION hybridvec_out(hybridvec) RETURNS cstring
+	AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION hybridvec_typmod_in(cstring[]) RETURNS integer
+	AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION hybridvec_recv(internal, oid, integer) RETURNS hybridvec
+	AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION hybridvec_send(hybridvec) RETURNS bytea
+	AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE hybridvec (
+	INPUT     = hybridvec_in,
+	OUTPUT    = hybridvec_out,
+	TYPMOD_IN = hybridvec_typmod_in,
+	RECEIVE   = hybridvec_recv,
+	SEND      = hybridvec_send,
+	STORAGE   = external
+);
+
+-- hybridvec functions
+
+CREATE FUNCTION hybridvec(vector, sparsevec, real DEFAULT 1, real DEFAULT 1) RETURNS hybridvec
+	AS 'MODULE_PATHNAME', 'hybridvec_from_parts' LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION hybridvec_dense(hybridvec) RETURNS vector
+	AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION hybridvec_sparse(hybridvec) RETURNS sparsevec
+	AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION inner_product(hybridvec, hybridvec) RETURNS float8
+	AS 'MODULE_PATHNAME', 'hybridvec_inner_product' LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- hybridvec private functions
+
+CREATE FUNCTION hybridvec_negative_inner_product(hybridvec, hybridvec) RETURNS float8
+	AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- hybridvec cast functions
+
+CREATE FUNCTION hybridvec(hybridvec, integer, boolean) RETURNS hybridvec
+	AS 'MODULE_PATHNAME' LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- hybridvec casts
+
+CREATE CAST (hybridvec AS hybridvec)
+	WITH FUNCTION hybridvec(hybridvec, integer, boolean) AS IMPLICIT;
+
+-- hybridvec operators
+
+CREATE OPERATOR <#> (
+	LEFTARG = hybridvec, RIGHTARG = hybridvec, PROCEDURE = hybridvec_negative_inner_product,
+	COMMUTATOR = '<#>'
+);
+
+-- hybridvec opclasses
+
+CREATE OPERATOR CLASS hybridvec_ip_ops
+	FOR TYPE hybridvec USING hnsw AS
+	OPERATOR 1 <#> (hybridvec, hybridvec) FOR ORDER BY float_ops,
+	FUNCTION 1 hybridvec_negative_inner_product(hybridvec, hybridvec),
+	FUNCTION 3 hnsw_hybridvec_support(internal);
+
+-- mmr functions
+
+CREATE FUNCTION vector_mmr_accum(internal, bigint, vector, vector, integer) RETURNS internal
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE PARALLEL SAFE;
+
+CREATE FUNCTION vector_mmr_accum(internal, bigint, vector, vector, integer, float8) RETURNS internal
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE PARALLEL SAFE;
+
+CREATE FUNCTION vector_mmr_final(internal) RETURNS bigint[]
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE PARALLEL SAFE;
+
+CREATE AGGREGATE mmr(bigint, vector, vector, integer) (
+	SFUNC = vector_mmr_accum,
+	STYPE = internal,
+	FINALFUNC = vector_mmr_final,
+	PARALLEL = SAFE
+);
+
+CREATE AGGREGATE mmr(bigint, vector, vector, integer, float8) (
+	SFUNC = vector_mmr_accum,
+	STYPE = internal,
+	FINALFUNC = vector_mmr_final,
+	PARALLEL = SAFE
+);
+
+-- group search functions
+
+CREATE FUNCTION vector_group_search(tbl regclass, col name, group_col name, query anyelement, k int, per_group int DEFAULT 1, op text DEFAULT '<->', exact_fallback bool DEFAULT false,
+	OUT tid tid, OUT group_key text, OUT distance float8) RETURNS SETOF record
+	AS 'MODULE_PATHNAME' LANGUAGE C VOLATILE STRICT PARALLEL UNSAFE;
@@ -0,0 +1,385 @@
+#include "postgres.h"
+
+#include <math.h>
+
+#include "access/htup_details.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_operator.h"
+#include "commands/defrem.h"
+#include "executor/spi.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "nodes/value.h"
+#include "portability/instr_time.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/lsyscache.h"
+#include "utils/syscache.h"
+#include "utils/tuplestore.h"
+
+#define ADVISOR_ITEMS "pg_temp.vector_advisor_items"
+#define ADVISOR_QUERIES "pg_temp.vector_advisor_queries"
+
+/* Parameter grid */
+static const int hnswM[] = {8, 16, 32};
+static const int hnswEfConstruction[] = {64, 128};
+static const int hnswEfSearch[] = {10, 20, 40, 80, 160, 320};
+static const int ivfflatListsDivisor[] = {2000, 1000, 500};
+static const int ivfflatProbes[] = {1, 2, 4, 8, 16, 32};
+
+typedef struct AdvisorResult
+{
+	char	   *method;
+	char	   *options;
+	char	   *search;
+	double		recall;
+	double		buildTime;
+	double		queryTime;
+}			AdvisorResult;
+
+typedef struct AdvisorState
+{
+	char	   *op;
+	int			k;
+	int			nqueries;
+	List	   *results;
+}			AdvisorState;
+
+/*
+ * Execute a query with SPI
+ */
+static void
+AdvisorExecute(const char *query, int expected)
+{
+	if (SPI_execute(query, false, 0) != expected)
+		elog(ERROR, "SPI_execute failed: %s", query);
+}
+
+/*
+ * Get the ORDER BY operator of an operator class as SQL
+ */
+static char *
+GetOrderByOperator(Oid opclassOid)
+{
+	Oid			opfamily = get_opclass_family(opclassOid);
+	Oid			opcintype = get_opclass_input_type(opclassOid);
+	Oid			opno = get_opfamily_member(opfamily, opcintype, opcintype, 1);
+	HeapTuple	tuple;
+	Form_pg_operator operform;
+	char	   *result;
+
+	if (!OidIsValid(opno))
+		elog(ERROR, "missing ordering operator for operator class");
+
+	tuple = SearchSysCache1(OPEROID, ObjectIdGetDatum(opno));
+	if (!HeapTupleIsValid(tuple))
+		elog(ERROR, "cache lookup failed for operator %u", opno);
+
+	operform = (Form_pg_operator) GETSTRUCT(tuple);
+	result = psprintf("OPERATOR(%s.%s)", quote_identifier(get_namespace_name(operform->oprnamespace)), NameStr(operform->oprname));
+	ReleaseSysCache(tuple);
+
+	return result;
+}
+
+/*
+ * Get the operator class for an access method
+ */
+static Oid
+GetOpclass(const char *method, char *opclass)
+{
+	Oid			amOid = get_index_am_oid(method, false);
+
+	return get_opclass_oid(amOid, list_make1(makeString(opclass)), true);
+}
+
+/*
+ * Get the estimated number of rows in a table
+ */
+static float4
+GetRelTuples(Oid relid)
+{
+	HeapTuple	tuple;
+	float4		reltuples;
+
+	tuple = SearchSysCache1(RELOID, ObjectIdGetDatum(relid));
+	if (!HeapTupleIsValid(tuple))
+		elog(ERROR, "cache lookup failed for relation %u", relid);
+
+	reltuples = ((Form_pg_class) GETSTRUCT(tuple))->reltuples;
+	ReleaseSysCache(tuple);
+
+	return reltuples;
+}
+
+/*
+ * Set a variable until the function returns
+ */
+static void
+SetAdvisorOption(const char *name, const char *value)
+{
+	(void) set_config_option(name, value, PGC_USERSET, PGC_S_SESSION, GUC_ACTION_SAVE, true, 0, false);
+}
+
+/*
+ * Get recall and time per query for the current settings
+ */
+static void
+MeasureQueries(AdvisorState * state, AdvisorResult * result)
+{
+	StringInfoData query;
+	instr_time	start;
+	instr_time	duration;
+	bool		isnull;
+	Datum		recall;
+
+	initStringInfo(&query);
+	appendStringInfo(&query,
+					 "SELECT AVG(cardinality(ARRAY(SELECT unnest(q.ids) INTERSECT SELECT i.id FROM (SELECT id FROM " ADVISOR_ITEMS " ORDER BY v %s q.v LIMIT %d) i)))::float8 / %d FROM " ADVISOR_QUERIES " q",
+					 state->op, state->k, state->k);
+
+	INSTR_TIME_SET_CURRENT(start);
+	AdvisorExecute(query.data, SPI_OK_SELECT);
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+
+	recall = SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isnull);
+	result->recall = isnull ? 0 : DatumGetFloat8(recall);
+	result->queryTime = INSTR_TIME_GET_MILLISEC(duration) / state->nqueries;
+
+	pfree(query.data);
+}
+
+/*
+ * Build an index and measure each search setting
+ */
+static void
+BenchmarkIndex(AdvisorState * state, const char *method, const char *opclass, const char *options, const char *searchName, const int *searchValues, int nsearch, int maxSearch)
+{
+	char	   *query;
+	instr_time	start;
+	instr_time	duration;
+	double		buildTime;
+
+	query = psprintf("CREATE INDEX vector_advisor_idx ON " ADVISOR_ITEMS " USING %s (v %s) WITH (%s)", method, quote_identifier(opclass), options);
+
+	INSTR_TIME_SET_CURRENT(start);
+	AdvisorExecute(query, SPI_OK_UTILITY);
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+	buildTime = INSTR_TIME_GET_MILLISEC(duration);
+
+	for (int i = 0; i < nsearch; i++)
+	{
+		AdvisorResult *result;
+		char		value[12];
+
+		if (searchValues[i] > maxSearch)
+			break;
+
+		CHECK_FOR_INTERRUPTS();
+
+		snprintf(value, sizeof(value), "%d", searchValues[i]);
+		SetAdvisorOption(searchName, value);
+
+		result = palloc0(sizeof(AdvisorResult));
+		result->method = pstrdup(method);
+		result->options = pstrdup(options);
+		result->search = psprintf("%s = %d", strchr(searchName, '.') + 1, searchValues[i]);
+		result->buildTime = buildTime;
+		MeasureQueries(state, result);
+
+		state->results = lappend(state->results, result);
+	}
+
+	AdvisorExecute("DROP INDEX pg_temp.vector_advisor_idx", SPI_OK_UTILITY);
+}
+
+/*
+ * Check if a result is not dominated by another result
+ */
+static bool
+IsPareto(AdvisorState * state, AdvisorResult * result)
+{
+	ListCell   *lc;
+
+	foreach(lc, state->results)
+	{
+		AdvisorResult *other = lfirst(lc);
+
+		if (other->recall >= result->recall && other->queryTime <= result->queryTime &&
+			(other->recall > result->recall || other->queryTime < result->queryTime))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Benchmark index parameters on a sample of a table
+ *
+ * Sampled rows are split into held-out queries and rows to index. Indexes
+ * are built on the sample with a small grid of parameters, and each search
+ * setting is compared with exact results.
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(vector_index_advisor);
+Datum
+vector_index_advisor(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	char	   *column = NameStr(*PG_GETARG_NAME(1));
+	char	   *opclass = NameStr(*PG_GETARG_NAME(2));
+	int			sampleRows = PG_GETARG_INT32(3);
+	int			queries = PG_GETARG_INT32(4);
+	int			k = PG_GETARG_INT32(5);
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldCtx;
+	AdvisorState state;
+	Oid			hnswOpclass;
+	Oid			ivfflatOpclass;
+	char	   *relname;
+	float4		reltuples;
+	double		percent;
+	int			items;
+	int			saveNestLevel;
+	bool		isnull;
+	ListCell   *lc;
+
+	if (sampleRows < 1 || queries < 1 || k < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("sample_rows, queries, and k must be greater than zero")));
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo) || !(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	hnswOpclass = GetOpclass("hnsw", opclass);
+	ivfflatOpclass = GetOpclass("ivfflat", opclass);
+
+	if (!OidIsValid(hnswOpclass) && !OidIsValid(ivfflatOpclass))
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_OBJECT),
+				 errmsg("operator class \"%s\" does not exist for hnsw or ivfflat", opclass)));
+
+	state.op = GetOrderByOperator(OidIsValid(hnswOpclass) ? hnswOpclass : ivfflatOpclass);
+	state.k = k;
+	state.results = NIL;
+
+	reltuples = GetRelTuples(relid);
+	relname = quote_qualified_identifier(get_namespace_name(get_rel_namespace(relid)), get_rel_name(relid));
+
+	/* Sample a few more rows than needed so the limit is usually reached */
+	percent = reltuples > 0 ? 100.0 * (sampleRows + queries) * 1.2 / reltuples : 100.0;
+	percent = Min(percent, 100.0);
+
+	saveNestLevel = NewGUCNestLevel();
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+
+	AdvisorExecute("DROP TABLE IF EXISTS " ADVISOR_ITEMS ", " ADVISOR_QUERIES, SPI_OK_UTILITY);
+
+	AdvisorExecute(psprintf("CREATE TEMP TABLE vector_advisor_items AS SELECT row_number() OVER () AS id, v FROM "
+							"(SELECT %s AS v FROM %s TABLESAMPLE BERNOULLI (%g) WHERE %s IS NOT NULL ORDER BY random() LIMIT %d) s",
+							quote_identifier(column), relname, percent, quote_identifier(column), sampleRows + queries),
+				   SPI_OK_UTILITY);
+
+	/* Hold out queries and get exact results */
+	AdvisorExecute(psprintf("CREATE TEMP TABLE vector_advisor_queries AS SELECT id, v, NULL::bigint[] AS ids FROM " ADVISOR_ITEMS " WHERE id <= %d", queries), SPI_OK_UTILITY);
+	AdvisorExecute(psprintf("DELETE FROM " ADVISOR_ITEMS " WHERE id <= %d", queries), SPI_OK_DELETE);
+	AdvisorExecute(psprintf("UPDATE " ADVISOR_QUERIES " q SET ids = ARRAY(SELECT id FROM " ADVISOR_ITEMS " ORDER BY v %s q.v LIMIT %d)", state.op, k), SPI_OK_UPDATE);
+	AdvisorExecute("ANALYZE " ADVISOR_ITEMS, SPI_OK_UTILITY);
+
+	AdvisorExecute("SELECT (SELECT COUNT(*) FROM " ADVISOR_ITEMS ")::int4, (SELECT COUNT(*) FROM " ADVISOR_QUERIES ")::int4", SPI_OK_SELECT);
+	items = DatumGetInt32(SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isnull));
+	state.nqueries = DatumGetInt32(SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 2, &isnull));
+
+	if (state.nqueries < queries || items < k)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("table has too few rows for %d queries and k = %d", queries, k)));
+
+	/* Use the index for all queries */
+	SetAdvisorOption("enable_seqscan", "off");
+	SetAdvisorOption("hnsw.target_recall", "0");
+	SetAdvisorOption("ivfflat.target_recall", "0");
+
+	if (OidIsValid(hnswOpclass))
+	{
+		int			start = 0;
+
+		/* Skip ef_search below k since fewer rows are returned */
+		while (start < lengthof(hnswEfSearch) - 1 && hnswEfSearch[start] < k)
+			start++;
+
+		for (int i = 0; i < lengthof(hnswM); i++)
+		{
+			for (int j = 0; j < lengthof(hnswEfConstruction); j++)
+			{
+				char	   *options = psprintf("m = %d, ef_construction = %d", hnswM[i], hnswEfConstruction[j]);
+
+				BenchmarkIndex(&state, "hnsw", opclass, options, "hnsw.ef_search", hnswEfSearch + start, lengthof(hnswEfSearch) - start, PG_INT32_MAX);
+			}
+		}
+	}
+
+	if (OidIsValid(ivfflatOpclass))
+	{
+		int			prevLists = 0;
+
+		for (int i = 0; i < lengthof(ivfflatListsDivisor); i++)
+		{
+			int			lists = Max(items / ivfflatListsDivisor[i], 1);
+
+			if (lists == prevLists)
+				continue;
+
+			BenchmarkIndex(&state, "ivfflat", opclass, psprintf("lists = %d", lists), "ivfflat.probes", ivfflatProbes, lengthof(ivfflatProbes), lists);
+			prevLists = lists;
+		}
+	}
+
+	AdvisorExecute("DROP TABLE " ADVISOR_ITEMS ", " ADVISOR_QUERIES, SPI_OK_UTILITY);
+
+	/* Restore variables */
+	AtEOXact_GUC(true, saveNestLevel);
+
+	/* Return results in the caller's memory context */
+	oldCtx = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	foreach(lc, state.results)
+	{
+		AdvisorResult *result = lfirst(lc);
+		Datum		values[7];
+		bool		nulls[7] = {0};
+
+		values[0] = CStringGetTextDatum(result->method);
+		values[1] = CStringGetTextDatum(result->options);
+		values[2] = CStringGetTextDatum(result->search);
+		values[3] = Float8GetDatum(result->recall);
+		values[4] = Float8GetDatum(result->buildTime);
+		values[5] = Float8GetDatum(result->queryTime);
+		values[6] = BoolGetDatum(IsPareto(&state, result));
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	MemoryContextSwitchTo(oldCtx);
+
+	SPI_finish();
+
+	return (Datum) 0;
+}
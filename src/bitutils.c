@@ -157,6 +157,34 @@ BitJaccardDistanceAvx512Popcount(uint32 bytes, unsigned char *ax, unsigned char
 }
 #endif
 
+/*
+ * Get the number of set bits
+ */
+BIT_TARGET_CLONES uint64
+BitPopcount(uint32 bytes, unsigned char *ax)
+{
+	uint64		count = 0;
+
+#ifdef popcount64
+	for (; bytes >= sizeof(uint64); bytes -= sizeof(uint64))
+	{
+		uint64		axs;
+
+		/* Ensure aligned */
+		memcpy(&axs, ax, sizeof(uint64));
+
+		count += popcount64(axs);
+
+		ax += sizeof(uint64);
+	}
+#endif
+
+	for (uint32 i = 0; i < bytes; i++)
+		count += pg_number_of_ones[ax[i]];
+
+	return count;
+}
+
 #ifdef BIT_DISPATCH
 #define CPU_FEATURE_OSXSAVE         (1 << 27)	/* F1 ECX */
 #define CPU_FEATURE_AVX512F         (1 << 16)	/* F7,0 EBX */
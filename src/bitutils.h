@@ -11,6 +11,7 @@
 extern uint64 (*BitHammingDistance) (uint32 bytes, unsigned char *ax, unsigned char *bx, uint64 distance);
 extern double (*BitJaccardDistance) (uint32 bytes, unsigned char *ax, unsigned char *bx, uint64 ab, uint64 aa, uint64 bb);
 
+uint64		BitPopcount(uint32 bytes, unsigned char *ax);
 void		BitvecInit(void);
 
 #endif
@@ -3,6 +3,7 @@
 #include "bitutils.h"
 #include "bitvec.h"
 #include "utils/varbit.h"
+#include "vector.h"
 
 #if PG_VERSION_NUM >= 160000
 #include "varatt.h"
@@ -52,6 +53,32 @@ hamming_distance(PG_FUNCTION_ARGS)
 	PG_RETURN_FLOAT8((double) BitHammingDistance(VARBITBYTES(a), VARBITS(a), VARBITS(b), 0));
 }
 
+/*
+ * Get the Hamming distance between two bit vectors, stopping early once
+ * greater than maxDistance
+ */
+double
+BitHammingBoundedDistance(Datum a, Datum b, double maxDistance)
+{
+	VarBit	   *va = DatumGetVarBitP(a);
+	VarBit	   *vb = DatumGetVarBitP(b);
+	uint32		bytes = VARBITBYTES(va);
+	uint64		distance = 0;
+
+	CheckDims(va, vb);
+
+	/* Check after each block so the kernel still uses popcount */
+	for (uint32 i = 0; i < bytes; i += BOUNDED_DISTANCE_BLOCK)
+	{
+		distance = BitHammingDistance(Min(BOUNDED_DISTANCE_BLOCK, bytes - i), VARBITS(va) + i, VARBITS(vb) + i, distance);
+
+		if (distance > maxDistance)
+			break;
+	}
+
+	return (double) distance;
+}
+
 /*
  * Get the Jaccard distance between two bit vectors
  */
@@ -66,3 +93,49 @@ jaccard_distance(PG_FUNCTION_ARGS)
 
 	PG_RETURN_FLOAT8(BitJaccardDistance(VARBITBYTES(a), VARBITS(a), VARBITS(b), 0, 0, 0));
 }
+
+/*
+ * Get the number of set bits in a bit vector
+ */
+uint64
+BitvecPopcount(Datum a)
+{
+	VarBit	   *va = DatumGetVarBitP(a);
+
+	return BitPopcount(VARBITBYTES(va), VARBITS(va));
+}
+
+/*
+ * Get the Jaccard distance between two bit vectors with known popcounts
+ *
+ * The intersection is derived from the Hamming distance, so only a single
+ * pass is needed. The result only needs to be exact when less than or equal
+ * to maxDistance.
+ */
+double
+BitJaccardPopcountDistance(Datum a, Datum b, uint64 aa, uint64 bb, double maxDistance)
+{
+	VarBit	   *va = DatumGetVarBitP(a);
+	VarBit	   *vb = DatumGetVarBitP(b);
+	double		minDistance;
+	uint64		distance;
+	uint64		ab;
+
+	CheckDims(va, vb);
+
+	if (aa == 0 || bb == 0)
+		return 1;
+
+	/* Intersection is at most the smaller popcount and union at least the larger */
+	minDistance = 1 - (Min(aa, bb) / (double) Max(aa, bb));
+	if (minDistance > maxDistance)
+		return minDistance;
+
+	distance = BitHammingDistance(VARBITBYTES(va), VARBITS(va), VARBITS(vb), 0);
+	ab = (aa + bb - distance) / 2;
+
+	if (ab == 0)
+		return 1;
+	else
+		return 1 - (ab / ((double) (aa + bb - ab)));
+}
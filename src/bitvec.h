@@ -4,5 +4,8 @@
 #include "utils/varbit.h"
 
 VarBit	   *InitBitVector(int dim);
+double		BitHammingBoundedDistance(Datum a, Datum b, double maxDistance);
+uint64		BitvecPopcount(Datum a);
+double		BitJaccardPopcountDistance(Datum a, Datum b, uint64 aa, uint64 bb, double maxDistance);
 
 #endif
@@ -0,0 +1,307 @@
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_operator.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "hnsw.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "nodes/value.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/lsyscache.h"
+#include "utils/syscache.h"
+#include "utils/memutils.h"
+#include "utils/tuplestore.h"
+
+#if PG_VERSION_NUM >= 130000
+#include "common/hashfn.h"
+#else
+#include "utils/hashutils.h"
+#endif
+
+typedef struct GroupSearchGroup
+{
+	char	   *key;
+	int			count;
+	char		status;
+}			GroupSearchGroup;
+
+typedef struct GroupSearchResult
+{
+	ItemPointerData tid;
+	char	   *key;
+	double		distance;
+}			GroupSearchResult;
+
+/*
+ * Get a distance operator for a type as SQL
+ */
+static char *
+GetDistanceOperator(char *name, Oid typid)
+{
+	Oid			opno = OpernameGetOprid(list_make1(makeString(name)), typid, typid);
+	HeapTuple	tuple;
+	Form_pg_operator operform;
+	char	   *result;
+
+	if (!OidIsValid(opno))
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_FUNCTION),
+				 errmsg("operator does not exist: %s %s %s", format_type_be(typid), name, format_type_be(typid))));
+
+	tuple = SearchSysCache1(OPEROID, ObjectIdGetDatum(opno));
+	if (!HeapTupleIsValid(tuple))
+		elog(ERROR, "cache lookup failed for operator %u", opno);
+
+	operform = (Form_pg_operator) GETSTRUCT(tuple);
+	if (operform->oprresult != FLOAT8OID)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("operator %s must return double precision", name)));
+
+	result = psprintf("OPERATOR(%s.%s)", quote_identifier(get_namespace_name(operform->oprnamespace)), NameStr(operform->oprname));
+	ReleaseSysCache(tuple);
+
+	return result;
+}
+
+/* Group hash table */
+static uint32
+hash_group(char *key)
+{
+	return DatumGetUInt32(hash_any((const unsigned char *) key, strlen(key)));
+}
+
+#define SH_PREFIX		grouphash
+#define SH_ELEMENT_TYPE	GroupSearchGroup
+#define SH_KEY_TYPE		char *
+#define	SH_KEY			key
+#define SH_HASH_KEY(tb, key)	hash_group(key)
+#define SH_EQUAL(tb, a, b)		(strcmp(a, b) == 0)
+#define	SH_SCOPE		static inline
+#define SH_DECLARE
+#define SH_DEFINE
+#include "lib/simplehash.h"
+
+/*
+ * Get the nearest rows for each of the k nearest groups
+ *
+ * The index does not store group keys, so this fetches nearest rows in
+ * rounds, doubling the limit and hnsw.ef_search until k groups are found.
+ * When a round returns fewer rows than requested, the index may have stopped
+ * early (hnsw.ef_search is capped and ivfflat.probes limits the lists
+ * scanned). The round is repeated with an exact scan if exact_fallback is
+ * set, and either way the caller is notified.
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(vector_group_search);
+Datum
+vector_group_search(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	char	   *column = NameStr(*PG_GETARG_NAME(1));
+	char	   *groupColumn = NameStr(*PG_GETARG_NAME(2));
+	Datum		value = PG_GETARG_DATUM(3);
+	Oid			valueType = get_fn_expr_argtype(fcinfo->flinfo, 3);
+	int			k = PG_GETARG_INT32(4);
+	int			perGroup = PG_GETARG_INT32(5);
+	char	   *op = text_to_cstring(PG_GETARG_TEXT_PP(6));
+	bool		exactFallback = PG_GETARG_BOOL(7);
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldCtx;
+	MemoryContext roundCtx;
+	char	   *relname;
+	char	   *opsql;
+	List	   *results = NIL;
+	int64		limit;
+	bool		exact = false;
+	int			ngroups;
+	int			saveNestLevel;
+	ListCell   *lc;
+
+	if (k < 1 || perGroup < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("k and per_group must be greater than zero")));
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo) || !(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	opsql = GetDistanceOperator(op, valueType);
+	relname = quote_qualified_identifier(get_namespace_name(get_rel_namespace(relid)), get_rel_name(relid));
+
+	/* Start with enough rows to fill every slot */
+	limit = Max((int64) k * perGroup, hnsw_ef_search);
+
+	/* Use a separate memory context for each round's groups and results */
+	roundCtx = AllocSetContextCreate(CurrentMemoryContext,
+									 "Group search round context",
+									 ALLOCSET_DEFAULT_SIZES);
+
+	saveNestLevel = NewGUCNestLevel();
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+
+	for (;;)
+	{
+		char	   *query;
+		char		efSearch[12];
+		uint64		processed;
+		grouphash_hash *groups;
+		int			nullCount = 0;
+
+		CHECK_FOR_INTERRUPTS();
+
+		snprintf(efSearch, sizeof(efSearch), "%d", (int) Min(limit, HNSW_MAX_EF_SEARCH));
+		(void) set_config_option("hnsw.ef_search", efSearch, PGC_USERSET, PGC_S_SESSION, GUC_ACTION_SAVE, true, 0, false);
+
+		query = psprintf("SELECT ctid, %s::text, %s %s $1 FROM %s WHERE %s IS NOT NULL ORDER BY %s %s $1 LIMIT " INT64_FORMAT,
+						 quote_identifier(groupColumn), quote_identifier(column), opsql, relname,
+						 quote_identifier(column), quote_identifier(column), opsql, limit);
+
+		if (SPI_execute_with_args(query, 1, &valueType, &value, NULL, true, 0) != SPI_OK_SELECT)
+			elog(ERROR, "SPI_execute_with_args failed: %s", query);
+
+		processed = SPI_processed;
+
+		/* Results are rebuilt each round since earlier rounds may have missed rows */
+		MemoryContextReset(roundCtx);
+		results = NIL;
+
+		oldCtx = MemoryContextSwitchTo(roundCtx);
+
+		groups = grouphash_create(roundCtx, k, NULL);
+		ngroups = 0;
+
+		for (uint64 i = 0; i < processed; i++)
+		{
+			HeapTuple	tuple = SPI_tuptable->vals[i];
+			TupleDesc	spidesc = SPI_tuptable->tupdesc;
+			char	   *key = SPI_getvalue(tuple, spidesc, 2);
+			int		   *count;
+			GroupSearchResult *result;
+			bool		isnull;
+
+			/* Rows without a group form a single group */
+			if (key == NULL)
+			{
+				if (nullCount == 0 && ngroups == k)
+					continue;
+
+				count = &nullCount;
+			}
+			else
+			{
+				GroupSearchGroup *group = grouphash_lookup(groups, key);
+
+				if (group == NULL)
+				{
+					bool		found;
+
+					if (ngroups == k)
+						continue;
+
+					group = grouphash_insert(groups, key, &found);
+					group->count = 0;
+				}
+
+				count = &group->count;
+			}
+
+			if (*count == perGroup)
+				continue;
+
+			if (*count == 0)
+				ngroups++;
+
+			(*count)++;
+
+			result = palloc(sizeof(GroupSearchResult));
+			result->tid = *DatumGetItemPointer(SPI_getbinval(tuple, spidesc, 1, &isnull));
+			result->key = key;
+			result->distance = DatumGetFloat8(SPI_getbinval(tuple, spidesc, 3, &isnull));
+			results = lappend(results, result);
+		}
+
+		MemoryContextSwitchTo(oldCtx);
+
+		SPI_freetuptable(SPI_tuptable);
+		pfree(query);
+
+		/* Stop when k groups are found */
+		if (ngroups == k)
+			break;
+
+		/* The index may have stopped early */
+		if (processed < (uint64) limit)
+		{
+			if (exact)
+				break;
+
+			if (!exactFallback)
+			{
+				ereport(NOTICE,
+						(errmsg("vector_group_search found %d of %d groups", ngroups, k),
+						 errdetail("The scan returned fewer rows than requested, so the index may have stopped early."),
+						 errhint("Use exact_fallback => true to repeat the search with an exact scan.")));
+				break;
+			}
+
+			ereport(NOTICE,
+					(errmsg("vector_group_search found %d of %d groups, repeating with an exact scan", ngroups, k)));
+
+			(void) set_config_option("enable_indexscan", "off", PGC_USERSET, PGC_S_SESSION, GUC_ACTION_SAVE, true, 0, false);
+			exact = true;
+			continue;
+		}
+
+		if (limit > PG_INT32_MAX)
+			break;
+
+		limit *= 2;
+	}
+
+	SPI_finish();
+
+	/* Restore variables */
+	AtEOXact_GUC(true, saveNestLevel);
+
+	/* Return results in the caller's memory context */
+	oldCtx = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	foreach(lc, results)
+	{
+		GroupSearchResult *result = lfirst(lc);
+		Datum		values[3];
+		bool		nulls[3] = {0};
+
+		values[0] = ItemPointerGetDatum(&result->tid);
+		values[1] = result->key != NULL ? CStringGetTextDatum(result->key) : (Datum) 0;
+		nulls[1] = result->key == NULL;
+		values[2] = Float8GetDatum(result->distance);
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	MemoryContextSwitchTo(oldCtx);
+
+	MemoryContextDelete(roundCtx);
+
+	return (Datum) 0;
+}
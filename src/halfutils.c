@@ -2,6 +2,7 @@
 
 #include "halfutils.h"
 #include "halfvec.h"
+#include "vector.h"
 
 #ifdef HALFVEC_DISPATCH
 #include <immintrin.h>
@@ -23,9 +24,13 @@ float		(*HalfvecL2SquaredDistance) (int dim, half * ax, half * bx);
 float		(*HalfvecInnerProduct) (int dim, half * ax, half * bx);
 double		(*HalfvecCosineSimilarity) (int dim, half * ax, half * bx);
 float		(*HalfvecL1Distance) (int dim, half * ax, half * bx);
+void		(*Float4ToHalfArray) (int dim, float *ax, half * rx);
+void		(*HalfToFloat4Array) (int dim, half * ax, float *rx);
+void		(*BinaryQuantizeFloat4) (int dim, float *ax, unsigned char *rx);
+void		(*BinaryQuantizeHalf) (int dim, half * ax, unsigned char *rx);
 
-static float
-HalfvecL2SquaredDistanceDefault(int dim, half * ax, half * bx)
+static pg_attribute_always_inline float
+HalfvecL2SquaredDistanceDefaultImpl(int dim, half * ax, half * bx)
 {
 	float		distance = 0.0;
 
@@ -40,9 +45,15 @@ HalfvecL2SquaredDistanceDefault(int dim, half * ax, half * bx)
 	return distance;
 }
 
+static float
+HalfvecL2SquaredDistanceDefault(int dim, half * ax, half * bx)
+{
+	VECTOR_SPECIALIZE_DIM(dim, HalfvecL2SquaredDistanceDefaultImpl, ax, bx);
+}
+
 #ifdef HALFVEC_DISPATCH
-TARGET_F16C static float
-HalfvecL2SquaredDistanceF16c(int dim, half * ax, half * bx)
+TARGET_F16C static pg_attribute_always_inline float
+HalfvecL2SquaredDistanceF16cImpl(int dim, half * ax, half * bx)
 {
 	float		distance;
 	int			i;
@@ -74,10 +85,16 @@ HalfvecL2SquaredDistanceF16c(int dim, half * ax, half * bx)
 
 	return distance;
 }
+
+TARGET_F16C static float
+HalfvecL2SquaredDistanceF16c(int dim, half * ax, half * bx)
+{
+	VECTOR_SPECIALIZE_DIM(dim, HalfvecL2SquaredDistanceF16cImpl, ax, bx);
+}
 #endif
 
-static float
-HalfvecInnerProductDefault(int dim, half * ax, half * bx)
+static pg_attribute_always_inline float
+HalfvecInnerProductDefaultImpl(int dim, half * ax, half * bx)
 {
 	float		distance = 0.0;
 
@@ -88,9 +105,15 @@ HalfvecInnerProductDefault(int dim, half * ax, half * bx)
 	return distance;
 }
 
+static float
+HalfvecInnerProductDefault(int dim, half * ax, half * bx)
+{
+	VECTOR_SPECIALIZE_DIM(dim, HalfvecInnerProductDefaultImpl, ax, bx);
+}
+
 #ifdef HALFVEC_DISPATCH
-TARGET_F16C static float
-HalfvecInnerProductF16c(int dim, half * ax, half * bx)
+TARGET_F16C static pg_attribute_always_inline float
+HalfvecInnerProductF16cImpl(int dim, half * ax, half * bx)
 {
 	float		distance;
 	int			i;
@@ -117,10 +140,16 @@ HalfvecInnerProductF16c(int dim, half * ax, half * bx)
 
 	return distance;
 }
+
+TARGET_F16C static float
+HalfvecInnerProductF16c(int dim, half * ax, half * bx)
+{
+	VECTOR_SPECIALIZE_DIM(dim, HalfvecInnerProductF16cImpl, ax, bx);
+}
 #endif
 
-static double
-HalfvecCosineSimilarityDefault(int dim, half * ax, half * bx)
+static pg_attribute_always_inline double
+HalfvecCosineSimilarityDefaultImpl(int dim, half * ax, half * bx)
 {
 	float		similarity = 0.0;
 	float		norma = 0.0;
@@ -141,9 +170,15 @@ HalfvecCosineSimilarityDefault(int dim, half * ax, half * bx)
 	return (double) similarity / sqrt((double) norma * (double) normb);
 }
 
+static double
+HalfvecCosineSimilarityDefault(int dim, half * ax, half * bx)
+{
+	VECTOR_SPECIALIZE_DIM(dim, HalfvecCosineSimilarityDefaultImpl, ax, bx);
+}
+
 #ifdef HALFVEC_DISPATCH
-TARGET_F16C static double
-HalfvecCosineSimilarityF16c(int dim, half * ax, half * bx)
+TARGET_F16C static pg_attribute_always_inline double
+HalfvecCosineSimilarityF16cImpl(int dim, half * ax, half * bx)
 {
 	float		similarity;
 	float		norma;
@@ -190,10 +225,16 @@ HalfvecCosineSimilarityF16c(int dim, half * ax, half * bx)
 	/* Use sqrt(a * b) over sqrt(a) * sqrt(b) */
 	return (double) similarity / sqrt((double) norma * (double) normb);
 }
+
+TARGET_F16C static double
+HalfvecCosineSimilarityF16c(int dim, half * ax, half * bx)
+{
+	VECTOR_SPECIALIZE_DIM(dim, HalfvecCosineSimilarityF16cImpl, ax, bx);
+}
 #endif
 
-static float
-HalfvecL1DistanceDefault(int dim, half * ax, half * bx)
+static pg_attribute_always_inline float
+HalfvecL1DistanceDefaultImpl(int dim, half * ax, half * bx)
 {
 	float		distance = 0.0;
 
@@ -204,10 +245,16 @@ HalfvecL1DistanceDefault(int dim, half * ax, half * bx)
 	return distance;
 }
 
+static float
+HalfvecL1DistanceDefault(int dim, half * ax, half * bx)
+{
+	VECTOR_SPECIALIZE_DIM(dim, HalfvecL1DistanceDefaultImpl, ax, bx);
+}
+
 #ifdef HALFVEC_DISPATCH
 /* Does not require FMA, but keep logic simple */
-TARGET_F16C static float
-HalfvecL1DistanceF16c(int dim, half * ax, half * bx)
+TARGET_F16C static pg_attribute_always_inline float
+HalfvecL1DistanceF16cImpl(int dim, half * ax, half * bx)
 {
 	float		distance;
 	int			i;
@@ -235,6 +282,131 @@ HalfvecL1DistanceF16c(int dim, half * ax, half * bx)
 
 	return distance;
 }
+
+TARGET_F16C static float
+HalfvecL1DistanceF16c(int dim, half * ax, half * bx)
+{
+	VECTOR_SPECIALIZE_DIM(dim, HalfvecL1DistanceF16cImpl, ax, bx);
+}
+#endif
+
+/*
+ * Conversions use the same instructions as distance functions, so they are
+ * dispatched here as well
+ */
+static void
+Float4ToHalfArrayDefault(int dim, float *ax, half * rx)
+{
+	/* Auto-vectorized with _Float16 */
+	for (int i = 0; i < dim; i++)
+		rx[i] = Float4ToHalfUnchecked(ax[i]);
+}
+
+#ifdef HALFVEC_DISPATCH
+TARGET_F16C static void
+Float4ToHalfArrayF16c(int dim, float *ax, half * rx)
+{
+	int			i;
+	int			count = (dim / 8) * 8;
+
+	for (i = 0; i < count; i += 8)
+	{
+		__m256		axs = _mm256_loadu_ps(ax + i);
+
+		_mm_storeu_si128((__m128i *) (rx + i), _mm256_cvtps_ph(axs, _MM_FROUND_TO_NEAREST_INT));
+	}
+
+	for (; i < dim; i++)
+		rx[i] = Float4ToHalfUnchecked(ax[i]);
+}
+#endif
+
+static void
+HalfToFloat4ArrayDefault(int dim, half * ax, float *rx)
+{
+	/* Auto-vectorized with _Float16 */
+	for (int i = 0; i < dim; i++)
+		rx[i] = HalfToFloat4(ax[i]);
+}
+
+#ifdef HALFVEC_DISPATCH
+TARGET_F16C static void
+HalfToFloat4ArrayF16c(int dim, half * ax, float *rx)
+{
+	int			i;
+	int			count = (dim / 8) * 8;
+
+	for (i = 0; i < count; i += 8)
+	{
+		__m128i		axi = _mm_loadu_si128((__m128i *) (ax + i));
+
+		_mm256_storeu_ps(rx + i, _mm256_cvtph_ps(axi));
+	}
+
+	for (; i < dim; i++)
+		rx[i] = HalfToFloat4(ax[i]);
+}
+#endif
+
+/*
+ * Set a bit for each positive element, first element in the most
+ * significant bit (bits must be zeroed)
+ */
+static void
+BinaryQuantizeFloat4Default(int dim, float *ax, unsigned char *rx)
+{
+	for (int i = 0; i < dim; i++)
+		rx[i / 8] |= (ax[i] > 0) << (7 - (i % 8));
+}
+
+#ifdef HALFVEC_DISPATCH
+/*
+ * Get a byte with a bit for each positive element
+ */
+TARGET_F16C static inline unsigned char
+BinaryQuantizeByteAvx(__m256 axs)
+{
+	/* Reverse elements so the first element is the most significant bit */
+	__m256		rev = _mm256_shuffle_ps(axs, axs, _MM_SHUFFLE(0, 1, 2, 3));
+
+	rev = _mm256_permute2f128_ps(rev, rev, 1);
+	return _mm256_movemask_ps(_mm256_cmp_ps(rev, _mm256_setzero_ps(), _CMP_GT_OQ));
+}
+
+TARGET_F16C static void
+BinaryQuantizeFloat4F16c(int dim, float *ax, unsigned char *rx)
+{
+	int			i;
+	int			count = (dim / 8) * 8;
+
+	for (i = 0; i < count; i += 8)
+		rx[i / 8] = BinaryQuantizeByteAvx(_mm256_loadu_ps(ax + i));
+
+	for (; i < dim; i++)
+		rx[i / 8] |= (ax[i] > 0) << (7 - (i % 8));
+}
+#endif
+
+static void
+BinaryQuantizeHalfDefault(int dim, half * ax, unsigned char *rx)
+{
+	for (int i = 0; i < dim; i++)
+		rx[i / 8] |= (HalfToFloat4(ax[i]) > 0) << (7 - (i % 8));
+}
+
+#ifdef HALFVEC_DISPATCH
+TARGET_F16C static void
+BinaryQuantizeHalfF16c(int dim, half * ax, unsigned char *rx)
+{
+	int			i;
+	int			count = (dim / 8) * 8;
+
+	for (i = 0; i < count; i += 8)
+		rx[i / 8] = BinaryQuantizeByteAvx(_mm256_cvtph_ps(_mm_loadu_si128((__m128i *) (ax + i))));
+
+	for (; i < dim; i++)
+		rx[i / 8] |= (HalfToFloat4(ax[i]) > 0) << (7 - (i % 8));
+}
 #endif
 
 #ifdef HALFVEC_DISPATCH
@@ -284,6 +456,10 @@ HalfvecInit(void)
 	HalfvecInnerProduct = HalfvecInnerProductDefault;
 	HalfvecCosineSimilarity = HalfvecCosineSimilarityDefault;
 	HalfvecL1Distance = HalfvecL1DistanceDefault;
+	Float4ToHalfArray = Float4ToHalfArrayDefault;
+	HalfToFloat4Array = HalfToFloat4ArrayDefault;
+	BinaryQuantizeFloat4 = BinaryQuantizeFloat4Default;
+	BinaryQuantizeHalf = BinaryQuantizeHalfDefault;
 
 #ifdef HALFVEC_DISPATCH
 	if (SupportsCpuFeature(CPU_FEATURE_AVX | CPU_FEATURE_F16C | CPU_FEATURE_FMA))
@@ -293,6 +469,10 @@ HalfvecInit(void)
 		HalfvecCosineSimilarity = HalfvecCosineSimilarityF16c;
 		/* Does not require FMA, but keep logic simple */
 		HalfvecL1Distance = HalfvecL1DistanceF16c;
+		Float4ToHalfArray = Float4ToHalfArrayF16c;
+		HalfToFloat4Array = HalfToFloat4ArrayF16c;
+		BinaryQuantizeFloat4 = BinaryQuantizeFloat4F16c;
+		BinaryQuantizeHalf = BinaryQuantizeHalfF16c;
 	}
 #endif
 }
@@ -14,6 +14,10 @@ extern float (*HalfvecL2SquaredDistance) (int dim, half * ax, half * bx);
 extern float (*HalfvecInnerProduct) (int dim, half * ax, half * bx);
 extern double (*HalfvecCosineSimilarity) (int dim, half * ax, half * bx);
 extern float (*HalfvecL1Distance) (int dim, half * ax, half * bx);
+extern void (*Float4ToHalfArray) (int dim, float *ax, half * rx);
+extern void (*HalfToFloat4Array) (int dim, half * ax, float *rx);
+extern void (*BinaryQuantizeFloat4) (int dim, float *ax, unsigned char *rx);
+extern void (*BinaryQuantizeHalf) (int dim, half * ax, unsigned char *rx);
 
 void		HalfvecInit(void);
 
@@ -56,6 +60,22 @@ HalfIsZero(half num)
 #endif
 }
 
+/*
+ * Check if any half bit patterns are NaN or infinite
+ *
+ * Uses a reduction instead of an early exit so the loop can be vectorized
+ */
+static inline bool
+AnyNonFiniteHalf(const uint16 *bits, int count)
+{
+	uint32		any = 0;
+
+	for (int i = 0; i < count; i++)
+		any |= (bits[i] & 0x7C00) == 0x7C00;
+
+	return any != 0;
+}
+
 /*
  * Convert a half to a float4
  */
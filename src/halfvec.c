@@ -11,6 +11,7 @@
 #include "lib/stringinfo.h"
 #include "libpq/pqformat.h"
 #include "port.h"				/* for strtof() */
+#include "sendrecv.h"
 #include "sparsevec.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
@@ -27,38 +28,6 @@
 #define STATE_DIMS(x) (ARR_DIMS(x)[0] - 1)
 #define CreateStateDatums(dim) palloc(sizeof(Datum) * (dim + 1))
 
-/*
- * Get a half from a message buffer
- */
-static half
-pq_getmsghalf(StringInfo msg)
-{
-	union
-	{
-		half		h;
-		uint16		i;
-	}			swap;
-
-	swap.i = pq_getmsgint(msg, 2);
-	return swap.h;
-}
-
-/*
- * Append a half to a StringInfo buffer
- */
-static void
-pq_sendhalf(StringInfo buf, half h)
-{
-	union
-	{
-		half		h;
-		uint16		i;
-	}			swap;
-
-	swap.h = h;
-	pq_sendint16(buf, swap.i);
-}
-
 /*
  * Ensure same dimensions
  */
@@ -398,10 +367,12 @@ halfvec_recv(PG_FUNCTION_ARGS)
 				 errmsg("expected unused to be 0, not %d", unused)));
 
 	result = InitHalfVector(dim);
-	for (int i = 0; i < dim; i++)
+	pq_copymsgint16s(buf, (uint16 *) result->x, dim);
+
+	if (AnyNonFiniteHalf((uint16 *) result->x, dim))
 	{
-		result->x[i] = pq_getmsghalf(buf);
-		CheckElement(result->x[i]);
+		for (int i = 0; i < dim; i++)
+			CheckElement(result->x[i]);
 	}
 
 	PG_RETURN_POINTER(result);
@@ -420,8 +391,7 @@ halfvec_send(PG_FUNCTION_ARGS)
 	pq_begintypsend(&buf);
 	pq_sendint(&buf, vec->dim, sizeof(int16));
 	pq_sendint(&buf, vec->unused, sizeof(int16));
-	for (int i = 0; i < vec->dim; i++)
-		pq_sendhalf(&buf, vec->x[i]);
+	pq_sendint16s(&buf, (uint16 *) vec->x, vec->dim);
 
 	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
 }
@@ -555,9 +525,14 @@ vector_to_halfvec(PG_FUNCTION_ARGS)
 	CheckExpectedDim(typmod, vec->dim);
 
 	result = InitHalfVector(vec->dim);
+	Float4ToHalfArray(vec->dim, vec->x, result->x);
 
-	for (int i = 0; i < vec->dim; i++)
-		result->x[i] = Float4ToHalf(vec->x[i]);
+	/* Vector elements are finite, so infinite elements are out of range */
+	if (AnyNonFiniteHalf((uint16 *) result->x, vec->dim))
+	{
+		for (int i = 0; i < vec->dim; i++)
+			result->x[i] = Float4ToHalf(vec->x[i]);
+	}
 
 	PG_RETURN_POINTER(result);
 }
@@ -693,6 +668,90 @@ halfvec_l1_distance(PG_FUNCTION_ARGS)
 	PG_RETURN_FLOAT8((double) HalfvecL1Distance(a->dim, a->x, b->x));
 }
 
+/*
+ * Get the L2 squared distance between half vectors, stopping early once
+ * greater than maxDistance
+ */
+static float
+HalfvecL2SquaredDistanceBounded(int dim, half * ax, half * bx, double maxDistance)
+{
+	float		distance = 0.0;
+
+	/* Check after each block so the kernel is still vectorized */
+	for (int i = 0; i < dim; i += BOUNDED_DISTANCE_BLOCK)
+	{
+		distance += HalfvecL2SquaredDistance(Min(BOUNDED_DISTANCE_BLOCK, dim - i), ax + i, bx + i);
+
+		if (distance > maxDistance)
+			break;
+	}
+
+	return distance;
+}
+
+/*
+ * Get the L1 distance between half vectors, stopping early once greater
+ * than maxDistance
+ */
+static float
+HalfvecL1DistanceBounded(int dim, half * ax, half * bx, double maxDistance)
+{
+	float		distance = 0.0;
+
+	/* Check after each block so the kernel is still vectorized */
+	for (int i = 0; i < dim; i += BOUNDED_DISTANCE_BLOCK)
+	{
+		distance += HalfvecL1Distance(Min(BOUNDED_DISTANCE_BLOCK, dim - i), ax + i, bx + i);
+
+		if (distance > maxDistance)
+			break;
+	}
+
+	return distance;
+}
+
+/*
+ * Get the bounded L2 squared distance between half vectors
+ */
+double
+HalfvecL2SquaredBoundedDistance(Datum a, Datum b, double maxDistance)
+{
+	HalfVector *va = DatumGetHalfVector(a);
+	HalfVector *vb = DatumGetHalfVector(b);
+
+	CheckDims(va, vb);
+
+	return (double) HalfvecL2SquaredDistanceBounded(va->dim, va->x, vb->x, maxDistance);
+}
+
+/*
+ * Get the bounded L2 distance between half vectors
+ */
+double
+HalfvecL2BoundedDistance(Datum a, Datum b, double maxDistance)
+{
+	HalfVector *va = DatumGetHalfVector(a);
+	HalfVector *vb = DatumGetHalfVector(b);
+
+	CheckDims(va, vb);
+
+	return sqrt((double) HalfvecL2SquaredDistanceBounded(va->dim, va->x, vb->x, maxDistance * maxDistance));
+}
+
+/*
+ * Get the bounded L1 distance between half vectors
+ */
+double
+HalfvecL1BoundedDistance(Datum a, Datum b, double maxDistance)
+{
+	HalfVector *va = DatumGetHalfVector(a);
+	HalfVector *vb = DatumGetHalfVector(b);
+
+	CheckDims(va, vb);
+
+	return (double) HalfvecL1DistanceBounded(va->dim, va->x, vb->x, maxDistance);
+}
+
 /*
  * Get the dimensions of a half vector
  */
@@ -727,6 +786,59 @@ halfvec_l2_norm(PG_FUNCTION_ARGS)
 	PG_RETURN_FLOAT8(sqrt(norm));
 }
 
+/* Number of elements to convert to float4 at a time */
+#define HALFVEC_BLOCK_SIZE 256
+
+#ifndef FLT16_SUPPORT
+/*
+ * Elementwise operations on half vectors
+ */
+typedef enum HalfvecOp
+{
+	HALFVEC_ADD,
+	HALFVEC_SUB,
+	HALFVEC_MUL
+}			HalfvecOp;
+
+/*
+ * Apply an elementwise operation in blocks of float4 so conversions use the
+ * dispatched kernels
+ */
+static void
+HalfvecElementwise(HalfvecOp op, int dim, half * ax, half * bx, half * rx)
+{
+	float		af[HALFVEC_BLOCK_SIZE];
+	float		bf[HALFVEC_BLOCK_SIZE];
+
+	for (int start = 0; start < dim; start += HALFVEC_BLOCK_SIZE)
+	{
+		int			count = Min(dim - start, HALFVEC_BLOCK_SIZE);
+
+		HalfToFloat4Array(count, ax + start, af);
+		HalfToFloat4Array(count, bx + start, bf);
+
+		/* Auto-vectorized */
+		switch (op)
+		{
+			case HALFVEC_ADD:
+				for (int i = 0; i < count; i++)
+					af[i] += bf[i];
+				break;
+			case HALFVEC_SUB:
+				for (int i = 0; i < count; i++)
+					af[i] -= bf[i];
+				break;
+			case HALFVEC_MUL:
+				for (int i = 0; i < count; i++)
+					af[i] *= bf[i];
+				break;
+		}
+
+		Float4ToHalfArray(count, af, rx + start);
+	}
+}
+#endif
+
 /*
  * Normalize a half vector with the L2 norm
  */
@@ -739,28 +851,43 @@ halfvec_l2_normalize(PG_FUNCTION_ARGS)
 	double		norm = 0;
 	HalfVector *result;
 	half	   *rx;
+	float		af[HALFVEC_BLOCK_SIZE];
 
 	result = InitHalfVector(a->dim);
 	rx = result->x;
 
-	/* Auto-vectorized */
-	for (int i = 0; i < a->dim; i++)
-		norm += (double) HalfToFloat4(ax[i]) * (double) HalfToFloat4(ax[i]);
+	for (int start = 0; start < a->dim; start += HALFVEC_BLOCK_SIZE)
+	{
+		int			count = Min(a->dim - start, HALFVEC_BLOCK_SIZE);
+
+		HalfToFloat4Array(count, ax + start, af);
+
+		/* Auto-vectorized */
+		for (int i = 0; i < count; i++)
+			norm += (double) af[i] * (double) af[i];
+	}
 
 	norm = sqrt(norm);
 
 	/* Return zero vector for zero norm */
 	if (norm > 0)
 	{
-		for (int i = 0; i < a->dim; i++)
-			rx[i] = Float4ToHalfUnchecked(HalfToFloat4(ax[i]) / norm);
-
-		/* Check for overflow */
-		for (int i = 0; i < a->dim; i++)
+		for (int start = 0; start < a->dim; start += HALFVEC_BLOCK_SIZE)
 		{
-			if (HalfIsInf(rx[i]))
-				float_overflow_error();
+			int			count = Min(a->dim - start, HALFVEC_BLOCK_SIZE);
+
+			HalfToFloat4Array(count, ax + start, af);
+
+			/* Auto-vectorized */
+			for (int i = 0; i < count; i++)
+				af[i] = af[i] / norm;
+
+			Float4ToHalfArray(count, af, rx + start);
 		}
+
+		/* Check for overflow */
+		if (AnyNonFiniteHalf((uint16 *) rx, a->dim))
+			float_overflow_error();
 	}
 
 	PG_RETURN_POINTER(result);
@@ -785,22 +912,17 @@ halfvec_add(PG_FUNCTION_ARGS)
 	result = InitHalfVector(a->dim);
 	rx = result->x;
 
+#ifdef FLT16_SUPPORT
 	/* Auto-vectorized */
 	for (int i = 0, imax = a->dim; i < imax; i++)
-	{
-#ifdef FLT16_SUPPORT
 		rx[i] = ax[i] + bx[i];
 #else
-		rx[i] = Float4ToHalfUnchecked(HalfToFloat4(ax[i]) + HalfToFloat4(bx[i]));
+	HalfvecElementwise(HALFVEC_ADD, a->dim, ax, bx, rx);
 #endif
-	}
 
 	/* Check for overflow */
-	for (int i = 0, imax = a->dim; i < imax; i++)
-	{
-		if (HalfIsInf(rx[i]))
-			float_overflow_error();
-	}
+	if (AnyNonFiniteHalf((uint16 *) rx, a->dim))
+		float_overflow_error();
 
 	PG_RETURN_POINTER(result);
 }
@@ -824,22 +946,17 @@ halfvec_sub(PG_FUNCTION_ARGS)
 	result = InitHalfVector(a->dim);
 	rx = result->x;
 
+#ifdef FLT16_SUPPORT
 	/* Auto-vectorized */
 	for (int i = 0, imax = a->dim; i < imax; i++)
-	{
-#ifdef FLT16_SUPPORT
 		rx[i] = ax[i] - bx[i];
 #else
-		rx[i] = Float4ToHalfUnchecked(HalfToFloat4(ax[i]) - HalfToFloat4(bx[i]));
+	HalfvecElementwise(HALFVEC_SUB, a->dim, ax, bx, rx);
 #endif
-	}
 
 	/* Check for overflow */
-	for (int i = 0, imax = a->dim; i < imax; i++)
-	{
-		if (HalfIsInf(rx[i]))
-			float_overflow_error();
-	}
+	if (AnyNonFiniteHalf((uint16 *) rx, a->dim))
+		float_overflow_error();
 
 	PG_RETURN_POINTER(result);
 }
@@ -857,31 +974,30 @@ halfvec_mul(PG_FUNCTION_ARGS)
 	half	   *bx = b->x;
 	HalfVector *result;
 	half	   *rx;
+	uint32		underflow = 0;
 
 	CheckDims(a, b);
 
 	result = InitHalfVector(a->dim);
 	rx = result->x;
 
+#ifdef FLT16_SUPPORT
 	/* Auto-vectorized */
 	for (int i = 0, imax = a->dim; i < imax; i++)
-	{
-#ifdef FLT16_SUPPORT
 		rx[i] = ax[i] * bx[i];
 #else
-		rx[i] = Float4ToHalfUnchecked(HalfToFloat4(ax[i]) * HalfToFloat4(bx[i]));
+	HalfvecElementwise(HALFVEC_MUL, a->dim, ax, bx, rx);
 #endif
-	}
 
 	/* Check for overflow and underflow */
+	if (AnyNonFiniteHalf((uint16 *) rx, a->dim))
+		float_overflow_error();
+
 	for (int i = 0, imax = a->dim; i < imax; i++)
-	{
-		if (HalfIsInf(rx[i]))
-			float_overflow_error();
+		underflow |= HalfIsZero(rx[i]) && !HalfIsZero(ax[i]) && !HalfIsZero(bx[i]);
 
-		if (HalfIsZero(rx[i]) && !(HalfIsZero(ax[i]) || HalfIsZero(bx[i])))
-			float_underflow_error();
-	}
+	if (underflow)
+		float_underflow_error();
 
 	PG_RETURN_POINTER(result);
 }
@@ -922,8 +1038,7 @@ halfvec_binary_quantize(PG_FUNCTION_ARGS)
 	VarBit	   *result = InitBitVector(a->dim);
 	unsigned char *rx = VARBITS(result);
 
-	for (int i = 0; i < a->dim; i++)
-		rx[i / 8] |= (HalfToFloat4(ax[i]) > 0) << (7 - (i % 8));
+	BinaryQuantizeHalf(a->dim, ax, rx);
 
 	PG_RETURN_VARBIT_P(result);
 }
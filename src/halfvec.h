@@ -66,5 +66,8 @@ typedef struct HalfVector
 }			HalfVector;
 
 HalfVector *InitHalfVector(int dim);
+double		HalfvecL2SquaredBoundedDistance(Datum a, Datum b, double maxDistance);
+double		HalfvecL2BoundedDistance(Datum a, Datum b, double maxDistance);
+double		HalfvecL1BoundedDistance(Datum a, Datum b, double maxDistance);
 
 #endif
@@ -17,35 +17,49 @@
 #endif
 
 int			hnsw_ef_search;
-int			hnsw_lock_tranche_id;
+double		hnsw_target_recall;
+int			hnsw_lock_tranche_ids[HNSW_TRANCHES];
 static relopt_kind hnsw_relopt_kind;
 
 /*
- * Assign a tranche ID for our LWLocks. This only needs to be done by one
- * backend, as the tranche ID is remembered in shared memory.
+ * Assign tranche IDs for our LWLocks. This only needs to be done by one
+ * backend, as the tranche IDs are remembered in shared memory.
  *
  * This shared memory area is very small, so we just allocate it from the
  * "slop" that PostgreSQL reserves for small allocations like this. If
  * this grows bigger, we should use a shmem_request_hook and
  * RequestAddinShmemSpace() to pre-reserve space for this.
+ *
+ * Each kind of lock has its own tranche so waits show up as distinct wait
+ * events.
  */
 void
 HnswInitLockTranche(void)
 {
+	static const char *const names[HNSW_TRANCHES] = {
+		[HNSW_ELEMENT_TRANCHE] = "HnswBuildElement",
+		[HNSW_ENTRY_TRANCHE] = "HnswBuildEntry",
+		[HNSW_ALLOCATOR_TRANCHE] = "HnswBuildAllocator",
+		[HNSW_FLUSH_TRANCHE] = "HnswBuildFlush"
+	};
 	int		   *tranche_ids;
 	bool		found;
 
 	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
-	tranche_ids = ShmemInitStruct("hnsw LWLock ids",
-								  sizeof(int) * 1,
+	tranche_ids = ShmemInitStruct("hnsw LWLock tranche ids",
+								  sizeof(int) * HNSW_TRANCHES,
 								  &found);
 	if (!found)
-		tranche_ids[0] = LWLockNewTrancheId();
-	hnsw_lock_tranche_id = tranche_ids[0];
+	{
+		for (int i = 0; i < HNSW_TRANCHES; i++)
+			tranche_ids[i] = LWLockNewTrancheId();
+	}
+	memcpy(hnsw_lock_tranche_ids, tranche_ids, sizeof(int) * HNSW_TRANCHES);
 	LWLockRelease(AddinShmemInitLock);
 
-	/* Per-backend registration of the tranche ID */
-	LWLockRegisterTranche(hnsw_lock_tranche_id, "HnswBuild");
+	/* Per-backend registration of the tranche IDs */
+	for (int i = 0; i < HNSW_TRANCHES; i++)
+		LWLockRegisterTranche(hnsw_lock_tranche_ids[i], names[i]);
 }
 
 /*
@@ -68,6 +82,18 @@ HnswInit(void)
 					  HNSW_DEFAULT_EF_CONSTRUCTION, HNSW_MIN_EF_CONSTRUCTION, HNSW_MAX_EF_CONSTRUCTION
 #if PG_VERSION_NUM >= 130000
 					  ,AccessExclusiveLock
+#endif
+		);
+	add_int_reloption(hnsw_relopt_kind, "prefix_dimensions", "Number of leading dimensions to index (0 for all)",
+					  HNSW_DEFAULT_PREFIX_DIMENSIONS, 0, VECTOR_MAX_DIM
+#if PG_VERSION_NUM >= 130000
+					  ,AccessExclusiveLock
+#endif
+		);
+	add_bool_reloption(hnsw_relopt_kind, "calibrate", "Estimate recall at build time for target_recall",
+					   HNSW_DEFAULT_CALIBRATE
+#if PG_VERSION_NUM >= 130000
+					   ,AccessExclusiveLock
 #endif
 		);
 
@@ -75,13 +101,17 @@ HnswInit(void)
 							"Valid range is 1..1000.", &hnsw_ef_search,
 							HNSW_DEFAULT_EF_SEARCH, HNSW_MIN_EF_SEARCH, HNSW_MAX_EF_SEARCH, PGC_USERSET, 0, NULL, NULL, NULL);
 
+	DefineCustomRealVariable("hnsw.target_recall", "Sets the target recall for search",
+							 "Zero disables. Increases ef_search based on calibration at index build time.", &hnsw_target_recall,
+							 0, 0, 1, PGC_USERSET, 0, NULL, NULL, NULL);
+
 	MarkGUCPrefixReserved("hnsw");
 }
 
 /*
  * Get the name of index build phase
  */
-static char *
+char *
 hnswbuildphasename(int64 phasenum)
 {
 	switch (phasenum)
@@ -90,6 +120,16 @@ hnswbuildphasename(int64 phasenum)
 			return "initializing";
 		case PROGRESS_HNSW_PHASE_LOAD:
 			return "loading tuples";
+		case PROGRESS_HNSW_PHASE_WRITE_PAGES:
+			return "writing pages";
+		case PROGRESS_HNSW_PHASE_WRITE_NEIGHBORS:
+			return "writing neighbors";
+		case PROGRESS_HNSW_PHASE_LOAD_DISK:
+			return "loading tuples on disk";
+		case PROGRESS_HNSW_PHASE_CALIBRATE:
+			return "calibrating";
+		case PROGRESS_HNSW_PHASE_WAL:
+			return "logging pages";
 		default:
 			return NULL;
 	}
@@ -152,6 +192,8 @@ hnswoptions(Datum reloptions, bool validate)
 	static const relopt_parse_elt tab[] = {
 		{"m", RELOPT_TYPE_INT, offsetof(HnswOptions, m)},
 		{"ef_construction", RELOPT_TYPE_INT, offsetof(HnswOptions, efConstruction)},
+		{"prefix_dimensions", RELOPT_TYPE_INT, offsetof(HnswOptions, prefixDimensions)},
+		{"calibrate", RELOPT_TYPE_BOOL, offsetof(HnswOptions, calibrate)},
 	};
 
 #if PG_VERSION_NUM >= 130000
@@ -221,6 +263,9 @@ hnswhandler(PG_FUNCTION_ARGS)
 	amroutine->ambuild = hnswbuild;
 	amroutine->ambuildempty = hnswbuildempty;
 	amroutine->aminsert = hnswinsert;
+#if PG_VERSION_NUM >= 170000
+	amroutine->aminsertcleanup = hnswinsertcleanup;
+#endif
 	amroutine->ambulkdelete = hnswbulkdelete;
 	amroutine->amvacuumcleanup = hnswvacuumcleanup;
 	amroutine->amcanreturn = NULL;
@@ -8,6 +8,10 @@
 #include "lib/pairingheap.h"
 #include "nodes/execnodes.h"
 #include "port.h"				/* for random() */
+#include "lockstats.h"
+#include "portability/instr_time.h"
+#include "recall.h"
+#include "scancache.h"
 #include "utils/relptr.h"
 #include "utils/sampling.h"
 #include "vector.h"
@@ -42,6 +46,14 @@
 #define HNSW_DEFAULT_EF_SEARCH	40
 #define HNSW_MIN_EF_SEARCH		1
 #define HNSW_MAX_EF_SEARCH		1000
+#define HNSW_DEFAULT_PREFIX_DIMENSIONS	0
+#define HNSW_DEFAULT_CALIBRATE	false
+
+/* Calibration for target recall */
+#define HNSW_CALIBRATION_QUERIES	50
+#define HNSW_CALIBRATION_K	10
+#define HNSW_CALIBRATION_STEPS	8
+#define HnswCalibrationEf(step) Min(HNSW_CALIBRATION_K << (step), HNSW_MAX_EF_SEARCH)
 
 /* Tuple types */
 #define HNSW_ELEMENT_TUPLE_TYPE  1
@@ -50,12 +62,21 @@
 /* Make graph robust against non-HOT updates */
 #define HNSW_HEAPTIDS 10
 
+/* Only the first heap TIDs of an element can be marked as dead */
+#define HNSW_DEADTIDS 8
+#define HnswHeapTidIsDead(deadtids, i) ((i) < HNSW_DEADTIDS && ((deadtids) & (1 << (i))))
+
 #define HNSW_UPDATE_ENTRY_GREATER 1
 #define HNSW_UPDATE_ENTRY_ALWAYS 2
 
 /* Build phases */
 /* PROGRESS_CREATEIDX_SUBPHASE_INITIALIZE is 1 */
 #define PROGRESS_HNSW_PHASE_LOAD		2
+#define PROGRESS_HNSW_PHASE_WRITE_PAGES	3
+#define PROGRESS_HNSW_PHASE_WRITE_NEIGHBORS	4
+#define PROGRESS_HNSW_PHASE_LOAD_DISK	5
+#define PROGRESS_HNSW_PHASE_CALIBRATE	6
+#define PROGRESS_HNSW_PHASE_WAL			7
 
 #define HNSW_MAX_SIZE (BLCKSZ - MAXALIGN(SizeOfPageHeaderData) - MAXALIGN(sizeof(HnswPageOpaqueData)) - sizeof(ItemIdData))
 #define HNSW_TUPLE_ALLOC_SIZE BLCKSZ
@@ -109,9 +130,17 @@
 #define HnswPtrPointer(hp) (hp).ptr
 #define HnswPtrOffset(hp) relptr_offset((hp).relptr)
 
+/* LWLock tranches for builds */
+#define HNSW_ELEMENT_TRANCHE	0
+#define HNSW_ENTRY_TRANCHE		1
+#define HNSW_ALLOCATOR_TRANCHE	2
+#define HNSW_FLUSH_TRANCHE		3
+#define HNSW_TRANCHES			4
+
 /* Variables */
 extern int	hnsw_ef_search;
-extern int	hnsw_lock_tranche_id;
+extern double hnsw_target_recall;
+extern int	hnsw_lock_tranche_ids[];
 
 typedef struct HnswElementData HnswElementData;
 typedef struct HnswNeighborArray HnswNeighborArray;
@@ -134,7 +163,9 @@ struct HnswElementData
 	uint8		heaptidsLength;
 	uint8		level;
 	uint8		deleted;
+	uint8		deadtids;
 	uint32		hash;
+	uint16		popcount;
 	HnswNeighborsPtr neighbors;
 	BlockNumber blkno;
 	OffsetNumber offno;
@@ -160,6 +191,13 @@ struct HnswNeighborArray
 	HnswCandidate items[FLEXIBLE_ARRAY_MEMBER];
 };
 
+typedef struct HnswQuery
+{
+	Datum		value;
+	uint16		popcount;		/* for Jaccard distance, 0 if unknown */
+	BoundedDistanceFunc boundedDistance;	/* NULL if not supported */
+}			HnswQuery;
+
 typedef struct HnswPairingHeapNode
 {
 	pairingheap_node ph_node;
@@ -172,6 +210,8 @@ typedef struct HnswOptions
 	int32		vl_len_;		/* varlena header (do not touch directly!) */
 	int			m;				/* number of connections */
 	int			efConstruction; /* size of dynamic candidate list */
+	int			prefixDimensions;	/* number of dimensions to index */
+	bool		calibrate;		/* estimate recall at build time */
 }			HnswOptions;
 
 typedef struct HnswGraph
@@ -238,6 +278,7 @@ typedef struct HnswTypeInfo
 	int			maxDimensions;
 	Datum		(*normalize) (PG_FUNCTION_ARGS);
 	void		(*checkValue) (Pointer v);
+	Datum		(*subvector) (PG_FUNCTION_ARGS);
 }			HnswTypeInfo;
 
 typedef struct HnswBuildState
@@ -251,6 +292,7 @@ typedef struct HnswBuildState
 
 	/* Settings */
 	int			dimensions;
+	int			prefixDimensions;
 	int			m;
 	int			efConstruction;
 
@@ -262,6 +304,7 @@ typedef struct HnswBuildState
 	FmgrInfo   *procinfo;
 	FmgrInfo   *normprocinfo;
 	Oid			collation;
+	BoundedDistanceFunc boundedDistance;
 
 	/* Variables */
 	HnswGraph	graphData;
@@ -274,6 +317,11 @@ typedef struct HnswBuildState
 	MemoryContext tmpCtx;
 	HnswAllocator allocator;
 
+	/* Timing */
+	int			phase;
+	instr_time	phaseStart;
+	double		phaseTuples;
+
 	/* Parallel builds */
 	HnswLeader *hnswleader;
 	HnswShared *hnswshared;
@@ -291,6 +339,7 @@ typedef struct HnswMetaPageData
 	OffsetNumber entryOffno;
 	int16		entryLevel;
 	BlockNumber insertPage;
+	float		calibration[HNSW_CALIBRATION_STEPS];	/* recall for each ef_search step, 0 if unknown */
 }			HnswMetaPageData;
 
 typedef HnswMetaPageData * HnswMetaPage;
@@ -309,10 +358,10 @@ typedef struct HnswElementTupleData
 	uint8		type;
 	uint8		level;
 	uint8		deleted;
-	uint8		unused;
+	uint8		deadtids;
 	ItemPointerData heaptids[HNSW_HEAPTIDS];
 	ItemPointerData neighbortid;
-	uint16		unused2;
+	uint16		popcount;		/* for Jaccard distance, 0 if unknown */
 	Vector		data;
 }			HnswElementTupleData;
 
@@ -331,14 +380,35 @@ typedef HnswNeighborTupleData * HnswNeighborTuple;
 typedef struct HnswScanOpaqueData
 {
 	const		HnswTypeInfo *typeInfo;
+	int			efSearch;
+	int			prefixDimensions;
 	bool		first;
 	List	   *w;
 	MemoryContext tmpCtx;
 
+	/* Previously returned heap TID */
+	ItemPointerData priorElementTid;
+	int			priorHeaptidIndex;
+	XLogRecPtr	searchLsn;
+
+	/* Cached results */
+	ScanCacheState *cache;
+
+	/* Recall monitoring */
+	RecallSampleState *recall;
+
+	/* Heap prefetching for prefix dimensions */
+	int			prefetchPos;	/* candidate to prefetch next */
+	int			prefetchHeaptidIndex;
+	int			prefetchAhead;	/* heap TIDs prefetched but not returned */
+	int			prefetchMaximum;
+	BlockNumber prefetchBlkno;
+
 	/* Support functions */
 	FmgrInfo   *procinfo;
 	FmgrInfo   *normprocinfo;
 	Oid			collation;
+	BoundedDistanceFunc boundedDistance;
 }			HnswScanOpaqueData;
 
 typedef HnswScanOpaqueData * HnswScanOpaque;
@@ -358,6 +428,7 @@ typedef struct HnswVacuumState
 	/* Support functions */
 	FmgrInfo   *procinfo;
 	Oid			collation;
+	BoundedDistanceFunc boundedDistance;
 
 	/* Variables */
 	struct tidhash_hash *deleted;
@@ -372,20 +443,24 @@ typedef struct HnswVacuumState
 /* Methods */
 int			HnswGetM(Relation index);
 int			HnswGetEfConstruction(Relation index);
+int			HnswGetPrefixDimensions(Relation index);
+bool		HnswGetCalibrate(Relation index);
 FmgrInfo   *HnswOptionalProcInfo(Relation index, uint16 procnum);
 Datum		HnswNormValue(const HnswTypeInfo * typeInfo, Oid collation, Datum value);
+Datum		HnswPrefixValue(const HnswTypeInfo * typeInfo, int prefixDimensions, Datum value);
 bool		HnswCheckNorm(FmgrInfo *procinfo, Oid collation, Datum value);
 Buffer		HnswNewBuffer(Relation index, ForkNumber forkNum);
 void		HnswInitPage(Buffer buf, Page page);
 void		HnswInit(void);
-List	   *HnswSearchLayer(char *base, Datum q, List *ep, int ef, int lc, Relation index, FmgrInfo *procinfo, Oid collation, int m, bool inserting, HnswElement skipElement);
+List	   *HnswSearchLayer(char *base, HnswQuery * q, List *ep, int ef, int lc, Relation index, FmgrInfo *procinfo, Oid collation, int m, bool inserting, HnswElement skipElement);
 HnswElement HnswGetEntryPoint(Relation index);
 void		HnswGetMetaPageInfo(Relation index, int *m, HnswElement * entryPoint);
+int			HnswGetEfSearch(Relation index);
 void	   *HnswAlloc(HnswAllocator * allocator, Size size);
 HnswElement HnswInitElement(char *base, ItemPointer tid, int m, double ml, int maxLevel, HnswAllocator * alloc);
 HnswElement HnswInitElementFromBlock(BlockNumber blkno, OffsetNumber offno);
-void		HnswFindElementNeighbors(char *base, HnswElement element, HnswElement entryPoint, Relation index, FmgrInfo *procinfo, Oid collation, int m, int efConstruction, bool existing);
-HnswCandidate *HnswEntryCandidate(char *base, HnswElement em, Datum q, Relation rel, FmgrInfo *procinfo, Oid collation, bool loadVec);
+void		HnswFindElementNeighbors(char *base, HnswElement element, HnswElement entryPoint, Relation index, FmgrInfo *procinfo, Oid collation, BoundedDistanceFunc boundedDistance, int m, int efConstruction, bool existing);
+HnswCandidate *HnswEntryCandidate(char *base, HnswElement em, HnswQuery * q, Relation rel, FmgrInfo *procinfo, Oid collation, bool loadVec);
 void		HnswUpdateMetaPage(Relation index, int updateEntry, HnswElement entryPoint, BlockNumber insertPage, ForkNumber forkNum, bool building);
 void		HnswSetNeighborTuple(char *base, HnswNeighborTuple ntup, HnswElement e, int m);
 void		HnswAddHeapTid(HnswElement element, ItemPointer heaptid);
@@ -393,7 +468,8 @@ void		HnswInitNeighbors(char *base, HnswElement element, int m, HnswAllocator *
 bool		HnswInsertTupleOnDisk(Relation index, Datum value, Datum *values, bool *isnull, ItemPointer heap_tid, bool building);
 void		HnswUpdateNeighborsOnDisk(Relation index, FmgrInfo *procinfo, Oid collation, HnswElement e, int m, bool checkExisting, bool building);
 void		HnswLoadElementFromTuple(HnswElement element, HnswElementTuple etup, bool loadHeaptids, bool loadVec);
-void		HnswLoadElement(HnswElement element, float *distance, Datum *q, Relation index, FmgrInfo *procinfo, Oid collation, bool loadVec);
+void		HnswLoadElement(HnswElement element, float *distance, HnswQuery * q, Relation index, FmgrInfo *procinfo, Oid collation, bool loadVec, float *maxDistance);
+uint16		HnswGetPopcount(FmgrInfo *procinfo, Datum value);
 void		HnswSetElementTuple(char *base, HnswElementTuple etup, HnswElement element);
 void		HnswUpdateConnection(char *base, HnswElement element, HnswCandidate * hc, int lm, int lc, int *updateIdx, Relation index, FmgrInfo *procinfo, Oid collation);
 void		HnswLoadNeighbors(HnswElement element, Relation index, int m);
@@ -403,6 +479,7 @@ PGDLLEXPORT void HnswParallelBuildMain(dsm_segment *seg, shm_toc *toc);
 
 /* Index access methods */
 IndexBuildResult *hnswbuild(Relation heap, Relation index, IndexInfo *indexInfo);
+char	   *hnswbuildphasename(int64 phasenum);
 void		hnswbuildempty(Relation index);
 bool		hnswinsert(Relation index, Datum *values, bool *isnull, ItemPointer heap_tid, Relation heap, IndexUniqueCheck checkUnique
 #if PG_VERSION_NUM >= 140000
@@ -410,6 +487,9 @@ bool		hnswinsert(Relation index, Datum *values, bool *isnull, ItemPointer heap_t
 #endif
 					   ,IndexInfo *indexInfo
 );
+#if PG_VERSION_NUM >= 170000
+void		hnswinsertcleanup(Relation index, IndexInfo *indexInfo);
+#endif
 IndexBulkDeleteResult *hnswbulkdelete(IndexVacuumInfo *info, IndexBulkDeleteResult *stats, IndexBulkDeleteCallback callback, void *callback_state);
 IndexBulkDeleteResult *hnswvacuumcleanup(IndexVacuumInfo *info, IndexBulkDeleteResult *stats);
 IndexScanDesc hnswbeginscan(Relation index, int nkeys, int norderbys);
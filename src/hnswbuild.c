@@ -53,6 +53,7 @@
 #include "tcop/tcopprot.h"
 #include "utils/datum.h"
 #include "utils/memutils.h"
+#include "vectortrace.h"
 
 #if PG_VERSION_NUM >= 140000
 #include "utils/backend_progress.h"
@@ -75,10 +76,71 @@
 #define PARALLEL_KEY_HNSW_AREA			UINT64CONST(0xA000000000000002)
 #define PARALLEL_KEY_QUERY_TEXT			UINT64CONST(0xA000000000000003)
 
+typedef struct HnswCalibrationNeighbors
+{
+	int			length;
+	float		distances[HNSW_CALIBRATION_K];
+	ItemPointerData tids[HNSW_CALIBRATION_K];
+}			HnswCalibrationNeighbors;
+
+typedef struct HnswCalibrationQuery
+{
+	Datum		value;
+	uint16		popcount;
+	HnswCalibrationNeighbors exact;
+}			HnswCalibrationQuery;
+
 #if PG_VERSION_NUM < 130000
 #define GENERATIONCHUNK_RAWSIZE (SIZEOF_SIZE_T + SIZEOF_VOID_P * 2)
 #endif
 
+#define PhaseLoadsTuples(phase) ((phase) == PROGRESS_HNSW_PHASE_LOAD || (phase) == PROGRESS_HNSW_PHASE_LOAD_DISK)
+
+/*
+ * Log the time spent in the current phase
+ */
+static void
+EndPhase(HnswBuildState * buildstate)
+{
+	instr_time	duration;
+	double		seconds;
+	double		tuples = buildstate->phaseTuples;
+
+	if (buildstate->phase == 0)
+		return;
+
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, buildstate->phaseStart);
+	seconds = INSTR_TIME_GET_DOUBLE(duration);
+
+	/* Load phases count tuples added to the graph by all participants */
+	if (PhaseLoadsTuples(buildstate->phase))
+		tuples = buildstate->graph->indtuples - buildstate->phaseTuples;
+
+	if (tuples > 0 && seconds > 0)
+		ereport(DEBUG1, (errmsg("hnsw %s: %.3f s, " INT64_FORMAT " tuples, %.0f tuples/s", hnswbuildphasename(buildstate->phase), seconds, (int64) tuples, tuples / seconds)));
+	else
+		ereport(DEBUG1, (errmsg("hnsw %s: %.3f s", hnswbuildphasename(buildstate->phase), seconds)));
+
+	buildstate->phase = 0;
+}
+
+/*
+ * Start a build phase
+ */
+static void
+StartPhase(HnswBuildState * buildstate, int phase)
+{
+	EndPhase(buildstate);
+
+	buildstate->phase = phase;
+	buildstate->phaseTuples = PhaseLoadsTuples(phase) ? buildstate->graph->indtuples : 0;
+	INSTR_TIME_SET_CURRENT(buildstate->phaseStart);
+
+	pgstat_progress_update_param(PROGRESS_CREATEIDX_SUBPHASE, phase);
+	TRACE_PGVECTOR_HNSW_BUILD_PHASE(RelationGetRelid(buildstate->index), phase);
+}
+
 /*
  * Create the metapage
  */
@@ -227,6 +289,9 @@ CreateGraphPages(HnswBuildState * buildstate)
 		/* Add placeholder for neighbors */
 		if (PageAddItem(page, (Item) ntup, ntupSize, InvalidOffsetNumber, false, false) != element->neighborOffno)
 			elog(ERROR, "failed to add index item to \"%s\"", RelationGetRelationName(index));
+
+		/* Update progress */
+		pgstat_progress_update_param(PROGRESS_CREATEIDX_TUPLES_DONE, ++buildstate->phaseTuples);
 	}
 
 	insertPage = BufferGetBlockNumber(buf);
@@ -287,6 +352,9 @@ WriteNeighborTuples(HnswBuildState * buildstate)
 		/* Commit */
 		MarkBufferDirty(buf);
 		UnlockReleaseBuffer(buf);
+
+		/* Update progress */
+		pgstat_progress_update_param(PROGRESS_CREATEIDX_TUPLES_DONE, ++buildstate->phaseTuples);
 	}
 
 	pfree(ntup);
@@ -302,10 +370,17 @@ FlushPages(HnswBuildState * buildstate)
 	elog(INFO, "memory: %zu MB", buildstate->graph->memoryUsed / (1024 * 1024));
 #endif
 
+	TRACE_PGVECTOR_HNSW_FLUSH_START(RelationGetRelid(buildstate->index), (int64) buildstate->graph->indtuples);
+
+	StartPhase(buildstate, PROGRESS_HNSW_PHASE_WRITE_PAGES);
 	CreateMetaPage(buildstate);
 	CreateGraphPages(buildstate);
+
+	StartPhase(buildstate, PROGRESS_HNSW_PHASE_WRITE_NEIGHBORS);
 	WriteNeighborTuples(buildstate);
 
+	TRACE_PGVECTOR_HNSW_FLUSH_DONE(RelationGetRelid(buildstate->index), (int64) buildstate->graph->indtuples);
+
 	buildstate->graph->flushed = true;
 	MemoryContextReset(buildstate->graphCtx);
 }
@@ -316,7 +391,7 @@ FlushPages(HnswBuildState * buildstate)
 static bool
 AddDuplicateInMemory(HnswElement element, HnswElement dup)
 {
-	LWLockAcquire(&dup->lock, LW_EXCLUSIVE);
+	LockStatsLWLockAcquire(&dup->lock, LW_EXCLUSIVE, VECTOR_LOCK_HNSW_ELEMENT);
 
 	if (dup->heaptidsLength == HNSW_HEAPTIDS)
 	{
@@ -390,7 +465,7 @@ UpdateNeighborsInMemory(char *base, FmgrInfo *procinfo, Oid collation, HnswEleme
 			Assert(neighborElement);
 
 			/* Use element for lock instead of hc since hc can be replaced */
-			LWLockAcquire(&neighborElement->lock, LW_EXCLUSIVE);
+			LockStatsLWLockAcquire(&neighborElement->lock, LW_EXCLUSIVE, VECTOR_LOCK_HNSW_ELEMENT);
 			HnswUpdateConnection(base, e, hc, lm, lc, NULL, NULL, procinfo, collation);
 			LWLockRelease(&neighborElement->lock);
 		}
@@ -438,11 +513,11 @@ InsertTupleInMemory(HnswBuildState * buildstate, HnswElement element)
 	char	   *base = buildstate->hnswarea;
 
 	/* Wait if another process needs exclusive lock on entry lock */
-	LWLockAcquire(entryWaitLock, LW_EXCLUSIVE);
+	LockStatsLWLockAcquire(entryWaitLock, LW_EXCLUSIVE, VECTOR_LOCK_HNSW_ENTRY);
 	LWLockRelease(entryWaitLock);
 
 	/* Get entry point */
-	LWLockAcquire(entryLock, LW_SHARED);
+	LockStatsLWLockAcquire(entryLock, LW_SHARED, VECTOR_LOCK_HNSW_ENTRY);
 	entryPoint = HnswPtrAccess(base, graph->entryPoint);
 
 	/* Prevent concurrent inserts when likely updating entry point */
@@ -452,8 +527,8 @@ InsertTupleInMemory(HnswBuildState * buildstate, HnswElement element)
 		LWLockRelease(entryLock);
 
 		/* Tell other processes to wait and get exclusive lock */
-		LWLockAcquire(entryWaitLock, LW_EXCLUSIVE);
-		LWLockAcquire(entryLock, LW_EXCLUSIVE);
+		LockStatsLWLockAcquire(entryWaitLock, LW_EXCLUSIVE, VECTOR_LOCK_HNSW_ENTRY);
+		LockStatsLWLockAcquire(entryLock, LW_EXCLUSIVE, VECTOR_LOCK_HNSW_ENTRY);
 		LWLockRelease(entryWaitLock);
 
 		/* Get latest entry point after lock is acquired */
@@ -461,7 +536,7 @@ InsertTupleInMemory(HnswBuildState * buildstate, HnswElement element)
 	}
 
 	/* Find neighbors for element */
-	HnswFindElementNeighbors(base, element, entryPoint, NULL, procinfo, collation, m, efConstruction, false);
+	HnswFindElementNeighbors(base, element, entryPoint, NULL, procinfo, collation, buildstate->boundedDistance, m, efConstruction, false);
 
 	/* Update graph in memory */
 	UpdateGraphInMemory(procinfo, collation, element, m, efConstruction, entryPoint, buildstate);
@@ -492,6 +567,10 @@ InsertTuple(Relation index, Datum *values, bool *isnull, ItemPointer heaptid, Hn
 	if (typeInfo->checkValue != NULL)
 		typeInfo->checkValue(DatumGetPointer(value));
 
+	/* Index prefix if needed */
+	if (buildstate->prefixDimensions > 0)
+		value = HnswPrefixValue(typeInfo, buildstate->prefixDimensions, value);
+
 	/* Normalize if needed */
 	if (buildstate->normprocinfo != NULL)
 	{
@@ -505,7 +584,7 @@ InsertTuple(Relation index, Datum *values, bool *isnull, ItemPointer heaptid, Hn
 	valueSize = VARSIZE_ANY(DatumGetPointer(value));
 
 	/* Ensure graph not flushed when inserting */
-	LWLockAcquire(flushLock, LW_SHARED);
+	LockStatsLWLockAcquire(flushLock, LW_SHARED, VECTOR_LOCK_HNSW_FLUSH);
 
 	/* Are we in the on-disk phase? */
 	if (graph->flushed)
@@ -519,7 +598,7 @@ InsertTuple(Relation index, Datum *values, bool *isnull, ItemPointer heaptid, Hn
 	 * In a parallel build, the HnswElement is allocated from the shared
 	 * memory area, so we need to coordinate with other processes.
 	 */
-	LWLockAcquire(&graph->allocatorLock, LW_EXCLUSIVE);
+	LockStatsLWLockAcquire(&graph->allocatorLock, LW_EXCLUSIVE, VECTOR_LOCK_HNSW_ALLOCATOR);
 
 	/*
 	 * Check that we have enough memory available for the new element now that
@@ -530,7 +609,7 @@ InsertTuple(Relation index, Datum *values, bool *isnull, ItemPointer heaptid, Hn
 		LWLockRelease(&graph->allocatorLock);
 
 		LWLockRelease(flushLock);
-		LWLockAcquire(flushLock, LW_EXCLUSIVE);
+		LockStatsLWLockAcquire(flushLock, LW_EXCLUSIVE, VECTOR_LOCK_HNSW_FLUSH);
 
 		if (!graph->flushed)
 		{
@@ -540,6 +619,7 @@ InsertTuple(Relation index, Datum *values, bool *isnull, ItemPointer heaptid, Hn
 					 errhint("Increase maintenance_work_mem to speed up builds.")));
 
 			FlushPages(buildstate);
+			StartPhase(buildstate, PROGRESS_HNSW_PHASE_LOAD_DISK);
 		}
 
 		LWLockRelease(flushLock);
@@ -561,9 +641,10 @@ InsertTuple(Relation index, Datum *values, bool *isnull, ItemPointer heaptid, Hn
 	/* Copy the datum */
 	memcpy(valuePtr, DatumGetPointer(value), valueSize);
 	HnswPtrStore(base, element->value, valuePtr);
+	element->popcount = HnswGetPopcount(buildstate->procinfo, value);
 
 	/* Create a lock for the element */
-	LWLockInitialize(&element->lock, hnsw_lock_tranche_id);
+	LWLockInitialize(&element->lock, hnsw_lock_tranche_ids[HNSW_ELEMENT_TRANCHE]);
 
 	/* Insert tuple */
 	InsertTupleInMemory(buildstate, element);
@@ -626,10 +707,10 @@ InitGraph(HnswGraph * graph, char *base, long memoryTotal)
 	graph->flushed = false;
 	graph->indtuples = 0;
 	SpinLockInit(&graph->lock);
-	LWLockInitialize(&graph->entryLock, hnsw_lock_tranche_id);
-	LWLockInitialize(&graph->entryWaitLock, hnsw_lock_tranche_id);
-	LWLockInitialize(&graph->allocatorLock, hnsw_lock_tranche_id);
-	LWLockInitialize(&graph->flushLock, hnsw_lock_tranche_id);
+	LWLockInitialize(&graph->entryLock, hnsw_lock_tranche_ids[HNSW_ENTRY_TRANCHE]);
+	LWLockInitialize(&graph->entryWaitLock, hnsw_lock_tranche_ids[HNSW_ENTRY_TRANCHE]);
+	LWLockInitialize(&graph->allocatorLock, hnsw_lock_tranche_ids[HNSW_ALLOCATOR_TRANCHE]);
+	LWLockInitialize(&graph->flushLock, hnsw_lock_tranche_ids[HNSW_FLUSH_TRANCHE]);
 }
 
 /*
@@ -688,6 +769,13 @@ InitBuildState(HnswBuildState * buildstate, Relation heap, Relation index, Index
 	buildstate->m = HnswGetM(index);
 	buildstate->efConstruction = HnswGetEfConstruction(index);
 	buildstate->dimensions = TupleDescAttr(index->rd_att, 0)->atttypmod;
+	buildstate->prefixDimensions = HnswGetPrefixDimensions(index);
+
+	/* Get support functions */
+	buildstate->procinfo = index_getprocinfo(index, 1, HNSW_DISTANCE_PROC);
+	buildstate->boundedDistance = GetBoundedDistanceFunc(buildstate->procinfo);
+	buildstate->normprocinfo = HnswOptionalProcInfo(index, HNSW_NORM_PROC);
+	buildstate->collation = index->rd_indcollation[0];
 
 	/* Disallow varbit since require fixed dimensions */
 	if (TupleDescAttr(index->rd_att, 0)->atttypid == VARBITOID)
@@ -697,6 +785,21 @@ InitBuildState(HnswBuildState * buildstate, Relation heap, Relation index, Index
 	if (buildstate->dimensions < 0)
 		elog(ERROR, "column does not have dimensions");
 
+	/* Scans recheck with the full distance, so prefix distances must be lower bounds */
+	if (buildstate->prefixDimensions > 0)
+	{
+		if (buildstate->typeInfo->subvector == NULL)
+			elog(ERROR, "prefix_dimensions not supported for this type");
+
+		if (GetBoundedDistanceFunc(buildstate->procinfo) == NULL)
+			elog(ERROR, "prefix_dimensions requires L2 or L1 distance");
+
+		if (buildstate->prefixDimensions > buildstate->dimensions)
+			elog(ERROR, "prefix_dimensions cannot be greater than column dimensions");
+
+		buildstate->dimensions = buildstate->prefixDimensions;
+	}
+
 	if (buildstate->dimensions > buildstate->typeInfo->maxDimensions)
 		elog(ERROR, "column cannot have more than %d dimensions for hnsw index", buildstate->typeInfo->maxDimensions);
 
@@ -706,11 +809,6 @@ InitBuildState(HnswBuildState * buildstate, Relation heap, Relation index, Index
 	buildstate->reltuples = 0;
 	buildstate->indtuples = 0;
 
-	/* Get support functions */
-	buildstate->procinfo = index_getprocinfo(index, 1, HNSW_DISTANCE_PROC);
-	buildstate->normprocinfo = HnswOptionalProcInfo(index, HNSW_NORM_PROC);
-	buildstate->collation = index->rd_indcollation[0];
-
 	InitGraph(&buildstate->graphData, NULL, maintenance_work_mem * 1024L);
 	buildstate->graph = &buildstate->graphData;
 	buildstate->ml = HnswGetMl(buildstate->m);
@@ -728,6 +826,10 @@ InitBuildState(HnswBuildState * buildstate, Relation heap, Relation index, Index
 
 	InitAllocator(&buildstate->allocator, &HnswMemoryContextAlloc, buildstate);
 
+	buildstate->phase = PROGRESS_CREATEIDX_SUBPHASE_INITIALIZE;
+	buildstate->phaseTuples = 0;
+	INSTR_TIME_SET_CURRENT(buildstate->phaseStart);
+
 	buildstate->hnswleader = NULL;
 	buildstate->hnswshared = NULL;
 	buildstate->hnswarea = NULL;
@@ -794,6 +896,9 @@ HnswParallelScanAndInsert(Relation heapRel, Relation indexRel, HnswShared * hnsw
 	buildstate.graph = &hnswshared->graphData;
 	buildstate.hnswarea = hnswarea;
 	InitAllocator(&buildstate.allocator, &HnswSharedMemoryAlloc, &buildstate);
+
+	/* The leader tracks the load phase */
+	buildstate.phase = PROGRESS_HNSW_PHASE_LOAD;
 	scan = table_beginscan_parallel(heapRel,
 									ParallelTableScanFromHnswShared(hnswshared));
 	reltuples = table_index_build_scan(heapRel, indexRel, indexInfo,
@@ -812,6 +917,10 @@ HnswParallelScanAndInsert(Relation heapRel, Relation indexRel, HnswShared * hnsw
 	else
 		ereport(DEBUG1, (errmsg("worker processed " INT64_FORMAT " tuples", (int64) reltuples)));
 
+	/* Log phases if this process flushed the graph */
+	if (buildstate.phase != PROGRESS_HNSW_PHASE_LOAD)
+		EndPhase(&buildstate);
+
 	/* Notify leader */
 	ConditionVariableSignal(&hnswshared->workersdonecv);
 
@@ -861,7 +970,9 @@ HnswParallelBuildMain(dsm_segment *seg, shm_toc *toc)
 	hnswarea = shm_toc_lookup(toc, PARALLEL_KEY_HNSW_AREA, false);
 
 	/* Perform inserts */
+	LockStatsBegin(indexRel);
 	HnswParallelScanAndInsert(heapRel, indexRel, hnswshared, hnswarea, false);
+	LockStatsEnd();
 
 	/* Close relations within worker */
 	index_close(indexRel, indexLockmode);
@@ -1075,7 +1186,7 @@ BuildGraph(HnswBuildState * buildstate, ForkNumber forkNum)
 {
 	int			parallel_workers = 0;
 
-	pgstat_progress_update_param(PROGRESS_CREATEIDX_SUBPHASE, PROGRESS_HNSW_PHASE_LOAD);
+	StartPhase(buildstate, PROGRESS_HNSW_PHASE_LOAD);
 
 	/* Calculate parallel workers */
 	if (buildstate->heap != NULL)
@@ -1106,6 +1217,267 @@ BuildGraph(HnswBuildState * buildstate, ForkNumber forkNum)
 		HnswEndParallel(buildstate->hnswleader);
 }
 
+/*
+ * Add a neighbor if it is one of the closest
+ */
+static void
+AddCalibrationNeighbor(HnswCalibrationNeighbors * neighbors, float distance, ItemPointer tid)
+{
+	int			i;
+
+	if (neighbors->length == HNSW_CALIBRATION_K && distance >= neighbors->distances[HNSW_CALIBRATION_K - 1])
+		return;
+
+	i = neighbors->length < HNSW_CALIBRATION_K ? neighbors->length++ : HNSW_CALIBRATION_K - 1;
+
+	/* Keep sorted by distance */
+	for (; i > 0 && neighbors->distances[i - 1] > distance; i--)
+	{
+		neighbors->distances[i] = neighbors->distances[i - 1];
+		neighbors->tids[i] = neighbors->tids[i - 1];
+	}
+
+	neighbors->distances[i] = distance;
+	neighbors->tids[i] = *tid;
+}
+
+/*
+ * Get the fraction of exact neighbors that were found
+ */
+static double
+GetCalibrationRecall(HnswCalibrationNeighbors * approx, HnswCalibrationNeighbors * exact)
+{
+	int			matches = 0;
+
+	if (exact->length == 0)
+		return 1;
+
+	for (int i = 0; i < approx->length; i++)
+	{
+		for (int j = 0; j < exact->length; j++)
+		{
+			if (ItemPointerEquals(&approx->tids[i], &exact->tids[j]))
+			{
+				matches++;
+				break;
+			}
+		}
+	}
+
+	return (double) matches / exact->length;
+}
+
+/*
+ * Sample elements to use as queries
+ */
+static int
+SampleCalibrationQueries(Relation index, HnswCalibrationQuery * queries)
+{
+	BlockNumber nblocks = RelationGetNumberOfBlocks(index);
+	BufferAccessStrategy bas = GetAccessStrategy(BAS_BULKREAD);
+	int64		seen = 0;
+
+	for (BlockNumber blkno = HNSW_HEAD_BLKNO; blkno < nblocks; blkno++)
+	{
+		Buffer		buf;
+		Page		page;
+		OffsetNumber maxoffno;
+
+		CHECK_FOR_INTERRUPTS();
+
+		buf = ReadBufferExtended(index, MAIN_FORKNUM, blkno, RBM_NORMAL, bas);
+		LockBuffer(buf, BUFFER_LOCK_SHARE);
+		page = BufferGetPage(buf);
+		maxoffno = PageGetMaxOffsetNumber(page);
+
+		for (OffsetNumber offno = FirstOffsetNumber; offno <= maxoffno; offno = OffsetNumberNext(offno))
+		{
+			HnswElementTuple etup = (HnswElementTuple) PageGetItem(page, PageGetItemId(page, offno));
+			int64		i;
+
+			if (!HnswIsElementTuple(etup) || etup->deleted)
+				continue;
+
+			/* Reservoir sampling */
+			i = seen < HNSW_CALIBRATION_QUERIES ? seen : (int64) (RandomDouble() * (seen + 1));
+			seen++;
+
+			if (i < HNSW_CALIBRATION_QUERIES)
+			{
+				HnswCalibrationQuery *query = &queries[i];
+
+				if (DatumGetPointer(query->value) != NULL)
+					pfree(DatumGetPointer(query->value));
+
+				query->value = datumCopy(PointerGetDatum(&etup->data), false, -1);
+				query->popcount = etup->popcount;
+			}
+		}
+
+		UnlockReleaseBuffer(buf);
+	}
+
+	FreeAccessStrategy(bas);
+
+	return Min(seen, HNSW_CALIBRATION_QUERIES);
+}
+
+/*
+ * Find exact neighbors of queries
+ *
+ * Queries are elements of the index, so they are their own closest neighbor.
+ * They are kept on both sides, like a search for an indexed value.
+ */
+static void
+FindCalibrationNeighbors(Relation index, FmgrInfo *procinfo, Oid collation, HnswCalibrationQuery * queries, int nqueries)
+{
+	BlockNumber nblocks = RelationGetNumberOfBlocks(index);
+	BufferAccessStrategy bas = GetAccessStrategy(BAS_BULKREAD);
+
+	for (BlockNumber blkno = HNSW_HEAD_BLKNO; blkno < nblocks; blkno++)
+	{
+		Buffer		buf;
+		Page		page;
+		OffsetNumber maxoffno;
+
+		CHECK_FOR_INTERRUPTS();
+
+		buf = ReadBufferExtended(index, MAIN_FORKNUM, blkno, RBM_NORMAL, bas);
+		LockBuffer(buf, BUFFER_LOCK_SHARE);
+		page = BufferGetPage(buf);
+		maxoffno = PageGetMaxOffsetNumber(page);
+
+		for (OffsetNumber offno = FirstOffsetNumber; offno <= maxoffno; offno = OffsetNumberNext(offno))
+		{
+			HnswElementTuple etup = (HnswElementTuple) PageGetItem(page, PageGetItemId(page, offno));
+			Datum		value = PointerGetDatum(&etup->data);
+			ItemPointerData tid;
+
+			if (!HnswIsElementTuple(etup) || etup->deleted)
+				continue;
+
+			ItemPointerSet(&tid, blkno, offno);
+
+			for (int i = 0; i < nqueries; i++)
+			{
+				HnswCalibrationQuery *query = &queries[i];
+				float		distance = (float) DatumGetFloat8(FunctionCall2Coll(procinfo, collation, query->value, value));
+
+				AddCalibrationNeighbor(&query->exact, distance, &tid);
+			}
+		}
+
+		UnlockReleaseBuffer(buf);
+	}
+
+	FreeAccessStrategy(bas);
+}
+
+/*
+ * Estimate recall for each ef_search step with sampled elements as queries
+ * and store it in the metapage for hnsw.target_recall
+ */
+static void
+CalibrateIndex(HnswBuildState * buildstate)
+{
+	Relation	index = buildstate->index;
+	FmgrInfo   *procinfo = buildstate->procinfo;
+	Oid			collation = buildstate->collation;
+	BoundedDistanceFunc boundedDistance = buildstate->boundedDistance;
+	HnswCalibrationQuery *queries;
+	int			nqueries;
+	double		recall[HNSW_CALIBRATION_STEPS] = {0};
+	int			m;
+	HnswElement entryPoint;
+	char	   *base = NULL;
+	MemoryContext calibrateCtx;
+	MemoryContext queryCtx;
+	MemoryContext oldCtx;
+	Buffer		buf;
+	HnswMetaPage metap;
+
+	/* Need more elements than neighbors */
+	if (buildstate->indtuples <= HNSW_CALIBRATION_K)
+		return;
+
+	calibrateCtx = AllocSetContextCreate(CurrentMemoryContext,
+										 "Hnsw calibration context",
+										 ALLOCSET_DEFAULT_SIZES);
+	queryCtx = AllocSetContextCreate(calibrateCtx,
+									 "Hnsw calibration query context",
+									 ALLOCSET_DEFAULT_SIZES);
+	oldCtx = MemoryContextSwitchTo(calibrateCtx);
+
+	queries = palloc0(sizeof(HnswCalibrationQuery) * HNSW_CALIBRATION_QUERIES);
+	nqueries = SampleCalibrationQueries(index, queries);
+	FindCalibrationNeighbors(index, procinfo, collation, queries, nqueries);
+
+	HnswGetMetaPageInfo(index, &m, &entryPoint);
+
+	if (entryPoint == NULL || nqueries == 0)
+	{
+		MemoryContextSwitchTo(oldCtx);
+		MemoryContextDelete(calibrateCtx);
+		return;
+	}
+
+	for (int i = 0; i < nqueries; i++)
+	{
+		HnswCalibrationQuery *query = &queries[i];
+		HnswQuery	q;
+		List	   *ep;
+
+		CHECK_FOR_INTERRUPTS();
+
+		MemoryContextSwitchTo(queryCtx);
+
+		q.value = query->value;
+		q.popcount = query->popcount;
+		q.boundedDistance = boundedDistance;
+
+		/* Same as index scans */
+		ep = list_make1(HnswEntryCandidate(base, entryPoint, &q, index, procinfo, collation, false));
+		for (int lc = entryPoint->level; lc >= 1; lc--)
+			ep = HnswSearchLayer(base, &q, ep, 1, lc, index, procinfo, collation, m, false, NULL);
+
+		for (int step = 0; step < HNSW_CALIBRATION_STEPS; step++)
+		{
+			List	   *w = HnswSearchLayer(base, &q, ep, HnswCalibrationEf(step), 0, index, procinfo, collation, m, false, NULL);
+			HnswCalibrationNeighbors approx;
+			ListCell   *lc2;
+
+			approx.length = 0;
+
+			foreach(lc2, w)
+			{
+				HnswCandidate *hc = (HnswCandidate *) lfirst(lc2);
+				HnswElement element = HnswPtrAccess(base, hc->element);
+				ItemPointerData tid;
+
+				ItemPointerSet(&tid, element->blkno, element->offno);
+				AddCalibrationNeighbor(&approx, hc->distance, &tid);
+			}
+
+			recall[step] += GetCalibrationRecall(&approx, &query->exact);
+		}
+
+		MemoryContextSwitchTo(calibrateCtx);
+		MemoryContextReset(queryCtx);
+	}
+
+	/* Update metapage */
+	buf = ReadBufferExtended(index, MAIN_FORKNUM, HNSW_METAPAGE_BLKNO, RBM_NORMAL, NULL);
+	LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
+	metap = HnswPageGetMeta(BufferGetPage(buf));
+	for (int step = 0; step < HNSW_CALIBRATION_STEPS; step++)
+		metap->calibration[step] = recall[step] / nqueries;
+	MarkBufferDirty(buf);
+	UnlockReleaseBuffer(buf);
+
+	MemoryContextSwitchTo(oldCtx);
+	MemoryContextDelete(calibrateCtx);
+}
+
 /*
  * Build the index
  */
@@ -1119,10 +1491,24 @@ BuildIndex(Relation heap, Relation index, IndexInfo *indexInfo,
 
 	InitBuildState(buildstate, heap, index, indexInfo, forkNum);
 
+	LockStatsBegin(index);
 	BuildGraph(buildstate, forkNum);
+	LockStatsEnd();
+
+	/* Calibrate for target recall */
+	if (forkNum == MAIN_FORKNUM && HnswGetCalibrate(index))
+	{
+		StartPhase(buildstate, PROGRESS_HNSW_PHASE_CALIBRATE);
+		CalibrateIndex(buildstate);
+	}
 
 	if (RelationNeedsWAL(index))
+	{
+		StartPhase(buildstate, PROGRESS_HNSW_PHASE_WAL);
 		log_newpage_range(index, forkNum, 0, RelationGetNumberOfBlocks(index), true);
+	}
+
+	EndPhase(buildstate);
 
 	FreeBuildState(buildstate);
 }
@@ -1136,6 +1522,9 @@ hnswbuild(Relation heap, Relation index, IndexInfo *indexInfo)
 	IndexBuildResult *result;
 	HnswBuildState buildstate;
 
+	/* Relfilenode could be reused */
+	ScanCacheInvalidate(index);
+
 	BuildIndex(heap, index, indexInfo, &buildstate, MAIN_FORKNUM);
 
 	result = (IndexBuildResult *) palloc(sizeof(IndexBuildResult));
@@ -0,0 +1,379 @@
+#include "postgres.h"
+
+#include "access/relation.h"
+#include "access/table.h"
+#include "access/tableam.h"
+#include "catalog/pg_class.h"
+#include "executor/tuptable.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "hnsw.h"
+#include "miscadmin.h"
+#include "storage/bufmgr.h"
+#include "storage/lmgr.h"
+#include "utils/acl.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/rls.h"
+#include "utils/snapmgr.h"
+#include "utils/tuplestore.h"
+
+typedef struct HnswGraphState
+{
+	Relation	index;
+	Relation	heap;
+	IndexFetchTableData *fetch;
+	TupleTableSlot *slot;
+	Snapshot	snapshot;
+	int			m;
+	int			k;
+	FmgrInfo   *procinfo;
+	Oid			collation;
+	FmgrInfo	opfinfo;		/* for reported distances */
+	tidhash_hash *visited;
+	Tuplestorestate *tupstore;
+	TupleDesc	tupdesc;
+}			HnswGraphState;
+
+/*
+ * Compare candidate distances, closest first
+ */
+static int
+#if PG_VERSION_NUM >= 130000
+CompareNearest(const ListCell *a, const ListCell *b)
+{
+	HnswCandidate *hca = lfirst(a);
+	HnswCandidate *hcb = lfirst(b);
+#else
+CompareNearest(const void *a, const void *b)
+{
+	HnswCandidate *hca = lfirst(*(ListCell **) a);
+	HnswCandidate *hcb = lfirst(*(ListCell **) b);
+#endif
+
+	if (hca->distance < hcb->distance)
+		return -1;
+
+	if (hca->distance > hcb->distance)
+		return 1;
+
+	return 0;
+}
+
+/*
+ * Get the TID of the version of a row that is visible to the snapshot
+ */
+static bool
+GetVisibleTid(HnswGraphState * gs, ItemPointer heaptid, ItemPointer visibletid)
+{
+	bool		call_again = false;
+	bool		all_dead = false;
+	bool		found;
+
+	/* Updated to the TID of the visible tuple in the HOT chain */
+	*visibletid = *heaptid;
+	found = table_index_fetch_tuple(gs->fetch, visibletid, gs->snapshot, gs->slot, &call_again, &all_dead);
+	ExecClearTuple(gs->slot);
+
+	return found;
+}
+
+/*
+ * Add the unvisited layer 0 neighbors of an element to the candidates
+ */
+static List *
+AddNeighbors(HnswGraphState * gs, HnswElement element, HnswQuery * q, List *candidates)
+{
+	char	   *base = NULL;
+	HnswNeighborArray *neighbors;
+
+	HnswLoadNeighbors(element, gs->index, gs->m);
+	neighbors = HnswGetNeighbors(base, element, 0);
+
+	for (int i = 0; i < neighbors->length; i++)
+	{
+		HnswCandidate *hc = &neighbors->items[i];
+		HnswElement e = HnswPtrAccess(base, hc->element);
+		ItemPointerData indextid;
+		bool		found;
+
+		ItemPointerSet(&indextid, e->blkno, e->offno);
+		tidhash_insert(gs->visited, indextid, &found);
+		if (found)
+			continue;
+
+		/* Keep the value to report the distance of the operator */
+		HnswLoadElement(e, &hc->distance, q, gs->index, gs->procinfo, gs->collation, true, NULL);
+
+		/* Skip elements without heap TIDs */
+		if (e->heaptidsLength == 0)
+			continue;
+
+		candidates = lappend(candidates, hc);
+	}
+
+	return candidates;
+}
+
+/*
+ * Add the approximate nearest neighbors of an element to the result
+ *
+ * Candidates are the layer 0 neighbors of the element and the neighbors of
+ * its k closest neighbors. The graph already links each element to close
+ * elements, so this avoids a search from the entry point for every element.
+ */
+static void
+AddElementNeighbors(HnswGraphState * gs, HnswElement element)
+{
+	char	   *base = NULL;
+	Datum		value = HnswGetValue(base, element);
+	HnswQuery	q;
+	List	   *candidates;
+	int			ndirect;
+	ListCell   *lc;
+	ItemPointerData indextid;
+	bool		found;
+	ItemPointerData *tids;
+	int			ntids = 0;
+	ItemPointerData *neighbors;
+	Datum	   *distances;
+	int			nneighbors = 0;
+	Datum		selfDistance;
+
+	/* Only report rows visible to the snapshot */
+	tids = palloc(sizeof(ItemPointerData) * element->heaptidsLength);
+	for (int i = 0; i < element->heaptidsLength; i++)
+	{
+		if (GetVisibleTid(gs, &element->heaptids[i], &tids[ntids]))
+			ntids++;
+	}
+
+	if (ntids == 0)
+		return;
+
+	q.value = value;
+	q.popcount = element->popcount;
+	q.boundedDistance = NULL;
+
+	/* Skip the element itself */
+	tidhash_reset(gs->visited);
+	ItemPointerSet(&indextid, element->blkno, element->offno);
+	tidhash_insert(gs->visited, indextid, &found);
+
+	candidates = AddNeighbors(gs, element, &q, NIL);
+	list_sort(candidates, CompareNearest);
+
+	/* Refine with neighbors of neighbors */
+	ndirect = Min(list_length(candidates), gs->k);
+	for (int i = 0; i < ndirect; i++)
+	{
+		HnswCandidate *hc = list_nth(candidates, i);
+
+		candidates = AddNeighbors(gs, HnswPtrAccess(base, hc->element), &q, candidates);
+	}
+	list_sort(candidates, CompareNearest);
+
+	/* Get the k closest visible rows */
+	neighbors = palloc(sizeof(ItemPointerData) * gs->k);
+	distances = palloc(sizeof(Datum) * gs->k);
+	foreach(lc, candidates)
+	{
+		HnswCandidate *hc = lfirst(lc);
+		HnswElement e = HnswPtrAccess(base, hc->element);
+		Datum		distance;
+
+		if (nneighbors >= gs->k)
+			break;
+
+		/* Report the distance of the operator */
+		distance = FunctionCall2Coll(&gs->opfinfo, gs->collation, value, HnswGetValue(base, e));
+
+		for (int j = 0; j < e->heaptidsLength && nneighbors < gs->k; j++)
+		{
+			if (!GetVisibleTid(gs, &e->heaptids[j], &neighbors[nneighbors]))
+				continue;
+
+			distances[nneighbors] = distance;
+			nneighbors++;
+		}
+	}
+
+	selfDistance = FunctionCall2Coll(&gs->opfinfo, gs->collation, value, value);
+
+	for (int i = 0; i < ntids; i++)
+	{
+		int			count = 0;
+
+		/* Rows with the same value are closest */
+		for (int j = 0; j < ntids && count < gs->k; j++)
+		{
+			Datum		values[3];
+			bool		nulls[3] = {0};
+
+			if (j == i)
+				continue;
+
+			values[0] = ItemPointerGetDatum(&tids[i]);
+			values[1] = ItemPointerGetDatum(&tids[j]);
+			values[2] = selfDistance;
+			tuplestore_putvalues(gs->tupstore, gs->tupdesc, values, nulls);
+			count++;
+		}
+
+		for (int j = 0; j < nneighbors && count < gs->k; j++)
+		{
+			Datum		values[3];
+			bool		nulls[3] = {0};
+
+			values[0] = ItemPointerGetDatum(&tids[i]);
+			values[1] = ItemPointerGetDatum(&neighbors[j]);
+			values[2] = distances[j];
+			tuplestore_putvalues(gs->tupstore, gs->tupdesc, values, nulls);
+			count++;
+		}
+	}
+}
+
+/*
+ * Get the approximate k nearest neighbors of every row in an HNSW index
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(hnsw_knn_graph);
+Datum
+hnsw_knn_graph(PG_FUNCTION_ARGS)
+{
+	Oid			indexOid = PG_GETARG_OID(0);
+	int			k = PG_GETARG_INT32(1);
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	HnswGraphState gs;
+	Relation	index;
+	Oid			heapOid;
+	Oid			opno;
+	AclResult	aclresult;
+	BlockNumber blkno = HNSW_HEAD_BLKNO;
+	BufferAccessStrategy bas = GetAccessStrategy(BAS_BULKREAD);
+	MemoryContext tmpCtx;
+	MemoryContext oldCtx;
+
+	if (k < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("k must be greater than zero")));
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo) || !(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	index = relation_open(indexOid, AccessShareLock);
+
+	if (index->rd_rel->relkind != RELKIND_INDEX || index->rd_indam->ambuild != hnswbuild)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not an hnsw index", RelationGetRelationName(index))));
+
+	/* Neighbors are only linked by prefix distances */
+	if (HnswGetPrefixDimensions(index) > 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("hnsw_knn_graph does not support indexes with prefix_dimensions")));
+
+	heapOid = index->rd_index->indrelid;
+	aclresult = pg_class_aclcheck(heapOid, GetUserId(), ACL_SELECT);
+	if (aclresult != ACLCHECK_OK)
+		aclcheck_error(aclresult, OBJECT_TABLE, get_rel_name(heapOid));
+
+	/* Rows are read without applying policies */
+	if (check_enable_rls(heapOid, InvalidOid, false) == RLS_ENABLED)
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 errmsg("hnsw_knn_graph does not support tables with row-level security")));
+
+	opno = get_opfamily_member(index->rd_opfamily[0], index->rd_opcintype[0], index->rd_opcintype[0], 1);
+	if (!OidIsValid(opno))
+		elog(ERROR, "missing ordering operator for hnsw index");
+
+	oldCtx = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	if (get_call_result_type(fcinfo, NULL, &gs.tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	gs.tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = gs.tupstore;
+	rsinfo->setDesc = gs.tupdesc;
+
+	MemoryContextSwitchTo(oldCtx);
+
+	gs.index = index;
+	gs.heap = table_open(heapOid, AccessShareLock);
+	gs.fetch = table_index_fetch_begin(gs.heap);
+	gs.slot = table_slot_create(gs.heap, NULL);
+	gs.snapshot = GetActiveSnapshot();
+	gs.k = k;
+	gs.procinfo = index_getprocinfo(index, 1, HNSW_DISTANCE_PROC);
+	gs.collation = index->rd_indcollation[0];
+	fmgr_info(get_opcode(opno), &gs.opfinfo);
+	HnswGetMetaPageInfo(index, &gs.m, NULL);
+
+	tmpCtx = AllocSetContextCreate(CurrentMemoryContext,
+								   "Hnsw knn graph temporary context",
+								   ALLOCSET_DEFAULT_SIZES);
+	gs.visited = tidhash_create(CurrentMemoryContext, 256, NULL);
+
+	while (BlockNumberIsValid(blkno))
+	{
+		Buffer		buf;
+		Page		page;
+		OffsetNumber maxoffno;
+		List	   *elements = NIL;
+		ListCell   *lc;
+
+		CHECK_FOR_INTERRUPTS();
+
+		oldCtx = MemoryContextSwitchTo(tmpCtx);
+
+		/* Copy elements so the page is not locked while reading neighbors */
+		buf = ReadBufferExtended(index, MAIN_FORKNUM, blkno, RBM_NORMAL, bas);
+		LockBuffer(buf, BUFFER_LOCK_SHARE);
+		page = BufferGetPage(buf);
+		maxoffno = PageGetMaxOffsetNumber(page);
+
+		for (OffsetNumber offno = FirstOffsetNumber; offno <= maxoffno; offno = OffsetNumberNext(offno))
+		{
+			HnswElementTuple etup = (HnswElementTuple) PageGetItem(page, PageGetItemId(page, offno));
+			HnswElement element;
+
+			if (!HnswIsElementTuple(etup) || etup->deleted || !ItemPointerIsValid(&etup->heaptids[0]))
+				continue;
+
+			element = HnswInitElementFromBlock(blkno, offno);
+			HnswLoadElementFromTuple(element, etup, true, true);
+			elements = lappend(elements, element);
+		}
+
+		blkno = HnswPageGetOpaque(page)->nextblkno;
+
+		UnlockReleaseBuffer(buf);
+
+		foreach(lc, elements)
+		{
+			/* Same as index scans */
+			LockPage(index, HNSW_SCAN_LOCK, ShareLock);
+			AddElementNeighbors(&gs, lfirst(lc));
+			UnlockPage(index, HNSW_SCAN_LOCK, ShareLock);
+		}
+
+		MemoryContextSwitchTo(oldCtx);
+		MemoryContextReset(tmpCtx);
+	}
+
+	MemoryContextDelete(tmpCtx);
+	FreeAccessStrategy(bas);
+	ExecDropSingleTupleTableSlot(gs.slot);
+	table_index_fetch_end(gs.fetch);
+	table_close(gs.heap, AccessShareLock);
+	relation_close(index, AccessShareLock);
+
+	return (Datum) 0;
+}
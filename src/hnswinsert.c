@@ -8,6 +8,15 @@
 #include "storage/lmgr.h"
 #include "utils/datum.h"
 #include "utils/memutils.h"
+#include "vectortrace.h"
+
+#if PG_VERSION_NUM >= 170000
+/* State for the validation phase of concurrent builds */
+typedef struct HnswInsertCache
+{
+	MemoryContext insertCtx;
+}			HnswInsertCache;
+#endif
 
 /*
  * Get the insert page
@@ -343,6 +352,9 @@ void
 HnswUpdateNeighborsOnDisk(Relation index, FmgrInfo *procinfo, Oid collation, HnswElement e, int m, bool checkExisting, bool building)
 {
 	char	   *base = NULL;
+	int			updated = 0;
+
+	TRACE_PGVECTOR_HNSW_NEIGHBORS_UPDATE_START(e->blkno, e->offno, e->level);
 
 	for (int lc = e->level; lc >= 0; lc--)
 	{
@@ -431,6 +443,8 @@ HnswUpdateNeighborsOnDisk(Relation index, FmgrInfo *procinfo, Oid collation, Hns
 					MarkBufferDirty(buf);
 				else
 					GenericXLogFinish(state);
+
+				updated++;
 			}
 			else if (!building)
 				GenericXLogAbort(state);
@@ -438,6 +452,8 @@ HnswUpdateNeighborsOnDisk(Relation index, FmgrInfo *procinfo, Oid collation, Hns
 			UnlockReleaseBuffer(buf);
 		}
 	}
+
+	TRACE_PGVECTOR_HNSW_NEIGHBORS_UPDATE_DONE(e->blkno, e->offno, updated);
 }
 
 /*
@@ -485,6 +501,8 @@ AddDuplicateOnDisk(Relation index, HnswElement element, HnswElement dup, bool bu
 
 	/* Add heap TID, modifying the tuple on the page directly */
 	etup->heaptids[i] = element->heaptids[0];
+	if (i < HNSW_DEADTIDS)
+		etup->deadtids &= ~(1 << i);
 
 	/* Commit */
 	if (building)
@@ -570,7 +588,7 @@ HnswInsertTupleOnDisk(Relation index, Datum value, Datum *values, bool *isnull,
 	 * before repairing graph. Use a page lock so it does not interfere with
 	 * buffer lock (or reads when vacuuming).
 	 */
-	LockPage(index, HNSW_UPDATE_LOCK, lockmode);
+	LockStatsLockPage(index, HNSW_UPDATE_LOCK, lockmode, VECTOR_LOCK_HNSW_UPDATE);
 
 	/* Get m and entry point */
 	HnswGetMetaPageInfo(index, &m, &entryPoint);
@@ -578,6 +596,7 @@ HnswInsertTupleOnDisk(Relation index, Datum value, Datum *values, bool *isnull,
 	/* Create an element */
 	element = HnswInitElement(base, heap_tid, m, HnswGetMl(m), HnswGetMaxLevel(m), NULL);
 	HnswPtrStore(base, element->value, DatumGetPointer(value));
+	element->popcount = HnswGetPopcount(procinfo, value);
 
 	/* Prevent concurrent inserts when likely updating entry point */
 	if (entryPoint == NULL || element->level > entryPoint->level)
@@ -587,14 +606,14 @@ HnswInsertTupleOnDisk(Relation index, Datum value, Datum *values, bool *isnull,
 
 		/* Get exclusive lock */
 		lockmode = ExclusiveLock;
-		LockPage(index, HNSW_UPDATE_LOCK, lockmode);
+		LockStatsLockPage(index, HNSW_UPDATE_LOCK, lockmode, VECTOR_LOCK_HNSW_UPDATE);
 
 		/* Get latest entry point after lock is acquired */
 		entryPoint = HnswGetEntryPoint(index);
 	}
 
 	/* Find neighbors for element */
-	HnswFindElementNeighbors(base, element, entryPoint, index, procinfo, collation, m, efConstruction, false);
+	HnswFindElementNeighbors(base, element, entryPoint, index, procinfo, collation, GetBoundedDistanceFunc(procinfo), m, efConstruction, false);
 
 	/* Update graph on disk */
 	UpdateGraphOnDisk(index, procinfo, collation, element, m, efConstruction, entryPoint, building);
@@ -615,6 +634,7 @@ HnswInsertTuple(Relation index, Datum *values, bool *isnull, ItemPointer heap_ti
 	const		HnswTypeInfo *typeInfo = HnswGetTypeInfo(index);
 	FmgrInfo   *normprocinfo;
 	Oid			collation = index->rd_indcollation[0];
+	int			prefixDimensions;
 
 	/* Detoast once for all calls */
 	value = PointerGetDatum(PG_DETOAST_DATUM(values[0]));
@@ -623,6 +643,11 @@ HnswInsertTuple(Relation index, Datum *values, bool *isnull, ItemPointer heap_ti
 	if (typeInfo->checkValue != NULL)
 		typeInfo->checkValue(DatumGetPointer(value));
 
+	/* Index prefix if needed */
+	prefixDimensions = HnswGetPrefixDimensions(index);
+	if (prefixDimensions > 0)
+		value = HnswPrefixValue(typeInfo, prefixDimensions, value);
+
 	/* Normalize if needed */
 	normprocinfo = HnswOptionalProcInfo(index, HNSW_NORM_PROC);
 	if (normprocinfo != NULL)
@@ -655,6 +680,45 @@ hnswinsert(Relation index, Datum *values, bool *isnull, ItemPointer heap_tid,
 	if (isnull[0])
 		return false;
 
+	/* Invalidate cached scan results (again after the insert) */
+	ScanCacheInvalidate(index);
+
+#if PG_VERSION_NUM >= 170000
+
+	/*
+	 * Reuse memory context during the validation phase of concurrent builds,
+	 * which inserts all tuples added during the build in a single pass
+	 */
+	if (indexInfo->ii_Concurrent)
+	{
+		HnswInsertCache *cache = (HnswInsertCache *) indexInfo->ii_AmCache;
+
+		if (cache == NULL)
+		{
+			cache = MemoryContextAllocZero(indexInfo->ii_Context, sizeof(HnswInsertCache));
+			cache->insertCtx = AllocSetContextCreate(indexInfo->ii_Context,
+													 "Hnsw insert temporary context",
+													 ALLOCSET_DEFAULT_SIZES);
+			indexInfo->ii_AmCache = cache;
+		}
+
+		oldCtx = MemoryContextSwitchTo(cache->insertCtx);
+
+		/* Insert tuple */
+		LockStatsBegin(index);
+		HnswInsertTuple(index, values, isnull, heap_tid);
+		LockStatsEnd();
+
+		ScanCacheInvalidate(index);
+
+		/* Reset memory context */
+		MemoryContextSwitchTo(oldCtx);
+		MemoryContextReset(cache->insertCtx);
+
+		return false;
+	}
+#endif
+
 	/* Create memory context */
 	insertCtx = AllocSetContextCreate(CurrentMemoryContext,
 									  "Hnsw insert temporary context",
@@ -662,7 +726,11 @@ hnswinsert(Relation index, Datum *values, bool *isnull, ItemPointer heap_tid,
 	oldCtx = MemoryContextSwitchTo(insertCtx);
 
 	/* Insert tuple */
+	LockStatsBegin(index);
 	HnswInsertTuple(index, values, isnull, heap_tid);
+	LockStatsEnd();
+
+	ScanCacheInvalidate(index);
 
 	/* Delete memory context */
 	MemoryContextSwitchTo(oldCtx);
@@ -670,3 +738,21 @@ hnswinsert(Relation index, Datum *values, bool *isnull, ItemPointer heap_tid,
 
 	return false;
 }
+
+#if PG_VERSION_NUM >= 170000
+/*
+ * Clean up after inserts
+ */
+void
+hnswinsertcleanup(Relation index, IndexInfo *indexInfo)
+{
+	HnswInsertCache *cache = (HnswInsertCache *) indexInfo->ii_AmCache;
+
+	if (cache == NULL)
+		return;
+
+	MemoryContextDelete(cache->insertCtx);
+	pfree(cache);
+	indexInfo->ii_AmCache = NULL;
+}
+#endif
@@ -1,17 +1,20 @@
 #include "postgres.h"
 
 #include "access/relscan.h"
+#include "access/xlog.h"
 #include "hnsw.h"
 #include "pgstat.h"
 #include "storage/bufmgr.h"
 #include "storage/lmgr.h"
 #include "utils/memutils.h"
+#include "utils/spccache.h"
+#include "vectortrace.h"
 
 /*
  * Algorithm 5 from paper
  */
 static List *
-GetScanItems(IndexScanDesc scan, Datum q)
+GetScanItems(IndexScanDesc scan, Datum value)
 {
 	HnswScanOpaque so = (HnswScanOpaque) scan->opaque;
 	Relation	index = scan->indexRelation;
@@ -22,6 +25,7 @@ GetScanItems(IndexScanDesc scan, Datum q)
 	int			m;
 	HnswElement entryPoint;
 	char	   *base = NULL;
+	HnswQuery	q;
 
 	/* Get m and entry point */
 	HnswGetMetaPageInfo(index, &m, &entryPoint);
@@ -29,15 +33,20 @@ GetScanItems(IndexScanDesc scan, Datum q)
 	if (entryPoint == NULL)
 		return NIL;
 
-	ep = list_make1(HnswEntryCandidate(base, entryPoint, q, index, procinfo, collation, false));
+	/* Compute popcount once for Jaccard distance */
+	q.value = value;
+	q.popcount = HnswGetPopcount(procinfo, value);
+	q.boundedDistance = so->boundedDistance;
+
+	ep = list_make1(HnswEntryCandidate(base, entryPoint, &q, index, procinfo, collation, false));
 
 	for (int lc = entryPoint->level; lc >= 1; lc--)
 	{
-		w = HnswSearchLayer(base, q, ep, 1, lc, index, procinfo, collation, m, false, NULL);
+		w = HnswSearchLayer(base, &q, ep, 1, lc, index, procinfo, collation, m, false, NULL);
 		ep = w;
 	}
 
-	return HnswSearchLayer(base, q, ep, hnsw_ef_search, 0, index, procinfo, collation, m, false, NULL);
+	return HnswSearchLayer(base, &q, ep, so->efSearch, 0, index, procinfo, collation, m, false, NULL);
 }
 
 /*
@@ -59,6 +68,10 @@ GetScanValue(IndexScanDesc scan)
 		Assert(!VARATT_IS_COMPRESSED(DatumGetPointer(value)));
 		Assert(!VARATT_IS_EXTENDED(DatumGetPointer(value)));
 
+		/* Search with prefix if needed */
+		if (so->prefixDimensions > 0)
+			value = HnswPrefixValue(so->typeInfo, so->prefixDimensions, value);
+
 		/* Normalize if needed */
 		if (so->normprocinfo != NULL)
 			value = HnswNormValue(so->typeInfo, so->collation, value);
@@ -67,6 +80,182 @@ GetScanValue(IndexScanDesc scan)
 	return value;
 }
 
+/*
+ * Prefetch heap blocks for upcoming candidates
+ *
+ * The executor fetches candidates from the heap in distance order to recheck
+ * the full distance, which is random I/O. Like the prefetch target of bitmap
+ * heap scans, keep up to effective_io_concurrency heap TIDs prefetched ahead
+ * of the next one returned, following the order they are returned in.
+ */
+static void
+PrefetchHeapTids(IndexScanDesc scan)
+{
+#ifdef USE_PREFETCH
+	HnswScanOpaque so = (HnswScanOpaque) scan->opaque;
+	char	   *base = NULL;
+
+	while (so->prefetchAhead < so->prefetchMaximum && so->prefetchPos >= 0)
+	{
+		HnswCandidate *hc = list_nth(so->w, so->prefetchPos);
+		HnswElement element = HnswPtrAccess(base, hc->element);
+		BlockNumber blkno;
+		int			heaptidIndex;
+
+		/* Heap TIDs are returned from last to first */
+		if (so->prefetchHeaptidIndex < 0)
+			so->prefetchHeaptidIndex = element->heaptidsLength;
+
+		if (so->prefetchHeaptidIndex == 0)
+		{
+			so->prefetchPos--;
+			so->prefetchHeaptidIndex = -1;
+			continue;
+		}
+
+		heaptidIndex = --so->prefetchHeaptidIndex;
+
+		/* Skip heap TIDs that will be skipped when returning */
+		if (scan->ignore_killed_tuples && HnswHeapTidIsDead(element->deadtids, heaptidIndex))
+			continue;
+
+		/* Skip repeated blocks */
+		blkno = ItemPointerGetBlockNumber(&element->heaptids[heaptidIndex]);
+		if (blkno != so->prefetchBlkno)
+		{
+			PrefetchBuffer(scan->heapRelation, MAIN_FORKNUM, blkno);
+			so->prefetchBlkno = blkno;
+		}
+
+		so->prefetchAhead++;
+	}
+#endif
+}
+
+/*
+ * Start prefetching heap blocks for a new set of candidates
+ */
+static void
+StartPrefetch(IndexScanDesc scan)
+{
+	HnswScanOpaque so = (HnswScanOpaque) scan->opaque;
+
+	so->prefetchPos = list_length(so->w) - 1;
+	so->prefetchHeaptidIndex = -1;
+	so->prefetchAhead = 0;
+	so->prefetchBlkno = InvalidBlockNumber;
+
+	/* Respect effective_io_concurrency like other prefetching */
+	if (scan->heapRelation != NULL)
+		so->prefetchMaximum = get_tablespace_io_concurrency(scan->heapRelation->rd_rel->reltablespace);
+	else
+		so->prefetchMaximum = 0;
+
+	PrefetchHeapTids(scan);
+}
+
+/*
+ * Search the index
+ */
+static void
+SearchIndex(IndexScanDesc scan, Datum value)
+{
+	HnswScanOpaque so = (HnswScanOpaque) scan->opaque;
+
+	/*
+	 * Get a shared lock. This allows vacuum to ensure no in-flight scans
+	 * before marking tuples as deleted.
+	 */
+	LockPage(scan->indexRelation, HNSW_SCAN_LOCK, ShareLock);
+
+	/* Pages modified after this point are not marked dead */
+	so->searchLsn = GetXLogInsertRecPtr();
+
+	TRACE_PGVECTOR_HNSW_SCAN_START(RelationGetRelid(scan->indexRelation), so->efSearch);
+
+	so->w = GetScanItems(scan, value);
+
+	TRACE_PGVECTOR_HNSW_SCAN_DONE(RelationGetRelid(scan->indexRelation), list_length(so->w));
+
+	/* Release shared lock */
+	UnlockPage(scan->indexRelation, HNSW_SCAN_LOCK, ShareLock);
+
+	/* Candidates are fetched from the heap to recheck */
+	if (so->prefixDimensions > 0)
+		StartPrefetch(scan);
+}
+
+/*
+ * Set the distance for the executor to recheck
+ *
+ * With prefix dimensions, the distance is a lower bound on the full
+ * distance, so the executor refines candidates with the full vector and
+ * returns them in the correct order.
+ */
+static void
+SetOrderByValue(IndexScanDesc scan, HnswCandidate * hc)
+{
+	HnswScanOpaque so = (HnswScanOpaque) scan->opaque;
+
+	if (so->prefixDimensions == 0)
+	{
+		scan->xs_recheckorderby = false;
+		return;
+	}
+
+	if (scan->orderByData->sk_flags & SK_ISNULL)
+	{
+		scan->xs_orderbyvals[0] = (Datum) 0;
+		scan->xs_orderbynulls[0] = true;
+	}
+	else
+	{
+		scan->xs_orderbyvals[0] = Float8GetDatum(PrefixDistanceLowerBound(so->procinfo, hc->distance));
+		scan->xs_orderbynulls[0] = false;
+	}
+
+	scan->xs_recheckorderby = true;
+}
+
+/*
+ * Mark the previously returned heap TID as dead
+ *
+ * This is only a hint, so a shared lock is sufficient. Since no pin is held
+ * between calls, skip if the page has changed since the search started, as
+ * the heap TID could have been removed by vacuum and reused. This requires
+ * WAL, so unlogged indexes are not supported.
+ */
+static void
+KillPriorTuple(IndexScanDesc scan)
+{
+	HnswScanOpaque so = (HnswScanOpaque) scan->opaque;
+	Relation	index = scan->indexRelation;
+	OffsetNumber offno = ItemPointerGetOffsetNumber(&so->priorElementTid);
+	int			i = so->priorHeaptidIndex;
+	Buffer		buf;
+	Page		page;
+
+	if (!RelationNeedsWAL(index))
+		return;
+
+	buf = ReadBuffer(index, ItemPointerGetBlockNumber(&so->priorElementTid));
+	LockBuffer(buf, BUFFER_LOCK_SHARE);
+	page = BufferGetPage(buf);
+
+	if (BufferGetLSNAtomic(buf) <= so->searchLsn && offno <= PageGetMaxOffsetNumber(page))
+	{
+		HnswElementTuple etup = (HnswElementTuple) PageGetItem(page, PageGetItemId(page, offno));
+
+		if (HnswIsElementTuple(etup) && ItemPointerEquals(&etup->heaptids[i], &scan->xs_heaptid) && !HnswHeapTidIsDead(etup->deadtids, i))
+		{
+			etup->deadtids |= (1 << i);
+			MarkBufferDirtyHint(buf, true);
+		}
+	}
+
+	UnlockReleaseBuffer(buf);
+}
+
 /*
  * Prepare for an index scan
  */
@@ -80,16 +269,36 @@ hnswbeginscan(Relation index, int nkeys, int norderbys)
 
 	so = (HnswScanOpaque) palloc(sizeof(HnswScanOpaqueData));
 	so->typeInfo = HnswGetTypeInfo(index);
+	so->efSearch = HnswGetEfSearch(index);
+	so->prefixDimensions = HnswGetPrefixDimensions(index);
 	so->first = true;
+	so->w = NIL;
+	ItemPointerSetInvalid(&so->priorElementTid);
+	so->prefetchPos = -1;
+	so->prefetchAhead = 0;
+	so->prefetchMaximum = 0;
+
+	/* Cached heap TIDs do not have distances to recheck */
+	so->cache = so->prefixDimensions > 0 ? NULL : ScanCacheBeginScan();
+	so->recall = RecallBeginScan();
 	so->tmpCtx = AllocSetContextCreate(CurrentMemoryContext,
 									   "Hnsw scan temporary context",
 									   ALLOCSET_DEFAULT_SIZES);
 
 	/* Set support functions */
 	so->procinfo = index_getprocinfo(index, 1, HNSW_DISTANCE_PROC);
+	so->boundedDistance = GetBoundedDistanceFunc(so->procinfo);
 	so->normprocinfo = HnswOptionalProcInfo(index, HNSW_NORM_PROC);
 	so->collation = index->rd_indcollation[0];
 
+	/* Distances for recheck */
+	if (so->prefixDimensions > 0)
+	{
+		scan->xs_orderbyvals = palloc0(sizeof(Datum) * scan->numberOfOrderBys);
+		scan->xs_orderbynulls = palloc(sizeof(bool) * scan->numberOfOrderBys);
+		memset(scan->xs_orderbynulls, true, sizeof(bool) * scan->numberOfOrderBys);
+	}
+
 	scan->opaque = so;
 
 	return scan;
@@ -103,7 +312,17 @@ hnswrescan(IndexScanDesc scan, ScanKey keys, int nkeys, ScanKey orderbys, int no
 {
 	HnswScanOpaque so = (HnswScanOpaque) scan->opaque;
 
+	if (so->cache != NULL)
+		ScanCacheEndSearch(so->cache);
+
+	if (so->recall != NULL)
+		RecallEndSample(so->recall);
+
 	so->first = true;
+	so->w = NIL;
+	ItemPointerSetInvalid(&so->priorElementTid);
+	so->prefetchPos = -1;
+	so->prefetchAhead = 0;
 	MemoryContextReset(so->tmpCtx);
 
 	if (keys && scan->numberOfKeys > 0)
@@ -128,6 +347,10 @@ hnswgettuple(IndexScanDesc scan, ScanDirection dir)
 	 */
 	Assert(ScanDirectionIsForward(dir));
 
+	/* Executor found previous heap TID to be dead to all transactions */
+	if (scan->kill_prior_tuple && ItemPointerIsValid(&so->priorElementTid))
+		KillPriorTuple(scan);
+
 	if (so->first)
 	{
 		Datum		value;
@@ -147,16 +370,13 @@ hnswgettuple(IndexScanDesc scan, ScanDirection dir)
 		/* Get scan value */
 		value = GetScanValue(scan);
 
-		/*
-		 * Get a shared lock. This allows vacuum to ensure no in-flight scans
-		 * before marking tuples as deleted.
-		 */
-		LockPage(scan->indexRelation, HNSW_SCAN_LOCK, ShareLock);
-
-		so->w = GetScanItems(scan, value);
+		/* Sample search for recall monitoring */
+		if (so->recall != NULL && !(scan->orderByData->sk_flags & SK_ISNULL))
+			RecallStartSample(so->recall, scan->indexRelation, scan->orderByData->sk_argument);
 
-		/* Release shared lock */
-		UnlockPage(scan->indexRelation, HNSW_SCAN_LOCK, ShareLock);
+		/* Replay cached heap TIDs if available */
+		if (so->cache == NULL || !ScanCacheLookup(so->cache, scan->indexRelation, value, so->efSearch))
+			SearchIndex(scan, value);
 
 		so->first = false;
 
@@ -165,12 +385,34 @@ hnswgettuple(IndexScanDesc scan, ScanDirection dir)
 #endif
 	}
 
+	if (so->cache != NULL && so->cache->replaying)
+	{
+		if (ScanCacheNext(so->cache, &scan->xs_heaptid))
+		{
+			ItemPointerSetInvalid(&so->priorElementTid);
+
+			if (so->recall != NULL)
+				RecallAddItem(so->recall, &scan->xs_heaptid);
+
+			MemoryContextSwitchTo(oldCtx);
+
+			scan->xs_recheck = false;
+			scan->xs_recheckorderby = false;
+			return true;
+		}
+
+		/* Search if more heap TIDs are needed */
+		if (!so->cache->complete)
+			SearchIndex(scan, GetScanValue(scan));
+	}
+
 	while (list_length(so->w) > 0)
 	{
 		char	   *base = NULL;
 		HnswCandidate *hc = llast(so->w);
 		HnswElement element = HnswPtrAccess(base, hc->element);
 		ItemPointer heaptid;
+		int			heaptidIndex;
 
 		/* Move to next element if no valid heap TIDs */
 		if (element->heaptidsLength == 0)
@@ -179,16 +421,47 @@ hnswgettuple(IndexScanDesc scan, ScanDirection dir)
 			continue;
 		}
 
-		heaptid = &element->heaptids[--element->heaptidsLength];
+		heaptidIndex = --element->heaptidsLength;
+		heaptid = &element->heaptids[heaptidIndex];
+
+		/* Skip heap TIDs marked as dead by previous scans */
+		if (scan->ignore_killed_tuples && HnswHeapTidIsDead(element->deadtids, heaptidIndex))
+			continue;
+
+		/* Skip heap TIDs already returned from the cache */
+		if (so->cache != NULL && !ScanCacheAddItem(so->cache, heaptid))
+			continue;
+
+		/* Remember for kill_prior_tuple */
+		if (heaptidIndex < HNSW_DEADTIDS)
+		{
+			ItemPointerSet(&so->priorElementTid, element->blkno, element->offno);
+			so->priorHeaptidIndex = heaptidIndex;
+		}
+		else
+			ItemPointerSetInvalid(&so->priorElementTid);
+
+		if (so->recall != NULL)
+			RecallAddItem(so->recall, heaptid);
+
+		/* Keep prefetching ahead of the returned heap TID */
+		if (so->prefetchAhead > 0)
+		{
+			so->prefetchAhead--;
+			PrefetchHeapTids(scan);
+		}
 
 		MemoryContextSwitchTo(oldCtx);
 
 		scan->xs_heaptid = *heaptid;
 		scan->xs_recheck = false;
-		scan->xs_recheckorderby = false;
+		SetOrderByValue(scan, hc);
 		return true;
 	}
 
+	if (so->cache != NULL)
+		ScanCacheFinish(so->cache);
+
 	MemoryContextSwitchTo(oldCtx);
 	return false;
 }
@@ -201,6 +474,18 @@ hnswendscan(IndexScanDesc scan)
 {
 	HnswScanOpaque so = (HnswScanOpaque) scan->opaque;
 
+	if (so->cache != NULL)
+	{
+		ScanCacheEndSearch(so->cache);
+		pfree(so->cache);
+	}
+
+	if (so->recall != NULL)
+	{
+		RecallEndSample(so->recall);
+		pfree(so->recall);
+	}
+
 	MemoryContextDelete(so->tmpCtx);
 
 	pfree(so);
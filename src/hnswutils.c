@@ -3,16 +3,19 @@
 #include <math.h>
 
 #include "access/generic_xlog.h"
+#include "bitvec.h"
 #include "catalog/pg_type.h"
 #include "catalog/pg_type_d.h"
 #include "fmgr.h"
 #include "hnsw.h"
+#include "hybridvec.h"
 #include "lib/pairingheap.h"
 #include "sparsevec.h"
 #include "storage/bufmgr.h"
 #include "utils/datum.h"
 #include "utils/memdebug.h"
 #include "utils/rel.h"
+#include "vectortrace.h"
 
 #if PG_VERSION_NUM >= 130000
 #include "common/hashfn.h"
@@ -140,6 +143,34 @@ HnswGetEfConstruction(Relation index)
 	return HNSW_DEFAULT_EF_CONSTRUCTION;
 }
 
+/*
+ * Get the number of dimensions to index
+ */
+int
+HnswGetPrefixDimensions(Relation index)
+{
+	HnswOptions *opts = (HnswOptions *) index->rd_options;
+
+	if (opts)
+		return opts->prefixDimensions;
+
+	return HNSW_DEFAULT_PREFIX_DIMENSIONS;
+}
+
+/*
+ * Get whether to calibrate at build time
+ */
+bool
+HnswGetCalibrate(Relation index)
+{
+	HnswOptions *opts = (HnswOptions *) index->rd_options;
+
+	if (opts)
+		return opts->calibrate;
+
+	return HNSW_DEFAULT_CALIBRATE;
+}
+
 /*
  * Get proc
  */
@@ -161,6 +192,15 @@ HnswNormValue(const HnswTypeInfo * typeInfo, Oid collation, Datum value)
 	return DirectFunctionCall1Coll(typeInfo->normalize, collation, value);
 }
 
+/*
+ * Get the prefix of a value that is indexed
+ */
+Datum
+HnswPrefixValue(const HnswTypeInfo * typeInfo, int prefixDimensions, Datum value)
+{
+	return DirectFunctionCall3(typeInfo->subvector, value, Int32GetDatum(1), Int32GetDatum(prefixDimensions));
+}
+
 /*
  * Check if non-zero norm
  */
@@ -252,6 +292,8 @@ HnswInitElement(char *base, ItemPointer heaptid, int m, double ml, int maxLevel,
 
 	element->level = level;
 	element->deleted = 0;
+	element->deadtids = 0;
+	element->popcount = 0;
 
 	HnswInitNeighbors(base, element, m, allocator);
 
@@ -317,6 +359,40 @@ HnswGetMetaPageInfo(Relation index, int *m, HnswElement * entryPoint)
 	UnlockReleaseBuffer(buf);
 }
 
+/*
+ * Get ef_search, increasing it to meet the target recall if needed
+ */
+int
+HnswGetEfSearch(Relation index)
+{
+	Buffer		buf;
+	Page		page;
+	HnswMetaPage metap;
+	int			efSearch = hnsw_ef_search;
+
+	if (hnsw_target_recall <= 0)
+		return efSearch;
+
+	buf = ReadBuffer(index, HNSW_METAPAGE_BLKNO);
+	LockBuffer(buf, BUFFER_LOCK_SHARE);
+	page = BufferGetPage(buf);
+	metap = HnswPageGetMeta(page);
+
+	/* Indexes built before calibration have zeros */
+	for (int i = 0; i < HNSW_CALIBRATION_STEPS; i++)
+	{
+		if (metap->calibration[i] >= hnsw_target_recall || (i == HNSW_CALIBRATION_STEPS - 1 && metap->calibration[i] > 0))
+		{
+			efSearch = Max(efSearch, HnswCalibrationEf(i));
+			break;
+		}
+	}
+
+	UnlockReleaseBuffer(buf);
+
+	return efSearch;
+}
+
 /*
  * Get the entry point
  */
@@ -401,6 +477,8 @@ HnswSetElementTuple(char *base, HnswElementTuple etup, HnswElement element)
 	etup->type = HNSW_ELEMENT_TUPLE_TYPE;
 	etup->level = element->level;
 	etup->deleted = 0;
+	etup->deadtids = 0;
+	etup->popcount = element->popcount;
 	for (int i = 0; i < HNSW_HEAPTIDS; i++)
 	{
 		if (i < element->heaptidsLength)
@@ -516,6 +594,8 @@ HnswLoadElementFromTuple(HnswElement element, HnswElementTuple etup, bool loadHe
 {
 	element->level = etup->level;
 	element->deleted = etup->deleted;
+	element->deadtids = etup->deadtids;
+	element->popcount = etup->popcount;
 	element->neighborPage = ItemPointerGetBlockNumber(&etup->neighbortid);
 	element->neighborOffno = ItemPointerGetOffsetNumber(&etup->neighbortid);
 	element->heaptidsLength = 0;
@@ -541,16 +621,52 @@ HnswLoadElementFromTuple(HnswElement element, HnswElementTuple etup, bool loadHe
 	}
 }
 
+PGDLLEXPORT Datum jaccard_distance(PG_FUNCTION_ARGS);
+
+/*
+ * Get the popcount of a value for Jaccard distance, or 0 if not applicable
+ */
+uint16
+HnswGetPopcount(FmgrInfo *procinfo, Datum value)
+{
+	if (procinfo->fn_addr != jaccard_distance || DatumGetPointer(value) == NULL)
+		return 0;
+
+	/* Fits since dimensions are limited */
+	return (uint16) BitvecPopcount(value);
+}
+
+/*
+ * Get the distance from q
+ *
+ * If maxDistance is set, the result only needs to be exact when less than or
+ * equal to it, which allows bounded distances to stop early
+ */
+static inline float
+GetDistance(HnswQuery * q, Datum value, uint16 popcount, FmgrInfo *procinfo, Oid collation, float *maxDistance)
+{
+	/* Popcounts are only set for Jaccard distance */
+	if (q->popcount > 0 && popcount > 0)
+		return (float) BitJaccardPopcountDistance(q->value, value, q->popcount, popcount, maxDistance != NULL ? *maxDistance : 1);
+
+	if (maxDistance != NULL && q->boundedDistance != NULL)
+		return (float) q->boundedDistance(q->value, value, *maxDistance);
+
+	return (float) DatumGetFloat8(FunctionCall2Coll(procinfo, collation, q->value, value));
+}
+
 /*
  * Load an element and optionally get its distance from q
  */
 void
-HnswLoadElement(HnswElement element, float *distance, Datum *q, Relation index, FmgrInfo *procinfo, Oid collation, bool loadVec)
+HnswLoadElement(HnswElement element, float *distance, HnswQuery * q, Relation index, FmgrInfo *procinfo, Oid collation, bool loadVec, float *maxDistance)
 {
 	Buffer		buf;
 	Page		page;
 	HnswElementTuple etup;
 
+	TRACE_PGVECTOR_HNSW_ELEMENT_LOAD_START(element->blkno, element->offno);
+
 	/* Read vector */
 	buf = ReadBuffer(index, element->blkno);
 	LockBuffer(buf, BUFFER_LOCK_SHARE);
@@ -566,40 +682,42 @@ HnswLoadElement(HnswElement element, float *distance, Datum *q, Relation index,
 	/* Calculate distance */
 	if (distance != NULL)
 	{
-		if (DatumGetPointer(*q) == NULL)
+		if (DatumGetPointer(q->value) == NULL)
 			*distance = 0;
 		else
-			*distance = (float) DatumGetFloat8(FunctionCall2Coll(procinfo, collation, *q, PointerGetDatum(&etup->data)));
+			*distance = GetDistance(q, PointerGetDatum(&etup->data), etup->popcount, procinfo, collation, maxDistance);
 	}
 
 	UnlockReleaseBuffer(buf);
+
+	TRACE_PGVECTOR_HNSW_ELEMENT_LOAD_DONE(element->blkno, element->offno);
 }
 
 /*
  * Get the distance for a candidate
  */
 static float
-GetCandidateDistance(char *base, HnswCandidate * hc, Datum q, FmgrInfo *procinfo, Oid collation)
+GetCandidateDistance(char *base, HnswCandidate * hc, HnswQuery * q, FmgrInfo *procinfo, Oid collation, float *maxDistance)
 {
 	HnswElement hce = HnswPtrAccess(base, hc->element);
 	Datum		value = HnswGetValue(base, hce);
 
-	return DatumGetFloat8(FunctionCall2Coll(procinfo, collation, q, value));
+	return GetDistance(q, value, hce->popcount, procinfo, collation, maxDistance);
 }
 
 /*
  * Create a candidate for the entry point
  */
 HnswCandidate *
-HnswEntryCandidate(char *base, HnswElement entryPoint, Datum q, Relation index, FmgrInfo *procinfo, Oid collation, bool loadVec)
+HnswEntryCandidate(char *base, HnswElement entryPoint, HnswQuery * q, Relation index, FmgrInfo *procinfo, Oid collation, bool loadVec)
 {
 	HnswCandidate *hc = palloc(sizeof(HnswCandidate));
 
 	HnswPtrStore(base, hc->element, entryPoint);
 	if (index == NULL)
-		hc->distance = GetCandidateDistance(base, hc, q, procinfo, collation);
+		hc->distance = GetCandidateDistance(base, hc, q, procinfo, collation, NULL);
 	else
-		HnswLoadElement(entryPoint, &hc->distance, &q, index, procinfo, collation, loadVec);
+		HnswLoadElement(entryPoint, &hc->distance, q, index, procinfo, collation, loadVec, NULL);
 	return hc;
 }
 
@@ -717,7 +835,7 @@ CountElement(char *base, HnswElement skipElement, HnswCandidate * hc)
  * Algorithm 2 from paper
  */
 List *
-HnswSearchLayer(char *base, Datum q, List *ep, int ef, int lc, Relation index, FmgrInfo *procinfo, Oid collation, int m, bool inserting, HnswElement skipElement)
+HnswSearchLayer(char *base, HnswQuery * q, List *ep, int ef, int lc, Relation index, FmgrInfo *procinfo, Oid collation, int m, bool inserting, HnswElement skipElement)
 {
 	List	   *w = NIL;
 	pairingheap *C = pairingheap_allocate(CompareNearestCandidates, NULL);
@@ -728,6 +846,8 @@ HnswSearchLayer(char *base, Datum q, List *ep, int ef, int lc, Relation index, F
 	HnswNeighborArray *neighborhoodData = NULL;
 	Size		neighborhoodSize;
 
+	TRACE_PGVECTOR_HNSW_SEARCH_LAYER_START(lc, ef);
+
 	InitVisited(base, &v, index, ef, m);
 
 	/* Create local memory for neighborhood if needed */
@@ -778,7 +898,7 @@ HnswSearchLayer(char *base, Datum q, List *ep, int ef, int lc, Relation index, F
 		/* Copy neighborhood to local memory if needed */
 		if (index == NULL)
 		{
-			LWLockAcquire(&cElement->lock, LW_SHARED);
+			LockStatsLWLockAcquire(&cElement->lock, LW_SHARED, VECTOR_LOCK_HNSW_ELEMENT);
 			memcpy(neighborhoodData, neighborhood, neighborhoodSize);
 			LWLockRelease(&cElement->lock);
 			neighborhood = neighborhoodData;
@@ -794,14 +914,18 @@ HnswSearchLayer(char *base, Datum q, List *ep, int ef, int lc, Relation index, F
 			if (!visited)
 			{
 				float		eDistance;
+				float	   *maxDistance;
 				HnswElement eElement = HnswPtrAccess(base, e->element);
 
 				f = ((HnswPairingHeapNode *) pairingheap_first(W))->inner;
 
+				/* Only needs to be exact if closer than furthest once W is full */
+				maxDistance = wlen >= ef ? &f->distance : NULL;
+
 				if (index == NULL)
-					eDistance = GetCandidateDistance(base, e, q, procinfo, collation);
+					eDistance = GetCandidateDistance(base, e, q, procinfo, collation, maxDistance);
 				else
-					HnswLoadElement(eElement, &eDistance, &q, index, procinfo, collation, inserting);
+					HnswLoadElement(eElement, &eDistance, q, index, procinfo, collation, inserting, maxDistance);
 
 				Assert(!eElement->deleted);
 
@@ -846,6 +970,8 @@ HnswSearchLayer(char *base, Datum q, List *ep, int ef, int lc, Relation index, F
 		w = lappend(w, hc);
 	}
 
+	TRACE_PGVECTOR_HNSW_SEARCH_LAYER_DONE(lc, list_length(w));
+
 	return w;
 }
 
@@ -917,10 +1043,13 @@ CompareCandidateDistancesOffset(const void *a, const void *b)
 static float
 HnswGetDistance(char *base, HnswElement a, HnswElement b, FmgrInfo *procinfo, Oid collation)
 {
-	Datum		aValue = HnswGetValue(base, a);
-	Datum		bValue = HnswGetValue(base, b);
+	HnswQuery	q;
 
-	return DatumGetFloat8(FunctionCall2Coll(procinfo, collation, aValue, bValue));
+	q.value = HnswGetValue(base, a);
+	q.popcount = a->popcount;
+	q.boundedDistance = NULL;
+
+	return GetDistance(&q, HnswGetValue(base, b), b->popcount, procinfo, collation, NULL);
 }
 
 /*
@@ -1094,7 +1223,11 @@ HnswUpdateConnection(char *base, HnswElement element, HnswCandidate * hc, int lm
 		/* Load elements on insert */
 		if (index != NULL)
 		{
-			Datum		q = HnswGetValue(base, hce);
+			HnswQuery	q;
+
+			q.value = HnswGetValue(base, hce);
+			q.popcount = hce->popcount;
+			q.boundedDistance = NULL;
 
 			for (int i = 0; i < currentNeighbors->length; i++)
 			{
@@ -1102,9 +1235,9 @@ HnswUpdateConnection(char *base, HnswElement element, HnswCandidate * hc, int lm
 				HnswElement hc3Element = HnswPtrAccess(base, hc3->element);
 
 				if (HnswPtrIsNull(base, hc3Element->value))
-					HnswLoadElement(hc3Element, &hc3->distance, &q, index, procinfo, collation, true);
+					HnswLoadElement(hc3Element, &hc3->distance, &q, index, procinfo, collation, true, NULL);
 				else
-					hc3->distance = GetCandidateDistance(base, hc3, q, procinfo, collation);
+					hc3->distance = GetCandidateDistance(base, hc3, &q, procinfo, collation, NULL);
 
 				/* Prune element if being deleted */
 				if (hc3Element->heaptidsLength == 0)
@@ -1198,15 +1331,19 @@ PrecomputeHash(char *base, HnswElement element)
  * Algorithm 1 from paper
  */
 void
-HnswFindElementNeighbors(char *base, HnswElement element, HnswElement entryPoint, Relation index, FmgrInfo *procinfo, Oid collation, int m, int efConstruction, bool existing)
+HnswFindElementNeighbors(char *base, HnswElement element, HnswElement entryPoint, Relation index, FmgrInfo *procinfo, Oid collation, BoundedDistanceFunc boundedDistance, int m, int efConstruction, bool existing)
 {
 	List	   *ep;
 	List	   *w;
 	int			level = element->level;
 	int			entryLevel;
-	Datum		q = HnswGetValue(base, element);
+	HnswQuery	q;
 	HnswElement skipElement = existing ? element : NULL;
 
+	q.value = HnswGetValue(base, element);
+	q.popcount = element->popcount;
+	q.boundedDistance = boundedDistance;
+
 #if PG_VERSION_NUM >= 130000
 	/* Precompute hash */
 	if (index == NULL)
@@ -1218,13 +1355,13 @@ HnswFindElementNeighbors(char *base, HnswElement element, HnswElement entryPoint
 		return;
 
 	/* Get entry point and level */
-	ep = list_make1(HnswEntryCandidate(base, entryPoint, q, index, procinfo, collation, true));
+	ep = list_make1(HnswEntryCandidate(base, entryPoint, &q, index, procinfo, collation, true));
 	entryLevel = entryPoint->level;
 
 	/* 1st phase: greedy search to insert level */
 	for (int lc = entryLevel; lc >= level + 1; lc--)
 	{
-		w = HnswSearchLayer(base, q, ep, 1, lc, index, procinfo, collation, m, true, skipElement);
+		w = HnswSearchLayer(base, &q, ep, 1, lc, index, procinfo, collation, m, true, skipElement);
 		ep = w;
 	}
 
@@ -1242,7 +1379,7 @@ HnswFindElementNeighbors(char *base, HnswElement element, HnswElement entryPoint
 		List	   *neighbors;
 		List	   *lw;
 
-		w = HnswSearchLayer(base, q, ep, efConstruction, lc, index, procinfo, collation, m, true, skipElement);
+		w = HnswSearchLayer(base, &q, ep, efConstruction, lc, index, procinfo, collation, m, true, skipElement);
 
 		/* Elements being deleted or skipped can help with search */
 		/* but should be removed before selecting neighbors */
@@ -1267,6 +1404,8 @@ HnswFindElementNeighbors(char *base, HnswElement element, HnswElement entryPoint
 PGDLLEXPORT Datum l2_normalize(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum halfvec_l2_normalize(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum sparsevec_l2_normalize(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum subvector(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum halfvec_subvector(PG_FUNCTION_ARGS);
 
 static void
 SparsevecCheckValue(Pointer v)
@@ -1277,6 +1416,23 @@ SparsevecCheckValue(Pointer v)
 		elog(ERROR, "sparsevec cannot have more than %d non-zero elements for hnsw index", HNSW_MAX_NNZ);
 }
 
+static void
+HybridvecCheckValue(Pointer v)
+{
+	HybridVector *vec = (HybridVector *) v;
+
+	if (vec->nnz > HNSW_MAX_NNZ)
+		elog(ERROR, "hybridvec cannot have more than %d non-zero sparse elements for hnsw index", HNSW_MAX_NNZ);
+
+	/* Dense and sparse parts share a single element tuple */
+	if (HNSW_ELEMENT_TUPLE_SIZE(VARSIZE_ANY(v)) > HNSW_MAX_SIZE)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("hybridvec index element size %zu exceeds maximum %zu for hnsw index",
+						(Size) HNSW_ELEMENT_TUPLE_SIZE(VARSIZE_ANY(v)), (Size) HNSW_MAX_SIZE),
+				 errhint("Reduce the number of dense dimensions or non-zero sparse elements.")));
+}
+
 /*
  * Get type info
  */
@@ -1290,7 +1446,8 @@ HnswGetTypeInfo(Relation index)
 		static const HnswTypeInfo typeInfo = {
 			.maxDimensions = HNSW_MAX_DIM,
 			.normalize = l2_normalize,
-			.checkValue = NULL
+			.checkValue = NULL,
+			.subvector = subvector
 		};
 
 		return (&typeInfo);
@@ -1306,7 +1463,8 @@ hnsw_halfvec_support(PG_FUNCTION_ARGS)
 	static const HnswTypeInfo typeInfo = {
 		.maxDimensions = HNSW_MAX_DIM * 2,
 		.normalize = halfvec_l2_normalize,
-		.checkValue = NULL
+		.checkValue = NULL,
+		.subvector = halfvec_subvector
 	};
 
 	PG_RETURN_POINTER(&typeInfo);
@@ -1319,7 +1477,8 @@ hnsw_bit_support(PG_FUNCTION_ARGS)
 	static const HnswTypeInfo typeInfo = {
 		.maxDimensions = HNSW_MAX_DIM * 32,
 		.normalize = NULL,
-		.checkValue = NULL
+		.checkValue = NULL,
+		.subvector = NULL
 	};
 
 	PG_RETURN_POINTER(&typeInfo);
@@ -1332,7 +1491,22 @@ hnsw_sparsevec_support(PG_FUNCTION_ARGS)
 	static const HnswTypeInfo typeInfo = {
 		.maxDimensions = SPARSEVEC_MAX_DIM,
 		.normalize = sparsevec_l2_normalize,
-		.checkValue = SparsevecCheckValue
+		.checkValue = SparsevecCheckValue,
+		.subvector = NULL
+	};
+
+	PG_RETURN_POINTER(&typeInfo);
+};
+
+PGDLLEXPORT PG_FUNCTION_INFO_V1(hnsw_hybridvec_support);
+Datum
+hnsw_hybridvec_support(PG_FUNCTION_ARGS)
+{
+	static const HnswTypeInfo typeInfo = {
+		.maxDimensions = HNSW_MAX_DIM,
+		.normalize = NULL,
+		.checkValue = HybridvecCheckValue,
+		.subvector = NULL
 	};
 
 	PG_RETURN_POINTER(&typeInfo);
@@ -63,6 +63,7 @@ RemoveHeapTids(HnswVacuumState * vacuumstate)
 			HnswElementTuple etup = (HnswElementTuple) PageGetItem(page, PageGetItemId(page, offno));
 			int			idx = 0;
 			bool		itemUpdated = false;
+			uint8		deadtids = 0;
 
 			/* Skip neighbor tuples */
 			if (!HnswIsElementTuple(etup))
@@ -83,6 +84,10 @@ RemoveHeapTids(HnswVacuumState * vacuumstate)
 					}
 					else
 					{
+						/* Keep dead flag with heap TID */
+						if (HnswHeapTidIsDead(etup->deadtids, i) && idx < HNSW_DEADTIDS)
+							deadtids |= (1 << idx);
+
 						/* Move to front of list */
 						etup->heaptids[idx++] = etup->heaptids[i];
 						stats->num_index_tuples++;
@@ -91,6 +96,8 @@ RemoveHeapTids(HnswVacuumState * vacuumstate)
 
 				if (itemUpdated)
 				{
+					etup->deadtids = deadtids;
+
 					/* Mark rest as invalid */
 					for (int i = idx; i < HNSW_HEAPTIDS; i++)
 						ItemPointerSetInvalid(&etup->heaptids[i]);
@@ -205,7 +212,7 @@ RepairGraphElement(HnswVacuumState * vacuumstate, HnswElement element, HnswEleme
 	element->heaptidsLength = 0;
 
 	/* Find neighbors for element, skipping itself */
-	HnswFindElementNeighbors(base, element, entryPoint, index, procinfo, collation, m, efConstruction, true);
+	HnswFindElementNeighbors(base, element, entryPoint, index, procinfo, collation, vacuumstate->boundedDistance, m, efConstruction, true);
 
 	/* Zero memory for each element */
 	MemSet(ntup, 0, HNSW_TUPLE_ALLOC_SIZE);
@@ -256,7 +263,7 @@ RepairGraphEntryPoint(HnswVacuumState * vacuumstate)
 		LockPage(index, HNSW_UPDATE_LOCK, ShareLock);
 
 		/* Load element */
-		HnswLoadElement(highestPoint, NULL, NULL, index, vacuumstate->procinfo, vacuumstate->collation, true);
+		HnswLoadElement(highestPoint, NULL, NULL, index, vacuumstate->procinfo, vacuumstate->collation, true, NULL);
 
 		/* Repair if needed */
 		if (NeedsUpdated(vacuumstate, highestPoint))
@@ -294,7 +301,7 @@ RepairGraphEntryPoint(HnswVacuumState * vacuumstate)
 			 * is outdated, this can remove connections at higher levels in
 			 * the graph until they are repaired, but this should be fine.
 			 */
-			HnswLoadElement(entryPoint, NULL, NULL, index, vacuumstate->procinfo, vacuumstate->collation, true);
+			HnswLoadElement(entryPoint, NULL, NULL, index, vacuumstate->procinfo, vacuumstate->collation, true, NULL);
 
 			if (NeedsUpdated(vacuumstate, entryPoint))
 			{
@@ -574,6 +581,7 @@ InitVacuumState(HnswVacuumState * vacuumstate, IndexVacuumInfo *info, IndexBulkD
 	vacuumstate->efConstruction = HnswGetEfConstruction(index);
 	vacuumstate->bas = GetAccessStrategy(BAS_BULKREAD);
 	vacuumstate->procinfo = index_getprocinfo(index, 1, HNSW_DISTANCE_PROC);
+	vacuumstate->boundedDistance = GetBoundedDistanceFunc(vacuumstate->procinfo);
 	vacuumstate->collation = index->rd_indcollation[0];
 	vacuumstate->ntup = palloc0(HNSW_TUPLE_ALLOC_SIZE);
 	vacuumstate->tmpCtx = AllocSetContextCreate(CurrentMemoryContext,
@@ -610,6 +618,9 @@ hnswbulkdelete(IndexVacuumInfo *info, IndexBulkDeleteResult *stats,
 
 	InitVacuumState(&vacuumstate, info, stats, callback, callback_state);
 
+	/* Invalidate cached scan results, including ones from concurrent scans */
+	ScanCacheInvalidate(info->index);
+
 	/* Pass 1: Remove heap TIDs */
 	RemoveHeapTids(&vacuumstate);
 
@@ -619,6 +630,9 @@ hnswbulkdelete(IndexVacuumInfo *info, IndexBulkDeleteResult *stats,
 	/* Pass 3: Mark as deleted */
 	MarkDeleted(&vacuumstate);
 
+	/* Heap TIDs can be reused after this */
+	ScanCacheInvalidate(info->index);
+
 	FreeVacuumState(&vacuumstate);
 
 	return vacuumstate.stats;
@@ -0,0 +1,457 @@
+#include "postgres.h"
+
+#include <math.h>
+
+#include "fmgr.h"
+#include "hybridvec.h"
+#include "libpq/pqformat.h"
+#include "sendrecv.h"
+#include "sparsevec.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/float.h"
+#include "vector.h"
+
+PGDLLEXPORT Datum vector_in(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum vector_out(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum sparsevec_in(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum sparsevec_out(PG_FUNCTION_ARGS);
+
+#if PG_VERSION_NUM < 120003
+static pg_noinline void
+float_overflow_error(void)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+			 errmsg("value out of range: overflow")));
+}
+#endif
+
+/*
+ * Ensure same dimensions
+ */
+static inline void
+CheckDims(HybridVector * a, HybridVector * b)
+{
+	if (a->dim != b->dim)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("different hybridvec dimensions %d and %d", a->dim, b->dim)));
+
+	if (a->sdim != b->sdim)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("different hybridvec sparse dimensions %d and %d", a->sdim, b->sdim)));
+}
+
+/*
+ * Ensure expected dimensions
+ */
+static inline void
+CheckExpectedDim(int32 typmod, int dim)
+{
+	if (typmod != -1 && typmod != dim)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("expected %d dimensions, not %d", typmod, dim)));
+}
+
+/*
+ * Ensure finite element
+ */
+static inline void
+CheckElement(float value)
+{
+	if (isnan(value))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("NaN not allowed in hybridvec")));
+
+	if (isinf(value))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("infinite value not allowed in hybridvec")));
+}
+
+/*
+ * Allocate and initialize a new hybrid vector
+ */
+HybridVector *
+InitHybridVector(int dim, int sdim, int nnz)
+{
+	HybridVector *result;
+	int			size;
+
+	size = HYBRIDVEC_SIZE(dim, nnz);
+	result = (HybridVector *) palloc0(size);
+	SET_VARSIZE(result, size);
+	result->dim = dim;
+	result->sdim = sdim;
+	result->nnz = nnz;
+
+	return result;
+}
+
+/*
+ * Create a hybrid vector from its parts, scaling each part by its weight
+ *
+ * Zero values are dropped from the sparse part, since sparse vectors do not
+ * store them.
+ */
+static HybridVector *
+BuildHybridVector(Vector * dense, SparseVector * sparse, float denseWeight, float sparseWeight)
+{
+	HybridVector *result;
+	float	   *values = SPARSEVEC_VALUES(sparse);
+	int32	   *rindices;
+	float	   *rvalues;
+	int			nnz = 0;
+
+	for (int i = 0; i < sparse->nnz; i++)
+		nnz += (values[i] * sparseWeight) != 0;
+
+	result = InitHybridVector(dense->dim, sparse->dim, nnz);
+	rindices = HYBRIDVEC_INDICES(result);
+	rvalues = HYBRIDVEC_VALUES(result);
+
+	for (int i = 0; i < dense->dim; i++)
+		result->x[i] = dense->x[i] * denseWeight;
+
+	for (int i = 0, j = 0; j < nnz; i++)
+	{
+		float		value = values[i] * sparseWeight;
+
+		rindices[j] = sparse->indices[i];
+		rvalues[j] = value;
+		j += value != 0;
+	}
+
+	/* Check for overflow */
+	if (AnyNonFiniteFloat4((uint32 *) result->x, dense->dim) || AnyNonFiniteFloat4((uint32 *) rvalues, nnz))
+		float_overflow_error();
+
+	return result;
+}
+
+/*
+ * Convert textual representation to internal representation
+ *
+ * The format is the dense part and the sparse part separated by a pipe, for
+ * example [1,2,3]|{1:1,5:2}/10
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(hybridvec_in);
+Datum
+hybridvec_in(PG_FUNCTION_ARGS)
+{
+	char	   *lit = PG_GETARG_CSTRING(0);
+	int32		typmod = PG_GETARG_INT32(2);
+	char	   *sep = strchr(lit, '|');
+	Vector	   *dense;
+	SparseVector *sparse;
+	HybridVector *result;
+
+	if (sep == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+				 errmsg("invalid input syntax for type hybridvec: \"%s\"", lit),
+				 errdetail("Dense and sparse parts must be separated by \"|\".")));
+
+	dense = DatumGetVector(DirectFunctionCall3(vector_in, CStringGetDatum(pnstrdup(lit, sep - lit)), ObjectIdGetDatum(InvalidOid), Int32GetDatum(-1)));
+	sparse = DatumGetSparseVector(DirectFunctionCall3(sparsevec_in, CStringGetDatum(sep + 1), ObjectIdGetDatum(InvalidOid), Int32GetDatum(-1)));
+
+	CheckExpectedDim(typmod, dense->dim);
+
+	result = BuildHybridVector(dense, sparse, 1, 1);
+
+	PG_RETURN_POINTER(result);
+}
+
+/*
+ * Convert internal representation to textual representation
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(hybridvec_out);
+Datum
+hybridvec_out(PG_FUNCTION_ARGS)
+{
+	HybridVector *hvec = PG_GETARG_HYBRIDVEC_P(0);
+	Vector	   *dense = InitVector(hvec->dim);
+	SparseVector *sparse = InitSparseVector(hvec->sdim, hvec->nnz);
+	char	   *denseOut;
+	char	   *sparseOut;
+
+	memcpy(dense->x, hvec->x, hvec->dim * sizeof(float));
+	memcpy(sparse->indices, HYBRIDVEC_INDICES(hvec), hvec->nnz * sizeof(int32));
+	memcpy(SPARSEVEC_VALUES(sparse), HYBRIDVEC_VALUES(hvec), hvec->nnz * sizeof(float));
+
+	denseOut = DatumGetCString(DirectFunctionCall1(vector_out, PointerGetDatum(dense)));
+	sparseOut = DatumGetCString(DirectFunctionCall1(sparsevec_out, PointerGetDatum(sparse)));
+
+	PG_FREE_IF_COPY(hvec, 0);
+	PG_RETURN_CSTRING(psprintf("%s|%s", denseOut, sparseOut));
+}
+
+/*
+ * Convert type modifier
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(hybridvec_typmod_in);
+Datum
+hybridvec_typmod_in(PG_FUNCTION_ARGS)
+{
+	ArrayType  *ta = PG_GETARG_ARRAYTYPE_P(0);
+	int32	   *tl;
+	int			n;
+
+	tl = ArrayGetIntegerTypmods(ta, &n);
+
+	if (n != 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("invalid type modifier")));
+
+	if (*tl < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("dimensions for type hybridvec must be at least 1")));
+
+	if (*tl > VECTOR_MAX_DIM)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("dimensions for type hybridvec cannot exceed %d", VECTOR_MAX_DIM)));
+
+	PG_RETURN_INT32(*tl);
+}
+
+/*
+ * Convert external binary representation to internal representation
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(hybridvec_recv);
+Datum
+hybridvec_recv(PG_FUNCTION_ARGS)
+{
+	StringInfo	buf = (StringInfo) PG_GETARG_POINTER(0);
+	int32		typmod = PG_GETARG_INT32(2);
+	HybridVector *result;
+	int16		dim;
+	int16		unused;
+	int32		sdim;
+	int32		nnz;
+	int32	   *indices;
+	float	   *values;
+
+	dim = pq_getmsgint(buf, sizeof(int16));
+	unused = pq_getmsgint(buf, sizeof(int16));
+	sdim = pq_getmsgint(buf, sizeof(int32));
+	nnz = pq_getmsgint(buf, sizeof(int32));
+
+	if (dim < 1 || dim > VECTOR_MAX_DIM)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("hybridvec must have between 1 and %d dimensions", VECTOR_MAX_DIM)));
+
+	if (sdim < 1 || sdim > SPARSEVEC_MAX_DIM)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("hybridvec must have between 1 and %d sparse dimensions", SPARSEVEC_MAX_DIM)));
+
+	if (nnz < 0 || nnz > SPARSEVEC_MAX_NNZ || nnz > sdim)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("invalid number of non-zero elements for hybridvec: %d", nnz)));
+
+	CheckExpectedDim(typmod, dim);
+
+	if (unused != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("expected unused to be 0, not %d", unused)));
+
+	result = InitHybridVector(dim, sdim, nnz);
+	indices = HYBRIDVEC_INDICES(result);
+	values = HYBRIDVEC_VALUES(result);
+
+	pq_copymsgint32s(buf, (uint32 *) result->x, dim);
+	for (int i = 0; i < dim; i++)
+		CheckElement(result->x[i]);
+
+	/* Binary representation uses zero-based numbering for indices */
+	pq_copymsgint32s(buf, (uint32 *) indices, nnz);
+	for (int i = 0; i < nnz; i++)
+	{
+		if (indices[i] < 0 || indices[i] >= sdim || (i > 0 && indices[i] <= indices[i - 1]))
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_EXCEPTION),
+					 errmsg("hybridvec indices must be in bounds and in strictly ascending order")));
+	}
+
+	pq_copymsgint32s(buf, (uint32 *) values, nnz);
+	for (int i = 0; i < nnz; i++)
+	{
+		CheckElement(values[i]);
+
+		if (values[i] == 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_EXCEPTION),
+					 errmsg("binary representation of hybridvec cannot contain zero sparse values")));
+	}
+
+	PG_RETURN_POINTER(result);
+}
+
+/*
+ * Convert internal representation to the external binary representation
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(hybridvec_send);
+Datum
+hybridvec_send(PG_FUNCTION_ARGS)
+{
+	HybridVector *hvec = PG_GETARG_HYBRIDVEC_P(0);
+	StringInfoData buf;
+
+	pq_begintypsend(&buf);
+	pq_sendint(&buf, hvec->dim, sizeof(int16));
+	pq_sendint(&buf, hvec->unused, sizeof(int16));
+	pq_sendint(&buf, hvec->sdim, sizeof(int32));
+	pq_sendint(&buf, hvec->nnz, sizeof(int32));
+	pq_sendint32s(&buf, (uint32 *) hvec->x, hvec->dim);
+
+	/* Binary representation uses zero-based numbering for indices */
+	pq_sendint32s(&buf, (uint32 *) HYBRIDVEC_INDICES(hvec), hvec->nnz);
+	pq_sendint32s(&buf, (uint32 *) HYBRIDVEC_VALUES(hvec), hvec->nnz);
+
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+/*
+ * Convert hybrid vector to hybrid vector
+ * This is needed to check the type modifier
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(hybridvec);
+Datum
+hybridvec(PG_FUNCTION_ARGS)
+{
+	HybridVector *hvec = PG_GETARG_HYBRIDVEC_P(0);
+	int32		typmod = PG_GETARG_INT32(1);
+
+	CheckExpectedDim(typmod, hvec->dim);
+
+	PG_RETURN_POINTER(hvec);
+}
+
+/*
+ * Create a hybrid vector from a dense vector and a sparse vector
+ *
+ * Since the inner product is bilinear, weighting the query is enough to get
+ * a weighted sum of the dense and sparse scores.
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(hybridvec_from_parts);
+Datum
+hybridvec_from_parts(PG_FUNCTION_ARGS)
+{
+	Vector	   *dense = PG_GETARG_VECTOR_P(0);
+	SparseVector *sparse = PG_GETARG_SPARSEVEC_P(1);
+	float		denseWeight = PG_GETARG_FLOAT4(2);
+	float		sparseWeight = PG_GETARG_FLOAT4(3);
+
+	if (isnan(denseWeight) || isinf(denseWeight) || isnan(sparseWeight) || isinf(sparseWeight))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("weights must be finite")));
+
+	PG_RETURN_POINTER(BuildHybridVector(dense, sparse, denseWeight, sparseWeight));
+}
+
+/*
+ * Get the dense part of a hybrid vector
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(hybridvec_dense);
+Datum
+hybridvec_dense(PG_FUNCTION_ARGS)
+{
+	HybridVector *hvec = PG_GETARG_HYBRIDVEC_P(0);
+	Vector	   *result = InitVector(hvec->dim);
+
+	memcpy(result->x, hvec->x, hvec->dim * sizeof(float));
+
+	PG_RETURN_POINTER(result);
+}
+
+/*
+ * Get the sparse part of a hybrid vector
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(hybridvec_sparse);
+Datum
+hybridvec_sparse(PG_FUNCTION_ARGS)
+{
+	HybridVector *hvec = PG_GETARG_HYBRIDVEC_P(0);
+	SparseVector *result = InitSparseVector(hvec->sdim, hvec->nnz);
+
+	memcpy(result->indices, HYBRIDVEC_INDICES(hvec), hvec->nnz * sizeof(int32));
+	memcpy(SPARSEVEC_VALUES(result), HYBRIDVEC_VALUES(hvec), hvec->nnz * sizeof(float));
+
+	PG_RETURN_POINTER(result);
+}
+
+/*
+ * Get the inner product of two hybrid vectors
+ */
+static float
+HybridvecInnerProduct(HybridVector * a, HybridVector * b)
+{
+	int32	   *aindices = HYBRIDVEC_INDICES(a);
+	int32	   *bindices = HYBRIDVEC_INDICES(b);
+	float	   *avalues = HYBRIDVEC_VALUES(a);
+	float	   *bvalues = HYBRIDVEC_VALUES(b);
+	float		dense = 0.0;
+	float		sparse = 0.0;
+	int			i = 0;
+	int			j = 0;
+
+	/* Auto-vectorized */
+	for (int k = 0; k < a->dim; k++)
+		dense += a->x[k] * b->x[k];
+
+	/* Merge sorted indices */
+	while (i < a->nnz && j < b->nnz)
+	{
+		int32		ai = aindices[i];
+		int32		bi = bindices[j];
+
+		if (ai == bi)
+			sparse += avalues[i] * bvalues[j];
+
+		i += ai <= bi;
+		j += bi <= ai;
+	}
+
+	return dense + sparse;
+}
+
+/*
+ * Get the inner product of two hybrid vectors
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(hybridvec_inner_product);
+Datum
+hybridvec_inner_product(PG_FUNCTION_ARGS)
+{
+	HybridVector *a = PG_GETARG_HYBRIDVEC_P(0);
+	HybridVector *b = PG_GETARG_HYBRIDVEC_P(1);
+
+	CheckDims(a, b);
+
+	PG_RETURN_FLOAT8((double) HybridvecInnerProduct(a, b));
+}
+
+/*
+ * Get the negative inner product of two hybrid vectors
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(hybridvec_negative_inner_product);
+Datum
+hybridvec_negative_inner_product(PG_FUNCTION_ARGS)
+{
+	HybridVector *a = PG_GETARG_HYBRIDVEC_P(0);
+	HybridVector *b = PG_GETARG_HYBRIDVEC_P(1);
+
+	CheckDims(a, b);
+
+	PG_RETURN_FLOAT8((double) -HybridvecInnerProduct(a, b));
+}
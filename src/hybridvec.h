@@ -0,0 +1,46 @@
+#ifndef HYBRIDVEC_H
+#define HYBRIDVEC_H
+
+#define DatumGetHybridVector(x)		((HybridVector *) PG_DETOAST_DATUM(x))
+#define PG_GETARG_HYBRIDVEC_P(x)	DatumGetHybridVector(PG_GETARG_DATUM(x))
+#define PG_RETURN_HYBRIDVEC_P(x)	PG_RETURN_POINTER(x)
+
+/*
+ * A dense vector and a sparse vector scored together
+ *
+ * Dense elements come first, then sparse indices (0-based and sorted), then
+ * sparse values.
+ */
+typedef struct HybridVector
+{
+	int32		vl_len_;		/* varlena header (do not touch directly!) */
+	int16		dim;			/* number of dense dimensions */
+	int16		unused;			/* reserved for future use, always zero */
+	int32		sdim;			/* number of sparse dimensions */
+	int32		nnz;			/* number of non-zero sparse elements */
+	float		x[FLEXIBLE_ARRAY_MEMBER];
+}			HybridVector;
+
+/* Use functions instead of macros to avoid double evaluation */
+
+static inline Size
+HYBRIDVEC_SIZE(int dim, int nnz)
+{
+	return offsetof(HybridVector, x) + (dim * sizeof(float)) + (nnz * sizeof(int32)) + (nnz * sizeof(float));
+}
+
+static inline int32 *
+HYBRIDVEC_INDICES(HybridVector * x)
+{
+	return (int32 *) (x->x + x->dim);
+}
+
+static inline float *
+HYBRIDVEC_VALUES(HybridVector * x)
+{
+	return (float *) (HYBRIDVEC_INDICES(x) + x->nnz);
+}
+
+HybridVector *InitHybridVector(int dim, int sdim, int nnz);
+
+#endif
@@ -2,6 +2,7 @@
 
 #include <float.h>
 
+#include "access/itup.h"
 #include "access/table.h"
 #include "access/tableam.h"
 #include "access/parallel.h"
@@ -19,6 +20,7 @@
 #include "tcop/tcopprot.h"
 #include "utils/memutils.h"
 #include "vector.h"
+#include "vectortrace.h"
 
 #if PG_VERSION_NUM >= 140000
 #include "utils/backend_progress.h"
@@ -42,6 +44,74 @@
 #define PARALLEL_KEY_IVFFLAT_CENTERS	UINT64CONST(0xA000000000000003)
 #define PARALLEL_KEY_QUERY_TEXT			UINT64CONST(0xA000000000000004)
 
+typedef struct IvfflatCalibrationNeighbors
+{
+	int			length;
+	float		distances[IVFFLAT_CALIBRATION_K];
+	ItemPointerData tids[IVFFLAT_CALIBRATION_K];
+}			IvfflatCalibrationNeighbors;
+
+typedef struct IvfflatCalibrationQuery
+{
+	Datum		value;
+	ItemPointerData tid;		/* index tuple of query */
+	int		   *ranks;			/* rank of each list by distance */
+	IvfflatCalibrationNeighbors neighbors[IVFFLAT_CALIBRATION_STEPS];	/* for each probes step */
+}			IvfflatCalibrationQuery;
+
+typedef struct IvfflatCalibrationList
+{
+	int			list;
+	double		distance;
+}			IvfflatCalibrationList;
+
+#define PhaseUsesTuples(phase) ((phase) == PROGRESS_IVFFLAT_PHASE_ASSIGN || (phase) == PROGRESS_IVFFLAT_PHASE_SORT || (phase) == PROGRESS_IVFFLAT_PHASE_LOAD)
+
+/*
+ * Log the time spent in the current phase
+ */
+static void
+EndPhase(IvfflatBuildState * buildstate)
+{
+	instr_time	duration;
+	double		seconds;
+	double		tuples = buildstate->phaseTuples;
+
+	if (buildstate->phase == 0)
+		return;
+
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, buildstate->phaseStart);
+	seconds = INSTR_TIME_GET_DOUBLE(duration);
+
+	/* Other phases count samples */
+	if (PhaseUsesTuples(buildstate->phase))
+		tuples = buildstate->indtuples;
+
+	if (tuples > 0 && seconds > 0)
+		ereport(DEBUG1, (errmsg("ivfflat %s: %.3f s, " INT64_FORMAT " tuples, %.0f tuples/s", ivfflatbuildphasename(buildstate->phase), seconds, (int64) tuples, tuples / seconds)));
+	else
+		ereport(DEBUG1, (errmsg("ivfflat %s: %.3f s", ivfflatbuildphasename(buildstate->phase), seconds)));
+
+	buildstate->phase = 0;
+}
+
+/*
+ * Start a build phase
+ */
+static void
+StartPhase(IvfflatBuildState * buildstate, int phase)
+{
+	EndPhase(buildstate);
+
+	buildstate->phase = phase;
+	buildstate->phaseTuples = 0;
+	INSTR_TIME_SET_CURRENT(buildstate->phaseStart);
+
+	pgstat_progress_update_param(PROGRESS_CREATEIDX_SUBPHASE, phase);
+	TRACE_PGVECTOR_IVFFLAT_BUILD_PHASE(RelationGetRelid(buildstate->index), phase);
+}
+
 /*
  * Add sample
  */
@@ -54,6 +124,10 @@ AddSample(Datum *values, IvfflatBuildState * buildstate)
 	/* Detoast once for all calls */
 	Datum		value = PointerGetDatum(PG_DETOAST_DATUM(values[0]));
 
+	/* Index prefix if needed */
+	if (buildstate->prefixDimensions > 0)
+		value = IvfflatPrefixValue(buildstate->typeInfo, buildstate->prefixDimensions, value);
+
 	/*
 	 * Normalize with KMEANS_NORM_PROC since spherical distance function
 	 * expects unit vectors
@@ -155,6 +229,10 @@ AddTupleToSort(Relation index, ItemPointer tid, Datum *values, IvfflatBuildState
 	/* Detoast once for all calls */
 	Datum		value = PointerGetDatum(PG_DETOAST_DATUM(values[0]));
 
+	/* Index prefix if needed */
+	if (buildstate->prefixDimensions > 0)
+		value = IvfflatPrefixValue(buildstate->typeInfo, buildstate->prefixDimensions, value);
+
 	/* Normalize if needed */
 	if (buildstate->normprocinfo != NULL)
 	{
@@ -167,7 +245,13 @@ AddTupleToSort(Relation index, ItemPointer tid, Datum *values, IvfflatBuildState
 	/* Find the list that minimizes the distance */
 	for (int i = 0; i < centers->length; i++)
 	{
-		distance = DatumGetFloat8(FunctionCall2Coll(buildstate->procinfo, buildstate->collation, value, PointerGetDatum(VectorArrayGet(centers, i))));
+		Datum		center = PointerGetDatum(VectorArrayGet(centers, i));
+
+		/* Stop early if not closer */
+		if (buildstate->boundedDistance != NULL)
+			distance = buildstate->boundedDistance(value, center, minDistance);
+		else
+			distance = DatumGetFloat8(FunctionCall2Coll(buildstate->procinfo, buildstate->collation, value, center));
 
 		if (distance < minDistance)
 		{
@@ -267,7 +351,7 @@ InsertTuples(Relation index, IvfflatBuildState * buildstate, ForkNumber forkNum)
 	TupleTableSlot *slot = MakeSingleTupleTableSlot(buildstate->tupdesc, &TTSOpsMinimalTuple);
 	TupleDesc	tupdesc = RelationGetDescr(index);
 
-	pgstat_progress_update_param(PROGRESS_CREATEIDX_SUBPHASE, PROGRESS_IVFFLAT_PHASE_LOAD);
+	StartPhase(buildstate, PROGRESS_IVFFLAT_PHASE_LOAD);
 
 	pgstat_progress_update_param(PROGRESS_CREATEIDX_TUPLES_TOTAL, buildstate->indtuples);
 
@@ -332,6 +416,14 @@ InitBuildState(IvfflatBuildState * buildstate, Relation heap, Relation index, In
 
 	buildstate->lists = IvfflatGetLists(index);
 	buildstate->dimensions = TupleDescAttr(index->rd_att, 0)->atttypmod;
+	buildstate->prefixDimensions = IvfflatGetPrefixDimensions(index);
+
+	/* Get support functions */
+	buildstate->procinfo = index_getprocinfo(index, 1, IVFFLAT_DISTANCE_PROC);
+	buildstate->boundedDistance = GetBoundedDistanceFunc(buildstate->procinfo);
+	buildstate->normprocinfo = IvfflatOptionalProcInfo(index, IVFFLAT_NORM_PROC);
+	buildstate->kmeansnormprocinfo = IvfflatOptionalProcInfo(index, IVFFLAT_KMEANS_NORM_PROC);
+	buildstate->collation = index->rd_indcollation[0];
 
 	/* Disallow varbit since require fixed dimensions */
 	if (TupleDescAttr(index->rd_att, 0)->atttypid == VARBITOID)
@@ -341,18 +433,27 @@ InitBuildState(IvfflatBuildState * buildstate, Relation heap, Relation index, In
 	if (buildstate->dimensions < 0)
 		elog(ERROR, "column does not have dimensions");
 
+	/* Scans recheck with the full distance, so prefix distances must be lower bounds */
+	if (buildstate->prefixDimensions > 0)
+	{
+		if (buildstate->typeInfo->subvector == NULL)
+			elog(ERROR, "prefix_dimensions not supported for this type");
+
+		if (buildstate->boundedDistance == NULL)
+			elog(ERROR, "prefix_dimensions requires L2 or L1 distance");
+
+		if (buildstate->prefixDimensions > buildstate->dimensions)
+			elog(ERROR, "prefix_dimensions cannot be greater than column dimensions");
+
+		buildstate->dimensions = buildstate->prefixDimensions;
+	}
+
 	if (buildstate->dimensions > buildstate->typeInfo->maxDimensions)
 		elog(ERROR, "column cannot have more than %d dimensions for ivfflat index", buildstate->typeInfo->maxDimensions);
 
 	buildstate->reltuples = 0;
 	buildstate->indtuples = 0;
 
-	/* Get support functions */
-	buildstate->procinfo = index_getprocinfo(index, 1, IVFFLAT_DISTANCE_PROC);
-	buildstate->normprocinfo = IvfflatOptionalProcInfo(index, IVFFLAT_NORM_PROC);
-	buildstate->kmeansnormprocinfo = IvfflatOptionalProcInfo(index, IVFFLAT_KMEANS_NORM_PROC);
-	buildstate->collation = index->rd_indcollation[0];
-
 	/* Require more than one dimension for spherical k-means */
 	if (buildstate->kmeansnormprocinfo != NULL && buildstate->dimensions == 1)
 		elog(ERROR, "dimensions must be greater than one for this opclass");
@@ -378,6 +479,10 @@ InitBuildState(IvfflatBuildState * buildstate, Relation heap, Relation index, In
 	buildstate->listCounts = palloc0(sizeof(int) * buildstate->lists);
 #endif
 
+	buildstate->phase = PROGRESS_CREATEIDX_SUBPHASE_INITIALIZE;
+	buildstate->phaseTuples = 0;
+	INSTR_TIME_SET_CURRENT(buildstate->phaseStart);
+
 	buildstate->ivfleader = NULL;
 }
 
@@ -406,8 +511,6 @@ ComputeCenters(IvfflatBuildState * buildstate)
 {
 	int			numSamples;
 
-	pgstat_progress_update_param(PROGRESS_CREATEIDX_SUBPHASE, PROGRESS_IVFFLAT_PHASE_KMEANS);
-
 	/* Target 50 samples per list, with at least 10000 samples */
 	/* The number of samples has a large effect on index build time */
 	numSamples = buildstate->lists * 50;
@@ -423,7 +526,9 @@ ComputeCenters(IvfflatBuildState * buildstate)
 	buildstate->samples = VectorArrayInit(numSamples, buildstate->dimensions, buildstate->centers->itemsize);
 	if (buildstate->heap != NULL)
 	{
+		StartPhase(buildstate, PROGRESS_IVFFLAT_PHASE_SAMPLE);
 		SampleRows(buildstate);
+		buildstate->phaseTuples = buildstate->samples->length;
 
 		if (buildstate->samples->length < buildstate->lists)
 		{
@@ -435,6 +540,8 @@ ComputeCenters(IvfflatBuildState * buildstate)
 	}
 
 	/* Calculate centers */
+	StartPhase(buildstate, PROGRESS_IVFFLAT_PHASE_KMEANS);
+	buildstate->phaseTuples = buildstate->samples->length;
 	IvfflatBench("k-means", IvfflatKmeans(buildstate->index, buildstate->samples, buildstate->centers, buildstate->typeInfo));
 
 	/* Free samples before we allocate more memory */
@@ -930,7 +1037,7 @@ AssignTuples(IvfflatBuildState * buildstate)
 	Oid			sortCollations[] = {InvalidOid};
 	bool		nullsFirstFlags[] = {false};
 
-	pgstat_progress_update_param(PROGRESS_CREATEIDX_SUBPHASE, PROGRESS_IVFFLAT_PHASE_ASSIGN);
+	StartPhase(buildstate, PROGRESS_IVFFLAT_PHASE_ASSIGN);
 
 	/* Calculate parallel workers */
 	if (buildstate->heap != NULL)
@@ -977,6 +1084,7 @@ CreateEntryPages(IvfflatBuildState * buildstate, ForkNumber forkNum)
 	IvfflatBench("assign tuples", AssignTuples(buildstate));
 
 	/* Sort */
+	StartPhase(buildstate, PROGRESS_IVFFLAT_PHASE_SORT);
 	IvfflatBench("sort tuples", tuplesort_performsort(buildstate->sortstate));
 
 	/* Load */
@@ -990,6 +1098,311 @@ CreateEntryPages(IvfflatBuildState * buildstate, ForkNumber forkNum)
 		IvfflatEndParallel(buildstate->ivfleader);
 }
 
+/*
+ * Add a neighbor if it is one of the closest
+ */
+static void
+AddCalibrationNeighbor(IvfflatCalibrationNeighbors * neighbors, float distance, ItemPointer tid)
+{
+	int			i;
+
+	if (neighbors->length == IVFFLAT_CALIBRATION_K && distance >= neighbors->distances[IVFFLAT_CALIBRATION_K - 1])
+		return;
+
+	i = neighbors->length < IVFFLAT_CALIBRATION_K ? neighbors->length++ : IVFFLAT_CALIBRATION_K - 1;
+
+	/* Keep sorted by distance */
+	for (; i > 0 && neighbors->distances[i - 1] > distance; i--)
+	{
+		neighbors->distances[i] = neighbors->distances[i - 1];
+		neighbors->tids[i] = neighbors->tids[i - 1];
+	}
+
+	neighbors->distances[i] = distance;
+	neighbors->tids[i] = *tid;
+}
+
+/*
+ * Get the fraction of exact neighbors that were found
+ */
+static double
+GetCalibrationRecall(IvfflatCalibrationNeighbors * approx, IvfflatCalibrationNeighbors * exact)
+{
+	int			matches = 0;
+
+	if (exact->length == 0)
+		return 1;
+
+	for (int i = 0; i < approx->length; i++)
+	{
+		for (int j = 0; j < exact->length; j++)
+		{
+			if (ItemPointerEquals(&approx->tids[i], &exact->tids[j]))
+			{
+				matches++;
+				break;
+			}
+		}
+	}
+
+	return (double) matches / exact->length;
+}
+
+/*
+ * Compare list distances
+ */
+static int
+CompareCalibrationLists(const void *a, const void *b)
+{
+	if (((const IvfflatCalibrationList *) a)->distance < ((const IvfflatCalibrationList *) b)->distance)
+		return -1;
+
+	if (((const IvfflatCalibrationList *) a)->distance > ((const IvfflatCalibrationList *) b)->distance)
+		return 1;
+
+	return 0;
+}
+
+/*
+ * Get the start page of each list
+ */
+static BlockNumber *
+GetCalibrationStartPages(Relation index, ListInfo * listInfo, int lists)
+{
+	BlockNumber *startPages = palloc(sizeof(BlockNumber) * lists);
+
+	for (int i = 0; i < lists; i++)
+	{
+		Buffer		buf;
+		Page		page;
+		IvfflatList list;
+
+		buf = ReadBuffer(index, listInfo[i].blkno);
+		LockBuffer(buf, BUFFER_LOCK_SHARE);
+		page = BufferGetPage(buf);
+		list = (IvfflatList) PageGetItem(page, PageGetItemId(page, listInfo[i].offno));
+		startPages[i] = list->startPage;
+		UnlockReleaseBuffer(buf);
+	}
+
+	return startPages;
+}
+
+/*
+ * Sample index tuples to use as queries
+ */
+static int
+SampleCalibrationQueries(Relation index, BlockNumber *startPages, int lists, IvfflatCalibrationQuery * queries)
+{
+	TupleDesc	tupdesc = RelationGetDescr(index);
+	BufferAccessStrategy bas = GetAccessStrategy(BAS_BULKREAD);
+	int64		seen = 0;
+
+	for (int i = 0; i < lists; i++)
+	{
+		BlockNumber searchPage = startPages[i];
+
+		while (BlockNumberIsValid(searchPage))
+		{
+			Buffer		buf;
+			Page		page;
+			OffsetNumber maxoffno;
+
+			CHECK_FOR_INTERRUPTS();
+
+			buf = ReadBufferExtended(index, MAIN_FORKNUM, searchPage, RBM_NORMAL, bas);
+			LockBuffer(buf, BUFFER_LOCK_SHARE);
+			page = BufferGetPage(buf);
+			maxoffno = PageGetMaxOffsetNumber(page);
+
+			for (OffsetNumber offno = FirstOffsetNumber; offno <= maxoffno; offno = OffsetNumberNext(offno))
+			{
+				IndexTuple	itup = (IndexTuple) PageGetItem(page, PageGetItemId(page, offno));
+				int64		j;
+
+				/* Reservoir sampling */
+				j = seen < IVFFLAT_CALIBRATION_QUERIES ? seen : (int64) (RandomDouble() * (seen + 1));
+				seen++;
+
+				if (j < IVFFLAT_CALIBRATION_QUERIES)
+				{
+					IvfflatCalibrationQuery *query = &queries[j];
+					bool		isnull;
+					Datum		value = index_getattr(itup, 1, tupdesc, &isnull);
+
+					if (DatumGetPointer(query->value) != NULL)
+						pfree(DatumGetPointer(query->value));
+
+					query->value = PointerGetDatum(PG_DETOAST_DATUM_COPY(value));
+					ItemPointerSet(&query->tid, searchPage, offno);
+				}
+			}
+
+			searchPage = IvfflatPageGetOpaque(page)->nextblkno;
+
+			UnlockReleaseBuffer(buf);
+		}
+	}
+
+	FreeAccessStrategy(bas);
+
+	return Min(seen, IVFFLAT_CALIBRATION_QUERIES);
+}
+
+/*
+ * Rank lists by distance to each query
+ */
+static void
+RankCalibrationLists(IvfflatBuildState * buildstate, IvfflatCalibrationQuery * queries, int nqueries)
+{
+	int			lists = buildstate->centers->length;
+	IvfflatCalibrationList *sorted = palloc(sizeof(IvfflatCalibrationList) * lists);
+
+	for (int i = 0; i < nqueries; i++)
+	{
+		IvfflatCalibrationQuery *query = &queries[i];
+
+		for (int j = 0; j < lists; j++)
+		{
+			sorted[j].list = j;
+			sorted[j].distance = DatumGetFloat8(FunctionCall2Coll(buildstate->procinfo, buildstate->collation, PointerGetDatum(VectorArrayGet(buildstate->centers, j)), query->value));
+		}
+
+		qsort(sorted, lists, sizeof(IvfflatCalibrationList), CompareCalibrationLists);
+
+		query->ranks = palloc(sizeof(int) * lists);
+		for (int j = 0; j < lists; j++)
+			query->ranks[sorted[j].list] = j;
+	}
+
+	pfree(sorted);
+}
+
+/*
+ * Find the neighbors of queries for each probes step, excluding themselves
+ */
+static void
+FindCalibrationNeighbors(IvfflatBuildState * buildstate, BlockNumber *startPages, IvfflatCalibrationQuery * queries, int nqueries, int nsteps)
+{
+	Relation	index = buildstate->index;
+	TupleDesc	tupdesc = RelationGetDescr(index);
+	int			lists = buildstate->centers->length;
+	BufferAccessStrategy bas = GetAccessStrategy(BAS_BULKREAD);
+	MemoryContext oldCtx = MemoryContextSwitchTo(buildstate->tmpCtx);
+
+	for (int i = 0; i < lists; i++)
+	{
+		BlockNumber searchPage = startPages[i];
+
+		while (BlockNumberIsValid(searchPage))
+		{
+			Buffer		buf;
+			Page		page;
+			OffsetNumber maxoffno;
+
+			CHECK_FOR_INTERRUPTS();
+
+			buf = ReadBufferExtended(index, MAIN_FORKNUM, searchPage, RBM_NORMAL, bas);
+			LockBuffer(buf, BUFFER_LOCK_SHARE);
+			page = BufferGetPage(buf);
+			maxoffno = PageGetMaxOffsetNumber(page);
+
+			for (OffsetNumber offno = FirstOffsetNumber; offno <= maxoffno; offno = OffsetNumberNext(offno))
+			{
+				IndexTuple	itup = (IndexTuple) PageGetItem(page, PageGetItemId(page, offno));
+				bool		isnull;
+				Datum		value = index_getattr(itup, 1, tupdesc, &isnull);
+				ItemPointerData tid;
+
+				ItemPointerSet(&tid, searchPage, offno);
+
+				for (int j = 0; j < nqueries; j++)
+				{
+					IvfflatCalibrationQuery *query = &queries[j];
+					float		distance;
+
+					if (ItemPointerEquals(&tid, &query->tid))
+						continue;
+
+					distance = (float) DatumGetFloat8(FunctionCall2Coll(buildstate->procinfo, buildstate->collation, value, query->value));
+
+					/* Add to each step that probes the list */
+					for (int step = nsteps - 1; step >= 0 && IvfflatCalibrationProbes(step, lists) > query->ranks[i]; step--)
+						AddCalibrationNeighbor(&query->neighbors[step], distance, &tid);
+				}
+			}
+
+			searchPage = IvfflatPageGetOpaque(page)->nextblkno;
+
+			UnlockReleaseBuffer(buf);
+
+			MemoryContextReset(buildstate->tmpCtx);
+		}
+	}
+
+	MemoryContextSwitchTo(oldCtx);
+	FreeAccessStrategy(bas);
+}
+
+/*
+ * Estimate recall for each probes step with sampled index tuples as queries
+ * and store it in the metapage for ivfflat.target_recall
+ */
+static void
+CalibrateIndex(IvfflatBuildState * buildstate)
+{
+	Relation	index = buildstate->index;
+	int			lists = buildstate->centers->length;
+	IvfflatCalibrationQuery *queries;
+	BlockNumber *startPages;
+	int			nqueries;
+	int			nsteps;
+	double		recall[IVFFLAT_CALIBRATION_STEPS] = {0};
+	Buffer		buf;
+	Page		page;
+	GenericXLogState *state;
+	IvfflatMetaPage metap;
+
+	/* Need more tuples than neighbors */
+	if (buildstate->indtuples <= IVFFLAT_CALIBRATION_K)
+		return;
+
+	/* The last step probes all lists */
+	for (nsteps = 1; IvfflatCalibrationProbes(nsteps - 1, lists) < lists; nsteps++)
+		;
+
+	queries = palloc0(sizeof(IvfflatCalibrationQuery) * IVFFLAT_CALIBRATION_QUERIES);
+	startPages = GetCalibrationStartPages(index, buildstate->listInfo, lists);
+	nqueries = SampleCalibrationQueries(index, startPages, lists, queries);
+	RankCalibrationLists(buildstate, queries, nqueries);
+	FindCalibrationNeighbors(buildstate, startPages, queries, nqueries, nsteps);
+
+	for (int i = 0; i < nqueries; i++)
+	{
+		for (int step = 0; step < nsteps; step++)
+			recall[step] += GetCalibrationRecall(&queries[i].neighbors[step], &queries[i].neighbors[nsteps - 1]);
+
+		pfree(DatumGetPointer(queries[i].value));
+		pfree(queries[i].ranks);
+	}
+
+	pfree(queries);
+	pfree(startPages);
+
+	if (nqueries == 0)
+		return;
+
+	/* Update metapage */
+	buf = ReadBufferExtended(index, MAIN_FORKNUM, IVFFLAT_METAPAGE_BLKNO, RBM_NORMAL, NULL);
+	LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
+	state = GenericXLogStart(index);
+	page = GenericXLogRegisterBuffer(state, buf, 0);
+	metap = IvfflatPageGetMeta(page);
+	for (int step = 0; step < nsteps; step++)
+		metap->calibration[step] = recall[step] / nqueries;
+	IvfflatCommitBuffer(buf, state);
+}
+
 /*
  * Build the index
  */
@@ -1006,6 +1419,15 @@ BuildIndex(Relation heap, Relation index, IndexInfo *indexInfo,
 	CreateListPages(index, buildstate->centers, buildstate->dimensions, buildstate->lists, forkNum, &buildstate->listInfo);
 	CreateEntryPages(buildstate, forkNum);
 
+	/* Calibrate for target recall */
+	if (forkNum == MAIN_FORKNUM && IvfflatGetCalibrate(index))
+	{
+		StartPhase(buildstate, PROGRESS_IVFFLAT_PHASE_CALIBRATE);
+		CalibrateIndex(buildstate);
+	}
+
+	EndPhase(buildstate);
+
 	FreeBuildState(buildstate);
 }
 
@@ -1018,6 +1440,9 @@ ivfflatbuild(Relation heap, Relation index, IndexInfo *indexInfo)
 	IndexBuildResult *result;
 	IvfflatBuildState buildstate;
 
+	/* Relfilenode could be reused */
+	ScanCacheInvalidate(index);
+
 	BuildIndex(heap, index, indexInfo, &buildstate, MAIN_FORKNUM);
 
 	result = (IndexBuildResult *) palloc(sizeof(IndexBuildResult));
@@ -16,6 +16,7 @@
 #endif
 
 int			ivfflat_probes;
+double		ivfflat_target_recall;
 static relopt_kind ivfflat_relopt_kind;
 
 /*
@@ -29,6 +30,18 @@ IvfflatInit(void)
 					  IVFFLAT_DEFAULT_LISTS, IVFFLAT_MIN_LISTS, IVFFLAT_MAX_LISTS
 #if PG_VERSION_NUM >= 130000
 					  ,AccessExclusiveLock
+#endif
+		);
+	add_int_reloption(ivfflat_relopt_kind, "prefix_dimensions", "Number of leading dimensions to index (0 for all)",
+					  IVFFLAT_DEFAULT_PREFIX_DIMENSIONS, 0, VECTOR_MAX_DIM
+#if PG_VERSION_NUM >= 130000
+					  ,AccessExclusiveLock
+#endif
+		);
+	add_bool_reloption(ivfflat_relopt_kind, "calibrate", "Estimate recall at build time for target_recall",
+					   IVFFLAT_DEFAULT_CALIBRATE
+#if PG_VERSION_NUM >= 130000
+					   ,AccessExclusiveLock
 #endif
 		);
 
@@ -36,13 +49,17 @@ IvfflatInit(void)
 							"Valid range is 1..lists.", &ivfflat_probes,
 							IVFFLAT_DEFAULT_PROBES, IVFFLAT_MIN_LISTS, IVFFLAT_MAX_LISTS, PGC_USERSET, 0, NULL, NULL, NULL);
 
+	DefineCustomRealVariable("ivfflat.target_recall", "Sets the target recall for search",
+							 "Zero disables. Increases probes based on calibration at index build time.", &ivfflat_target_recall,
+							 0, 0, 1, PGC_USERSET, 0, NULL, NULL, NULL);
+
 	MarkGUCPrefixReserved("ivfflat");
 }
 
 /*
  * Get the name of index build phase
  */
-static char *
+char *
 ivfflatbuildphasename(int64 phasenum)
 {
 	switch (phasenum)
@@ -55,6 +72,12 @@ ivfflatbuildphasename(int64 phasenum)
 			return "assigning tuples";
 		case PROGRESS_IVFFLAT_PHASE_LOAD:
 			return "loading tuples";
+		case PROGRESS_IVFFLAT_PHASE_SAMPLE:
+			return "sampling table";
+		case PROGRESS_IVFFLAT_PHASE_SORT:
+			return "sorting tuples";
+		case PROGRESS_IVFFLAT_PHASE_CALIBRATE:
+			return "calibrating";
 		default:
 			return NULL;
 	}
@@ -71,6 +94,7 @@ ivfflatcostestimate(PlannerInfo *root, IndexPath *path, double loop_count,
 {
 	GenericCosts costs;
 	int			lists;
+	int			probes;
 	double		ratio;
 	double		spc_seq_page_cost;
 	Relation	index;
@@ -90,10 +114,11 @@ ivfflatcostestimate(PlannerInfo *root, IndexPath *path, double loop_count,
 
 	index = index_open(path->indexinfo->indexoid, NoLock);
 	IvfflatGetMetaPageInfo(index, &lists, NULL);
+	probes = IvfflatGetProbes(index, lists);
 	index_close(index, NoLock);
 
 	/* Get the ratio of lists that we need to visit */
-	ratio = ((double) ivfflat_probes) / lists;
+	ratio = ((double) probes) / lists;
 	if (ratio > 1.0)
 		ratio = 1.0;
 
@@ -146,6 +171,8 @@ ivfflatoptions(Datum reloptions, bool validate)
 {
 	static const relopt_parse_elt tab[] = {
 		{"lists", RELOPT_TYPE_INT, offsetof(IvfflatOptions, lists)},
+		{"prefix_dimensions", RELOPT_TYPE_INT, offsetof(IvfflatOptions, prefixDimensions)},
+		{"calibrate", RELOPT_TYPE_BOOL, offsetof(IvfflatOptions, calibrate)},
 	};
 
 #if PG_VERSION_NUM >= 130000
@@ -215,6 +242,9 @@ ivfflathandler(PG_FUNCTION_ARGS)
 	amroutine->ambuild = ivfflatbuild;
 	amroutine->ambuildempty = ivfflatbuildempty;
 	amroutine->aminsert = ivfflatinsert;
+#if PG_VERSION_NUM >= 170000
+	amroutine->aminsertcleanup = ivfflatinsertcleanup;
+#endif
 	amroutine->ambulkdelete = ivfflatbulkdelete;
 	amroutine->amvacuumcleanup = ivfflatvacuumcleanup;
 	amroutine->amcanreturn = NULL;	/* tuple not included in heapsort */
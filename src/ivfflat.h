@@ -9,6 +9,10 @@
 #include "lib/pairingheap.h"
 #include "nodes/execnodes.h"
 #include "port.h"				/* for random() */
+#include "portability/instr_time.h"
+#include "lockstats.h"
+#include "recall.h"
+#include "scancache.h"
 #include "utils/sampling.h"
 #include "utils/tuplesort.h"
 #include "vector.h"
@@ -17,10 +21,6 @@
 #include "common/pg_prng.h"
 #endif
 
-#ifdef IVFFLAT_BENCH
-#include "portability/instr_time.h"
-#endif
-
 #define IVFFLAT_MAX_DIM 2000
 
 /* Support functions */
@@ -43,12 +43,23 @@
 #define IVFFLAT_MIN_LISTS		1
 #define IVFFLAT_MAX_LISTS		32768
 #define IVFFLAT_DEFAULT_PROBES	1
+#define IVFFLAT_DEFAULT_PREFIX_DIMENSIONS	0
+#define IVFFLAT_DEFAULT_CALIBRATE	false
+
+/* Calibration for target recall */
+#define IVFFLAT_CALIBRATION_QUERIES	50
+#define IVFFLAT_CALIBRATION_K	10
+#define IVFFLAT_CALIBRATION_STEPS	16
+#define IvfflatCalibrationProbes(step, lists) Min(1 << (step), lists)
 
 /* Build phases */
 /* PROGRESS_CREATEIDX_SUBPHASE_INITIALIZE is 1 */
 #define PROGRESS_IVFFLAT_PHASE_KMEANS	2
 #define PROGRESS_IVFFLAT_PHASE_ASSIGN	3
 #define PROGRESS_IVFFLAT_PHASE_LOAD		4
+#define PROGRESS_IVFFLAT_PHASE_SAMPLE	5
+#define PROGRESS_IVFFLAT_PHASE_SORT		6
+#define PROGRESS_IVFFLAT_PHASE_CALIBRATE	7
 
 #define IVFFLAT_LIST_SIZE(size)	(offsetof(IvfflatListData, center) + size)
 
@@ -80,6 +91,7 @@
 
 /* Variables */
 extern int	ivfflat_probes;
+extern double ivfflat_target_recall;
 
 typedef struct VectorArrayData
 {
@@ -103,6 +115,8 @@ typedef struct IvfflatOptions
 {
 	int32		vl_len_;		/* varlena header (do not touch directly!) */
 	int			lists;			/* number of lists */
+	int			prefixDimensions;	/* number of dimensions to index */
+	bool		calibrate;		/* estimate recall at build time */
 }			IvfflatOptions;
 
 typedef struct IvfflatSpool
@@ -156,6 +170,7 @@ typedef struct IvfflatTypeInfo
 	Size		(*itemSize) (int dimensions);
 	void		(*updateCenter) (Pointer v, int dimensions, float *x);
 	void		(*sumCenter) (Pointer v, float *x);
+	Datum		(*subvector) (PG_FUNCTION_ARGS);
 }			IvfflatTypeInfo;
 
 typedef struct IvfflatBuildState
@@ -168,6 +183,7 @@ typedef struct IvfflatBuildState
 
 	/* Settings */
 	int			dimensions;
+	int			prefixDimensions;
 	int			lists;
 
 	/* Statistics */
@@ -179,6 +195,7 @@ typedef struct IvfflatBuildState
 	FmgrInfo   *normprocinfo;
 	FmgrInfo   *kmeansnormprocinfo;
 	Oid			collation;
+	BoundedDistanceFunc boundedDistance;
 
 	/* Variables */
 	VectorArray samples;
@@ -204,6 +221,11 @@ typedef struct IvfflatBuildState
 	/* Memory */
 	MemoryContext tmpCtx;
 
+	/* Timing */
+	int			phase;
+	instr_time	phaseStart;
+	double		phaseTuples;
+
 	/* Parallel builds */
 	IvfflatLeader *ivfleader;
 }			IvfflatBuildState;
@@ -214,6 +236,7 @@ typedef struct IvfflatMetaPageData
 	uint32		version;
 	uint16		dimensions;
 	uint16		lists;
+	float		calibration[IVFFLAT_CALIBRATION_STEPS];	/* recall for each probes step, 0 if unknown */
 }			IvfflatMetaPageData;
 
 typedef IvfflatMetaPageData * IvfflatMetaPage;
@@ -248,6 +271,7 @@ typedef struct IvfflatScanOpaqueData
 	const		IvfflatTypeInfo *typeInfo;
 	int			probes;
 	int			dimensions;
+	int			prefixDimensions;
 	bool		first;
 
 	/* Sorting */
@@ -256,10 +280,21 @@ typedef struct IvfflatScanOpaqueData
 	TupleTableSlot *slot;
 	bool		isnull;
 
+	/* Previously returned index TID */
+	ItemPointerData priorIndexTid;
+	XLogRecPtr	searchLsn;
+
+	/* Cached results */
+	ScanCacheState *cache;
+
+	/* Recall monitoring */
+	RecallSampleState *recall;
+
 	/* Support functions */
 	FmgrInfo   *procinfo;
 	FmgrInfo   *normprocinfo;
 	Oid			collation;
+	BoundedDistanceFunc boundedDistance;
 	Datum		(*distfunc) (FmgrInfo *flinfo, Oid collation, Datum arg1, Datum arg2);
 
 	/* Lists */
@@ -289,11 +324,16 @@ VectorArraySet(VectorArray arr, int offset, Pointer val)
 VectorArray VectorArrayInit(int maxlen, int dimensions, Size itemsize);
 void		VectorArrayFree(VectorArray arr);
 void		IvfflatKmeans(Relation index, VectorArray samples, VectorArray centers, const IvfflatTypeInfo * typeInfo);
+void		IvfflatKmeansWithProcs(VectorArray samples, VectorArray centers, FmgrInfo *procinfo, FmgrInfo *normprocinfo, FmgrInfo *checkprocinfo, Oid collation, const IvfflatTypeInfo * typeInfo);
 FmgrInfo   *IvfflatOptionalProcInfo(Relation index, uint16 procnum);
 Datum		IvfflatNormValue(const IvfflatTypeInfo * typeInfo, Oid collation, Datum value);
+Datum		IvfflatPrefixValue(const IvfflatTypeInfo * typeInfo, int prefixDimensions, Datum value);
 bool		IvfflatCheckNorm(FmgrInfo *procinfo, Oid collation, Datum value);
 int			IvfflatGetLists(Relation index);
+int			IvfflatGetPrefixDimensions(Relation index);
+bool		IvfflatGetCalibrate(Relation index);
 void		IvfflatGetMetaPageInfo(Relation index, int *lists, int *dimensions);
+int			IvfflatGetProbes(Relation index, int lists);
 void		IvfflatUpdateList(Relation index, ListInfo listInfo, BlockNumber insertPage, BlockNumber originalInsertPage, BlockNumber startPage, ForkNumber forkNum);
 void		IvfflatCommitBuffer(Buffer buf, GenericXLogState *state);
 void		IvfflatAppendPage(Relation index, Buffer *buf, Page *page, GenericXLogState **state, ForkNumber forkNum);
@@ -302,10 +342,12 @@ void		IvfflatInitPage(Buffer buf, Page page);
 void		IvfflatInitRegisterPage(Relation index, Buffer *buf, Page *page, GenericXLogState **state);
 void		IvfflatInit(void);
 const		IvfflatTypeInfo *IvfflatGetTypeInfo(Relation index);
+const		IvfflatTypeInfo *IvfflatGetVectorTypeInfo(void);
 PGDLLEXPORT void IvfflatParallelBuildMain(dsm_segment *seg, shm_toc *toc);
 
 /* Index access methods */
 IndexBuildResult *ivfflatbuild(Relation heap, Relation index, IndexInfo *indexInfo);
+char	   *ivfflatbuildphasename(int64 phasenum);
 void		ivfflatbuildempty(Relation index);
 bool		ivfflatinsert(Relation index, Datum *values, bool *isnull, ItemPointer heap_tid, Relation heap, IndexUniqueCheck checkUnique
 #if PG_VERSION_NUM >= 140000
@@ -313,6 +355,9 @@ bool		ivfflatinsert(Relation index, Datum *values, bool *isnull, ItemPointer hea
 #endif
 						  ,IndexInfo *indexInfo
 );
+#if PG_VERSION_NUM >= 170000
+void		ivfflatinsertcleanup(Relation index, IndexInfo *indexInfo);
+#endif
 IndexBulkDeleteResult *ivfflatbulkdelete(IndexVacuumInfo *info, IndexBulkDeleteResult *stats, IndexBulkDeleteCallback callback, void *callback_state);
 IndexBulkDeleteResult *ivfflatvacuumcleanup(IndexVacuumInfo *info, IndexBulkDeleteResult *stats);
 IndexScanDesc ivfflatbeginscan(Relation index, int nkeys, int norderbys);
@@ -4,10 +4,50 @@
 
 #include "access/generic_xlog.h"
 #include "ivfflat.h"
+#include "miscadmin.h"
 #include "storage/bufmgr.h"
 #include "storage/lmgr.h"
 #include "utils/memutils.h"
 
+#if PG_VERSION_NUM >= 170000
+/*
+ * Buffer for tuples inserted during the validation phase of
+ * CREATE INDEX CONCURRENTLY and REINDEX CONCURRENTLY
+ */
+typedef struct IvfflatBufferedTuple
+{
+	int			list;
+	IndexTuple	itup;
+}			IvfflatBufferedTuple;
+
+typedef struct IvfflatInsertBufferData
+{
+	/* Support functions */
+	const		IvfflatTypeInfo *typeInfo;
+	FmgrInfo   *procinfo;
+	FmgrInfo   *normprocinfo;
+	Oid			collation;
+	BoundedDistanceFunc boundedDistance;
+	int			prefixDimensions;
+
+	/* Lists */
+	int			lists;
+	ListInfo   *listInfo;
+	Datum	   *centers;
+
+	/* Tuples */
+	IvfflatBufferedTuple *tuples;
+	int			ntuples;
+	int			maxtuples;
+
+	/* Memory */
+	MemoryContext tupleCtx;
+	MemoryContext tmpCtx;
+}			IvfflatInsertBufferData;
+
+typedef IvfflatInsertBufferData * IvfflatInsertBuffer;
+#endif
+
 /*
  * Find the list that minimizes the distance function
  */
@@ -18,6 +58,7 @@ FindInsertPage(Relation index, Datum *values, BlockNumber *insertPage, ListInfo
 	BlockNumber nextblkno = IVFFLAT_HEAD_BLKNO;
 	FmgrInfo   *procinfo;
 	Oid			collation;
+	BoundedDistanceFunc boundedDistance;
 
 	/* Avoid compiler warning */
 	listInfo->blkno = nextblkno;
@@ -25,6 +66,7 @@ FindInsertPage(Relation index, Datum *values, BlockNumber *insertPage, ListInfo
 
 	procinfo = index_getprocinfo(index, 1, IVFFLAT_DISTANCE_PROC);
 	collation = index->rd_indcollation[0];
+	boundedDistance = GetBoundedDistanceFunc(procinfo);
 
 	/* Search all list pages */
 	while (BlockNumberIsValid(nextblkno))
@@ -44,7 +86,12 @@ FindInsertPage(Relation index, Datum *values, BlockNumber *insertPage, ListInfo
 			double		distance;
 
 			list = (IvfflatList) PageGetItem(cpage, PageGetItemId(cpage, offno));
-			distance = DatumGetFloat8(FunctionCall2Coll(procinfo, collation, values[0], PointerGetDatum(&list->center)));
+
+			/* Stop early if not closer */
+			if (boundedDistance != NULL)
+				distance = boundedDistance(values[0], PointerGetDatum(&list->center), minDistance);
+			else
+				distance = DatumGetFloat8(FunctionCall2Coll(procinfo, collation, values[0], PointerGetDatum(&list->center)));
 
 			if (distance < minDistance || !BlockNumberIsValid(*insertPage))
 			{
@@ -61,6 +108,108 @@ FindInsertPage(Relation index, Datum *values, BlockNumber *insertPage, ListInfo
 	}
 }
 
+/*
+ * Add tuples to a list
+ *
+ * Tuples that fit on the same page share a WAL record
+ */
+static void
+AddTuplesToList(Relation index, IndexTuple *itups, int ntuples, BlockNumber insertPage, ListInfo listInfo)
+{
+	BlockNumber originalInsertPage = insertPage;
+	Buffer		buf;
+	Page		page;
+	GenericXLogState *state;
+	bool		pageChanged = false;
+
+	buf = ReadBuffer(index, insertPage);
+	LockStatsLockBuffer(buf, VECTOR_LOCK_IVFFLAT_INSERT);
+
+	state = GenericXLogStart(index);
+	page = GenericXLogRegisterBuffer(state, buf, 0);
+
+	for (int i = 0; i < ntuples; i++)
+	{
+		IndexTuple	itup = itups[i];
+		Size		itemsz = MAXALIGN(IndexTupleSize(itup));
+
+		Assert(itemsz <= BLCKSZ - MAXALIGN(SizeOfPageHeaderData) - MAXALIGN(sizeof(IvfflatPageOpaqueData)) - sizeof(ItemIdData));
+
+		/* Find a page to insert the item */
+		while (PageGetFreeSpace(page) < itemsz)
+		{
+			insertPage = IvfflatPageGetOpaque(page)->nextblkno;
+
+			if (BlockNumberIsValid(insertPage))
+			{
+				/* Keep items already added to this page */
+				if (pageChanged)
+					IvfflatCommitBuffer(buf, state);
+				else
+				{
+					GenericXLogAbort(state);
+					UnlockReleaseBuffer(buf);
+				}
+
+				/* Move to next page */
+				buf = ReadBuffer(index, insertPage);
+				LockStatsLockBuffer(buf, VECTOR_LOCK_IVFFLAT_INSERT);
+			}
+			else
+			{
+				Buffer		newbuf;
+				Page		newpage;
+
+				/* Add a new page */
+				LockRelationForExtension(index, ExclusiveLock);
+				newbuf = IvfflatNewBuffer(index, MAIN_FORKNUM);
+				UnlockRelationForExtension(index, ExclusiveLock);
+
+				/* Init new page */
+				newpage = GenericXLogRegisterBuffer(state, newbuf, GENERIC_XLOG_FULL_IMAGE);
+				IvfflatInitPage(newbuf, newpage);
+
+				/* Update insert page */
+				insertPage = BufferGetBlockNumber(newbuf);
+
+				/* Update previous buffer */
+				IvfflatPageGetOpaque(page)->nextblkno = insertPage;
+
+				/* Commit */
+				GenericXLogFinish(state);
+
+				/* Unlock previous buffer */
+				UnlockReleaseBuffer(buf);
+
+				buf = newbuf;
+			}
+
+			/* Prepare buffer */
+			state = GenericXLogStart(index);
+			page = GenericXLogRegisterBuffer(state, buf, 0);
+			pageChanged = false;
+		}
+
+		/* Add to next offset */
+		if (PageAddItem(page, (Item) itup, itemsz, InvalidOffsetNumber, false, false) == InvalidOffsetNumber)
+			elog(ERROR, "failed to add index item to \"%s\"", RelationGetRelationName(index));
+
+		pageChanged = true;
+	}
+
+	if (pageChanged)
+		IvfflatCommitBuffer(buf, state);
+	else
+	{
+		GenericXLogAbort(state);
+		UnlockReleaseBuffer(buf);
+	}
+
+	/* Update the insert page */
+	if (insertPage != originalInsertPage)
+		IvfflatUpdateList(index, listInfo, insertPage, originalInsertPage, InvalidBlockNumber, MAIN_FORKNUM);
+}
+
 /*
  * Insert a tuple into the index
  */
@@ -71,17 +220,18 @@ InsertTuple(Relation index, Datum *values, bool *isnull, ItemPointer heap_tid, R
 	IndexTuple	itup;
 	Datum		value;
 	FmgrInfo   *normprocinfo;
-	Buffer		buf;
-	Page		page;
-	GenericXLogState *state;
-	Size		itemsz;
+	int			prefixDimensions;
 	BlockNumber insertPage = InvalidBlockNumber;
 	ListInfo	listInfo;
-	BlockNumber originalInsertPage;
 
 	/* Detoast once for all calls */
 	value = PointerGetDatum(PG_DETOAST_DATUM(values[0]));
 
+	/* Index prefix if needed */
+	prefixDimensions = IvfflatGetPrefixDimensions(index);
+	if (prefixDimensions > 0)
+		value = IvfflatPrefixValue(typeInfo, prefixDimensions, value);
+
 	/* Normalize if needed */
 	normprocinfo = IvfflatOptionalProcInfo(index, IVFFLAT_NORM_PROC);
 	if (normprocinfo != NULL)
@@ -95,82 +245,244 @@ InsertTuple(Relation index, Datum *values, bool *isnull, ItemPointer heap_tid, R
 	}
 
 	/* Find the insert page - sets the page and list info */
-	FindInsertPage(index, values, &insertPage, &listInfo);
+	FindInsertPage(index, &value, &insertPage, &listInfo);
 	Assert(BlockNumberIsValid(insertPage));
-	originalInsertPage = insertPage;
 
 	/* Form tuple */
 	itup = index_form_tuple(RelationGetDescr(index), &value, isnull);
 	itup->t_tid = *heap_tid;
 
-	/* Get tuple size */
-	itemsz = MAXALIGN(IndexTupleSize(itup));
-	Assert(itemsz <= BLCKSZ - MAXALIGN(SizeOfPageHeaderData) - MAXALIGN(sizeof(IvfflatPageOpaqueData)) - sizeof(ItemIdData));
+	AddTuplesToList(index, &itup, 1, insertPage, listInfo);
+}
 
-	/* Find a page to insert the item */
-	for (;;)
-	{
-		buf = ReadBuffer(index, insertPage);
-		LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
+#if PG_VERSION_NUM >= 170000
+/*
+ * Create the insert buffer
+ *
+ * List centers do not change after the index is built, so they are read once
+ */
+static IvfflatInsertBuffer
+CreateInsertBuffer(Relation index, IndexInfo *indexInfo)
+{
+	IvfflatInsertBuffer buffer;
+	MemoryContext oldCtx = MemoryContextSwitchTo(indexInfo->ii_Context);
+	BlockNumber nextblkno = IVFFLAT_HEAD_BLKNO;
+	int			listCount = 0;
 
-		state = GenericXLogStart(index);
-		page = GenericXLogRegisterBuffer(state, buf, 0);
+	buffer = palloc0(sizeof(IvfflatInsertBufferData));
+	buffer->typeInfo = IvfflatGetTypeInfo(index);
+	buffer->procinfo = index_getprocinfo(index, 1, IVFFLAT_DISTANCE_PROC);
+	buffer->boundedDistance = GetBoundedDistanceFunc(buffer->procinfo);
+	buffer->normprocinfo = IvfflatOptionalProcInfo(index, IVFFLAT_NORM_PROC);
+	buffer->collation = index->rd_indcollation[0];
+	buffer->prefixDimensions = IvfflatGetPrefixDimensions(index);
 
-		if (PageGetFreeSpace(page) >= itemsz)
-			break;
+	IvfflatGetMetaPageInfo(index, &buffer->lists, NULL);
+	buffer->listInfo = palloc(sizeof(ListInfo) * buffer->lists);
+	buffer->centers = palloc(sizeof(Datum) * buffer->lists);
 
-		insertPage = IvfflatPageGetOpaque(page)->nextblkno;
+	/* Read all list pages */
+	while (BlockNumberIsValid(nextblkno))
+	{
+		Buffer		cbuf;
+		Page		cpage;
+		OffsetNumber maxoffno;
+
+		cbuf = ReadBuffer(index, nextblkno);
+		LockBuffer(cbuf, BUFFER_LOCK_SHARE);
+		cpage = BufferGetPage(cbuf);
+		maxoffno = PageGetMaxOffsetNumber(cpage);
 
-		if (BlockNumberIsValid(insertPage))
+		for (OffsetNumber offno = FirstOffsetNumber; offno <= maxoffno; offno = OffsetNumberNext(offno))
 		{
-			/* Move to next page */
-			GenericXLogAbort(state);
-			UnlockReleaseBuffer(buf);
+			IvfflatList list = (IvfflatList) PageGetItem(cpage, PageGetItemId(cpage, offno));
+			Size		size = VARSIZE_ANY(&list->center);
+			Pointer		center;
+
+			if (listCount >= buffer->lists)
+				elog(ERROR, "unexpected number of lists in \"%s\"", RelationGetRelationName(index));
+
+			center = palloc(size);
+			memcpy(center, &list->center, size);
+
+			buffer->listInfo[listCount].blkno = nextblkno;
+			buffer->listInfo[listCount].offno = offno;
+			buffer->centers[listCount] = PointerGetDatum(center);
+			listCount++;
 		}
-		else
-		{
-			Buffer		newbuf;
-			Page		newpage;
 
-			/* Add a new page */
-			LockRelationForExtension(index, ExclusiveLock);
-			newbuf = IvfflatNewBuffer(index, MAIN_FORKNUM);
-			UnlockRelationForExtension(index, ExclusiveLock);
+		nextblkno = IvfflatPageGetOpaque(cpage)->nextblkno;
 
-			/* Init new page */
-			newpage = GenericXLogRegisterBuffer(state, newbuf, GENERIC_XLOG_FULL_IMAGE);
-			IvfflatInitPage(newbuf, newpage);
+		UnlockReleaseBuffer(cbuf);
+	}
 
-			/* Update insert page */
-			insertPage = BufferGetBlockNumber(newbuf);
+	buffer->lists = listCount;
 
-			/* Update previous buffer */
-			IvfflatPageGetOpaque(page)->nextblkno = insertPage;
+	buffer->maxtuples = 1024;
+	buffer->tuples = palloc(sizeof(IvfflatBufferedTuple) * buffer->maxtuples);
 
-			/* Commit */
-			GenericXLogFinish(state);
+	buffer->tupleCtx = AllocSetContextCreate(indexInfo->ii_Context,
+											 "Ivfflat insert buffer context",
+											 ALLOCSET_DEFAULT_SIZES);
+	buffer->tmpCtx = AllocSetContextCreate(indexInfo->ii_Context,
+										   "Ivfflat insert temporary context",
+										   ALLOCSET_DEFAULT_SIZES);
 
-			/* Unlock previous buffer */
-			UnlockReleaseBuffer(buf);
+	MemoryContextSwitchTo(oldCtx);
 
-			/* Prepare new buffer */
-			state = GenericXLogStart(index);
-			buf = newbuf;
-			page = GenericXLogRegisterBuffer(state, buf, 0);
-			break;
+	return buffer;
+}
+
+/*
+ * Compare buffered tuples by list, then by heap TID
+ */
+static int
+CompareBufferedTuples(const void *a, const void *b)
+{
+	const		IvfflatBufferedTuple *ta = (const IvfflatBufferedTuple *) a;
+	const		IvfflatBufferedTuple *tb = (const IvfflatBufferedTuple *) b;
+
+	if (ta->list != tb->list)
+		return ta->list < tb->list ? -1 : 1;
+
+	return ItemPointerCompare(&ta->itup->t_tid, &tb->itup->t_tid);
+}
+
+/*
+ * Get the current insert page for a list
+ */
+static BlockNumber
+GetListInsertPage(Relation index, ListInfo listInfo)
+{
+	Buffer		buf;
+	Page		page;
+	IvfflatList list;
+	BlockNumber insertPage;
+
+	buf = ReadBuffer(index, listInfo.blkno);
+	LockBuffer(buf, BUFFER_LOCK_SHARE);
+	page = BufferGetPage(buf);
+	list = (IvfflatList) PageGetItem(page, PageGetItemId(page, listInfo.offno));
+	insertPage = list->insertPage;
+	UnlockReleaseBuffer(buf);
+
+	return insertPage;
+}
+
+/*
+ * Flush the insert buffer, appending tuples one list at a time
+ */
+static void
+FlushInsertBuffer(Relation index, IvfflatInsertBuffer buffer)
+{
+	MemoryContext oldCtx = MemoryContextSwitchTo(buffer->tmpCtx);
+	IndexTuple *itups = palloc(sizeof(IndexTuple) * buffer->ntuples);
+	int			i = 0;
+
+	/* Invalidate scan results cached after tuples were buffered */
+	ScanCacheInvalidate(index);
+
+	qsort(buffer->tuples, buffer->ntuples, sizeof(IvfflatBufferedTuple), CompareBufferedTuples);
+
+	for (int j = 0; j < buffer->ntuples; j++)
+		itups[j] = buffer->tuples[j].itup;
+
+	LockStatsBegin(index);
+
+	while (i < buffer->ntuples)
+	{
+		int			list = buffer->tuples[i].list;
+		int			start = i;
+		ListInfo	listInfo = buffer->listInfo[list];
+
+		while (i < buffer->ntuples && buffer->tuples[i].list == list)
+			i++;
+
+		AddTuplesToList(index, itups + start, i - start, GetListInsertPage(index, listInfo), listInfo);
+	}
+
+	LockStatsEnd();
+
+	ScanCacheInvalidate(index);
+
+	MemoryContextSwitchTo(oldCtx);
+	MemoryContextReset(buffer->tmpCtx);
+	MemoryContextReset(buffer->tupleCtx);
+	buffer->ntuples = 0;
+}
+
+/*
+ * Add a tuple to the insert buffer
+ */
+static void
+BufferTuple(Relation index, Datum *values, bool *isnull, ItemPointer heap_tid, IvfflatInsertBuffer buffer)
+{
+	MemoryContext oldCtx = MemoryContextSwitchTo(buffer->tmpCtx);
+	Datum		value;
+	double		minDistance = DBL_MAX;
+	int			closest = 0;
+	IvfflatBufferedTuple *tuple;
+
+	/* Detoast once for all calls */
+	value = PointerGetDatum(PG_DETOAST_DATUM(values[0]));
+
+	/* Index prefix if needed */
+	if (buffer->prefixDimensions > 0)
+		value = IvfflatPrefixValue(buffer->typeInfo, buffer->prefixDimensions, value);
+
+	/* Normalize if needed */
+	if (buffer->normprocinfo != NULL)
+	{
+		if (!IvfflatCheckNorm(buffer->normprocinfo, buffer->collation, value))
+		{
+			MemoryContextSwitchTo(oldCtx);
+			MemoryContextReset(buffer->tmpCtx);
+			return;
 		}
+
+		value = IvfflatNormValue(buffer->typeInfo, buffer->collation, value);
 	}
 
-	/* Add to next offset */
-	if (PageAddItem(page, (Item) itup, itemsz, InvalidOffsetNumber, false, false) == InvalidOffsetNumber)
-		elog(ERROR, "failed to add index item to \"%s\"", RelationGetRelationName(index));
+	/* Find the closest list */
+	for (int i = 0; i < buffer->lists; i++)
+	{
+		double		distance;
+
+		/* Stop early if not closer */
+		if (buffer->boundedDistance != NULL)
+			distance = buffer->boundedDistance(value, buffer->centers[i], minDistance);
+		else
+			distance = DatumGetFloat8(FunctionCall2Coll(buffer->procinfo, buffer->collation, value, buffer->centers[i]));
 
-	IvfflatCommitBuffer(buf, state);
+		if (distance < minDistance)
+		{
+			closest = i;
+			minDistance = distance;
+		}
+	}
 
-	/* Update the insert page */
-	if (insertPage != originalInsertPage)
-		IvfflatUpdateList(index, listInfo, insertPage, originalInsertPage, InvalidBlockNumber, MAIN_FORKNUM);
+	/* Grow array if needed */
+	if (buffer->ntuples == buffer->maxtuples)
+	{
+		buffer->maxtuples *= 2;
+		buffer->tuples = repalloc(buffer->tuples, sizeof(IvfflatBufferedTuple) * buffer->maxtuples);
+	}
+
+	/* Form tuple */
+	MemoryContextSwitchTo(buffer->tupleCtx);
+	tuple = &buffer->tuples[buffer->ntuples++];
+	tuple->list = closest;
+	tuple->itup = index_form_tuple(RelationGetDescr(index), &value, isnull);
+	tuple->itup->t_tid = *heap_tid;
+
+	MemoryContextSwitchTo(oldCtx);
+	MemoryContextReset(buffer->tmpCtx);
+
+	/* Flush if buffer exceeds maintenance_work_mem */
+	if (MemoryContextMemAllocated(buffer->tupleCtx, false) + sizeof(IvfflatBufferedTuple) * buffer->maxtuples >= (Size) maintenance_work_mem * 1024L)
+		FlushInsertBuffer(index, buffer);
 }
+#endif
 
 /*
  * Insert a tuple into the index
@@ -191,6 +503,21 @@ ivfflatinsert(Relation index, Datum *values, bool *isnull, ItemPointer heap_tid,
 	if (isnull[0])
 		return false;
 
+	/* Invalidate cached scan results (again after the insert) */
+	ScanCacheInvalidate(index);
+
+#if PG_VERSION_NUM >= 170000
+	/* Buffer tuples during the validation phase of concurrent builds */
+	if (indexInfo->ii_Concurrent)
+	{
+		if (indexInfo->ii_AmCache == NULL)
+			indexInfo->ii_AmCache = CreateInsertBuffer(index, indexInfo);
+
+		BufferTuple(index, values, isnull, heap_tid, (IvfflatInsertBuffer) indexInfo->ii_AmCache);
+		return false;
+	}
+#endif
+
 	/*
 	 * Use memory context since detoast, IvfflatNormValue, and
 	 * index_form_tuple can allocate
@@ -201,7 +528,11 @@ ivfflatinsert(Relation index, Datum *values, bool *isnull, ItemPointer heap_tid,
 	oldCtx = MemoryContextSwitchTo(insertCtx);
 
 	/* Insert tuple */
+	LockStatsBegin(index);
 	InsertTuple(index, values, isnull, heap_tid, heap);
+	LockStatsEnd();
+
+	ScanCacheInvalidate(index);
 
 	/* Delete memory context */
 	MemoryContextSwitchTo(oldCtx);
@@ -209,3 +540,24 @@ ivfflatinsert(Relation index, Datum *values, bool *isnull, ItemPointer heap_tid,
 
 	return false;
 }
+
+#if PG_VERSION_NUM >= 170000
+/*
+ * Flush buffered tuples
+ */
+void
+ivfflatinsertcleanup(Relation index, IndexInfo *indexInfo)
+{
+	IvfflatInsertBuffer buffer = (IvfflatInsertBuffer) indexInfo->ii_AmCache;
+
+	if (buffer == NULL)
+		return;
+
+	if (buffer->ntuples > 0)
+		FlushInsertBuffer(index, buffer);
+
+	MemoryContextDelete(buffer->tupleCtx);
+	MemoryContextDelete(buffer->tmpCtx);
+	indexInfo->ii_AmCache = NULL;
+}
+#endif
@@ -7,11 +7,18 @@
 #include "halfutils.h"
 #include "halfvec.h"
 #include "ivfflat.h"
+#include "libpq/pqformat.h"
 #include "miscadmin.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/datum.h"
 #include "utils/memutils.h"
 #include "vector.h"
+#include "vectortrace.h"
+
+#if PG_VERSION_NUM >= 160000
+#include "varatt.h"
+#endif
 
 /*
  * Initialize with kmeans++
@@ -19,18 +26,13 @@
  * https://theory.stanford.edu/~sergei/papers/kMeansPP-soda.pdf
  */
 static void
-InitCenters(Relation index, VectorArray samples, VectorArray centers, float *lowerBound)
+InitCenters(VectorArray samples, VectorArray centers, float *lowerBound, FmgrInfo *procinfo, Oid collation)
 {
-	FmgrInfo   *procinfo;
-	Oid			collation;
 	int64		j;
 	float	   *weight = palloc(samples->length * sizeof(float));
 	int			numCenters = centers->maxlen;
 	int			numSamples = samples->length;
 
-	procinfo = index_getprocinfo(index, 1, IVFFLAT_KMEANS_DISTANCE_PROC);
-	collation = index->rd_indcollation[0];
-
 	/* Choose an initial center uniformly at random */
 	VectorArraySet(centers, 0, VectorArrayGet(samples, RandomInt() % samples->length));
 	centers->length++;
@@ -120,11 +122,9 @@ NormCenters(const IvfflatTypeInfo * typeInfo, Oid collation, VectorArray centers
  * Quick approach if we have no data
  */
 static void
-RandomCenters(Relation index, VectorArray centers, const IvfflatTypeInfo * typeInfo)
+RandomCenters(VectorArray centers, FmgrInfo *normprocinfo, Oid collation, const IvfflatTypeInfo * typeInfo)
 {
 	int			dimensions = centers->dim;
-	FmgrInfo   *normprocinfo = IvfflatOptionalProcInfo(index, IVFFLAT_KMEANS_NORM_PROC);
-	Oid			collation = index->rd_indcollation[0];
 	float	   *x = (float *) palloc(sizeof(float) * dimensions);
 
 	/* Fill with random data */
@@ -251,6 +251,20 @@ ComputeNewCenters(VectorArray samples, float *agg, VectorArray newCenters, int *
 		NormCenters(typeInfo, collation, newCenters);
 }
 
+/*
+ * Get the sum of distances from samples to their centers
+ */
+static double
+GetInertia(VectorArray samples, VectorArray centers, int *closestCenters, FmgrInfo *procinfo, Oid collation)
+{
+	double		inertia = 0;
+
+	for (int j = 0; j < samples->length; j++)
+		inertia += DatumGetFloat8(FunctionCall2Coll(procinfo, collation, PointerGetDatum(VectorArrayGet(samples, j)), PointerGetDatum(VectorArrayGet(centers, closestCenters[j]))));
+
+	return inertia;
+}
+
 /*
  * Use Elkan for performance. This requires distance function to satisfy triangle inequality.
  *
@@ -260,11 +274,8 @@ ComputeNewCenters(VectorArray samples, float *agg, VectorArray newCenters, int *
  * https://www.aaai.org/Papers/ICML/2003/ICML03-022.pdf
  */
 static void
-ElkanKmeans(Relation index, VectorArray samples, VectorArray centers, const IvfflatTypeInfo * typeInfo)
+ElkanKmeans(VectorArray samples, VectorArray centers, FmgrInfo *procinfo, FmgrInfo *normprocinfo, Oid collation, const IvfflatTypeInfo * typeInfo)
 {
-	FmgrInfo   *procinfo;
-	FmgrInfo   *normprocinfo;
-	Oid			collation;
 	int			dimensions = centers->dim;
 	int			numCenters = centers->maxlen;
 	int			numSamples = samples->length;
@@ -306,11 +317,6 @@ ElkanKmeans(Relation index, VectorArray samples, VectorArray centers, const Ivff
 	if (numCenters * numCenters > INT_MAX)
 		elog(ERROR, "Indexing overflow detected. Please report a bug.");
 
-	/* Set support functions */
-	procinfo = index_getprocinfo(index, 1, IVFFLAT_KMEANS_DISTANCE_PROC);
-	normprocinfo = IvfflatOptionalProcInfo(index, IVFFLAT_KMEANS_NORM_PROC);
-	collation = index->rd_indcollation[0];
-
 	/* Allocate space */
 	/* Use float instead of double to save memory */
 	agg = palloc(aggSize);
@@ -331,7 +337,7 @@ ElkanKmeans(Relation index, VectorArray samples, VectorArray centers, const Ivff
 #endif
 
 	/* Pick initial centers */
-	InitCenters(index, samples, centers, lowerBound);
+	InitCenters(samples, centers, lowerBound, procinfo, collation);
 
 	/* Assign each x to its closest initial center c(x) = argmin d(x,c) */
 	for (int64 j = 0; j < numSamples; j++)
@@ -492,6 +498,11 @@ ElkanKmeans(Relation index, VectorArray samples, VectorArray centers, const Ivff
 		for (int j = 0; j < numCenters; j++)
 			VectorArraySet(centers, j, VectorArrayGet(newCenters, j));
 
+		TRACE_PGVECTOR_IVFFLAT_KMEANS_ITERATION(iteration, changes);
+
+		/* Inertia is only computed when the message is logged */
+		ereport(DEBUG1, (errmsg("k-means iteration %d: %d changes, inertia %.3e", iteration + 1, changes, GetInertia(samples, centers, closestCenters, procinfo, collation))));
+
 		if (changes == 0 && iteration != 0)
 			break;
 	}
@@ -528,12 +539,8 @@ CheckElements(VectorArray centers, const IvfflatTypeInfo * typeInfo)
  * Ensure no zero vectors for cosine distance
  */
 static void
-CheckNorms(VectorArray centers, Relation index)
+CheckNorms(VectorArray centers, FmgrInfo *normprocinfo, Oid collation)
 {
-	/* Check NORM_PROC instead of KMEANS_NORM_PROC */
-	FmgrInfo   *normprocinfo = IvfflatOptionalProcInfo(index, IVFFLAT_NORM_PROC);
-	Oid			collation = index->rd_indcollation[0];
-
 	if (normprocinfo == NULL)
 		return;
 
@@ -550,21 +557,24 @@ CheckNorms(VectorArray centers, Relation index)
  * Detect issues with centers
  */
 static void
-CheckCenters(Relation index, VectorArray centers, const IvfflatTypeInfo * typeInfo)
+CheckCenters(VectorArray centers, FmgrInfo *checkprocinfo, Oid collation, const IvfflatTypeInfo * typeInfo)
 {
 	if (centers->length != centers->maxlen)
 		elog(ERROR, "Not enough centers. Please report a bug.");
 
 	CheckElements(centers, typeInfo);
-	CheckNorms(centers, index);
+	CheckNorms(centers, checkprocinfo, collation);
 }
 
 /*
- * Perform naive k-means centering
- * We use spherical k-means for inner product and cosine
+ * Perform k-means with the given support functions
+ *
+ * procinfo is the distance function, normprocinfo normalizes centers after
+ * each iteration, and checkprocinfo detects zero vectors for cosine distance
+ * (both optional)
  */
 void
-IvfflatKmeans(Relation index, VectorArray samples, VectorArray centers, const IvfflatTypeInfo * typeInfo)
+IvfflatKmeansWithProcs(VectorArray samples, VectorArray centers, FmgrInfo *procinfo, FmgrInfo *normprocinfo, FmgrInfo *checkprocinfo, Oid collation, const IvfflatTypeInfo * typeInfo)
 {
 	MemoryContext kmeansCtx = AllocSetContextCreate(CurrentMemoryContext,
 													"Ivfflat kmeans temporary context",
@@ -572,12 +582,454 @@ IvfflatKmeans(Relation index, VectorArray samples, VectorArray centers, const Iv
 	MemoryContext oldCtx = MemoryContextSwitchTo(kmeansCtx);
 
 	if (samples->length == 0)
-		RandomCenters(index, centers, typeInfo);
+		RandomCenters(centers, normprocinfo, collation, typeInfo);
 	else
-		ElkanKmeans(index, samples, centers, typeInfo);
+		ElkanKmeans(samples, centers, procinfo, normprocinfo, collation, typeInfo);
 
-	CheckCenters(index, centers, typeInfo);
+	CheckCenters(centers, checkprocinfo, collation, typeInfo);
 
 	MemoryContextSwitchTo(oldCtx);
 	MemoryContextDelete(kmeansCtx);
 }
+
+/*
+ * Perform naive k-means centering
+ * We use spherical k-means for inner product and cosine
+ */
+void
+IvfflatKmeans(Relation index, VectorArray samples, VectorArray centers, const IvfflatTypeInfo * typeInfo)
+{
+	FmgrInfo   *procinfo = index_getprocinfo(index, 1, IVFFLAT_KMEANS_DISTANCE_PROC);
+	FmgrInfo   *normprocinfo = IvfflatOptionalProcInfo(index, IVFFLAT_KMEANS_NORM_PROC);
+
+	/* Check NORM_PROC instead of KMEANS_NORM_PROC */
+	FmgrInfo   *checkprocinfo = IvfflatOptionalProcInfo(index, IVFFLAT_NORM_PROC);
+
+	IvfflatKmeansWithProcs(samples, centers, procinfo, normprocinfo, checkprocinfo, index->rd_indcollation[0], typeInfo);
+}
+
+/* Samples per center, same as index builds */
+#define KMEANS_SAMPLES_PER_CENTER 50
+
+typedef enum KmeansDistance
+{
+	KMEANS_L2,
+	KMEANS_INNER_PRODUCT,
+	KMEANS_COSINE
+}			KmeansDistance;
+
+typedef struct KmeansState
+{
+	int			k;
+	KmeansDistance distance;
+	Oid			typid;
+	int64		rows;			/* rows added, including ones not sampled */
+	VectorArray samples;		/* reservoir sample */
+}			KmeansState;
+
+PGDLLEXPORT Datum l2_distance(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum l2_normalize(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum vector_norm(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum vector_spherical_distance(PG_FUNCTION_ARGS);
+
+/*
+ * Get the distance from its name
+ */
+static KmeansDistance
+GetKmeansDistance(text *name)
+{
+	char	   *str = text_to_cstring(name);
+
+	if (strcmp(str, "l2") == 0)
+		return KMEANS_L2;
+
+	if (strcmp(str, "inner_product") == 0)
+		return KMEANS_INNER_PRODUCT;
+
+	if (strcmp(str, "cosine") == 0)
+		return KMEANS_COSINE;
+
+	ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("invalid distance: \"%s\"", str),
+			 errhint("Valid distances are \"l2\", \"inner_product\", and \"cosine\".")));
+}
+
+/*
+ * Initialize samples in the aggregate context
+ */
+static VectorArray
+InitSamples(MemoryContext aggContext, int k, int dimensions)
+{
+	const		IvfflatTypeInfo *typeInfo = IvfflatGetVectorTypeInfo();
+	int			maxlen = k * KMEANS_SAMPLES_PER_CENTER;
+	Size		itemsize = typeInfo->itemSize(dimensions);
+	Size		totalSize = VECTOR_ARRAY_SIZE(maxlen, itemsize);
+	MemoryContext oldCtx;
+	VectorArray samples;
+
+	/* Add one to error message to ceil */
+	if (totalSize > (Size) maintenance_work_mem * 1024L)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("memory required is %zu MB, maintenance_work_mem is %d MB",
+						totalSize / (1024 * 1024) + 1, maintenance_work_mem / 1024)));
+
+	oldCtx = MemoryContextSwitchTo(aggContext);
+	samples = VectorArrayInit(maxlen, dimensions, itemsize);
+	MemoryContextSwitchTo(oldCtx);
+
+	return samples;
+}
+
+/*
+ * Copy a state to the aggregate context
+ */
+static KmeansState *
+CopyKmeansState(MemoryContext aggContext, KmeansState * state)
+{
+	KmeansState *copy = MemoryContextAlloc(aggContext, sizeof(KmeansState));
+
+	*copy = *state;
+
+	if (state->samples != NULL)
+	{
+		copy->samples = InitSamples(aggContext, state->k, state->samples->dim);
+		copy->samples->length = state->samples->length;
+		memcpy(copy->samples->items, state->samples->items, state->samples->length * state->samples->itemsize);
+	}
+
+	return copy;
+}
+
+/*
+ * Swap two samples
+ */
+static void
+SwapSamples(VectorArray samples, int i, int j, Pointer tmp)
+{
+	memcpy(tmp, VectorArrayGet(samples, i), samples->itemsize);
+	memcpy(VectorArrayGet(samples, i), VectorArrayGet(samples, j), samples->itemsize);
+	memcpy(VectorArrayGet(samples, j), tmp, samples->itemsize);
+}
+
+/*
+ * Merge the samples of two states into the first
+ *
+ * Each state keeps a uniform sample of its rows, so the merged sample takes
+ * from each in proportion to the rows it has seen
+ */
+static void
+MergeSamples(KmeansState * state1, KmeansState * state2)
+{
+	VectorArray a = state1->samples;
+	VectorArray b = state2->samples;
+	int			maxlen = a->maxlen;
+	int			takeA;
+	int			takeB;
+	int		   *order;
+
+	if (a->dim != b->dim)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("expected %d dimensions, not %d", a->dim, b->dim)));
+
+	if (a->length + b->length <= maxlen)
+	{
+		takeA = a->length;
+		takeB = b->length;
+	}
+	else
+	{
+		double		fraction = (double) state2->rows / (state1->rows + state2->rows);
+
+		takeB = (int) rint(maxlen * fraction);
+		takeB = Max(takeB, maxlen - a->length);
+		takeB = Min(takeB, b->length);
+		takeA = maxlen - takeB;
+	}
+
+	/* Keep a random subset of the first sample */
+	if (takeA < a->length)
+	{
+		Pointer		tmp = palloc(a->itemsize);
+
+		for (int i = 0; i < takeA; i++)
+			SwapSamples(a, i, i + RandomInt() % (a->length - i), tmp);
+
+		pfree(tmp);
+		a->length = takeA;
+	}
+
+	/* Add a random subset of the second sample without modifying it */
+	order = palloc(sizeof(int) * b->length);
+	for (int i = 0; i < b->length; i++)
+		order[i] = i;
+
+	for (int i = 0; i < takeB; i++)
+	{
+		int			j = i + RandomInt() % (b->length - i);
+		int			tmp = order[i];
+
+		order[i] = order[j];
+		order[j] = tmp;
+
+		VectorArraySet(a, a->length++, VectorArrayGet(b, order[i]));
+	}
+
+	pfree(order);
+
+	state1->rows += state2->rows;
+}
+
+/*
+ * Add a value to the aggregate state
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(vector_kmeans_accum);
+Datum
+vector_kmeans_accum(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggContext;
+	KmeansState *state = PG_ARGISNULL(0) ? NULL : (KmeansState *) PG_GETARG_POINTER(0);
+	Vector	   *value;
+	VectorArray samples;
+
+	if (!AggCheckCallContext(fcinfo, &aggContext))
+		elog(ERROR, "vector_kmeans_accum called in non-aggregate context");
+
+	if (state == NULL)
+	{
+		if (PG_ARGISNULL(2) || PG_GETARG_INT32(2) < 1 || PG_GETARG_INT32(2) > IVFFLAT_MAX_LISTS)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("k must be between 1 and %d", IVFFLAT_MAX_LISTS)));
+
+		state = MemoryContextAllocZero(aggContext, sizeof(KmeansState));
+		state->k = PG_GETARG_INT32(2);
+		state->distance = PG_NARGS() > 3 && !PG_ARGISNULL(3) ? GetKmeansDistance(PG_GETARG_TEXT_PP(3)) : KMEANS_L2;
+		state->typid = get_fn_expr_argtype(fcinfo->flinfo, 1);
+	}
+
+	if (PG_ARGISNULL(1))
+		PG_RETURN_POINTER(state);
+
+	value = PG_GETARG_VECTOR_P(1);
+
+	if (state->samples == NULL)
+		state->samples = InitSamples(aggContext, state->k, value->dim);
+	else if (value->dim != state->samples->dim)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("expected %d dimensions, not %d", state->samples->dim, value->dim)));
+
+	/* Skip zero vectors and normalize for cosine distance like index builds */
+	if (state->distance == KMEANS_COSINE)
+	{
+		if (DatumGetFloat8(DirectFunctionCall1(vector_norm, PointerGetDatum(value))) == 0)
+			PG_RETURN_POINTER(state);
+
+		value = DatumGetVector(DirectFunctionCall1(l2_normalize, PointerGetDatum(value)));
+	}
+
+	state->rows++;
+	samples = state->samples;
+
+	/* Reservoir sampling */
+	if (samples->length < samples->maxlen)
+		VectorArraySet(samples, samples->length++, (Pointer) value);
+	else
+	{
+		int64		j = (int64) (RandomDouble() * state->rows);
+
+		if (j < samples->maxlen)
+			VectorArraySet(samples, j, (Pointer) value);
+	}
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * Combine aggregate states
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(vector_kmeans_combine);
+Datum
+vector_kmeans_combine(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggContext;
+	KmeansState *state1 = PG_ARGISNULL(0) ? NULL : (KmeansState *) PG_GETARG_POINTER(0);
+	KmeansState *state2 = PG_ARGISNULL(1) ? NULL : (KmeansState *) PG_GETARG_POINTER(1);
+
+	if (!AggCheckCallContext(fcinfo, &aggContext))
+		elog(ERROR, "vector_kmeans_combine called in non-aggregate context");
+
+	if (state2 == NULL)
+	{
+		if (state1 == NULL)
+			PG_RETURN_NULL();
+
+		PG_RETURN_POINTER(state1);
+	}
+
+	if (state1 == NULL)
+		PG_RETURN_POINTER(CopyKmeansState(aggContext, state2));
+
+	if (state2->samples == NULL)
+		PG_RETURN_POINTER(state1);
+
+	if (state1->samples == NULL)
+	{
+		state1->samples = CopyKmeansState(aggContext, state2)->samples;
+		state1->rows = state2->rows;
+		PG_RETURN_POINTER(state1);
+	}
+
+	MergeSamples(state1, state2);
+
+	PG_RETURN_POINTER(state1);
+}
+
+/*
+ * Serialize an aggregate state for parallel workers
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(vector_kmeans_serialize);
+Datum
+vector_kmeans_serialize(PG_FUNCTION_ARGS)
+{
+	KmeansState *state = (KmeansState *) PG_GETARG_POINTER(0);
+	StringInfoData buf;
+
+	pq_begintypsend(&buf);
+	pq_sendint32(&buf, state->k);
+	pq_sendint32(&buf, state->distance);
+	pq_sendint32(&buf, state->typid);
+	pq_sendint64(&buf, state->rows);
+
+	if (state->samples == NULL)
+		pq_sendint32(&buf, -1);
+	else
+	{
+		VectorArray samples = state->samples;
+
+		pq_sendint32(&buf, samples->dim);
+		pq_sendint32(&buf, samples->length);
+
+		for (int i = 0; i < samples->length; i++)
+		{
+			Pointer		item = VectorArrayGet(samples, i);
+
+			pq_sendbytes(&buf, item, VARSIZE_ANY(item));
+		}
+	}
+
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+/*
+ * Deserialize an aggregate state from parallel workers
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(vector_kmeans_deserialize);
+Datum
+vector_kmeans_deserialize(PG_FUNCTION_ARGS)
+{
+	bytea	   *sstate = PG_GETARG_BYTEA_PP(0);
+	MemoryContext aggContext;
+	KmeansState *state;
+	StringInfoData buf;
+	int			dimensions;
+
+	if (!AggCheckCallContext(fcinfo, &aggContext))
+		elog(ERROR, "vector_kmeans_deserialize called in non-aggregate context");
+
+	initStringInfo(&buf);
+	appendBinaryStringInfo(&buf, VARDATA_ANY(sstate), VARSIZE_ANY_EXHDR(sstate));
+
+	state = palloc0(sizeof(KmeansState));
+	state->k = pq_getmsgint(&buf, 4);
+	state->distance = (KmeansDistance) pq_getmsgint(&buf, 4);
+	state->typid = pq_getmsgint(&buf, 4);
+	state->rows = pq_getmsgint64(&buf);
+
+	dimensions = (int) pq_getmsgint(&buf, 4);
+	if (dimensions != -1)
+	{
+		int			length = pq_getmsgint(&buf, 4);
+		Size		size = VECTOR_SIZE(dimensions);
+
+		state->samples = InitSamples(CurrentMemoryContext, state->k, dimensions);
+		if (length > state->samples->maxlen)
+			elog(ERROR, "invalid k-means state");
+
+		/* Copy since data may not be aligned */
+		for (int i = 0; i < length; i++)
+			memcpy(VectorArrayGet(state->samples, state->samples->length++), pq_getmsgbytes(&buf, size), size);
+	}
+
+	pq_getmsgend(&buf);
+	pfree(buf.data);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * Initialize a support function for a C function
+ */
+static void
+InitKmeansProcInfo(FmgrInfo *finfo, PGFunction func, short nargs)
+{
+	MemSet(finfo, 0, sizeof(FmgrInfo));
+	finfo->fn_addr = func;
+	finfo->fn_oid = InvalidOid;
+	finfo->fn_nargs = nargs;
+	finfo->fn_strict = true;
+	finfo->fn_mcxt = CurrentMemoryContext;
+}
+
+/*
+ * Get the centers from the aggregate state
+ *
+ * Uses the same k-means as IVFFlat index builds, including spherical k-means
+ * for inner product and cosine distance
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(vector_kmeans_final);
+Datum
+vector_kmeans_final(PG_FUNCTION_ARGS)
+{
+	KmeansState *state = PG_ARGISNULL(0) ? NULL : (KmeansState *) PG_GETARG_POINTER(0);
+	const		IvfflatTypeInfo *typeInfo = IvfflatGetVectorTypeInfo();
+	VectorArray centers;
+	FmgrInfo	procinfo;
+	FmgrInfo	normprocinfo;
+	Datum	   *datums;
+	ArrayType  *result;
+
+	if (state == NULL || state->samples == NULL || state->samples->length == 0)
+		PG_RETURN_NULL();
+
+	if (state->samples->length < state->k)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("k-means requires at least %d rows, but there are %d", state->k, state->samples->length)));
+
+	InitKmeansProcInfo(&normprocinfo, vector_norm, 1);
+	if (state->distance == KMEANS_L2)
+		InitKmeansProcInfo(&procinfo, l2_distance, 2);
+	else
+		InitKmeansProcInfo(&procinfo, vector_spherical_distance, 2);
+
+	centers = VectorArrayInit(state->k, state->samples->dim, state->samples->itemsize);
+	IvfflatKmeansWithProcs(state->samples, centers, &procinfo,
+						   state->distance == KMEANS_L2 ? NULL : &normprocinfo,
+						   state->distance == KMEANS_COSINE ? &normprocinfo : NULL,
+						   InvalidOid, typeInfo);
+
+	datums = palloc(sizeof(Datum) * centers->length);
+	for (int i = 0; i < centers->length; i++)
+		datums[i] = PointerGetDatum(VectorArrayGet(centers, i));
+
+	result = construct_array(datums, centers->length, state->typid, -1, false, 'i');
+
+	VectorArrayFree(centers);
+	pfree(datums);
+
+	PG_RETURN_ARRAYTYPE_P(result);
+}
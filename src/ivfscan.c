@@ -3,6 +3,7 @@
 #include <float.h>
 
 #include "access/relscan.h"
+#include "access/xlog.h"
 #include "catalog/pg_operator_d.h"
 #include "catalog/pg_type_d.h"
 #include "lib/pairingheap.h"
@@ -10,6 +11,7 @@
 #include "miscadmin.h"
 #include "pgstat.h"
 #include "storage/bufmgr.h"
+#include "vectortrace.h"
 
 /*
  * Compare list distances
@@ -36,6 +38,11 @@ GetScanLists(IndexScanDesc scan, Datum value)
 	BlockNumber nextblkno = IVFFLAT_HEAD_BLKNO;
 	int			listCount = 0;
 	double		maxDistance = DBL_MAX;
+	BoundedDistanceFunc boundedDistance = NULL;
+
+	/* Stop early for lists that are not closer once probes lists are found */
+	if (so->distfunc == FunctionCall2Coll)
+		boundedDistance = so->boundedDistance;
 
 	/* Search all list pages */
 	while (BlockNumberIsValid(nextblkno))
@@ -56,7 +63,10 @@ GetScanLists(IndexScanDesc scan, Datum value)
 			double		distance;
 
 			/* Use procinfo from the index instead of scan key for performance */
-			distance = DatumGetFloat8(so->distfunc(so->procinfo, so->collation, PointerGetDatum(&list->center), value));
+			if (boundedDistance != NULL && listCount == so->probes)
+				distance = boundedDistance(PointerGetDatum(&list->center), value, maxDistance);
+			else
+				distance = DatumGetFloat8(so->distfunc(so->procinfo, so->collation, PointerGetDatum(&list->center), value));
 
 			if (listCount < so->probes)
 			{
@@ -115,6 +125,8 @@ GetScanItems(IndexScanDesc scan, Datum value)
 	 */
 	BufferAccessStrategy bas = GetAccessStrategy(BAS_BULKREAD);
 
+	TRACE_PGVECTOR_IVFFLAT_SCAN_START(RelationGetRelid(scan->indexRelation), so->probes);
+
 	/* Search closest probes lists */
 	while (!pairingheap_is_empty(so->listQueue))
 	{
@@ -138,6 +150,11 @@ GetScanItems(IndexScanDesc scan, Datum value)
 				Datum		datum;
 				bool		isnull;
 				ItemId		itemid = PageGetItemId(page, offno);
+				ItemPointerData indextid;
+
+				/* Skip tuples marked as dead by previous scans */
+				if (scan->ignore_killed_tuples && ItemIdIsDead(itemid))
+					continue;
 
 				itup = (IndexTuple) PageGetItem(page, itemid);
 				datum = index_getattr(itup, 1, tupdesc, &isnull);
@@ -153,6 +170,9 @@ GetScanItems(IndexScanDesc scan, Datum value)
 				slot->tts_isnull[0] = false;
 				slot->tts_values[1] = PointerGetDatum(&itup->t_tid);
 				slot->tts_isnull[1] = false;
+				ItemPointerSet(&indextid, searchPage, offno);
+				slot->tts_values[2] = PointerGetDatum(&indextid);
+				slot->tts_isnull[2] = false;
 				ExecStoreVirtualTuple(slot);
 
 				tuplesort_puttupleslot(so->sortstate, slot);
@@ -168,6 +188,8 @@ GetScanItems(IndexScanDesc scan, Datum value)
 
 	FreeAccessStrategy(bas);
 
+	TRACE_PGVECTOR_IVFFLAT_SCAN_DONE(RelationGetRelid(scan->indexRelation), (int64) tuples);
+
 	if (tuples < 100)
 		ereport(DEBUG1,
 				(errmsg("index scan found few tuples"),
@@ -177,6 +199,80 @@ GetScanItems(IndexScanDesc scan, Datum value)
 	tuplesort_performsort(so->sortstate);
 }
 
+/*
+ * Mark the previously returned tuple as dead
+ *
+ * This is only a hint, so a shared lock is sufficient. Since no pin is held
+ * between calls, skip if the page has changed since the search started, as
+ * vacuum could have moved the tuple and the heap TID could have been reused.
+ * This requires WAL, so unlogged indexes are not supported.
+ */
+static void
+KillPriorTuple(IndexScanDesc scan)
+{
+	IvfflatScanOpaque so = (IvfflatScanOpaque) scan->opaque;
+	Relation	index = scan->indexRelation;
+	OffsetNumber offno = ItemPointerGetOffsetNumber(&so->priorIndexTid);
+	Buffer		buf;
+	Page		page;
+
+	if (!RelationNeedsWAL(index))
+		return;
+
+	buf = ReadBuffer(index, ItemPointerGetBlockNumber(&so->priorIndexTid));
+	LockBuffer(buf, BUFFER_LOCK_SHARE);
+	page = BufferGetPage(buf);
+
+	if (BufferGetLSNAtomic(buf) <= so->searchLsn && offno <= PageGetMaxOffsetNumber(page))
+	{
+		ItemId		itemid = PageGetItemId(page, offno);
+
+		if (ItemIdIsNormal(itemid))
+		{
+			IndexTuple	itup = (IndexTuple) PageGetItem(page, itemid);
+
+			if (ItemPointerEquals(&itup->t_tid, &scan->xs_heaptid))
+			{
+				ItemIdMarkDead(itemid);
+				MarkBufferDirtyHint(buf, true);
+			}
+		}
+	}
+
+	UnlockReleaseBuffer(buf);
+}
+
+/*
+ * Set the distance for the executor to recheck
+ *
+ * Prefix distances do not exceed full distances, so the executor can
+ * reorder tuples by the full distance as they are returned.
+ */
+static void
+SetOrderByValue(IndexScanDesc scan, Datum distance)
+{
+	IvfflatScanOpaque so = (IvfflatScanOpaque) scan->opaque;
+
+	if (so->prefixDimensions == 0)
+	{
+		scan->xs_recheckorderby = false;
+		return;
+	}
+
+	if (scan->orderByData->sk_flags & SK_ISNULL)
+	{
+		scan->xs_orderbyvals[0] = (Datum) 0;
+		scan->xs_orderbynulls[0] = true;
+	}
+	else
+	{
+		scan->xs_orderbyvals[0] = Float8GetDatum(PrefixDistanceLowerBound(so->procinfo, DatumGetFloat8(distance)));
+		scan->xs_orderbynulls[0] = false;
+	}
+
+	scan->xs_recheckorderby = true;
+}
+
 /*
  * Zero distance
  */
@@ -209,6 +305,10 @@ GetScanValue(IndexScanDesc scan)
 		Assert(!VARATT_IS_COMPRESSED(DatumGetPointer(value)));
 		Assert(!VARATT_IS_EXTENDED(DatumGetPointer(value)));
 
+		/* Search with prefix if needed */
+		if (so->prefixDimensions > 0)
+			value = IvfflatPrefixValue(so->typeInfo, so->prefixDimensions, value);
+
 		/* Normalize if needed */
 		if (so->normprocinfo != NULL)
 			value = IvfflatNormValue(so->typeInfo, so->collation, value);
@@ -217,6 +317,21 @@ GetScanValue(IndexScanDesc scan)
 	return value;
 }
 
+/*
+ * Search the index
+ */
+static void
+SearchIndex(IndexScanDesc scan, Datum value)
+{
+	IvfflatScanOpaque so = (IvfflatScanOpaque) scan->opaque;
+
+	/* Pages modified after this point are not marked dead */
+	so->searchLsn = GetXLogInsertRecPtr();
+
+	IvfflatBench("GetScanLists", GetScanLists(scan, value));
+	IvfflatBench("GetScanItems", GetScanItems(scan, value));
+}
+
 /*
  * Prepare for an index scan
  */
@@ -231,31 +346,47 @@ ivfflatbeginscan(Relation index, int nkeys, int norderbys)
 	Oid			sortOperators[] = {Float8LessOperator};
 	Oid			sortCollations[] = {InvalidOid};
 	bool		nullsFirstFlags[] = {false};
-	int			probes = ivfflat_probes;
+	int			probes;
 
 	scan = RelationGetIndexScan(index, nkeys, norderbys);
 
 	/* Get lists and dimensions from metapage */
 	IvfflatGetMetaPageInfo(index, &lists, &dimensions);
 
-	if (probes > lists)
-		probes = lists;
+	probes = IvfflatGetProbes(index, lists);
 
 	so = (IvfflatScanOpaque) palloc(offsetof(IvfflatScanOpaqueData, lists) + probes * sizeof(IvfflatScanList));
 	so->typeInfo = IvfflatGetTypeInfo(index);
 	so->first = true;
 	so->probes = probes;
 	so->dimensions = dimensions;
+	so->prefixDimensions = IvfflatGetPrefixDimensions(index);
 
 	/* Set support functions */
 	so->procinfo = index_getprocinfo(index, 1, IVFFLAT_DISTANCE_PROC);
+	so->boundedDistance = GetBoundedDistanceFunc(so->procinfo);
 	so->normprocinfo = IvfflatOptionalProcInfo(index, IVFFLAT_NORM_PROC);
 	so->collation = index->rd_indcollation[0];
 
+	ItemPointerSetInvalid(&so->priorIndexTid);
+
+	/* Cached heap TIDs do not have distances to recheck */
+	so->cache = so->prefixDimensions > 0 ? NULL : ScanCacheBeginScan();
+	so->recall = RecallBeginScan();
+
+	/* Distances for recheck */
+	if (so->prefixDimensions > 0)
+	{
+		scan->xs_orderbyvals = palloc0(sizeof(Datum) * scan->numberOfOrderBys);
+		scan->xs_orderbynulls = palloc(sizeof(bool) * scan->numberOfOrderBys);
+		memset(scan->xs_orderbynulls, true, sizeof(bool) * scan->numberOfOrderBys);
+	}
+
 	/* Create tuple description for sorting */
-	so->tupdesc = CreateTemplateTupleDesc(2);
+	so->tupdesc = CreateTemplateTupleDesc(3);
 	TupleDescInitEntry(so->tupdesc, (AttrNumber) 1, "distance", FLOAT8OID, -1, 0);
 	TupleDescInitEntry(so->tupdesc, (AttrNumber) 2, "heaptid", TIDOID, -1, 0);
+	TupleDescInitEntry(so->tupdesc, (AttrNumber) 3, "indextid", TIDOID, -1, 0);
 
 	/* Prep sort */
 	so->sortstate = tuplesort_begin_heap(so->tupdesc, 1, attNums, sortOperators, sortCollations, nullsFirstFlags, work_mem, NULL, false);
@@ -277,12 +408,19 @@ ivfflatrescan(IndexScanDesc scan, ScanKey keys, int nkeys, ScanKey orderbys, int
 {
 	IvfflatScanOpaque so = (IvfflatScanOpaque) scan->opaque;
 
+	if (so->cache != NULL)
+		ScanCacheEndSearch(so->cache);
+
+	if (so->recall != NULL)
+		RecallEndSample(so->recall);
+
 #if PG_VERSION_NUM >= 130000
 	if (!so->first)
 		tuplesort_reset(so->sortstate);
 #endif
 
 	so->first = true;
+	ItemPointerSetInvalid(&so->priorIndexTid);
 	pairingheap_reset(so->listQueue);
 
 	if (keys && scan->numberOfKeys > 0)
@@ -306,6 +444,10 @@ ivfflatgettuple(IndexScanDesc scan, ScanDirection dir)
 	 */
 	Assert(ScanDirectionIsForward(dir));
 
+	/* Executor found previous heap TID to be dead to all transactions */
+	if (scan->kill_prior_tuple && ItemPointerIsValid(&so->priorIndexTid))
+		KillPriorTuple(scan);
+
 	if (so->first)
 	{
 		Datum		value;
@@ -323,8 +465,15 @@ ivfflatgettuple(IndexScanDesc scan, ScanDirection dir)
 			elog(ERROR, "non-MVCC snapshots are not supported with ivfflat");
 
 		value = GetScanValue(scan);
-		IvfflatBench("GetScanLists", GetScanLists(scan, value));
-		IvfflatBench("GetScanItems", GetScanItems(scan, value));
+
+		/* Sample search for recall monitoring */
+		if (so->recall != NULL && !(scan->orderByData->sk_flags & SK_ISNULL))
+			RecallStartSample(so->recall, scan->indexRelation, scan->orderByData->sk_argument);
+
+		/* Replay cached heap TIDs if available */
+		if (so->cache == NULL || !ScanCacheLookup(so->cache, scan->indexRelation, value, so->probes))
+			SearchIndex(scan, value);
+
 		so->first = false;
 
 		/* Clean up if we allocated a new value */
@@ -332,16 +481,56 @@ ivfflatgettuple(IndexScanDesc scan, ScanDirection dir)
 			pfree(DatumGetPointer(value));
 	}
 
-	if (tuplesort_gettupleslot(so->sortstate, true, false, so->slot, NULL))
+	if (so->cache != NULL && so->cache->replaying)
+	{
+		if (ScanCacheNext(so->cache, &scan->xs_heaptid))
+		{
+			ItemPointerSetInvalid(&so->priorIndexTid);
+
+			if (so->recall != NULL)
+				RecallAddItem(so->recall, &scan->xs_heaptid);
+
+			scan->xs_recheck = false;
+			scan->xs_recheckorderby = false;
+			return true;
+		}
+
+		/* Search if more heap TIDs are needed */
+		if (!so->cache->complete)
+		{
+			Datum		value = GetScanValue(scan);
+
+			SearchIndex(scan, value);
+
+			if (value != scan->orderByData->sk_argument)
+				pfree(DatumGetPointer(value));
+		}
+		else
+			return false;
+	}
+
+	while (tuplesort_gettupleslot(so->sortstate, true, false, so->slot, NULL))
 	{
 		ItemPointer heaptid = (ItemPointer) DatumGetPointer(slot_getattr(so->slot, 2, &so->isnull));
+		ItemPointer indextid = (ItemPointer) DatumGetPointer(slot_getattr(so->slot, 3, &so->isnull));
 
+		/* Skip heap TIDs already returned from the cache */
+		if (so->cache != NULL && !ScanCacheAddItem(so->cache, heaptid))
+			continue;
+
+		if (so->recall != NULL)
+			RecallAddItem(so->recall, heaptid);
+
+		so->priorIndexTid = *indextid;
 		scan->xs_heaptid = *heaptid;
 		scan->xs_recheck = false;
-		scan->xs_recheckorderby = false;
+		SetOrderByValue(scan, slot_getattr(so->slot, 1, &so->isnull));
 		return true;
 	}
 
+	if (so->cache != NULL)
+		ScanCacheFinish(so->cache);
+
 	return false;
 }
 
@@ -353,6 +542,18 @@ ivfflatendscan(IndexScanDesc scan)
 {
 	IvfflatScanOpaque so = (IvfflatScanOpaque) scan->opaque;
 
+	if (so->cache != NULL)
+	{
+		ScanCacheEndSearch(so->cache);
+		pfree(so->cache);
+	}
+
+	if (so->recall != NULL)
+	{
+		RecallEndSample(so->recall);
+		pfree(so->recall);
+	}
+
 	pairingheap_free(so->listQueue);
 	tuplesort_end(so->sortstate);
 
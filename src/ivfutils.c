@@ -52,6 +52,34 @@ IvfflatGetLists(Relation index)
 	return IVFFLAT_DEFAULT_LISTS;
 }
 
+/*
+ * Get the number of dimensions to index
+ */
+int
+IvfflatGetPrefixDimensions(Relation index)
+{
+	IvfflatOptions *opts = (IvfflatOptions *) index->rd_options;
+
+	if (opts)
+		return opts->prefixDimensions;
+
+	return IVFFLAT_DEFAULT_PREFIX_DIMENSIONS;
+}
+
+/*
+ * Get whether to calibrate at build time
+ */
+bool
+IvfflatGetCalibrate(Relation index)
+{
+	IvfflatOptions *opts = (IvfflatOptions *) index->rd_options;
+
+	if (opts)
+		return opts->calibrate;
+
+	return IVFFLAT_DEFAULT_CALIBRATE;
+}
+
 /*
  * Get proc
  */
@@ -73,6 +101,15 @@ IvfflatNormValue(const IvfflatTypeInfo * typeInfo, Oid collation, Datum value)
 	return DirectFunctionCall1Coll(typeInfo->normalize, collation, value);
 }
 
+/*
+ * Get the prefix of a value that is indexed
+ */
+Datum
+IvfflatPrefixValue(const IvfflatTypeInfo * typeInfo, int prefixDimensions, Datum value)
+{
+	return DirectFunctionCall3(typeInfo->subvector, value, Int32GetDatum(1), Int32GetDatum(prefixDimensions));
+}
+
 /*
  * Check if non-zero norm
  */
@@ -178,6 +215,43 @@ IvfflatGetMetaPageInfo(Relation index, int *lists, int *dimensions)
 	UnlockReleaseBuffer(buf);
 }
 
+/*
+ * Get probes, increasing it to meet the target recall if needed
+ */
+int
+IvfflatGetProbes(Relation index, int lists)
+{
+	Buffer		buf;
+	Page		page;
+	IvfflatMetaPage metap;
+	int			probes = ivfflat_probes;
+
+	if (ivfflat_target_recall > 0)
+	{
+		buf = ReadBuffer(index, IVFFLAT_METAPAGE_BLKNO);
+		LockBuffer(buf, BUFFER_LOCK_SHARE);
+		page = BufferGetPage(buf);
+		metap = IvfflatPageGetMeta(page);
+
+		/* Searching all lists is exact, so zeros mean not calibrated */
+		for (int i = 0; i < IVFFLAT_CALIBRATION_STEPS; i++)
+		{
+			if (metap->calibration[i] >= ivfflat_target_recall)
+			{
+				probes = Max(probes, IvfflatCalibrationProbes(i, lists));
+				break;
+			}
+		}
+
+		UnlockReleaseBuffer(buf);
+	}
+
+	if (probes > lists)
+		probes = lists;
+
+	return probes;
+}
+
 /*
  * Update the start or insert page of a list
  */
@@ -228,6 +302,8 @@ IvfflatUpdateList(Relation index, ListInfo listInfo,
 PGDLLEXPORT Datum l2_normalize(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum halfvec_l2_normalize(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum sparsevec_l2_normalize(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum subvector(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum halfvec_subvector(PG_FUNCTION_ARGS);
 
 static Size
 VectorItemSize(int dimensions)
@@ -314,6 +390,24 @@ BitSumCenter(Pointer v, float *x)
 		x[k] += (float) (((VARBITS(vec)[k / 8]) >> (7 - (k % 8))) & 0x01);
 }
 
+/*
+ * Get type info for vectors
+ */
+const		IvfflatTypeInfo *
+IvfflatGetVectorTypeInfo(void)
+{
+	static const IvfflatTypeInfo typeInfo = {
+		.maxDimensions = IVFFLAT_MAX_DIM,
+		.normalize = l2_normalize,
+		.itemSize = VectorItemSize,
+		.updateCenter = VectorUpdateCenter,
+		.sumCenter = VectorSumCenter,
+		.subvector = subvector
+	};
+
+	return (&typeInfo);
+}
+
 /*
  * Get type info
  */
@@ -323,17 +417,7 @@ IvfflatGetTypeInfo(Relation index)
 	FmgrInfo   *procinfo = IvfflatOptionalProcInfo(index, IVFFLAT_TYPE_INFO_PROC);
 
 	if (procinfo == NULL)
-	{
-		static const IvfflatTypeInfo typeInfo = {
-			.maxDimensions = IVFFLAT_MAX_DIM,
-			.normalize = l2_normalize,
-			.itemSize = VectorItemSize,
-			.updateCenter = VectorUpdateCenter,
-			.sumCenter = VectorSumCenter
-		};
-
-		return (&typeInfo);
-	}
+		return IvfflatGetVectorTypeInfo();
 	else
 		return (const IvfflatTypeInfo *) DatumGetPointer(FunctionCall0Coll(procinfo, InvalidOid));
 }
@@ -347,7 +431,8 @@ ivfflat_halfvec_support(PG_FUNCTION_ARGS)
 		.normalize = halfvec_l2_normalize,
 		.itemSize = HalfvecItemSize,
 		.updateCenter = HalfvecUpdateCenter,
-		.sumCenter = HalfvecSumCenter
+		.sumCenter = HalfvecSumCenter,
+		.subvector = halfvec_subvector
 	};
 
 	PG_RETURN_POINTER(&typeInfo);
@@ -362,7 +447,8 @@ ivfflat_bit_support(PG_FUNCTION_ARGS)
 		.normalize = NULL,
 		.itemSize = BitItemSize,
 		.updateCenter = BitUpdateCenter,
-		.sumCenter = BitSumCenter
+		.sumCenter = BitSumCenter,
+		.subvector = NULL
 	};
 
 	PG_RETURN_POINTER(&typeInfo);
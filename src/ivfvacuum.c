@@ -19,6 +19,9 @@ ivfflatbulkdelete(IndexVacuumInfo *info, IndexBulkDeleteResult *stats,
 	if (stats == NULL)
 		stats = (IndexBulkDeleteResult *) palloc0(sizeof(IndexBulkDeleteResult));
 
+	/* Invalidate cached scan results, including ones from concurrent scans */
+	ScanCacheInvalidate(index);
+
 	/* Iterate over list pages */
 	while (BlockNumberIsValid(blkno))
 	{
@@ -132,6 +135,9 @@ ivfflatbulkdelete(IndexVacuumInfo *info, IndexBulkDeleteResult *stats,
 
 	FreeAccessStrategy(bas);
 
+	/* Heap TIDs can be reused after this */
+	ScanCacheInvalidate(index);
+
 	return stats;
 }
 
@@ -0,0 +1,504 @@
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "funcapi.h"
+#include "lockstats.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "portability/instr_time.h"
+#include "storage/bufmgr.h"
+#include "storage/ipc.h"
+#include "storage/lmgr.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/rel.h"
+#include "utils/tuplestore.h"
+
+#define LOCK_STATS_NAME "pgvector lock stats"
+
+/* Indexes with statistics */
+#define LOCK_STATS_MAX_INDEXES 128
+
+typedef struct LockStatsCounters
+{
+	pg_atomic_uint64 acquisitions;
+	pg_atomic_uint64 waits;
+	pg_atomic_uint64 waitTime;	/* microseconds */
+}			LockStatsCounters;
+
+typedef struct LockStatsEntry
+{
+	Oid			dbOid;
+	Oid			indexOid;
+	LockStatsCounters counters[VECTOR_LOCK_CLASSES];
+}			LockStatsEntry;
+
+typedef struct LockStatsShared
+{
+	LWLock	   *lock;
+	int			nentries;
+	pg_atomic_uint64 resets;	/* entries can be reused after a reset */
+	LockStatsEntry entries[LOCK_STATS_MAX_INDEXES];
+}			LockStatsShared;
+
+typedef struct LockStatsSlot
+{
+	Oid			indexOid;
+	int			slot;
+}			LockStatsSlot;
+
+typedef struct LockStatsPending
+{
+	uint64		acquisitions;
+	uint64		waits;
+	uint64		waitTime;
+}			LockStatsPending;
+
+static const char *const lockClassNames[VECTOR_LOCK_CLASSES] = {
+	[VECTOR_LOCK_HNSW_UPDATE] = "hnsw update",
+	[VECTOR_LOCK_HNSW_ELEMENT] = "hnsw element",
+	[VECTOR_LOCK_HNSW_ENTRY] = "hnsw entry",
+	[VECTOR_LOCK_HNSW_ALLOCATOR] = "hnsw allocator",
+	[VECTOR_LOCK_HNSW_FLUSH] = "hnsw flush",
+	[VECTOR_LOCK_IVFFLAT_INSERT] = "ivfflat insert page"
+};
+
+static LockStatsShared * lockStats = NULL;
+
+/* Counters are kept locally until the operation on the index finishes */
+static Oid	pendingIndexOid = InvalidOid;
+static LockStatsPending pending[VECTOR_LOCK_CLASSES];
+
+/* Entries found by this backend, so flushing does not need the lock */
+static LockStatsSlot localSlots[LOCK_STATS_MAX_INDEXES];
+static int	nlocalSlots = 0;
+static uint64 localResets = 0;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+
+#if PG_VERSION_NUM >= 150000
+/*
+ * Request shared memory
+ */
+static void
+LockStatsShmemRequest(void)
+{
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
+
+	RequestAddinShmemSpace(sizeof(LockStatsShared));
+	RequestNamedLWLockTranche(LOCK_STATS_NAME, 1);
+}
+#endif
+
+/*
+ * Initialize shared memory
+ */
+static void
+LockStatsShmemStartup(void)
+{
+	bool		found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	lockStats = ShmemInitStruct(LOCK_STATS_NAME, sizeof(LockStatsShared), &found);
+	if (!found)
+	{
+		lockStats->lock = &(GetNamedLWLockTranche(LOCK_STATS_NAME))->lock;
+		lockStats->nentries = 0;
+		pg_atomic_init_u64(&lockStats->resets, 0);
+
+		for (int i = 0; i < LOCK_STATS_MAX_INDEXES; i++)
+		{
+			for (int j = 0; j < VECTOR_LOCK_CLASSES; j++)
+			{
+				pg_atomic_init_u64(&lockStats->entries[i].counters[j].acquisitions, 0);
+				pg_atomic_init_u64(&lockStats->entries[i].counters[j].waits, 0);
+				pg_atomic_init_u64(&lockStats->entries[i].counters[j].waitTime, 0);
+			}
+		}
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * Initialize shared memory
+ */
+void
+LockStatsInit(void)
+{
+	/* Shared memory can only be requested at server start */
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+#if PG_VERSION_NUM >= 150000
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = LockStatsShmemRequest;
+#else
+	RequestAddinShmemSpace(sizeof(LockStatsShared));
+	RequestNamedLWLockTranche(LOCK_STATS_NAME, 1);
+#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = LockStatsShmemStartup;
+}
+
+/*
+ * Find the entry for an index
+ */
+static LockStatsEntry *
+FindEntry(Oid dbOid, Oid indexOid)
+{
+	for (int i = 0; i < lockStats->nentries; i++)
+	{
+		if (lockStats->entries[i].dbOid == dbOid && lockStats->entries[i].indexOid == indexOid)
+			return &lockStats->entries[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Forget entries found by this backend if statistics were reset since
+ */
+static void
+CheckLocalSlots(void)
+{
+	uint64		resets = pg_atomic_read_u64(&lockStats->resets);
+
+	if (resets != localResets)
+	{
+		nlocalSlots = 0;
+		localResets = resets;
+	}
+}
+
+/*
+ * Get the entry for an index, taking the lock only if this backend has not
+ * found it before
+ *
+ * Counters flushed while a reset is in progress may be lost, which is fine
+ * for statistics.
+ */
+static LockStatsEntry *
+GetEntry(Oid indexOid)
+{
+	LockStatsEntry *entry;
+
+	CheckLocalSlots();
+
+	for (int i = 0; i < nlocalSlots; i++)
+	{
+		if (localSlots[i].indexOid == indexOid)
+			return &lockStats->entries[localSlots[i].slot];
+	}
+
+	LWLockAcquire(lockStats->lock, LW_SHARED);
+	entry = FindEntry(MyDatabaseId, indexOid);
+	if (entry == NULL)
+	{
+		/* Another backend may have added it in between */
+		LWLockRelease(lockStats->lock);
+		LWLockAcquire(lockStats->lock, LW_EXCLUSIVE);
+
+		entry = FindEntry(MyDatabaseId, indexOid);
+		if (entry == NULL && lockStats->nentries < LOCK_STATS_MAX_INDEXES)
+		{
+			entry = &lockStats->entries[lockStats->nentries];
+			entry->dbOid = MyDatabaseId;
+			entry->indexOid = indexOid;
+			lockStats->nentries++;
+		}
+	}
+
+	/* Resets take the lock exclusively, so the count is current */
+	CheckLocalSlots();
+
+	if (entry != NULL && nlocalSlots < LOCK_STATS_MAX_INDEXES)
+	{
+		localSlots[nlocalSlots].indexOid = indexOid;
+		localSlots[nlocalSlots].slot = entry - lockStats->entries;
+		nlocalSlots++;
+	}
+
+	LWLockRelease(lockStats->lock);
+
+	return entry;
+}
+
+/*
+ * Add pending counters to shared memory
+ */
+static void
+FlushPending(void)
+{
+	LockStatsEntry *entry;
+	bool		any = false;
+
+	for (int i = 0; i < VECTOR_LOCK_CLASSES; i++)
+	{
+		if (pending[i].acquisitions > 0)
+		{
+			any = true;
+			break;
+		}
+	}
+
+	if (!any)
+		return;
+
+	entry = GetEntry(pendingIndexOid);
+
+	/* Counters are dropped when the table is full */
+	if (entry != NULL)
+	{
+		for (int i = 0; i < VECTOR_LOCK_CLASSES; i++)
+		{
+			if (pending[i].acquisitions == 0)
+				continue;
+
+			pg_atomic_fetch_add_u64(&entry->counters[i].acquisitions, pending[i].acquisitions);
+			pg_atomic_fetch_add_u64(&entry->counters[i].waits, pending[i].waits);
+			pg_atomic_fetch_add_u64(&entry->counters[i].waitTime, pending[i].waitTime);
+		}
+	}
+
+	MemSet(pending, 0, sizeof(pending));
+}
+
+/*
+ * Start counting lock acquisitions for an index
+ */
+void
+LockStatsBegin(Relation index)
+{
+	if (lockStats == NULL)
+		return;
+
+	/* Flush counters left by an operation that errored */
+	if (OidIsValid(pendingIndexOid))
+		FlushPending();
+
+	pendingIndexOid = RelationGetRelid(index);
+}
+
+/*
+ * Stop counting lock acquisitions and add them to shared memory
+ */
+void
+LockStatsEnd(void)
+{
+	if (lockStats == NULL || !OidIsValid(pendingIndexOid))
+		return;
+
+	FlushPending();
+	pendingIndexOid = InvalidOid;
+}
+
+/*
+ * Record an acquisition
+ */
+static inline void
+RecordAcquisition(VectorLockClass lockClass, instr_time *start)
+{
+	pending[lockClass].acquisitions++;
+
+	if (start != NULL)
+	{
+		instr_time	duration;
+
+		INSTR_TIME_SET_CURRENT(duration);
+		INSTR_TIME_SUBTRACT(duration, *start);
+
+		pending[lockClass].waits++;
+		pending[lockClass].waitTime += INSTR_TIME_GET_MICROSEC(duration);
+	}
+}
+
+/*
+ * Check if acquisitions are counted
+ */
+static inline bool
+Counting(void)
+{
+	return OidIsValid(pendingIndexOid);
+}
+
+/*
+ * Acquire a heavyweight page lock
+ */
+void
+LockStatsLockPage(Relation index, BlockNumber blkno, LOCKMODE mode, VectorLockClass lockClass)
+{
+	instr_time	start;
+
+	if (!Counting())
+	{
+		LockPage(index, blkno, mode);
+		return;
+	}
+
+	if (ConditionalLockPage(index, blkno, mode))
+	{
+		RecordAcquisition(lockClass, NULL);
+		return;
+	}
+
+	INSTR_TIME_SET_CURRENT(start);
+	LockPage(index, blkno, mode);
+	RecordAcquisition(lockClass, &start);
+}
+
+/*
+ * Acquire an LWLock
+ */
+void
+LockStatsLWLockAcquire(LWLock *lock, LWLockMode mode, VectorLockClass lockClass)
+{
+	instr_time	start;
+
+	if (!Counting())
+	{
+		LWLockAcquire(lock, mode);
+		return;
+	}
+
+	if (LWLockConditionalAcquire(lock, mode))
+	{
+		RecordAcquisition(lockClass, NULL);
+		return;
+	}
+
+	INSTR_TIME_SET_CURRENT(start);
+	LWLockAcquire(lock, mode);
+	RecordAcquisition(lockClass, &start);
+}
+
+/*
+ * Acquire an exclusive buffer lock
+ */
+void
+LockStatsLockBuffer(Buffer buf, VectorLockClass lockClass)
+{
+	instr_time	start;
+
+	if (!Counting())
+	{
+		LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
+		return;
+	}
+
+	if (ConditionalLockBuffer(buf))
+	{
+		RecordAcquisition(lockClass, NULL);
+		return;
+	}
+
+	INSTR_TIME_SET_CURRENT(start);
+	LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
+	RecordAcquisition(lockClass, &start);
+}
+
+/*
+ * Get lock statistics for indexes in the current database
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(vector_lock_stats);
+Datum
+vector_lock_stats(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldCtx;
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo) || !(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	oldCtx = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldCtx);
+
+	if (lockStats == NULL)
+		return (Datum) 0;
+
+	LWLockAcquire(lockStats->lock, LW_SHARED);
+
+	for (int i = 0; i < lockStats->nentries; i++)
+	{
+		LockStatsEntry *entry = &lockStats->entries[i];
+
+		if (entry->dbOid != MyDatabaseId)
+			continue;
+
+		for (int j = 0; j < VECTOR_LOCK_CLASSES; j++)
+		{
+			LockStatsCounters *counters = &entry->counters[j];
+			Datum		values[5];
+			bool		nulls[5] = {0};
+			uint64		acquisitions = pg_atomic_read_u64(&counters->acquisitions);
+
+			if (acquisitions == 0)
+				continue;
+
+			values[0] = ObjectIdGetDatum(entry->indexOid);
+			values[1] = CStringGetTextDatum(lockClassNames[j]);
+			values[2] = Int64GetDatum((int64) acquisitions);
+			values[3] = Int64GetDatum((int64) pg_atomic_read_u64(&counters->waits));
+			values[4] = Float8GetDatum(pg_atomic_read_u64(&counters->waitTime) / 1000.0);
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		}
+	}
+
+	LWLockRelease(lockStats->lock);
+
+	return (Datum) 0;
+}
+
+/*
+ * Reset lock statistics
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(vector_lock_stats_reset);
+Datum
+vector_lock_stats_reset(PG_FUNCTION_ARGS)
+{
+	if (lockStats == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("lock statistics are not enabled"),
+				 errhint("Add vector to shared_preload_libraries.")));
+
+	LWLockAcquire(lockStats->lock, LW_EXCLUSIVE);
+
+	for (int i = 0; i < lockStats->nentries; i++)
+	{
+		for (int j = 0; j < VECTOR_LOCK_CLASSES; j++)
+		{
+			pg_atomic_write_u64(&lockStats->entries[i].counters[j].acquisitions, 0);
+			pg_atomic_write_u64(&lockStats->entries[i].counters[j].waits, 0);
+			pg_atomic_write_u64(&lockStats->entries[i].counters[j].waitTime, 0);
+		}
+	}
+	lockStats->nentries = 0;
+	pg_atomic_fetch_add_u64(&lockStats->resets, 1);
+
+	LWLockRelease(lockStats->lock);
+
+	PG_RETURN_VOID();
+}
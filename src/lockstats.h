@@ -0,0 +1,30 @@
+#ifndef LOCKSTATS_H
+#define LOCKSTATS_H
+
+#include "postgres.h"
+
+#include "storage/block.h"
+#include "storage/buf.h"
+#include "storage/lockdefs.h"
+#include "storage/lwlock.h"
+#include "utils/relcache.h"
+
+typedef enum VectorLockClass
+{
+	VECTOR_LOCK_HNSW_UPDATE,
+	VECTOR_LOCK_HNSW_ELEMENT,
+	VECTOR_LOCK_HNSW_ENTRY,
+	VECTOR_LOCK_HNSW_ALLOCATOR,
+	VECTOR_LOCK_HNSW_FLUSH,
+	VECTOR_LOCK_IVFFLAT_INSERT,
+	VECTOR_LOCK_CLASSES
+}			VectorLockClass;
+
+void		LockStatsInit(void);
+void		LockStatsBegin(Relation index);
+void		LockStatsEnd(void);
+void		LockStatsLockPage(Relation index, BlockNumber blkno, LOCKMODE mode, VectorLockClass lockClass);
+void		LockStatsLWLockAcquire(LWLock *lock, LWLockMode mode, VectorLockClass lockClass);
+void		LockStatsLockBuffer(Buffer buf, VectorLockClass lockClass);
+
+#endif
@@ -0,0 +1,232 @@
+#include "postgres.h"
+
+#include <float.h>
+#include <math.h>
+
+#include "catalog/pg_type.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "utils/array.h"
+#include "utils/memutils.h"
+#include "vector.h"
+
+#if PG_VERSION_NUM < 130000
+#define TYPALIGN_DOUBLE 'd'
+#endif
+
+typedef struct MmrState
+{
+	int			k;
+	double		lambda;
+	int			dim;
+	int			length;			/* number of candidates */
+	int			maxlen;			/* allocated candidates */
+	float	   *query;			/* normalized query */
+	int64	   *ids;
+	float	   *relevance;		/* cosine similarity to query */
+	float	   *items;			/* normalized candidates, dim floats each */
+}			MmrState;
+
+static pg_attribute_always_inline float
+InnerProduct(int dim, float *ax, float *bx)
+{
+	float		distance = 0.0;
+
+	/* Auto-vectorized */
+	for (int i = 0; i < dim; i++)
+		distance += ax[i] * bx[i];
+
+	return distance;
+}
+
+/*
+ * Copy a vector with unit norm, leaving zero vectors as zero
+ */
+static void
+NormalizeInto(Vector * v, float *x)
+{
+	double		norm = 0.0;
+
+	/* Auto-vectorized */
+	for (int i = 0; i < v->dim; i++)
+		norm += (double) v->x[i] * (double) v->x[i];
+
+	norm = sqrt(norm);
+
+	for (int i = 0; i < v->dim; i++)
+		x[i] = norm > 0 ? v->x[i] / norm : 0;
+}
+
+/*
+ * Add a candidate to the aggregate state
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(vector_mmr_accum);
+Datum
+vector_mmr_accum(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggContext;
+	MmrState   *state = PG_ARGISNULL(0) ? NULL : (MmrState *) PG_GETARG_POINTER(0);
+	Vector	   *value;
+	float	   *item;
+
+	if (!AggCheckCallContext(fcinfo, &aggContext))
+		elog(ERROR, "vector_mmr_accum called in non-aggregate context");
+
+	if (state == NULL)
+	{
+		Vector	   *query;
+
+		if (PG_ARGISNULL(3))
+			ereport(ERROR,
+					(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+					 errmsg("query must not be null")));
+
+		if (PG_ARGISNULL(4) || PG_GETARG_INT32(4) < 1)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("k must be greater than 0")));
+
+		state = MemoryContextAllocZero(aggContext, sizeof(MmrState));
+		state->k = PG_GETARG_INT32(4);
+		state->lambda = PG_NARGS() > 5 && !PG_ARGISNULL(5) ? PG_GETARG_FLOAT8(5) : 0.5;
+
+		if (isnan(state->lambda) || state->lambda < 0 || state->lambda > 1)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("lambda must be between 0 and 1")));
+
+		query = PG_GETARG_VECTOR_P(3);
+		state->dim = query->dim;
+		state->query = MemoryContextAlloc(aggContext, sizeof(float) * query->dim);
+		NormalizeInto(query, state->query);
+	}
+
+	/* Skip candidates without an id or vector */
+	if (PG_ARGISNULL(1) || PG_ARGISNULL(2))
+		PG_RETURN_POINTER(state);
+
+	value = PG_GETARG_VECTOR_P(2);
+
+	if (value->dim != state->dim)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("expected %d dimensions, not %d", state->dim, value->dim)));
+
+	if (state->length == state->maxlen)
+	{
+		int			maxlen = state->maxlen == 0 ? 64 : state->maxlen * 2;
+
+		if ((Size) maxlen * state->dim * sizeof(float) > MaxAllocSize)
+			ereport(ERROR,
+					(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+					 errmsg("too many candidates for mmr")));
+
+		if (state->maxlen == 0)
+		{
+			state->ids = MemoryContextAlloc(aggContext, sizeof(int64) * maxlen);
+			state->relevance = MemoryContextAlloc(aggContext, sizeof(float) * maxlen);
+			state->items = MemoryContextAlloc(aggContext, sizeof(float) * state->dim * maxlen);
+		}
+		else
+		{
+			state->ids = repalloc(state->ids, sizeof(int64) * maxlen);
+			state->relevance = repalloc(state->relevance, sizeof(float) * maxlen);
+			state->items = repalloc(state->items, sizeof(float) * state->dim * maxlen);
+		}
+
+		state->maxlen = maxlen;
+	}
+
+	item = state->items + (Size) state->length * state->dim;
+	NormalizeInto(value, item);
+
+	state->ids[state->length] = PG_GETARG_INT64(1);
+	state->relevance[state->length] = InnerProduct(state->dim, state->query, item);
+	state->length++;
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * Select candidates with Maximal Marginal Relevance
+ *
+ * https://www.cs.cmu.edu/~jgc/publication/The_Use_MMR_Diversity_Based_LTMIR_1998.pdf
+ *
+ * Uses cosine similarity. Instead of the full candidate-candidate matrix,
+ * keeps the maximum similarity of each candidate to the selected ones and
+ * updates it with one row of the matrix after each selection, so only k * n
+ * inner products are computed.
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(vector_mmr_final);
+Datum
+vector_mmr_final(PG_FUNCTION_ARGS)
+{
+	MmrState   *state = PG_ARGISNULL(0) ? NULL : (MmrState *) PG_GETARG_POINTER(0);
+	int			k;
+	float	   *maxSimilarity;
+	bool	   *selected;
+	Datum	   *datums;
+	ArrayType  *result;
+
+	if (state == NULL || state->length == 0)
+		PG_RETURN_NULL();
+
+	k = Min(state->k, state->length);
+	maxSimilarity = palloc(sizeof(float) * state->length);
+	selected = palloc0(sizeof(bool) * state->length);
+	datums = palloc(sizeof(Datum) * k);
+
+	/* No penalty until a candidate is selected */
+	for (int i = 0; i < state->length; i++)
+		maxSimilarity[i] = 0;
+
+	for (int n = 0; n < k; n++)
+	{
+		int			best = -1;
+		double		bestScore = -DBL_MAX;
+		float	   *bestItem;
+
+		/* Ties go to the earlier candidate, which keeps the input order */
+		for (int i = 0; i < state->length; i++)
+		{
+			double		score;
+
+			if (selected[i])
+				continue;
+
+			score = state->lambda * state->relevance[i] - (1 - state->lambda) * maxSimilarity[i];
+			if (score > bestScore)
+			{
+				best = i;
+				bestScore = score;
+			}
+		}
+
+		selected[best] = true;
+		datums[n] = Int64GetDatum(state->ids[best]);
+		bestItem = state->items + (Size) best * state->dim;
+
+		/* Update similarity to the selected set */
+		for (int i = 0; i < state->length; i++)
+		{
+			float		similarity;
+
+			if (selected[i])
+				continue;
+
+			similarity = InnerProduct(state->dim, bestItem, state->items + (Size) i * state->dim);
+			if (n == 0 || similarity > maxSimilarity[i])
+				maxSimilarity[i] = similarity;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	result = construct_array(datums, k, INT8OID, sizeof(int64), FLOAT8PASSBYVAL, TYPALIGN_DOUBLE);
+
+	pfree(maxSimilarity);
+	pfree(selected);
+	pfree(datums);
+
+	PG_RETURN_ARRAYTYPE_P(result);
+}
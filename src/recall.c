@@ -0,0 +1,635 @@
+#include "postgres.h"
+
+#include "access/relation.h"
+#include "access/xact.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_operator.h"
+#include "catalog/pg_type_d.h"
+#include "executor/spi.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "recall.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "tcop/tcopprot.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/ruleutils.h"
+#include "utils/snapmgr.h"
+#include "utils/syscache.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
+
+#if PG_VERSION_NUM >= 150000
+#include "common/pg_prng.h"
+#endif
+
+#if PG_VERSION_NUM >= 160000
+#include "varatt.h"
+#endif
+
+#if PG_VERSION_NUM >= 150000
+#define RandomDouble() pg_prng_double(&pg_global_prng_state)
+#else
+#define RandomDouble() (((double) random()) / MAX_RANDOM_VALUE)
+#endif
+
+#define RECALL_NAME "pgvector recall"
+
+/* Samples waiting for the worker */
+#define RECALL_QUEUE_SIZE 16
+
+/* Larger values are not sampled */
+#define RECALL_MAX_VALUE_SIZE (16 * 1024)
+
+/* Indexes with statistics */
+#define RECALL_MAX_INDEXES 64
+
+/* Number of recent samples for recall */
+#define RECALL_WINDOW 100
+
+/* Time between runs of the worker in milliseconds */
+#define RECALL_NAPTIME 10000
+
+typedef struct RecallSample
+{
+	Oid			dbOid;
+	Oid			indexOid;
+	int			nitems;
+	ItemPointerData items[RECALL_MAX_ITEMS];
+	Size		valueSize;
+	char		value[RECALL_MAX_VALUE_SIZE];
+}			RecallSample;
+
+typedef struct RecallStats
+{
+	Oid			dbOid;
+	Oid			indexOid;
+	int64		samples;
+	double		recall;
+	TimestampTz lastSample;
+}			RecallStats;
+
+typedef struct RecallShared
+{
+	LWLock	   *lock;
+	Oid			dbOid;			/* database of worker */
+	int			head;
+	int			count;
+	RecallStats stats[RECALL_MAX_INDEXES];
+	RecallSample queue[RECALL_QUEUE_SIZE];
+}			RecallShared;
+
+static char *recall_database;
+static double recall_sample_rate;
+static RecallShared * recallShared = NULL;
+
+static volatile sig_atomic_t got_sighup = false;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+
+#if PG_VERSION_NUM >= 150000
+/*
+ * Request shared memory
+ */
+static void
+RecallShmemRequest(void)
+{
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
+
+	RequestAddinShmemSpace(sizeof(RecallShared));
+	RequestNamedLWLockTranche(RECALL_NAME, 1);
+}
+#endif
+
+/*
+ * Initialize shared memory
+ */
+static void
+RecallShmemStartup(void)
+{
+	bool		found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	recallShared = ShmemInitStruct(RECALL_NAME, sizeof(RecallShared), &found);
+	if (!found)
+	{
+		MemSet(recallShared, 0, sizeof(RecallShared));
+		recallShared->lock = &(GetNamedLWLockTranche(RECALL_NAME))->lock;
+		recallShared->dbOid = InvalidOid;
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * Initialize variables, shared memory, and worker
+ */
+void
+RecallInit(void)
+{
+	BackgroundWorker worker;
+
+	/* Shared memory and workers can only be requested at server start */
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	DefineCustomStringVariable("vector.recall_database", "Sets the database to monitor recall for",
+							   "Empty disables monitoring.", &recall_database,
+							   "", PGC_POSTMASTER, 0, NULL, NULL, NULL);
+
+	DefineCustomRealVariable("vector.recall_sample_rate", "Sets the fraction of index scans to sample for recall monitoring",
+							 "Valid range is 0..1.", &recall_sample_rate,
+							 0, 0, 1, PGC_SUSET, 0, NULL, NULL, NULL);
+
+	if (recall_database == NULL || recall_database[0] == '\0')
+		return;
+
+#if PG_VERSION_NUM >= 150000
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = RecallShmemRequest;
+#else
+	RequestAddinShmemSpace(sizeof(RecallShared));
+	RequestNamedLWLockTranche(RECALL_NAME, 1);
+#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = RecallShmemStartup;
+
+	MemSet(&worker, 0, sizeof(BackgroundWorker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = 10;
+	snprintf(worker.bgw_library_name, BGW_MAXLEN, "vector");
+	snprintf(worker.bgw_function_name, BGW_MAXLEN, "RecallWorkerMain");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "pgvector recall worker");
+	snprintf(worker.bgw_type, BGW_MAXLEN, "pgvector recall worker");
+	RegisterBackgroundWorker(&worker);
+}
+
+/*
+ * Prepare sampling for a scan, or return NULL if not monitored
+ */
+RecallSampleState *
+RecallBeginScan(void)
+{
+	RecallSampleState *state;
+
+	/* Only the database of the worker is monitored */
+	if (recallShared == NULL || recall_sample_rate <= 0 || MyDatabaseId != recallShared->dbOid)
+		return NULL;
+
+	state = palloc(sizeof(RecallSampleState));
+	state->active = false;
+	state->value = NULL;
+	state->nitems = 0;
+	return state;
+}
+
+/*
+ * Decide whether to sample a search
+ */
+void
+RecallStartSample(RecallSampleState * state, Relation index, Datum value)
+{
+	Size		size;
+
+	state->active = false;
+	state->nitems = 0;
+
+	if (DatumGetPointer(value) == NULL || RandomDouble() >= recall_sample_rate)
+		return;
+
+	size = VARSIZE_ANY(DatumGetPointer(value));
+	if (size > RECALL_MAX_VALUE_SIZE)
+		return;
+
+	if (state->value != NULL)
+		pfree(state->value);
+
+	state->value = MemoryContextAlloc(GetMemoryChunkContext(state), size);
+	memcpy(state->value, DatumGetPointer(value), size);
+	state->indexOid = RelationGetRelid(index);
+	state->active = true;
+}
+
+/*
+ * Add a heap TID returned by the search
+ */
+void
+RecallAddItem(RecallSampleState * state, ItemPointer heaptid)
+{
+	if (state->active && state->nitems < RECALL_MAX_ITEMS)
+		state->items[state->nitems++] = *heaptid;
+}
+
+/*
+ * Add the sample to the queue
+ */
+void
+RecallEndSample(RecallSampleState * state)
+{
+	if (!state->active)
+		return;
+
+	state->active = false;
+
+	if (state->nitems == 0)
+		return;
+
+	LWLockAcquire(recallShared->lock, LW_EXCLUSIVE);
+
+	/* Drop sample if the worker is behind */
+	if (recallShared->count < RECALL_QUEUE_SIZE)
+	{
+		RecallSample *sample = &recallShared->queue[(recallShared->head + recallShared->count) % RECALL_QUEUE_SIZE];
+
+		sample->dbOid = MyDatabaseId;
+		sample->indexOid = state->indexOid;
+		sample->nitems = state->nitems;
+		memcpy(sample->items, state->items, state->nitems * sizeof(ItemPointerData));
+		sample->valueSize = VARSIZE_ANY(state->value);
+		memcpy(sample->value, state->value, sample->valueSize);
+		recallShared->count++;
+	}
+
+	LWLockRelease(recallShared->lock);
+}
+
+/*
+ * Remove the next sample from the queue
+ */
+static bool
+PopSample(RecallSample * sample)
+{
+	bool		found = false;
+
+	LWLockAcquire(recallShared->lock, LW_EXCLUSIVE);
+
+	if (recallShared->count > 0)
+	{
+		memcpy(sample, &recallShared->queue[recallShared->head], sizeof(RecallSample));
+		recallShared->head = (recallShared->head + 1) % RECALL_QUEUE_SIZE;
+		recallShared->count--;
+		found = true;
+	}
+
+	LWLockRelease(recallShared->lock);
+
+	return found;
+}
+
+/*
+ * Add recall for a sample to statistics
+ */
+static void
+UpdateStats(Oid dbOid, Oid indexOid, double recall)
+{
+	RecallStats *stats = NULL;
+
+	LWLockAcquire(recallShared->lock, LW_EXCLUSIVE);
+
+	for (int i = 0; i < RECALL_MAX_INDEXES; i++)
+	{
+		if (recallShared->stats[i].samples > 0 && recallShared->stats[i].dbOid == dbOid && recallShared->stats[i].indexOid == indexOid)
+		{
+			stats = &recallShared->stats[i];
+			break;
+		}
+	}
+
+	/* Use unused statistics or replace the least recently sampled ones */
+	if (stats == NULL)
+	{
+		for (int i = 0; i < RECALL_MAX_INDEXES; i++)
+		{
+			if (stats == NULL || recallShared->stats[i].samples == 0 || recallShared->stats[i].lastSample < stats->lastSample)
+				stats = &recallShared->stats[i];
+
+			if (stats->samples == 0)
+				break;
+		}
+
+		stats->dbOid = dbOid;
+		stats->indexOid = indexOid;
+		stats->samples = 0;
+		stats->recall = 0;
+	}
+
+	stats->samples++;
+	stats->recall += (recall - stats->recall) / Min(stats->samples, RECALL_WINDOW);
+	stats->lastSample = GetCurrentTimestamp();
+
+	LWLockRelease(recallShared->lock);
+}
+
+/*
+ * Get the ORDER BY operator of an index as SQL
+ */
+static char *
+GetOrderByOperator(Relation index)
+{
+	Oid			opno = get_opfamily_member(index->rd_opfamily[0], index->rd_opcintype[0], index->rd_opcintype[0], 1);
+	HeapTuple	tuple;
+	Form_pg_operator operform;
+	char	   *result;
+
+	if (!OidIsValid(opno))
+		return NULL;
+
+	tuple = SearchSysCache1(OPEROID, ObjectIdGetDatum(opno));
+	if (!HeapTupleIsValid(tuple))
+		return NULL;
+
+	operform = (Form_pg_operator) GETSTRUCT(tuple);
+	result = psprintf("OPERATOR(%s.%s)", quote_identifier(get_namespace_name(operform->oprnamespace)), NameStr(operform->oprname));
+	ReleaseSysCache(tuple);
+
+	return result;
+}
+
+/*
+ * Get the owner of a relation, or InvalidOid if it no longer exists
+ */
+static Oid
+GetRelOwner(Oid relid)
+{
+	HeapTuple	tuple;
+	Oid			owner;
+
+	tuple = SearchSysCache1(RELOID, ObjectIdGetDatum(relid));
+	if (!HeapTupleIsValid(tuple))
+		return InvalidOid;
+
+	owner = ((Form_pg_class) GETSTRUCT(tuple))->relowner;
+	ReleaseSysCache(tuple);
+
+	return owner;
+}
+
+/*
+ * Compare heap TIDs returned by the index with an exact search
+ */
+static void
+ProcessSample(RecallSample * sample)
+{
+	Relation	index;
+	Oid			heapOid;
+	Oid			typid;
+	char	   *op;
+	char	   *heapName;
+	char	   *expr;
+	Datum	   *tids;
+	ItemPointerData *approx;
+	uint64		k;
+	uint64		matched = 0;
+	Pointer		value;
+	StringInfoData query;
+	Oid			argtypes[2];
+	Datum		args[2];
+	Oid			owner;
+	Oid			saveUserId;
+	int			saveSecContext;
+	int			saveNestLevel;
+
+	index = try_relation_open(sample->indexOid, AccessShareLock);
+	if (index == NULL)
+		return;
+
+	if (index->rd_rel->relkind != RELKIND_INDEX)
+	{
+		relation_close(index, AccessShareLock);
+		return;
+	}
+
+	heapOid = index->rd_index->indrelid;
+	typid = index->rd_opcintype[0];
+	op = GetOrderByOperator(index);
+	relation_close(index, AccessShareLock);
+
+	if (op == NULL)
+		return;
+
+	owner = GetRelOwner(heapOid);
+	if (!OidIsValid(owner))
+		return;
+
+	heapName = quote_qualified_identifier(get_namespace_name(get_rel_namespace(heapOid)), get_rel_name(heapOid));
+	expr = pg_get_indexdef_columns(sample->indexOid, false);
+
+	/* Get heap TIDs from the index that are still visible */
+	tids = palloc(sizeof(Datum) * sample->nitems);
+	for (int i = 0; i < sample->nitems; i++)
+		tids[i] = PointerGetDatum(&sample->items[i]);
+
+	/*
+	 * Run queries as the table owner, like maintenance commands, so the
+	 * worker does not evaluate expressions with superuser privileges
+	 */
+	GetUserIdAndSecContext(&saveUserId, &saveSecContext);
+	SetUserIdAndSecContext(owner, saveSecContext | SECURITY_RESTRICTED_OPERATION);
+	saveNestLevel = NewGUCNestLevel();
+
+	initStringInfo(&query);
+	appendStringInfo(&query, "SELECT ctid FROM %s WHERE ctid = ANY($1)", heapName);
+	argtypes[0] = TIDARRAYOID;
+	args[0] = PointerGetDatum(construct_array(tids, sample->nitems, TIDOID, sizeof(ItemPointerData), false, 's'));
+
+	if (SPI_execute_with_args(query.data, 1, argtypes, args, NULL, true, 0) != SPI_OK_SELECT)
+		elog(ERROR, "SPI_execute_with_args failed");
+
+	k = SPI_processed;
+	if (k == 0)
+	{
+		AtEOXact_GUC(false, saveNestLevel);
+		SetUserIdAndSecContext(saveUserId, saveSecContext);
+		return;
+	}
+
+	approx = palloc(sizeof(ItemPointerData) * k);
+	for (uint64 i = 0; i < k; i++)
+	{
+		bool		isnull;
+
+		approx[i] = *DatumGetItemPointer(SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 1, &isnull));
+	}
+
+	/* Get exact results with a (possibly parallel) sequential scan */
+	if (SPI_execute("SET LOCAL enable_indexscan = off", false, 0) != SPI_OK_UTILITY)
+		elog(ERROR, "SPI_execute failed");
+
+	value = palloc(sample->valueSize);
+	memcpy(value, sample->value, sample->valueSize);
+
+	resetStringInfo(&query);
+	appendStringInfo(&query, "SELECT ctid FROM %s ORDER BY %s %s $1 LIMIT $2", heapName, expr, op);
+	argtypes[0] = typid;
+	args[0] = PointerGetDatum(value);
+	argtypes[1] = INT8OID;
+	args[1] = Int64GetDatum((int64) k);
+
+	if (SPI_execute_with_args(query.data, 2, argtypes, args, NULL, true, 0) != SPI_OK_SELECT)
+		elog(ERROR, "SPI_execute_with_args failed");
+
+	for (uint64 i = 0; i < SPI_processed; i++)
+	{
+		bool		isnull;
+		ItemPointer tid = DatumGetItemPointer(SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 1, &isnull));
+
+		for (uint64 j = 0; j < k; j++)
+		{
+			if (ItemPointerEquals(tid, &approx[j]))
+			{
+				matched++;
+				break;
+			}
+		}
+	}
+
+	/* Restore settings and user */
+	AtEOXact_GUC(false, saveNestLevel);
+	SetUserIdAndSecContext(saveUserId, saveSecContext);
+
+	UpdateStats(sample->dbOid, sample->indexOid, (double) matched / k);
+}
+
+/*
+ * Handle SIGHUP
+ */
+static void
+RecallWorkerSighup(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_sighup = true;
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
+
+/*
+ * Compute recall for sampled scans
+ */
+void
+RecallWorkerMain(Datum main_arg)
+{
+	RecallSample *sample;
+
+	pqsignal(SIGHUP, RecallWorkerSighup);
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	BackgroundWorkerInitializeConnection(recall_database, NULL, 0);
+
+	/* Start sampling scans in this database */
+	LWLockAcquire(recallShared->lock, LW_EXCLUSIVE);
+	recallShared->dbOid = MyDatabaseId;
+	LWLockRelease(recallShared->lock);
+
+	sample = palloc(sizeof(RecallSample));
+
+	for (;;)
+	{
+		(void) WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH, RECALL_NAPTIME, PG_WAIT_EXTENSION);
+		ResetLatch(MyLatch);
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (got_sighup)
+		{
+			got_sighup = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		while (PopSample(sample))
+		{
+			SetCurrentStatementStartTimestamp();
+			StartTransactionCommand();
+			SPI_connect();
+			PushActiveSnapshot(GetTransactionSnapshot());
+			pgstat_report_activity(STATE_RUNNING, "computing recall");
+
+			ProcessSample(sample);
+
+			SPI_finish();
+			PopActiveSnapshot();
+			CommitTransactionCommand();
+			pgstat_report_activity(STATE_IDLE, NULL);
+
+			CHECK_FOR_INTERRUPTS();
+		}
+	}
+}
+
+/*
+ * Get recall statistics for indexes in the current database
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(vector_recall_stats);
+Datum
+vector_recall_stats(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldCtx;
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo) || !(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	oldCtx = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldCtx);
+
+	if (recallShared == NULL)
+		return (Datum) 0;
+
+	LWLockAcquire(recallShared->lock, LW_SHARED);
+
+	for (int i = 0; i < RECALL_MAX_INDEXES; i++)
+	{
+		RecallStats *stats = &recallShared->stats[i];
+		Datum		values[4];
+		bool		nulls[4] = {0};
+
+		if (stats->samples == 0 || stats->dbOid != MyDatabaseId)
+			continue;
+
+		values[0] = ObjectIdGetDatum(stats->indexOid);
+		values[1] = Int64GetDatum(stats->samples);
+		values[2] = Float8GetDatum(stats->recall);
+		values[3] = TimestampTzGetDatum(stats->lastSample);
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	LWLockRelease(recallShared->lock);
+
+	return (Datum) 0;
+}
@@ -0,0 +1,29 @@
+#ifndef RECALL_H
+#define RECALL_H
+
+#include "postgres.h"
+
+#include "storage/itemptr.h"
+#include "utils/relcache.h"
+
+/* Max heap TIDs per sample */
+#define RECALL_MAX_ITEMS 100
+
+typedef struct RecallSampleState
+{
+	bool		active;
+	Oid			indexOid;
+	Pointer		value;
+	int			nitems;
+	ItemPointerData items[RECALL_MAX_ITEMS];
+}			RecallSampleState;
+
+void		RecallInit(void);
+RecallSampleState *RecallBeginScan(void);
+void		RecallStartSample(RecallSampleState * state, Relation index, Datum value);
+void		RecallAddItem(RecallSampleState * state, ItemPointer heaptid);
+void		RecallEndSample(RecallSampleState * state);
+
+PGDLLEXPORT void RecallWorkerMain(Datum main_arg);
+
+#endif
@@ -0,0 +1,541 @@
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "access/xlog.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "scancache.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/guc.h"
+#include "utils/rel.h"
+
+#if PG_VERSION_NUM >= 130000
+#include "common/hashfn.h"
+#else
+#include "utils/hashutils.h"
+#endif
+
+#if PG_VERSION_NUM >= 160000
+#include "varatt.h"
+#endif
+
+#define SCAN_CACHE_NAME "pgvector scan cache"
+
+/* Entries per set */
+#define SCAN_CACHE_WAYS 4
+
+/* Indexes with the same hash share a counter */
+#define SCAN_CACHE_COUNTERS 1024
+
+typedef struct ScanCacheEntry
+{
+	ScanCacheKey key;
+	uint64		counter;
+	pg_atomic_uint64 lastUsed;
+	bool		used;
+	bool		complete;
+	int			nitems;
+	ItemPointerData items[SCAN_CACHE_MAX_ITEMS];
+	Size		valueSize;
+	char		value[SCAN_CACHE_MAX_VALUE_SIZE];
+}			ScanCacheEntry;
+
+typedef struct ScanCacheShared
+{
+	LWLock	   *lock;
+	int			nentries;
+	pg_atomic_uint64 clock;
+	pg_atomic_uint64 hits;
+	pg_atomic_uint64 misses;
+	pg_atomic_uint64 invalidations;
+	pg_atomic_uint64 evictions;
+	pg_atomic_uint64 counters[SCAN_CACHE_COUNTERS];
+	ScanCacheEntry entries[FLEXIBLE_ARRAY_MEMBER];
+}			ScanCacheShared;
+
+static int	scan_cache_size;
+static ScanCacheShared * scanCache = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+
+/*
+ * Get the number of entries
+ */
+static int
+ScanCacheEntries(void)
+{
+	Size		entries = ((Size) scan_cache_size * 1024) / sizeof(ScanCacheEntry);
+
+	/* Only use full sets */
+	return (int) (entries - entries % SCAN_CACHE_WAYS);
+}
+
+/*
+ * Get the size of shared memory
+ */
+static Size
+ScanCacheShmemSize(void)
+{
+	return add_size(offsetof(ScanCacheShared, entries), mul_size(ScanCacheEntries(), sizeof(ScanCacheEntry)));
+}
+
+#if PG_VERSION_NUM >= 150000
+/*
+ * Request shared memory
+ */
+static void
+ScanCacheShmemRequest(void)
+{
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
+
+	RequestAddinShmemSpace(ScanCacheShmemSize());
+	RequestNamedLWLockTranche(SCAN_CACHE_NAME, 1);
+}
+#endif
+
+/*
+ * Initialize shared memory
+ */
+static void
+ScanCacheShmemStartup(void)
+{
+	bool		found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	scanCache = ShmemInitStruct(SCAN_CACHE_NAME, ScanCacheShmemSize(), &found);
+	if (!found)
+	{
+		scanCache->lock = &(GetNamedLWLockTranche(SCAN_CACHE_NAME))->lock;
+		scanCache->nentries = ScanCacheEntries();
+		pg_atomic_init_u64(&scanCache->clock, 0);
+		pg_atomic_init_u64(&scanCache->hits, 0);
+		pg_atomic_init_u64(&scanCache->misses, 0);
+		pg_atomic_init_u64(&scanCache->invalidations, 0);
+		pg_atomic_init_u64(&scanCache->evictions, 0);
+
+		for (int i = 0; i < SCAN_CACHE_COUNTERS; i++)
+			pg_atomic_init_u64(&scanCache->counters[i], 0);
+
+		for (int i = 0; i < scanCache->nentries; i++)
+		{
+			scanCache->entries[i].used = false;
+			pg_atomic_init_u64(&scanCache->entries[i].lastUsed, 0);
+		}
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * Initialize variables and shared memory
+ */
+void
+ScanCacheInit(void)
+{
+	/* Shared memory can only be requested at server start */
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	DefineCustomIntVariable("vector.scan_cache_size", "Sets the maximum memory to use for caching index scan results",
+							"Zero disables the cache.", &scan_cache_size,
+							0, 0, MAX_KILOBYTES, PGC_POSTMASTER, GUC_UNIT_KB, NULL, NULL, NULL);
+
+	if (ScanCacheEntries() == 0)
+		return;
+
+#if PG_VERSION_NUM >= 150000
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = ScanCacheShmemRequest;
+#else
+	RequestAddinShmemSpace(ScanCacheShmemSize());
+	RequestNamedLWLockTranche(SCAN_CACHE_NAME, 1);
+#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = ScanCacheShmemStartup;
+}
+
+/*
+ * Initialize a key for an index
+ */
+static void
+InitKey(ScanCacheKey * key, Relation index)
+{
+	/* Zero padding for comparisons */
+	MemSet(key, 0, sizeof(ScanCacheKey));
+
+	/* Use the relfilenode so rewrites do not need to invalidate */
+#if PG_VERSION_NUM >= 160000
+	key->spcOid = index->rd_locator.spcOid;
+	key->dbOid = index->rd_locator.dbOid;
+	key->relNumber = index->rd_locator.relNumber;
+#else
+	key->spcOid = index->rd_node.spcNode;
+	key->dbOid = index->rd_node.dbNode;
+	key->relNumber = index->rd_node.relNode;
+#endif
+}
+
+/*
+ * Get the modification counter for a key
+ */
+static pg_atomic_uint64 *
+GetCounter(ScanCacheKey * key)
+{
+	uint32		hash = hash_combine(hash_combine(murmurhash32(key->spcOid), murmurhash32(key->dbOid)), murmurhash32(key->relNumber));
+
+	return &scanCache->counters[hash % SCAN_CACHE_COUNTERS];
+}
+
+/*
+ * Get the first entry in the set for a key
+ */
+static ScanCacheEntry *
+GetSet(ScanCacheKey * key)
+{
+	uint64		hash = hash_combine64(key->hash, ((uint64) murmurhash32(key->relNumber) << 32) | (uint32) key->param);
+
+	return &scanCache->entries[(hash % (scanCache->nentries / SCAN_CACHE_WAYS)) * SCAN_CACHE_WAYS];
+}
+
+/*
+ * Find the entry for a search in a set
+ *
+ * The hash only narrows the search, so compare the value as well
+ */
+static ScanCacheEntry *
+FindEntry(ScanCacheEntry * set, ScanCacheState * state)
+{
+	for (int i = 0; i < SCAN_CACHE_WAYS; i++)
+	{
+		if (set[i].used && memcmp(&set[i].key, &state->key, sizeof(ScanCacheKey)) == 0 &&
+			set[i].valueSize == state->valueSize &&
+			memcmp(set[i].value, state->value, state->valueSize) == 0)
+			return &set[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Prepare the cache for a scan, or return NULL if not available
+ */
+ScanCacheState *
+ScanCacheBeginScan(void)
+{
+	ScanCacheState *state;
+
+	/* Replayed modifications do not update counters */
+	if (scanCache == NULL || RecoveryInProgress())
+		return NULL;
+
+	state = palloc(sizeof(ScanCacheState));
+	state->active = false;
+	state->replaying = false;
+	return state;
+}
+
+/*
+ * Look up cached heap TIDs for a search
+ */
+bool
+ScanCacheLookup(ScanCacheState * state, Relation index, Datum value, int param)
+{
+	ScanCacheEntry *entry;
+	Size		size;
+	bool		found = false;
+
+	state->active = false;
+	state->replaying = false;
+	state->complete = false;
+	state->dirty = false;
+	state->overflow = false;
+	state->nitems = 0;
+	state->nreplayed = 0;
+	state->pos = 0;
+
+	/* Null values are not cached */
+	if (DatumGetPointer(value) == NULL)
+		return false;
+
+	/* Values are stored in entries to compare */
+	size = VARSIZE_ANY(DatumGetPointer(value));
+	if (size > SCAN_CACHE_MAX_VALUE_SIZE)
+		return false;
+
+	InitKey(&state->key, index);
+	state->key.param = param;
+	state->key.hash = DatumGetUInt64(hash_any_extended((unsigned char *) DatumGetPointer(value), size, 0));
+	state->valueSize = size;
+	memcpy(state->value, DatumGetPointer(value), size);
+	state->active = true;
+
+	/*
+	 * Read before searching so modifications that happen during the search
+	 * invalidate the result
+	 */
+	state->counter = pg_atomic_read_u64(GetCounter(&state->key));
+
+	LWLockAcquire(scanCache->lock, LW_SHARED);
+
+	entry = FindEntry(GetSet(&state->key), state);
+	if (entry != NULL)
+	{
+		if (entry->counter == state->counter)
+		{
+			memcpy(state->items, entry->items, entry->nitems * sizeof(ItemPointerData));
+			state->nitems = entry->nitems;
+			state->complete = entry->complete;
+			pg_atomic_write_u64(&entry->lastUsed, pg_atomic_fetch_add_u64(&scanCache->clock, 1));
+			found = true;
+		}
+		else
+			pg_atomic_fetch_add_u64(&scanCache->invalidations, 1);
+	}
+
+	LWLockRelease(scanCache->lock);
+
+	pg_atomic_fetch_add_u64(found ? &scanCache->hits : &scanCache->misses, 1);
+
+	state->replaying = found;
+	return found;
+}
+
+/*
+ * Get the next cached heap TID
+ *
+ * Once this returns false, the caller needs to search unless the cached
+ * heap TIDs were complete.
+ */
+bool
+ScanCacheNext(ScanCacheState * state, ItemPointer heaptid)
+{
+	if (state->pos < state->nitems)
+	{
+		*heaptid = state->items[state->pos++];
+		return true;
+	}
+
+	/* Prepare to skip replayed heap TIDs in search results */
+	state->replaying = false;
+	state->nreplayed = state->nitems;
+	state->pos = 0;
+	return false;
+}
+
+/*
+ * Add a heap TID from search results
+ *
+ * Returns false if it was already returned from the cache. Search results
+ * have the same order as cached heap TIDs, but may be missing ones that were
+ * marked dead since.
+ */
+bool
+ScanCacheAddItem(ScanCacheState * state, ItemPointer heaptid)
+{
+	if (!state->active)
+		return true;
+
+	for (int i = state->pos; i < state->nreplayed; i++)
+	{
+		if (ItemPointerEquals(&state->items[i], heaptid))
+		{
+			state->pos = i + 1;
+			return false;
+		}
+	}
+
+	if (state->nitems < SCAN_CACHE_MAX_ITEMS)
+		state->items[state->nitems++] = *heaptid;
+	else
+		state->overflow = true;
+
+	state->dirty = true;
+	return true;
+}
+
+/*
+ * Mark that all heap TIDs were returned
+ */
+void
+ScanCacheFinish(ScanCacheState * state)
+{
+	if (state->active && !state->complete && !state->overflow)
+	{
+		state->complete = true;
+		state->dirty = true;
+	}
+}
+
+/*
+ * Store heap TIDs
+ */
+static void
+StoreEntry(ScanCacheState * state)
+{
+	ScanCacheEntry *set;
+	ScanCacheEntry *entry;
+
+	/* Skip if index was modified during the search */
+	if (pg_atomic_read_u64(GetCounter(&state->key)) != state->counter)
+		return;
+
+	LWLockAcquire(scanCache->lock, LW_EXCLUSIVE);
+
+	set = GetSet(&state->key);
+	entry = FindEntry(set, state);
+
+	if (entry != NULL)
+	{
+		/* Keep existing entry if newer or more complete */
+		if (entry->counter > state->counter || (entry->counter == state->counter && (entry->complete || (!state->complete && entry->nitems >= state->nitems))))
+		{
+			LWLockRelease(scanCache->lock);
+			return;
+		}
+	}
+	else
+	{
+		/* Use an unused entry or evict the least recently used one */
+		for (int i = 0; i < SCAN_CACHE_WAYS; i++)
+		{
+			if (!set[i].used)
+			{
+				entry = &set[i];
+				break;
+			}
+
+			if (entry == NULL || pg_atomic_read_u64(&set[i].lastUsed) < pg_atomic_read_u64(&entry->lastUsed))
+				entry = &set[i];
+		}
+
+		if (entry->used)
+			pg_atomic_fetch_add_u64(&scanCache->evictions, 1);
+	}
+
+	entry->key = state->key;
+	entry->counter = state->counter;
+	entry->complete = state->complete;
+	entry->nitems = state->nitems;
+	memcpy(entry->items, state->items, state->nitems * sizeof(ItemPointerData));
+	entry->valueSize = state->valueSize;
+	memcpy(entry->value, state->value, state->valueSize);
+	entry->used = true;
+	pg_atomic_write_u64(&entry->lastUsed, pg_atomic_fetch_add_u64(&scanCache->clock, 1));
+
+	LWLockRelease(scanCache->lock);
+}
+
+/*
+ * End a search, storing heap TIDs that were returned
+ */
+void
+ScanCacheEndSearch(ScanCacheState * state)
+{
+	if (state->active && state->dirty)
+		StoreEntry(state);
+
+	state->active = false;
+	state->replaying = false;
+}
+
+/*
+ * Invalidate cached heap TIDs for an index
+ *
+ * Must be called both before and after the index is modified. A scan that
+ * starts while the modification is in progress can see the counter after
+ * the first call, so the second call keeps its results from being reused.
+ */
+void
+ScanCacheInvalidate(Relation index)
+{
+	ScanCacheKey key;
+
+	if (scanCache == NULL)
+		return;
+
+	InitKey(&key, index);
+	pg_atomic_fetch_add_u64(GetCounter(&key), 1);
+}
+
+/*
+ * Ensure the cache is enabled
+ */
+static void
+CheckEnabled(void)
+{
+	if (scanCache == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("scan cache is not enabled"),
+				 errhint("Add vector to shared_preload_libraries and set vector.scan_cache_size.")));
+}
+
+/*
+ * Get scan cache statistics
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(vector_scan_cache_stats);
+Datum
+vector_scan_cache_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Datum		values[6];
+	bool		nulls[6] = {0};
+	int			entries = 0;
+
+	CheckEnabled();
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	LWLockAcquire(scanCache->lock, LW_SHARED);
+	for (int i = 0; i < scanCache->nentries; i++)
+	{
+		if (scanCache->entries[i].used)
+			entries++;
+	}
+	LWLockRelease(scanCache->lock);
+
+	values[0] = Int32GetDatum(scanCache->nentries);
+	values[1] = Int32GetDatum(entries);
+	values[2] = Int64GetDatum((int64) pg_atomic_read_u64(&scanCache->hits));
+	values[3] = Int64GetDatum((int64) pg_atomic_read_u64(&scanCache->misses));
+	values[4] = Int64GetDatum((int64) pg_atomic_read_u64(&scanCache->invalidations));
+	values[5] = Int64GetDatum((int64) pg_atomic_read_u64(&scanCache->evictions));
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/*
+ * Remove all entries and reset statistics
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(vector_scan_cache_reset);
+Datum
+vector_scan_cache_reset(PG_FUNCTION_ARGS)
+{
+	CheckEnabled();
+
+	LWLockAcquire(scanCache->lock, LW_EXCLUSIVE);
+	for (int i = 0; i < scanCache->nentries; i++)
+		scanCache->entries[i].used = false;
+	LWLockRelease(scanCache->lock);
+
+	pg_atomic_write_u64(&scanCache->hits, 0);
+	pg_atomic_write_u64(&scanCache->misses, 0);
+	pg_atomic_write_u64(&scanCache->invalidations, 0);
+	pg_atomic_write_u64(&scanCache->evictions, 0);
+
+	PG_RETURN_VOID();
+}
@@ -0,0 +1,50 @@
+#ifndef SCANCACHE_H
+#define SCANCACHE_H
+
+#include "postgres.h"
+
+#include "storage/itemptr.h"
+#include "utils/relcache.h"
+
+/* Max heap TIDs per entry */
+#define SCAN_CACHE_MAX_ITEMS 256
+
+/* Max size of scan values, enough for any value that can be indexed */
+#define SCAN_CACHE_MAX_VALUE_SIZE 8192
+
+typedef struct ScanCacheKey
+{
+	Oid			spcOid;
+	Oid			dbOid;
+	Oid			relNumber;
+	int			param;			/* ef_search or probes */
+	uint64		hash;			/* hash of scan value */
+}			ScanCacheKey;
+
+typedef struct ScanCacheState
+{
+	ScanCacheKey key;
+	uint64		counter;		/* modification counter when search started */
+	bool		active;			/* cache is used for current search */
+	bool		replaying;		/* returning heap TIDs from the cache */
+	bool		complete;		/* no heap TIDs after cached ones */
+	bool		dirty;			/* has heap TIDs not in the cache */
+	bool		overflow;		/* too many heap TIDs to cache */
+	int			nitems;
+	int			nreplayed;
+	int			pos;
+	ItemPointerData items[SCAN_CACHE_MAX_ITEMS];
+	Size		valueSize;
+	char		value[SCAN_CACHE_MAX_VALUE_SIZE];
+}			ScanCacheState;
+
+void		ScanCacheInit(void);
+ScanCacheState *ScanCacheBeginScan(void);
+bool		ScanCacheLookup(ScanCacheState * state, Relation index, Datum value, int param);
+bool		ScanCacheNext(ScanCacheState * state, ItemPointer heaptid);
+bool		ScanCacheAddItem(ScanCacheState * state, ItemPointer heaptid);
+void		ScanCacheFinish(ScanCacheState * state);
+void		ScanCacheEndSearch(ScanCacheState * state);
+void		ScanCacheInvalidate(Relation index);
+
+#endif
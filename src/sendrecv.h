@@ -0,0 +1,92 @@
+#ifndef SENDRECV_H
+#define SENDRECV_H
+
+#include "postgres.h"
+
+#include "lib/stringinfo.h"
+#include "libpq/pqformat.h"
+#include "port/pg_bswap.h"
+
+/*
+ * Bulk versions of pq_getmsgint and pq_sendint for arrays of elements
+ *
+ * Elements are copied with a single bounds check and swapped in a separate
+ * loop without calls or branches, which the compiler can vectorize with
+ * shuffles.
+ */
+
+/*
+ * Get 32-bit values from a message buffer
+ */
+static inline void
+pq_copymsgint32s(StringInfo msg, uint32 *dst, int count)
+{
+	pq_copymsgbytes(msg, (char *) dst, sizeof(uint32) * count);
+
+#ifndef WORDS_BIGENDIAN
+	for (int i = 0; i < count; i++)
+		dst[i] = pg_bswap32(dst[i]);
+#endif
+}
+
+/*
+ * Get 16-bit values from a message buffer
+ */
+static inline void
+pq_copymsgint16s(StringInfo msg, uint16 *dst, int count)
+{
+	pq_copymsgbytes(msg, (char *) dst, sizeof(uint16) * count);
+
+#ifndef WORDS_BIGENDIAN
+	for (int i = 0; i < count; i++)
+		dst[i] = pg_bswap16(dst[i]);
+#endif
+}
+
+/*
+ * Append 32-bit values to a StringInfo buffer
+ */
+static inline void
+pq_sendint32s(StringInfo buf, const uint32 *src, int count)
+{
+	Size		size = sizeof(uint32) * count;
+	uint32	   *dst;
+
+	enlargeStringInfo(buf, size);
+	dst = (uint32 *) (buf->data + buf->len);
+
+#ifdef WORDS_BIGENDIAN
+	memcpy(dst, src, size);
+#else
+	for (int i = 0; i < count; i++)
+		dst[i] = pg_bswap32(src[i]);
+#endif
+
+	buf->len += size;
+	buf->data[buf->len] = '\0';
+}
+
+/*
+ * Append 16-bit values to a StringInfo buffer
+ */
+static inline void
+pq_sendint16s(StringInfo buf, const uint16 *src, int count)
+{
+	Size		size = sizeof(uint16) * count;
+	uint16	   *dst;
+
+	enlargeStringInfo(buf, size);
+	dst = (uint16 *) (buf->data + buf->len);
+
+#ifdef WORDS_BIGENDIAN
+	memcpy(dst, src, size);
+#else
+	for (int i = 0; i < count; i++)
+		dst[i] = pg_bswap16(src[i]);
+#endif
+
+	buf->len += size;
+	buf->data[buf->len] = '\0';
+}
+
+#endif
@@ -8,6 +8,7 @@
 #include "halfutils.h"
 #include "halfvec.h"
 #include "libpq/pqformat.h"
+#include "sendrecv.h"
 #include "sparsevec.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
@@ -522,15 +523,13 @@ sparsevec_recv(PG_FUNCTION_ARGS)
 	values = SPARSEVEC_VALUES(result);
 
 	/* Binary representation uses zero-based numbering for indices */
+	pq_copymsgint32s(buf, (uint32 *) result->indices, nnz);
 	for (int i = 0; i < nnz; i++)
-	{
-		result->indices[i] = pq_getmsgint(buf, sizeof(int32));
 		CheckIndex(result->indices, i, dim);
-	}
 
+	pq_copymsgint32s(buf, (uint32 *) values, nnz);
 	for (int i = 0; i < nnz; i++)
 	{
-		values[i] = pq_getmsgfloat4(buf);
 		CheckElement(values[i]);
 
 		if (values[i] == 0)
@@ -559,11 +558,8 @@ sparsevec_send(PG_FUNCTION_ARGS)
 	pq_sendint(&buf, svec->unused, sizeof(int32));
 
 	/* Binary representation uses zero-based numbering for indices */
-	for (int i = 0; i < svec->nnz; i++)
-		pq_sendint(&buf, svec->indices[i], sizeof(int32));
-
-	for (int i = 0; i < svec->nnz; i++)
-		pq_sendfloat4(&buf, values[i]);
+	pq_sendint32s(&buf, (uint32 *) svec->indices, svec->nnz);
+	pq_sendint32s(&buf, (uint32 *) values, svec->nnz);
 
 	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
 }
@@ -610,18 +606,13 @@ vector_to_sparsevec(PG_FUNCTION_ARGS)
 
 	result = InitSparseVector(dim, nnz);
 	values = SPARSEVEC_VALUES(result);
-	for (int i = 0; i < dim; i++)
-	{
-		if (vec->x[i] != 0)
-		{
-			/* Safety check */
-			if (j >= result->nnz)
-				elog(ERROR, "safety check failed");
 
-			result->indices[j] = i;
-			values[j] = vec->x[i];
-			j++;
-		}
+	/* Write every element and advance past nonzero ones to avoid branches */
+	for (int i = 0; i < dim && j < nnz; i++)
+	{
+		result->indices[j] = i;
+		values[j] = vec->x[i];
+		j += vec->x[i] != 0;
 	}
 
 	PG_RETURN_POINTER(result);
@@ -653,18 +644,13 @@ halfvec_to_sparsevec(PG_FUNCTION_ARGS)
 
 	result = InitSparseVector(dim, nnz);
 	values = SPARSEVEC_VALUES(result);
-	for (int i = 0; i < dim; i++)
-	{
-		if (!HalfIsZero(vec->x[i]))
-		{
-			/* Safety check */
-			if (j >= result->nnz)
-				elog(ERROR, "safety check failed");
 
-			result->indices[j] = i;
-			values[j] = HalfToFloat4(vec->x[i]);
-			j++;
-		}
+	/* Write every element and advance past nonzero ones to avoid branches */
+	for (int i = 0; i < dim && j < nnz; i++)
+	{
+		result->indices[j] = i;
+		values[j] = HalfToFloat4(vec->x[i]);
+		j += !HalfIsZero(vec->x[i]);
 	}
 
 	PG_RETURN_POINTER(result);
@@ -12,12 +12,18 @@
 #include "hnsw.h"
 #include "ivfflat.h"
 #include "lib/stringinfo.h"
+#include "lockstats.h"
 #include "libpq/pqformat.h"
+#include "miscadmin.h"
 #include "port.h"				/* for strtof() */
+#include "recall.h"
+#include "scancache.h"
+#include "sendrecv.h"
 #include "sparsevec.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/float.h"
+#include "utils/guc.h"
 #include "utils/lsyscache.h"
 #include "utils/numeric.h"
 #include "vector.h"
@@ -26,6 +32,10 @@
 #include "varatt.h"
 #endif
 
+#if PG_VERSION_NUM < 150000
+#define MarkGUCPrefixReserved(x) EmitWarningsOnPlaceholders(x)
+#endif
+
 #if PG_VERSION_NUM < 130000
 #define TYPALIGN_DOUBLE 'd'
 #define TYPALIGN_INT 'i'
@@ -53,6 +63,13 @@ _PG_init(void)
 	HalfvecInit();
 	HnswInit();
 	IvfflatInit();
+	ScanCacheInit();
+	RecallInit();
+	LockStatsInit();
+
+	/* vector.* variables are only defined when preloaded */
+	if (process_shared_preload_libraries_in_progress)
+		MarkGUCPrefixReserved("vector");
 }
 
 /*
@@ -401,10 +418,12 @@ vector_recv(PG_FUNCTION_ARGS)
 				 errmsg("expected unused to be 0, not %d", unused)));
 
 	result = InitVector(dim);
-	for (int i = 0; i < dim; i++)
+	pq_copymsgint32s(buf, (uint32 *) result->x, dim);
+
+	if (AnyNonFiniteFloat4((uint32 *) result->x, dim))
 	{
-		result->x[i] = pq_getmsgfloat4(buf);
-		CheckElement(result->x[i]);
+		for (int i = 0; i < dim; i++)
+			CheckElement(result->x[i]);
 	}
 
 	PG_RETURN_POINTER(result);
@@ -423,8 +442,7 @@ vector_send(PG_FUNCTION_ARGS)
 	pq_begintypsend(&buf);
 	pq_sendint(&buf, vec->dim, sizeof(int16));
 	pq_sendint(&buf, vec->unused, sizeof(int16));
-	for (int i = 0; i < vec->dim; i++)
-		pq_sendfloat4(&buf, vec->x[i]);
+	pq_sendint32s(&buf, (uint32 *) vec->x, vec->dim);
 
 	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
 }
@@ -558,15 +576,13 @@ halfvec_to_vector(PG_FUNCTION_ARGS)
 	CheckExpectedDim(typmod, vec->dim);
 
 	result = InitVector(vec->dim);
-
-	for (int i = 0; i < vec->dim; i++)
-		result->x[i] = HalfToFloat4(vec->x[i]);
+	HalfToFloat4Array(vec->dim, vec->x, result->x);
 
 	PG_RETURN_POINTER(result);
 }
 
-VECTOR_TARGET_CLONES static float
-VectorL2SquaredDistance(int dim, float *ax, float *bx)
+static pg_attribute_always_inline float
+VectorL2SquaredDistanceImpl(int dim, float *ax, float *bx)
 {
 	float		distance = 0.0;
 
@@ -581,6 +597,12 @@ VectorL2SquaredDistance(int dim, float *ax, float *bx)
 	return distance;
 }
 
+VECTOR_TARGET_CLONES static float
+VectorL2SquaredDistance(int dim, float *ax, float *bx)
+{
+	VECTOR_SPECIALIZE_DIM(dim, VectorL2SquaredDistanceImpl, ax, bx);
+}
+
 /*
  * Get the L2 distance between vectors
  */
@@ -612,8 +634,8 @@ vector_l2_squared_distance(PG_FUNCTION_ARGS)
 	PG_RETURN_FLOAT8((double) VectorL2SquaredDistance(a->dim, a->x, b->x));
 }
 
-VECTOR_TARGET_CLONES static float
-VectorInnerProduct(int dim, float *ax, float *bx)
+static pg_attribute_always_inline float
+VectorInnerProductImpl(int dim, float *ax, float *bx)
 {
 	float		distance = 0.0;
 
@@ -624,6 +646,12 @@ VectorInnerProduct(int dim, float *ax, float *bx)
 	return distance;
 }
 
+VECTOR_TARGET_CLONES static float
+VectorInnerProduct(int dim, float *ax, float *bx)
+{
+	VECTOR_SPECIALIZE_DIM(dim, VectorInnerProductImpl, ax, bx);
+}
+
 /*
  * Get the inner product of two vectors
  */
@@ -654,8 +682,8 @@ vector_negative_inner_product(PG_FUNCTION_ARGS)
 	PG_RETURN_FLOAT8((double) -VectorInnerProduct(a->dim, a->x, b->x));
 }
 
-VECTOR_TARGET_CLONES static double
-VectorCosineSimilarity(int dim, float *ax, float *bx)
+static pg_attribute_always_inline double
+VectorCosineSimilarityImpl(int dim, float *ax, float *bx)
 {
 	float		similarity = 0.0;
 	float		norma = 0.0;
@@ -673,6 +701,12 @@ VectorCosineSimilarity(int dim, float *ax, float *bx)
 	return (double) similarity / sqrt((double) norma * (double) normb);
 }
 
+VECTOR_TARGET_CLONES static double
+VectorCosineSimilarity(int dim, float *ax, float *bx)
+{
+	VECTOR_SPECIALIZE_DIM(dim, VectorCosineSimilarityImpl, ax, bx);
+}
+
 /*
  * Get the cosine distance between two vectors
  */
@@ -730,8 +764,8 @@ vector_spherical_distance(PG_FUNCTION_ARGS)
 }
 
 /* Does not require FMA, but keep logic simple */
-VECTOR_TARGET_CLONES static float
-VectorL1Distance(int dim, float *ax, float *bx)
+static pg_attribute_always_inline float
+VectorL1DistanceImpl(int dim, float *ax, float *bx)
 {
 	float		distance = 0.0;
 
@@ -742,6 +776,12 @@ VectorL1Distance(int dim, float *ax, float *bx)
 	return distance;
 }
 
+VECTOR_TARGET_CLONES static float
+VectorL1Distance(int dim, float *ax, float *bx)
+{
+	VECTOR_SPECIALIZE_DIM(dim, VectorL1DistanceImpl, ax, bx);
+}
+
 /*
  * Get the L1 distance between two vectors
  */
@@ -757,6 +797,140 @@ l1_distance(PG_FUNCTION_ARGS)
 	PG_RETURN_FLOAT8((double) VectorL1Distance(a->dim, a->x, b->x));
 }
 
+/*
+ * Get the L2 squared distance between vectors, stopping early once greater
+ * than maxDistance
+ */
+static float
+VectorL2SquaredDistanceBounded(int dim, float *ax, float *bx, double maxDistance)
+{
+	float		distance = 0.0;
+
+	/* Check after each block so the kernel is still vectorized */
+	for (int i = 0; i < dim; i += BOUNDED_DISTANCE_BLOCK)
+	{
+		distance += VectorL2SquaredDistance(Min(BOUNDED_DISTANCE_BLOCK, dim - i), ax + i, bx + i);
+
+		if (distance > maxDistance)
+			break;
+	}
+
+	return distance;
+}
+
+/*
+ * Get the L1 distance between vectors, stopping early once greater than
+ * maxDistance
+ */
+static float
+VectorL1DistanceBounded(int dim, float *ax, float *bx, double maxDistance)
+{
+	float		distance = 0.0;
+
+	/* Check after each block so the kernel is still vectorized */
+	for (int i = 0; i < dim; i += BOUNDED_DISTANCE_BLOCK)
+	{
+		distance += VectorL1Distance(Min(BOUNDED_DISTANCE_BLOCK, dim - i), ax + i, bx + i);
+
+		if (distance > maxDistance)
+			break;
+	}
+
+	return distance;
+}
+
+/*
+ * Get the bounded L2 squared distance between vectors
+ */
+static double
+VectorL2SquaredBoundedDistance(Datum a, Datum b, double maxDistance)
+{
+	Vector	   *va = DatumGetVector(a);
+	Vector	   *vb = DatumGetVector(b);
+
+	CheckDims(va, vb);
+
+	return (double) VectorL2SquaredDistanceBounded(va->dim, va->x, vb->x, maxDistance);
+}
+
+/*
+ * Get the bounded L2 distance between vectors
+ */
+static double
+VectorL2BoundedDistance(Datum a, Datum b, double maxDistance)
+{
+	Vector	   *va = DatumGetVector(a);
+	Vector	   *vb = DatumGetVector(b);
+
+	CheckDims(va, vb);
+
+	return sqrt((double) VectorL2SquaredDistanceBounded(va->dim, va->x, vb->x, maxDistance * maxDistance));
+}
+
+/*
+ * Get the bounded L1 distance between vectors
+ */
+static double
+VectorL1BoundedDistance(Datum a, Datum b, double maxDistance)
+{
+	Vector	   *va = DatumGetVector(a);
+	Vector	   *vb = DatumGetVector(b);
+
+	CheckDims(va, vb);
+
+	return (double) VectorL1DistanceBounded(va->dim, va->x, vb->x, maxDistance);
+}
+
+PGDLLEXPORT Datum halfvec_l2_distance(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum halfvec_l2_squared_distance(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum halfvec_l1_distance(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hamming_distance(PG_FUNCTION_ARGS);
+
+/*
+ * Get the bounded version of a distance function
+ *
+ * Only possible for distances that increase with each dimension
+ */
+BoundedDistanceFunc
+GetBoundedDistanceFunc(FmgrInfo *procinfo)
+{
+	PGFunction	fn = procinfo->fn_addr;
+
+	if (fn == vector_l2_squared_distance)
+		return VectorL2SquaredBoundedDistance;
+	else if (fn == l2_distance)
+		return VectorL2BoundedDistance;
+	else if (fn == l1_distance)
+		return VectorL1BoundedDistance;
+	else if (fn == halfvec_l2_squared_distance)
+		return HalfvecL2SquaredBoundedDistance;
+	else if (fn == halfvec_l2_distance)
+		return HalfvecL2BoundedDistance;
+	else if (fn == halfvec_l1_distance)
+		return HalfvecL1BoundedDistance;
+	else if (fn == hamming_distance)
+		return BitHammingBoundedDistance;
+
+	return NULL;
+}
+
+/*
+ * Get a lower bound on the ORDER BY distance from the distance of a prefix
+ *
+ * Only possible for distances that increase with each dimension. The margin
+ * covers the different summation order when computing the full distance.
+ */
+double
+PrefixDistanceLowerBound(FmgrInfo *procinfo, double distance)
+{
+	PGFunction	fn = procinfo->fn_addr;
+
+	if (fn == vector_l2_squared_distance || fn == halfvec_l2_squared_distance)
+		distance = sqrt(distance);
+
+	return distance * (1 - PREFIX_DISTANCE_MARGIN);
+}
+
 /*
  * Get the dimensions of a vector
  */
@@ -816,11 +990,8 @@ l2_normalize(PG_FUNCTION_ARGS)
 			rx[i] = ax[i] / norm;
 
 		/* Check for overflow */
-		for (int i = 0; i < a->dim; i++)
-		{
-			if (isinf(rx[i]))
-				float_overflow_error();
-		}
+		if (AnyNonFiniteFloat4((uint32 *) rx, a->dim))
+			float_overflow_error();
 	}
 
 	PG_RETURN_POINTER(result);
@@ -850,11 +1021,8 @@ vector_add(PG_FUNCTION_ARGS)
 		rx[i] = ax[i] + bx[i];
 
 	/* Check for overflow */
-	for (int i = 0, imax = a->dim; i < imax; i++)
-	{
-		if (isinf(rx[i]))
-			float_overflow_error();
-	}
+	if (AnyNonFiniteFloat4((uint32 *) rx, a->dim))
+		float_overflow_error();
 
 	PG_RETURN_POINTER(result);
 }
@@ -883,11 +1051,8 @@ vector_sub(PG_FUNCTION_ARGS)
 		rx[i] = ax[i] - bx[i];
 
 	/* Check for overflow */
-	for (int i = 0, imax = a->dim; i < imax; i++)
-	{
-		if (isinf(rx[i]))
-			float_overflow_error();
-	}
+	if (AnyNonFiniteFloat4((uint32 *) rx, a->dim))
+		float_overflow_error();
 
 	PG_RETURN_POINTER(result);
 }
@@ -905,6 +1070,7 @@ vector_mul(PG_FUNCTION_ARGS)
 	float	   *bx = b->x;
 	Vector	   *result;
 	float	   *rx;
+	uint32		underflow = 0;
 
 	CheckDims(a, b);
 
@@ -916,14 +1082,14 @@ vector_mul(PG_FUNCTION_ARGS)
 		rx[i] = ax[i] * bx[i];
 
 	/* Check for overflow and underflow */
+	if (AnyNonFiniteFloat4((uint32 *) rx, a->dim))
+		float_overflow_error();
+
 	for (int i = 0, imax = a->dim; i < imax; i++)
-	{
-		if (isinf(rx[i]))
-			float_overflow_error();
+		underflow |= rx[i] == 0 && ax[i] != 0 && bx[i] != 0;
 
-		if (rx[i] == 0 && !(ax[i] == 0 || bx[i] == 0))
-			float_underflow_error();
-	}
+	if (underflow)
+		float_underflow_error();
 
 	PG_RETURN_POINTER(result);
 }
@@ -952,6 +1118,95 @@ vector_concat(PG_FUNCTION_ARGS)
 	PG_RETURN_POINTER(result);
 }
 
+/* Number of output elements to accumulate at a time for projections */
+#define PROJECT_BLOCK_SIZE 256
+
+/*
+ * Multiply a vector by a row-major matrix
+ *
+ * Output elements are accumulated in blocks that stay in cache while rows
+ * of the matrix are streamed through.
+ */
+static void
+VectorProject(int rows, int cols, float *x, float *m, float *y)
+{
+	for (int start = 0; start < cols; start += PROJECT_BLOCK_SIZE)
+	{
+		int			count = Min(cols - start, PROJECT_BLOCK_SIZE);
+		float	   *ry = y + start;
+
+		for (int i = 0; i < rows; i++)
+		{
+			float		xi = x[i];
+			float	   *mi = m + (Size) i * cols + start;
+
+			/* Auto-vectorized */
+			for (int j = 0; j < count; j++)
+				ry[j] += xi * mi[j];
+		}
+	}
+}
+
+/*
+ * Project a vector with a matrix
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(vector_project);
+Datum
+vector_project(PG_FUNCTION_ARGS)
+{
+	Vector	   *a = PG_GETARG_VECTOR_P(0);
+	ArrayType  *matrix = PG_GETARG_ARRAYTYPE_P(1);
+	float	   *mx;
+	int			rows;
+	int			cols;
+	Vector	   *result;
+
+	if (ARR_ELEMTYPE(matrix) != FLOAT4OID)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("unsupported array type")));
+
+	if (ARR_NDIM(matrix) != 2)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("matrix must be 2-D")));
+
+	if (ARR_HASNULL(matrix) && array_contains_nulls(matrix))
+		ereport(ERROR,
+				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+				 errmsg("matrix must not contain nulls")));
+
+	rows = ARR_DIMS(matrix)[0];
+	cols = ARR_DIMS(matrix)[1];
+
+	if (rows != a->dim)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("matrix must have %d rows, not %d", a->dim, rows)));
+
+	CheckDim(cols);
+
+	/* Elements are contiguous float4 without nulls */
+	mx = (float *) ARR_DATA_PTR(matrix);
+
+	result = InitVector(cols);
+	VectorProject(rows, cols, a->x, mx, result->x);
+
+	/* Check for overflow */
+	if (AnyNonFiniteFloat4((uint32 *) result->x, cols))
+	{
+		if (AnyNonFiniteFloat4((uint32 *) mx, rows * cols))
+		{
+			for (int i = 0; i < rows * cols; i++)
+				CheckElement(mx[i]);
+		}
+
+		float_overflow_error();
+	}
+
+	PG_RETURN_POINTER(result);
+}
+
 /*
  * Quantize a vector
  */
@@ -964,8 +1219,7 @@ binary_quantize(PG_FUNCTION_ARGS)
 	VarBit	   *result = InitBitVector(a->dim);
 	unsigned char *rx = VARBITS(result);
 
-	for (int i = 0; i < a->dim; i++)
-		rx[i / 8] |= (ax[i] > 0) << (7 - (i % 8));
+	BinaryQuantizeFloat4(a->dim, ax, rx);
 
 	PG_RETURN_VARBIT_P(result);
 }
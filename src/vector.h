@@ -1,8 +1,41 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 
+#include "fmgr.h"
+
 #define VECTOR_MAX_DIM 16000
 
+/* Number of elements (or bytes for bit) between checks for bounded distances */
+#define BOUNDED_DISTANCE_BLOCK 128
+
+/* Relative slack for prefix distances to stay below the full distance */
+#define PREFIX_DISTANCE_MARGIN 1e-3
+
+/*
+ * Call an inlined kernel with constant dimensions for common embedding sizes
+ * (and bounded distance blocks) so loops can be fully unrolled without a tail
+ */
+#define VECTOR_SPECIALIZE_DIM(dim, kernel, ...) \
+	do { \
+		switch (dim) \
+		{ \
+			case 128: \
+				return kernel(128, __VA_ARGS__); \
+			case 384: \
+				return kernel(384, __VA_ARGS__); \
+			case 768: \
+				return kernel(768, __VA_ARGS__); \
+			case 1024: \
+				return kernel(1024, __VA_ARGS__); \
+			case 1536: \
+				return kernel(1536, __VA_ARGS__); \
+			case 3072: \
+				return kernel(3072, __VA_ARGS__); \
+			default: \
+				return kernel(dim, __VA_ARGS__); \
+		} \
+	} while (0)
+
 #define VECTOR_SIZE(_dim)		(offsetof(Vector, x) + sizeof(float)*(_dim))
 #define DatumGetVector(x)		((Vector *) PG_DETOAST_DATUM(x))
 #define PG_GETARG_VECTOR_P(x)	DatumGetVector(PG_GETARG_DATUM(x))
@@ -16,8 +49,36 @@ typedef struct Vector
 	float		x[FLEXIBLE_ARRAY_MEMBER];
 }			Vector;
 
+/*
+ * Distance that can stop early once greater than maxDistance
+ *
+ * Returns the distance when less than or equal to maxDistance, otherwise any
+ * value greater than maxDistance. Results can differ from the distance
+ * function in the last bits, since the sum is accumulated in blocks.
+ */
+typedef double (*BoundedDistanceFunc) (Datum a, Datum b, double maxDistance);
+
+/*
+ * Check if any float4 bit patterns are NaN or infinite
+ *
+ * Uses a reduction instead of an early exit so the loop can be vectorized.
+ * Callers can check elements individually for a more specific error.
+ */
+static inline bool
+AnyNonFiniteFloat4(const uint32 *bits, int count)
+{
+	uint32		any = 0;
+
+	for (int i = 0; i < count; i++)
+		any |= (bits[i] & 0x7F800000) == 0x7F800000;
+
+	return any != 0;
+}
+
 Vector	   *InitVector(int dim);
 void		PrintVector(char *msg, Vector * vector);
 int			vector_cmp_internal(Vector * a, Vector * b);
+BoundedDistanceFunc GetBoundedDistanceFunc(FmgrInfo *procinfo);
+double		PrefixDistanceLowerBound(FmgrInfo *procinfo, double distance);
 
 #endif
@@ -0,0 +1,800 @@
+#include "postgres.h"
+
+#include <math.h>
+
+#include "catalog/pg_authid.h"
+#include "catalog/pg_type.h"
+#include "executor/executor.h"
+#include "executor/spi.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "halfutils.h"
+#include "halfvec.h"
+#include "miscadmin.h"
+#include "port/pg_bswap.h"
+#include "storage/fd.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "vector.h"
+
+#define NPY_MAGIC "\x93NUMPY"
+#define NPY_MAGIC_LEN 6
+
+/* Header length for writing, so it can be rewritten once the count is known */
+#define NPY_HEADER_LEN 128
+
+#ifdef WORDS_BIGENDIAN
+#define LittleEndian16(x) pg_bswap16(x)
+#define LittleEndian32(x) pg_bswap32(x)
+#else
+#define LittleEndian16(x) (x)
+#define LittleEndian32(x) (x)
+#endif
+
+/* Rows to fetch at a time for writing */
+#define WRITE_BATCH_SIZE 1000
+
+#if PG_VERSION_NUM < 140000
+#define ROLE_PG_READ_SERVER_FILES DEFAULT_ROLE_READ_SERVER_FILES
+#define ROLE_PG_WRITE_SERVER_FILES DEFAULT_ROLE_WRITE_SERVER_FILES
+#endif
+
+typedef enum VectorFileFormat
+{
+	VECTOR_FILE_NPY,
+	VECTOR_FILE_FVECS,
+	VECTOR_FILE_BVECS
+}			VectorFileFormat;
+
+typedef enum VectorFileElement
+{
+	VECTOR_FILE_FLOAT4,
+	VECTOR_FILE_FLOAT8,
+	VECTOR_FILE_HALF,
+	VECTOR_FILE_UINT8
+}			VectorFileElement;
+
+typedef struct VectorFile
+{
+	FILE	   *file;
+	char	   *path;
+	VectorFileFormat format;
+	VectorFileElement element;
+	int			elementSize;
+	int			dim;			/* for npy */
+	int64		rows;			/* for npy */
+	int64		processed;
+	char	   *buffer;
+	Size		bufferSize;
+}			VectorFile;
+
+/*
+ * Get the format from the argument or the file extension
+ */
+static VectorFileFormat
+GetFormat(char *path, text *formatText)
+{
+	char	   *format;
+
+	if (formatText != NULL)
+		format = text_to_cstring(formatText);
+	else
+	{
+		format = strrchr(path, '.');
+		if (format == NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("could not determine format of file \"%s\"", path),
+					 errhint("Specify the format.")));
+		format++;
+	}
+
+	if (pg_strcasecmp(format, "npy") == 0)
+		return VECTOR_FILE_NPY;
+	else if (pg_strcasecmp(format, "fvecs") == 0)
+		return VECTOR_FILE_FVECS;
+	else if (pg_strcasecmp(format, "bvecs") == 0)
+		return VECTOR_FILE_BVECS;
+
+	ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("unsupported format \"%s\"", format),
+			 errhint("Supported formats are npy, fvecs, and bvecs.")));
+}
+
+/*
+ * Get the size of an element
+ */
+static int
+GetElementSize(VectorFileElement element)
+{
+	switch (element)
+	{
+		case VECTOR_FILE_FLOAT4:
+			return sizeof(float);
+		case VECTOR_FILE_FLOAT8:
+			return sizeof(double);
+		case VECTOR_FILE_HALF:
+			return sizeof(half);
+		case VECTOR_FILE_UINT8:
+			return sizeof(uint8);
+	}
+
+	pg_unreachable();
+}
+
+/*
+ * Read bytes or error
+ *
+ * Returns false if the end of the file is reached before any bytes when
+ * allowed, since that is where a file of records ends.
+ */
+static bool
+ReadBytes(VectorFile * vf, void *ptr, Size size, bool allowEof)
+{
+	Size		n = fread(ptr, 1, size, vf->file);
+
+	if (n == size)
+		return true;
+
+	if (ferror(vf->file))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read file \"%s\": %m", vf->path)));
+
+	if (n == 0 && allowEof)
+		return false;
+
+	ereport(ERROR,
+			(errcode(ERRCODE_DATA_CORRUPTED),
+			 errmsg("unexpected end of file \"%s\"", vf->path)));
+}
+
+/*
+ * Write bytes or error
+ */
+static void
+WriteBytes(VectorFile * vf, const void *ptr, Size size)
+{
+	if (fwrite(ptr, 1, size, vf->file) != size)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write file \"%s\": %m", vf->path)));
+}
+
+/*
+ * Convert between little-endian and host byte order in place
+ */
+static inline void
+SwapBytes(VectorFile * vf, void *ptr, int count)
+{
+#ifdef WORDS_BIGENDIAN
+	for (int i = 0; i < count; i++)
+	{
+		switch (vf->elementSize)
+		{
+			case 2:
+				((uint16 *) ptr)[i] = pg_bswap16(((uint16 *) ptr)[i]);
+				break;
+			case 4:
+				((uint32 *) ptr)[i] = pg_bswap32(((uint32 *) ptr)[i]);
+				break;
+			case 8:
+				((uint64 *) ptr)[i] = pg_bswap64(((uint64 *) ptr)[i]);
+				break;
+		}
+	}
+#endif
+}
+
+/*
+ * Get a value from an npy header dictionary
+ */
+static char *
+GetNpyHeaderValue(VectorFile * vf, char *header, const char *key)
+{
+	char	   *value = strstr(header, key);
+
+	if (value == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("missing %s in npy header of file \"%s\"", key, vf->path)));
+
+	value += strlen(key);
+	while (*value == ' ' || *value == ':')
+		value++;
+
+	return value;
+}
+
+/*
+ * Read an npy header
+ */
+static void
+ReadNpyHeader(VectorFile * vf)
+{
+	char		magic[NPY_MAGIC_LEN + 2];
+	uint32		headerLen;
+	char	   *header;
+	char	   *descr;
+	char	   *shape;
+	long long	rows;
+	int			dim;
+
+	ReadBytes(vf, magic, sizeof(magic), false);
+
+	if (memcmp(magic, NPY_MAGIC, NPY_MAGIC_LEN) != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("file \"%s\" is not an npy file", vf->path)));
+
+	/* Version 1 has a 2-byte header length and later versions have 4 */
+	if (magic[NPY_MAGIC_LEN] == 1)
+	{
+		uint16		len;
+
+		ReadBytes(vf, &len, sizeof(len), false);
+		headerLen = LittleEndian16(len);
+	}
+	else
+	{
+		ReadBytes(vf, &headerLen, sizeof(headerLen), false);
+		headerLen = LittleEndian32(headerLen);
+	}
+
+	if (headerLen > MaxAllocSize - 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("invalid npy header in file \"%s\"", vf->path)));
+
+	header = palloc(headerLen + 1);
+	ReadBytes(vf, header, headerLen, false);
+	header[headerLen] = '\0';
+
+	descr = GetNpyHeaderValue(vf, header, "'descr'");
+	if (strncmp(descr, "'<f4'", 5) == 0)
+		vf->element = VECTOR_FILE_FLOAT4;
+	else if (strncmp(descr, "'<f8'", 5) == 0)
+		vf->element = VECTOR_FILE_FLOAT8;
+	else if (strncmp(descr, "'<f2'", 5) == 0)
+		vf->element = VECTOR_FILE_HALF;
+	else if (strncmp(descr, "'|u1'", 5) == 0)
+		vf->element = VECTOR_FILE_UINT8;
+	else
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("unsupported npy dtype in file \"%s\"", vf->path),
+				 errhint("Supported dtypes are <f4, <f8, <f2, and |u1.")));
+
+	if (strncmp(GetNpyHeaderValue(vf, header, "'fortran_order'"), "False", 5) != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("npy file \"%s\" must be in C order", vf->path)));
+
+	shape = GetNpyHeaderValue(vf, header, "'shape'");
+	if (sscanf(shape, "(%lld , %d )", &rows, &dim) != 2 || rows < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("npy file \"%s\" must have two dimensions", vf->path)));
+
+	vf->rows = rows;
+	vf->dim = dim;
+	vf->elementSize = GetElementSize(vf->element);
+
+	pfree(header);
+}
+
+/*
+ * Open a file for reading
+ */
+static VectorFile *
+OpenReader(char *path, text *formatText)
+{
+	VectorFile *vf = palloc0(sizeof(VectorFile));
+
+	/* Same as COPY FROM a file */
+	if (!has_privs_of_role(GetUserId(), ROLE_PG_READ_SERVER_FILES))
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 errmsg("permission denied to read file"),
+				 errdetail("Only roles with privileges of the \"%s\" role may read server files.",
+						   "pg_read_server_files")));
+
+	vf->path = path;
+	vf->format = GetFormat(path, formatText);
+
+	vf->file = AllocateFile(path, PG_BINARY_R);
+	if (vf->file == NULL)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\" for reading: %m", path)));
+
+	if (vf->format == VECTOR_FILE_NPY)
+		ReadNpyHeader(vf);
+	else
+	{
+		vf->element = vf->format == VECTOR_FILE_FVECS ? VECTOR_FILE_FLOAT4 : VECTOR_FILE_UINT8;
+		vf->elementSize = GetElementSize(vf->element);
+	}
+
+	return vf;
+}
+
+/*
+ * Get the dimensions of the next row
+ *
+ * Returns false when there are no more rows.
+ */
+static bool
+ReadDim(VectorFile * vf, int *dim)
+{
+	int32		d;
+
+	if (vf->format == VECTOR_FILE_NPY)
+	{
+		if (vf->processed >= vf->rows)
+			return false;
+
+		*dim = vf->dim;
+		return true;
+	}
+
+	/* fvecs and bvecs records start with the dimensions */
+	if (!ReadBytes(vf, &d, sizeof(d), true))
+		return false;
+
+	*dim = LittleEndian32(d);
+	return true;
+}
+
+/*
+ * Read the elements of a row into the buffer
+ */
+static char *
+ReadElements(VectorFile * vf, int dim)
+{
+	Size		size = (Size) vf->elementSize * dim;
+
+	if (vf->bufferSize < size)
+	{
+		if (vf->buffer != NULL)
+			pfree(vf->buffer);
+		vf->buffer = MemoryContextAlloc(GetMemoryChunkContext(vf), size);
+		vf->bufferSize = size;
+	}
+
+	ReadBytes(vf, vf->buffer, size, false);
+	SwapBytes(vf, vf->buffer, dim);
+	return vf->buffer;
+}
+
+/*
+ * Get an element of the buffer as a float
+ */
+static inline float
+GetElement(VectorFile * vf, char *buffer, int i)
+{
+	switch (vf->element)
+	{
+		case VECTOR_FILE_FLOAT4:
+			return ((float *) buffer)[i];
+		case VECTOR_FILE_FLOAT8:
+			return (float) ((double *) buffer)[i];
+		case VECTOR_FILE_HALF:
+			return HalfToFloat4(((half *) buffer)[i]);
+		case VECTOR_FILE_UINT8:
+			return (float) ((uint8 *) buffer)[i];
+	}
+
+	pg_unreachable();
+}
+
+/*
+ * Read a row as a vector
+ */
+static Datum
+ReadVector(VectorFile * vf, int dim)
+{
+	Vector	   *result;
+
+	if (dim < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("vector must have at least 1 dimension")));
+
+	if (dim > VECTOR_MAX_DIM)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("vector cannot have more than %d dimensions", VECTOR_MAX_DIM)));
+
+	result = InitVector(dim);
+
+	/* Read directly into the vector when the layout matches */
+	if (vf->element == VECTOR_FILE_FLOAT4)
+	{
+		ReadBytes(vf, result->x, sizeof(float) * dim, false);
+		SwapBytes(vf, result->x, dim);
+	}
+	else
+	{
+		char	   *buffer = ReadElements(vf, dim);
+
+		for (int i = 0; i < dim; i++)
+			result->x[i] = GetElement(vf, buffer, i);
+	}
+
+	for (int i = 0; i < dim; i++)
+	{
+		if (isnan(result->x[i]))
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_EXCEPTION),
+					 errmsg("NaN not allowed in vector")));
+
+		if (isinf(result->x[i]))
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_EXCEPTION),
+					 errmsg("infinite value not allowed in vector")));
+	}
+
+	return PointerGetDatum(result);
+}
+
+/*
+ * Read a row as a half vector
+ */
+static Datum
+ReadHalfVector(VectorFile * vf, int dim)
+{
+	HalfVector *result;
+
+	if (dim < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("halfvec must have at least 1 dimension")));
+
+	if (dim > HALFVEC_MAX_DIM)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("halfvec cannot have more than %d dimensions", HALFVEC_MAX_DIM)));
+
+	result = InitHalfVector(dim);
+
+	/* Read directly into the vector when the layout matches */
+	if (vf->element == VECTOR_FILE_HALF)
+	{
+		ReadBytes(vf, result->x, sizeof(half) * dim, false);
+		SwapBytes(vf, result->x, dim);
+	}
+	else
+	{
+		char	   *buffer = ReadElements(vf, dim);
+
+		for (int i = 0; i < dim; i++)
+			result->x[i] = Float4ToHalf(GetElement(vf, buffer, i));
+	}
+
+	for (int i = 0; i < dim; i++)
+	{
+		if (HalfIsNan(result->x[i]))
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_EXCEPTION),
+					 errmsg("NaN not allowed in halfvec")));
+
+		if (HalfIsInf(result->x[i]))
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_EXCEPTION),
+					 errmsg("infinite value not allowed in halfvec")));
+	}
+
+	return PointerGetDatum(result);
+}
+
+/*
+ * Close the file of a reader
+ */
+static void
+CloseReader(Datum arg)
+{
+	VectorFile *vf = (VectorFile *) DatumGetPointer(arg);
+
+	if (vf->file != NULL)
+	{
+		FreeFile(vf->file);
+		vf->file = NULL;
+	}
+}
+
+/*
+ * Read a file as a set of vectors or half vectors
+ *
+ * Rows are returned one at a time, so they are not held in memory or spilled
+ * to disk before the caller sees them
+ */
+static Datum
+ReadFile(FunctionCallInfo fcinfo, bool isHalf)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	FuncCallContext *funcctx;
+	VectorFile *vf;
+	int			dim;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext oldCtx;
+		char	   *path;
+		text	   *formatText;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldCtx = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		path = text_to_cstring(PG_GETARG_TEXT_PP(0));
+		formatText = PG_NARGS() > 1 ? PG_GETARG_TEXT_PP(1) : NULL;
+		vf = OpenReader(path, formatText);
+		funcctx->user_fctx = vf;
+
+		/* Close the file if the caller stops early */
+		RegisterExprContextCallback(rsinfo->econtext, CloseReader, PointerGetDatum(vf));
+
+		MemoryContextSwitchTo(oldCtx);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	vf = (VectorFile *) funcctx->user_fctx;
+
+	if (ReadDim(vf, &dim))
+	{
+		Datum		value = isHalf ? ReadHalfVector(vf, dim) : ReadVector(vf, dim);
+
+		vf->processed++;
+		SRF_RETURN_NEXT(funcctx, value);
+	}
+
+	UnregisterExprContextCallback(rsinfo->econtext, CloseReader, PointerGetDatum(vf));
+	CloseReader(PointerGetDatum(vf));
+	SRF_RETURN_DONE(funcctx);
+}
+
+/*
+ * Read a file as a set of vectors
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(vector_read_file);
+Datum
+vector_read_file(PG_FUNCTION_ARGS)
+{
+	return ReadFile(fcinfo, false);
+}
+
+/*
+ * Read a file as a set of half vectors
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(halfvec_read_file);
+Datum
+halfvec_read_file(PG_FUNCTION_ARGS)
+{
+	return ReadFile(fcinfo, true);
+}
+
+/*
+ * Write an npy header
+ *
+ * The header is padded to a fixed length so it can be rewritten with the
+ * number of rows at the end.
+ */
+static void
+WriteNpyHeader(VectorFile * vf)
+{
+	char		header[NPY_HEADER_LEN];
+	const char *descr = vf->element == VECTOR_FILE_HALF ? "<f2" : "<f4";
+	int			dictLen = NPY_HEADER_LEN - NPY_MAGIC_LEN - 4;
+	int			len;
+
+	memcpy(header, NPY_MAGIC, NPY_MAGIC_LEN);
+	header[NPY_MAGIC_LEN] = 1;
+	header[NPY_MAGIC_LEN + 1] = 0;
+	header[NPY_MAGIC_LEN + 2] = dictLen & 0xFF;
+	header[NPY_MAGIC_LEN + 3] = dictLen >> 8;
+
+	len = snprintf(header + NPY_MAGIC_LEN + 4, dictLen, "{'descr': '%s', 'fortran_order': False, 'shape': (" INT64_FORMAT ", %d), }", descr, vf->processed, vf->dim);
+	memset(header + NPY_MAGIC_LEN + 4 + len, ' ', dictLen - len - 1);
+	header[NPY_HEADER_LEN - 1] = '\n';
+
+	WriteBytes(vf, header, NPY_HEADER_LEN);
+}
+
+/*
+ * Write a vector or half vector
+ */
+static void
+WriteRow(VectorFile * vf, Datum value, bool isHalf)
+{
+	int			dim;
+	void	   *x;
+
+	if (isHalf)
+	{
+		HalfVector *vec = DatumGetHalfVector(value);
+
+		dim = vec->dim;
+		x = vec->x;
+	}
+	else
+	{
+		Vector	   *vec = DatumGetVector(value);
+
+		dim = vec->dim;
+		x = vec->x;
+	}
+
+	if (vf->format == VECTOR_FILE_NPY)
+	{
+		if (vf->processed == 0)
+			vf->dim = dim;
+		else if (dim != vf->dim)
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_EXCEPTION),
+					 errmsg("npy files require the same dimensions for all rows, expected %d, not %d", vf->dim, dim)));
+	}
+	else
+	{
+		int32		d = LittleEndian32(dim);
+
+		WriteBytes(vf, &d, sizeof(d));
+	}
+
+	/* Convert half vectors for fvecs */
+	if (isHalf && vf->element == VECTOR_FILE_FLOAT4)
+	{
+		float	   *buffer = palloc(sizeof(float) * dim);
+
+		for (int i = 0; i < dim; i++)
+			buffer[i] = HalfToFloat4(((half *) x)[i]);
+
+		x = buffer;
+	}
+
+#ifdef WORDS_BIGENDIAN
+	if (!(isHalf && vf->element == VECTOR_FILE_FLOAT4))
+	{
+		void	   *copy = palloc(vf->elementSize * dim);
+
+		memcpy(copy, x, vf->elementSize * dim);
+		x = copy;
+	}
+	SwapBytes(vf, x, dim);
+#endif
+
+	WriteBytes(vf, x, (Size) vf->elementSize * dim);
+}
+
+/*
+ * Write the results of a query to a file
+ */
+static Datum
+WriteFile(FunctionCallInfo fcinfo, bool isHalf)
+{
+	char	   *path = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	char	   *query = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	text	   *formatText = PG_NARGS() > 2 ? PG_GETARG_TEXT_PP(2) : NULL;
+	char	   *schema = get_namespace_name(get_func_namespace(fcinfo->flinfo->fn_oid));
+	VectorFile *vf = palloc0(sizeof(VectorFile));
+	SPIPlanPtr	plan;
+	Portal		portal;
+	MemoryContext tmpCtx;
+	MemoryContext oldCtx;
+
+	/* Same as COPY TO a file */
+	if (!has_privs_of_role(GetUserId(), ROLE_PG_WRITE_SERVER_FILES))
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 errmsg("permission denied to write file"),
+				 errdetail("Only roles with privileges of the \"%s\" role may write server files.",
+						   "pg_write_server_files")));
+
+	vf->path = path;
+	vf->format = GetFormat(path, formatText);
+
+	if (vf->format == VECTOR_FILE_BVECS)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("bvecs format is only supported for reading")));
+
+	vf->element = isHalf && vf->format == VECTOR_FILE_NPY ? VECTOR_FILE_HALF : VECTOR_FILE_FLOAT4;
+	vf->elementSize = GetElementSize(vf->element);
+
+	vf->file = AllocateFile(path, PG_BINARY_W);
+	if (vf->file == NULL)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\" for writing: %m", path)));
+
+	if (vf->format == VECTOR_FILE_NPY)
+		WriteNpyHeader(vf);
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+
+	/* Cast the first column so any type with a cast can be written */
+	plan = SPI_prepare(psprintf("SELECT q.v::%s.%s FROM (%s) q(v)", quote_identifier(schema), isHalf ? "halfvec" : "vector", query), 0, NULL);
+	if (plan == NULL)
+		elog(ERROR, "SPI_prepare failed: %s", SPI_result_code_string(SPI_result));
+
+	portal = SPI_cursor_open(NULL, plan, NULL, NULL, true);
+
+	tmpCtx = AllocSetContextCreate(CurrentMemoryContext,
+								   "Vector file temporary context",
+								   ALLOCSET_DEFAULT_SIZES);
+
+	for (;;)
+	{
+		SPI_cursor_fetch(portal, true, WRITE_BATCH_SIZE);
+
+		if (SPI_processed == 0)
+			break;
+
+		for (uint64 i = 0; i < SPI_processed; i++)
+		{
+			bool		isnull;
+			Datum		value = SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 1, &isnull);
+
+			CHECK_FOR_INTERRUPTS();
+
+			if (isnull)
+				ereport(ERROR,
+						(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+						 errmsg("cannot write null value to file")));
+
+			oldCtx = MemoryContextSwitchTo(tmpCtx);
+			WriteRow(vf, value, isHalf);
+			MemoryContextSwitchTo(oldCtx);
+			MemoryContextReset(tmpCtx);
+
+			vf->processed++;
+		}
+
+		SPI_freetuptable(SPI_tuptable);
+	}
+
+	SPI_cursor_close(portal);
+	MemoryContextDelete(tmpCtx);
+	SPI_finish();
+
+	/* Rewrite header with the number of rows */
+	if (vf->format == VECTOR_FILE_NPY)
+	{
+		if (fseek(vf->file, 0, SEEK_SET) != 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not seek in file \"%s\": %m", path)));
+
+		WriteNpyHeader(vf);
+	}
+
+	if (FreeFile(vf->file) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not close file \"%s\": %m", path)));
+
+	PG_RETURN_INT64(vf->processed);
+}
+
+/*
+ * Write the results of a query to a file as vectors
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(vector_write_file);
+Datum
+vector_write_file(PG_FUNCTION_ARGS)
+{
+	return WriteFile(fcinfo, false);
+}
+
+/*
+ * Write the results of a query to a file as half vectors
+ */
+PGDLLEXPORT PG_FUNCTION_INFO_V1(halfvec_write_file);
+Datum
+halfvec_write_file(PG_FUNCTION_ARGS)
+{
+	return WriteFile(fcinfo, true);
+}
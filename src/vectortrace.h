@@ -0,0 +1,31 @@
+#ifndef VECTORTRACE_H
+#define VECTORTRACE_H
+
+#include "postgres.h"
+
+/*
+ * Static probes are available when Postgres is built with --enable-dtrace
+ *
+ * See src/probes.d for arguments
+ */
+#ifdef ENABLE_DTRACE
+#include "probes.h"
+#else
+#define TRACE_PGVECTOR_HNSW_SCAN_START(arg0, arg1) do {} while (0)
+#define TRACE_PGVECTOR_HNSW_SCAN_DONE(arg0, arg1) do {} while (0)
+#define TRACE_PGVECTOR_HNSW_SEARCH_LAYER_START(arg0, arg1) do {} while (0)
+#define TRACE_PGVECTOR_HNSW_SEARCH_LAYER_DONE(arg0, arg1) do {} while (0)
+#define TRACE_PGVECTOR_HNSW_ELEMENT_LOAD_START(arg0, arg1) do {} while (0)
+#define TRACE_PGVECTOR_HNSW_ELEMENT_LOAD_DONE(arg0, arg1) do {} while (0)
+#define TRACE_PGVECTOR_HNSW_NEIGHBORS_UPDATE_START(arg0, arg1, arg2) do {} while (0)
+#define TRACE_PGVECTOR_HNSW_NEIGHBORS_UPDATE_DONE(arg0, arg1, arg2) do {} while (0)
+#define TRACE_PGVECTOR_HNSW_BUILD_PHASE(arg0, arg1) do {} while (0)
+#define TRACE_PGVECTOR_HNSW_FLUSH_START(arg0, arg1) do {} while (0)
+#define TRACE_PGVECTOR_HNSW_FLUSH_DONE(arg0, arg1) do {} while (0)
+#define TRACE_PGVECTOR_IVFFLAT_SCAN_START(arg0, arg1) do {} while (0)
+#define TRACE_PGVECTOR_IVFFLAT_SCAN_DONE(arg0, arg1) do {} while (0)
+#define TRACE_PGVECTOR_IVFFLAT_KMEANS_ITERATION(arg0, arg1) do {} while (0)
+#define TRACE_PGVECTOR_IVFFLAT_BUILD_PHASE(arg0, arg1) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,129 @@
+use strict;
+use warnings;
+use IPC::Run;
+use PostgresNode;
+use TestLib;
+use Test::More;
+
+# Runs KNN queries, inserts, updates, deletes, and vacuum concurrently
+# and reports throughput and latency for each operation
+my $rows = $ENV{BENCH_ROWS} || 100000;
+my $dim = $ENV{BENCH_DIM} || 128;
+my $clients = $ENV{BENCH_CLIENTS} || 8;
+my $duration = $ENV{BENCH_DURATION} || 30;
+
+my $array_sql = join(",", ('random()') x $dim);
+
+# Initialize node
+my $node = get_new_node('node');
+$node->init;
+$node->append_conf('postgresql.conf', qq(
+autovacuum = off
+shared_buffers = 256MB
+maintenance_work_mem = 1GB
+max_connections = 100
+));
+$node->start;
+
+my $dir = $node->basedir;
+
+$node->safe_psql("postgres", "CREATE EXTENSION vector;");
+
+# Start pgbench with weighted scripts
+sub start_pgbench
+{
+	my ($name, $nclients, $scripts) = @_;
+
+	my @cmd = (
+		'pgbench', '--no-vacuum', "--client=$nclients", "--jobs=$nclients",
+		"--time=$duration", '--log', "--log-prefix=$dir/$name",
+		'--host', $node->host, '--port', $node->port, 'postgres'
+	);
+
+	for my $script (@$scripts)
+	{
+		my ($op, $weight, $sql) = @$script;
+		my $file = "$dir/${name}_$op.sql";
+		append_to_file($file, $sql);
+		push(@cmd, "--file=$file\@$weight");
+	}
+
+	my ($stdout, $stderr) = ('', '');
+	my $h = IPC::Run::start(\@cmd, '>', \$stdout, '2>', \$stderr);
+	return { handle => $h, name => $name, ops => [map { $_->[0] } @$scripts], stdout => \$stdout, stderr => \$stderr };
+}
+
+# Wait for pgbench and get latencies in milliseconds for each operation
+sub finish_pgbench
+{
+	my ($run) = @_;
+
+	$run->{handle}->finish;
+	is($run->{handle}->result, 0, "$run->{name} pgbench: ${$run->{stderr}}");
+
+	my %latencies = map { $_ => [] } @{$run->{ops}};
+	for my $log (glob("$dir/$run->{name}.*"))
+	{
+		for my $line (split(/\n/, slurp_file($log)))
+		{
+			# client_id transaction_no time script_no time_epoch time_us
+			my @fields = split(/\s+/, $line);
+			next unless defined($fields[3]) && $fields[2] =~ /^\d+$/;
+			push(@{$latencies{$run->{ops}[$fields[3]]}}, $fields[2] / 1000.0);
+		}
+	}
+	return \%latencies;
+}
+
+sub percentile
+{
+	my ($sorted, $p) = @_;
+	return $sorted->[int($p * $#$sorted)];
+}
+
+sub report
+{
+	my ($method, $latencies) = @_;
+
+	for my $op (sort keys %$latencies)
+	{
+		my @sorted = sort { $a <=> $b } @{$latencies->{$op}};
+		my $count = scalar(@sorted);
+
+		ok($count > 0, "$method $op ran");
+		next if $count == 0;
+
+		diag(sprintf("%-8s %-7s %8d tx %10.1f tps  p50 %8.3f ms  p99 %8.3f ms",
+			$method, $op, $count, $count / $duration, percentile(\@sorted, 0.5), percentile(\@sorted, 0.99)));
+	}
+}
+
+for my $method ("hnsw", "ivfflat")
+{
+	my $options = $method eq "ivfflat" ? " WITH (lists = " . int(sqrt($rows)) . ")" : "";
+
+	$node->safe_psql("postgres", "DROP TABLE IF EXISTS items;");
+	$node->safe_psql("postgres", "CREATE TABLE items (id bigserial PRIMARY KEY, embedding vector($dim));");
+	$node->safe_psql("postgres",
+		"INSERT INTO items (embedding) SELECT ARRAY[$array_sql] FROM generate_series(1, $rows) i;"
+	);
+	$node->safe_psql("postgres", "CREATE INDEX ON items USING $method (embedding vector_l2_ops)$options;");
+	$node->safe_psql("postgres", "VACUUM ANALYZE items;");
+
+	my $writes = start_pgbench("${method}_writes", $clients, [
+		["knn", 70, "SELECT id FROM items ORDER BY embedding <-> (SELECT ARRAY[$array_sql]::vector($dim)) LIMIT 10;"],
+		["insert", 15, "INSERT INTO items (embedding) VALUES (ARRAY[$array_sql]);"],
+		["update", 10, "\\set id random(1, $rows)\nUPDATE items SET embedding = ARRAY[$array_sql] WHERE id = :id;"],
+		["delete", 5, "\\set id random(1, $rows)\nDELETE FROM items WHERE id = :id;"]
+	]);
+
+	# Vacuum runs back to back in its own session since it conflicts with itself
+	my $vacuum = start_pgbench("${method}_vacuum", 1, [
+		["vacuum", 1, "VACUUM items;"]
+	]);
+
+	my %latencies = (%{finish_pgbench($writes)}, %{finish_pgbench($vacuum)});
+	report($method, \%latencies);
+}
+
+done_testing();
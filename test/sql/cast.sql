@@ -27,6 +27,8 @@ SELECT '[1,2,3]'::vector::halfvec(3);
 SELECT '[1,2,3]'::vector::halfvec(2);
 SELECT '[65520]'::vector::halfvec;
 SELECT '[1e-8]'::vector::halfvec;
+SELECT '[1,2,3,4,5,6,7,8,9,65520]'::vector::halfvec;
+SELECT '[1,2,3,4,5,6,7,8,9,10]'::vector::halfvec::vector;
 
 SELECT '[1,2,3]'::halfvec::vector;
 SELECT '[1,2,3]'::halfvec::vector(3);
@@ -41,6 +43,7 @@ SELECT '{1e-8,-1e-8}'::real[]::halfvec;
 SELECT '[0,1.5,0,3.5,0]'::vector::sparsevec;
 SELECT '[0,1.5,0,3.5,0]'::vector::sparsevec(5);
 SELECT '[0,1.5,0,3.5,0]'::vector::sparsevec(4);
+SELECT '[0,0,1.5,0,0,0,0,0,0,3.5]'::vector::sparsevec;
 
 SELECT '{2:1.5,4:3.5}/5'::sparsevec::vector;
 SELECT '{2:1.5,4:3.5}/5'::sparsevec::vector(5);
@@ -50,6 +53,7 @@ SELECT '{}/16001'::sparsevec::vector;
 SELECT '[0,1.5,0,3.5,0]'::halfvec::sparsevec;
 SELECT '[0,1.5,0,3.5,0]'::halfvec::sparsevec(5);
 SELECT '[0,1.5,0,3.5,0]'::halfvec::sparsevec(4);
+SELECT '[0,0,1.5,0,0,0,0,0,0,3.5]'::halfvec::sparsevec;
 
 SELECT '{2:1.5,4:3.5}/5'::sparsevec::halfvec;
 SELECT '{2:1.5,4:3.5}/5'::sparsevec::halfvec(5);
@@ -0,0 +1,46 @@
+SET enable_seqscan = off;
+
+-- inner product
+
+CREATE TABLE t (val hybridvec(3));
+INSERT INTO t (val) VALUES ('[0,0,0]|{}/3'), ('[1,2,3]|{1:1}/3'), ('[1,1,1]|{2:5}/3'), (NULL);
+CREATE INDEX ON t USING hnsw (val hybridvec_ip_ops);
+
+INSERT INTO t (val) VALUES ('[2,2,2]|{}/3');
+
+SELECT * FROM t ORDER BY val <#> '[1,1,2]|{1:1,2:1}/3';
+SELECT * FROM t ORDER BY val <#> hybridvec('[1,1,2]', '{1:1,2:1}/3', 1, 0);
+SELECT COUNT(*) FROM (SELECT * FROM t ORDER BY val <#> (SELECT NULL::hybridvec)) t2;
+
+TRUNCATE t;
+SELECT * FROM t ORDER BY val <#> '[1,1,2]|{1:1,2:1}/3';
+
+DROP TABLE t;
+
+-- non-zero elements
+
+CREATE TABLE t (val hybridvec(1));
+INSERT INTO t (val) VALUES (hybridvec('[1]', array_fill(1, ARRAY[1001])::vector::sparsevec));
+CREATE INDEX ON t USING hnsw (val hybridvec_ip_ops);
+TRUNCATE t;
+CREATE INDEX ON t USING hnsw (val hybridvec_ip_ops);
+INSERT INTO t (val) VALUES (hybridvec('[1]', array_fill(1, ARRAY[1001])::vector::sparsevec));
+DROP TABLE t;
+
+-- element size
+
+CREATE TABLE t (val hybridvec(16));
+CREATE INDEX ON t USING hnsw (val hybridvec_ip_ops);
+INSERT INTO t (val) VALUES (hybridvec(array_fill(1, ARRAY[16])::vector, array_fill(1, ARRAY[1000])::vector::sparsevec));
+DROP TABLE t;
+
+CREATE TABLE t (val hybridvec(17));
+CREATE INDEX ON t USING hnsw (val hybridvec_ip_ops);
+INSERT INTO t (val) VALUES (hybridvec(array_fill(1, ARRAY[17])::vector, array_fill(1, ARRAY[1000])::vector::sparsevec));
+DROP TABLE t;
+
+CREATE TABLE t (val hybridvec(2000));
+CREATE INDEX ON t USING hnsw (val hybridvec_ip_ops);
+INSERT INTO t (val) VALUES (hybridvec(array_fill(1, ARRAY[2000])::vector, array_fill(1, ARRAY[8])::vector::sparsevec));
+INSERT INTO t (val) VALUES (hybridvec(array_fill(1, ARRAY[2000])::vector, array_fill(1, ARRAY[9])::vector::sparsevec));
+DROP TABLE t;
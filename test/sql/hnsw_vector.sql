@@ -67,6 +67,52 @@ SELECT * FROM t ORDER BY val <-> '[3,3,3]';
 
 DROP TABLE t;
 
+-- prefix dimensions
+
+CREATE TABLE t (val vector(3));
+INSERT INTO t (val) VALUES ('[0,0,0]'), ('[1,2,3]'), ('[1,1,1]'), (NULL);
+CREATE INDEX ON t USING hnsw (val vector_l2_ops) WITH (prefix_dimensions = 1);
+
+INSERT INTO t (val) VALUES ('[1,2,4]');
+
+SELECT * FROM t ORDER BY val <-> '[3,3,3]';
+SELECT COUNT(*) FROM (SELECT * FROM t ORDER BY val <-> (SELECT NULL::vector)) t2;
+
+DROP TABLE t;
+
+-- bounded distances
+
+SET hnsw.ef_search = 5;
+
+CREATE TABLE t (i int4, a vector(127), b vector(128), c vector(129));
+INSERT INTO t SELECT i, array_fill(i, ARRAY[127]), array_fill(i, ARRAY[128]), array_fill(i, ARRAY[129]) FROM generate_series(1, 20) i;
+CREATE INDEX ON t USING hnsw (a vector_l2_ops);
+CREATE INDEX ON t USING hnsw (b vector_l2_ops);
+CREATE INDEX ON t USING hnsw (c vector_l2_ops);
+CREATE INDEX ON t USING hnsw (a vector_l1_ops);
+CREATE INDEX ON t USING hnsw (b vector_l1_ops);
+CREATE INDEX ON t USING hnsw (c vector_l1_ops);
+
+SELECT array_agg(i) FROM (SELECT i FROM t ORDER BY a <-> array_fill(7.3, ARRAY[127])::vector LIMIT 5) t2;
+SELECT array_agg(i) FROM (SELECT i FROM t ORDER BY b <-> array_fill(7.3, ARRAY[128])::vector LIMIT 5) t2;
+SELECT array_agg(i) FROM (SELECT i FROM t ORDER BY c <-> array_fill(7.3, ARRAY[129])::vector LIMIT 5) t2;
+SELECT array_agg(i) FROM (SELECT i FROM t ORDER BY a <+> array_fill(7.3, ARRAY[127])::vector LIMIT 5) t2;
+SELECT array_agg(i) FROM (SELECT i FROM t ORDER BY b <+> array_fill(7.3, ARRAY[128])::vector LIMIT 5) t2;
+SELECT array_agg(i) FROM (SELECT i FROM t ORDER BY c <+> array_fill(7.3, ARRAY[129])::vector LIMIT 5) t2;
+
+SET enable_indexscan = off;
+
+SELECT array_agg(i) FROM (SELECT i FROM t ORDER BY a <-> array_fill(7.3, ARRAY[127])::vector LIMIT 5) t2;
+SELECT array_agg(i) FROM (SELECT i FROM t ORDER BY b <-> array_fill(7.3, ARRAY[128])::vector LIMIT 5) t2;
+SELECT array_agg(i) FROM (SELECT i FROM t ORDER BY c <-> array_fill(7.3, ARRAY[129])::vector LIMIT 5) t2;
+SELECT array_agg(i) FROM (SELECT i FROM t ORDER BY a <+> array_fill(7.3, ARRAY[127])::vector LIMIT 5) t2;
+SELECT array_agg(i) FROM (SELECT i FROM t ORDER BY b <+> array_fill(7.3, ARRAY[128])::vector LIMIT 5) t2;
+SELECT array_agg(i) FROM (SELECT i FROM t ORDER BY c <+> array_fill(7.3, ARRAY[129])::vector LIMIT 5) t2;
+
+RESET enable_indexscan;
+RESET hnsw.ef_search;
+DROP TABLE t;
+
 -- options
 
 CREATE TABLE t (val vector(3));
@@ -75,6 +121,9 @@ CREATE INDEX ON t USING hnsw (val vector_l2_ops) WITH (m = 101);
 CREATE INDEX ON t USING hnsw (val vector_l2_ops) WITH (ef_construction = 3);
 CREATE INDEX ON t USING hnsw (val vector_l2_ops) WITH (ef_construction = 1001);
 CREATE INDEX ON t USING hnsw (val vector_l2_ops) WITH (m = 16, ef_construction = 31);
+CREATE INDEX ON t USING hnsw (val vector_l2_ops) WITH (prefix_dimensions = -1);
+CREATE INDEX ON t USING hnsw (val vector_l2_ops) WITH (prefix_dimensions = 4);
+CREATE INDEX ON t USING hnsw (val vector_ip_ops) WITH (prefix_dimensions = 1);
 
 SHOW hnsw.ef_search;
 
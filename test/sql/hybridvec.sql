@@ -0,0 +1,24 @@
+SELECT '[1,2,3]|{1:1.5,3:3.5}/5'::hybridvec;
+SELECT '[1,2,3]|{}/5'::hybridvec;
+SELECT '[1,2,3]|{1:0,2:1}/5'::hybridvec;
+SELECT '[1,2,3]'::hybridvec;
+SELECT '{1:1}/5|[1,2,3]'::hybridvec;
+SELECT '[1,2,3]|{1:1}/5'::hybridvec(3);
+SELECT '[1,2,3]|{1:1}/5'::hybridvec(2);
+SELECT '[1,2,3]|{1:1}/5'::hybridvec(0);
+
+SELECT hybridvec('[1,2,3]', '{1:1,3:2}/5');
+SELECT hybridvec('[1,2,3]', '{1:1,3:2}/5', 2, 0.5);
+SELECT hybridvec('[1,2,3]', '{1:1,3:2}/5', 1, 0);
+SELECT hybridvec('[1e38]', '{1:1}/5', 10, 1);
+SELECT hybridvec('[1,2,3]', '{1:1,3:2}/5', 'NaN', 1);
+
+SELECT hybridvec_dense('[1,2,3]|{1:1.5,3:3.5}/5');
+SELECT hybridvec_sparse('[1,2,3]|{1:1.5,3:3.5}/5');
+
+SELECT inner_product('[1,2,3]|{1:1,3:2}/5'::hybridvec, '[4,5,6]|{2:1,3:3,5:4}/5');
+SELECT inner_product('[1,2,3]|{}/5'::hybridvec, '[4,5,6]|{2:1,3:3,5:4}/5');
+SELECT inner_product('[1,2]|{1:1}/5'::hybridvec, '[1,2,3]|{1:1}/5');
+SELECT inner_product('[1,2,3]|{1:1}/5'::hybridvec, '[1,2,3]|{1:1}/6');
+
+SELECT '[1,2,3]|{1:1,3:2}/5'::hybridvec <#> '[4,5,6]|{2:1,3:3,5:4}/5';
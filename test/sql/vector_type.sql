@@ -140,6 +140,13 @@ SELECT subvector('[1,2,3,4,5]'::vector, 2147483647, 10);
 SELECT subvector('[1,2,3,4,5]'::vector, 3, 2147483647);
 SELECT subvector('[1,2,3,4,5]'::vector, -2147483644, 2147483647);
 
+SELECT vector_project('[1,2]'::vector, '{{1,0,1},{0,1,1}}');
+SELECT vector_project('[1,2]'::vector, '{{1,0},{0,1},{1,1}}');
+SELECT vector_project('[1,2]'::vector, '{1,2}');
+SELECT vector_project('[1,2]'::vector, '{{1},{NULL}}');
+SELECT vector_project('[1e38]'::vector, '{{10}}');
+SELECT vector_project('[1]'::vector, '{{NaN}}');
+
 SELECT avg(v) FROM unnest(ARRAY['[1,2,3]'::vector, '[3,5,7]']) v;
 SELECT avg(v) FROM unnest(ARRAY['[1,2,3]'::vector, '[3,5,7]', NULL]) v;
 SELECT avg(v) FROM unnest(ARRAY[]::vector[]) v;
@@ -152,3 +159,19 @@ SELECT sum(v) FROM unnest(ARRAY['[1,2,3]'::vector, '[3,5,7]', NULL]) v;
 SELECT sum(v) FROM unnest(ARRAY[]::vector[]) v;
 SELECT sum(v) FROM unnest(ARRAY['[1,2]'::vector, '[3]']) v;
 SELECT sum(v) FROM unnest(ARRAY['[3e38]'::vector, '[3e38]']) v;
+
+SELECT kmeans(v, 1) FROM unnest(ARRAY['[1,2,3]'::vector, '[3,4,5]', NULL]) v;
+SELECT c FROM unnest((SELECT kmeans(v, 2) FROM unnest(ARRAY['[0,0]'::vector, '[0,1]', '[10,10]', '[10,11]']) v)) c ORDER BY c;
+SELECT kmeans(v, 1) FROM unnest(ARRAY[]::vector[]) v;
+SELECT kmeans(v, 3) FROM unnest(ARRAY['[1,2,3]'::vector, '[3,4,5]']) v;
+SELECT kmeans(v, 1) FROM unnest(ARRAY['[1,2]'::vector, '[3]']) v;
+SELECT kmeans(v, 0) FROM unnest(ARRAY['[1,2,3]'::vector]) v;
+SELECT kmeans(v, 1, 'hamming') FROM unnest(ARRAY['[1,2,3]'::vector]) v;
+
+SELECT mmr(i, v, '[1,1]', 3) FROM unnest(ARRAY['[1,0]'::vector, '[1,0.2]', '[0.6,0.8]', '[0,1]']) WITH ORDINALITY t (v, i);
+SELECT mmr(i, v, '[1,1]', 2, 1) FROM unnest(ARRAY['[1,0]'::vector, '[1,0.2]', '[0.6,0.8]', '[0,1]']) WITH ORDINALITY t (v, i);
+SELECT mmr(i, v, '[1,1]', 10) FROM unnest(ARRAY['[1,0]'::vector, NULL, '[0,1]']) WITH ORDINALITY t (v, i);
+SELECT mmr(i, v, '[1,1]', 1) FROM unnest(ARRAY[]::vector[]) WITH ORDINALITY t (v, i);
+SELECT mmr(i, v, '[1,1]', 1) FROM unnest(ARRAY['[1,2,3]'::vector]) WITH ORDINALITY t (v, i);
+SELECT mmr(i, v, '[1,1]', 0) FROM unnest(ARRAY['[1,0]'::vector]) WITH ORDINALITY t (v, i);
+SELECT mmr(i, v, '[1,1]', 1, 2) FROM unnest(ARRAY['[1,0]'::vector]) WITH ORDINALITY t (v, i);
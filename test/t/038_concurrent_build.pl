@@ -0,0 +1,72 @@
+use strict;
+use warnings;
+use PostgresNode;
+use TestLib;
+use Test::More;
+
+my $dim = 3;
+
+my $array_sql = join(",", ('random()') x $dim);
+
+# Initialize node
+my $node = get_new_node('node');
+$node->init;
+$node->start;
+
+$node->safe_psql("postgres", "CREATE EXTENSION vector;");
+
+# Rows inserted during the build are added in the validation phase
+my @cases = (
+	["ivfflat", "vector_l2_ops) WITH (lists = 4", "ivfflat.probes = 4"],
+	["hnsw", "vector_l2_ops", "hnsw.ef_search = 1000"]
+);
+
+for my $case (@cases)
+{
+	my ($type, $opclass, $setting) = @$case;
+
+	# Create table and index
+	$node->safe_psql("postgres", "DROP TABLE IF EXISTS tst;");
+	$node->safe_psql("postgres", "CREATE TABLE tst (i serial, v vector($dim));");
+	$node->safe_psql("postgres",
+		"INSERT INTO tst (v) SELECT ARRAY[$array_sql] FROM generate_series(1, 500) i;"
+	);
+	$node->safe_psql("postgres", "CREATE INDEX tst_v_idx ON tst USING $type (v $opclass);");
+
+	# Insert while rebuilding
+	$node->pgbench(
+		"--no-vacuum --client=5 --transactions=50",
+		0,
+		[qr{actually processed}],
+		[qr{^$}],
+		"concurrent INSERTs and REINDEX",
+		{
+			"038_${type}_concurrent_build_insert" => "INSERT INTO tst (v) SELECT ARRAY[$array_sql] FROM generate_series(1, 5) i;",
+			"038_${type}_concurrent_build_reindex" => "REINDEX INDEX CONCURRENTLY tst_v_idx;"
+		}
+	);
+
+	my $valid = $node->safe_psql("postgres", "SELECT indisvalid FROM pg_index WHERE indexrelid = 'tst_v_idx'::regclass;");
+	is($valid, "t");
+
+	# Check all rows are in the index without duplicates
+	my $expected = $node->safe_psql("postgres", "SELECT COUNT(*) FROM tst;");
+	my $count = $node->safe_psql("postgres", qq(
+		SET enable_seqscan = off;
+		SET $setting;
+		SELECT COUNT(*), COUNT(DISTINCT i) FROM (SELECT i FROM tst ORDER BY v <-> (SELECT v FROM tst LIMIT 1)) t;
+	));
+	is($count, "$expected|$expected");
+
+	# Check rows from the validation phase are found in order
+	my $query = "[" . join(",", map { rand() } (1 .. $dim)) . "]";
+	my $exact = $node->safe_psql("postgres", "SELECT i FROM tst ORDER BY v <-> '$query' LIMIT 10;");
+	my $actual = $node->safe_psql("postgres", qq(
+		SET enable_seqscan = off;
+		SET $setting;
+		SELECT i FROM tst ORDER BY v <-> '$query' LIMIT 10;
+	));
+	is($actual, $exact);
+}
+
+done_testing();
@@ -0,0 +1,82 @@
+use strict;
+use warnings;
+use PostgresNode;
+use TestLib;
+use Test::More;
+
+my $dim = 3;
+
+my $array_sql = join(",", ('random()') x $dim);
+
+# Initialize node
+my $node = get_new_node('node');
+$node->init;
+$node->append_conf('postgresql.conf', 'autovacuum = off');
+$node->start;
+
+$node->safe_psql("postgres", "CREATE EXTENSION vector;");
+
+my @cases = (
+	["ivfflat", "WITH (lists = 10)", "ivfflat.probes = 10", 1000],
+	["hnsw", "", "hnsw.ef_search = 1000", 200]
+);
+
+for my $case (@cases)
+{
+	my ($type, $options, $setting, $n) = @$case;
+
+	# Returns the rows returned by the index scan and the buffers it accessed
+	my $index_scan = sub {
+		my $explain = $node->safe_psql("postgres", qq(
+			SET enable_seqscan = off;
+			SET $setting;
+			EXPLAIN (ANALYZE, BUFFERS, COSTS OFF, TIMING OFF) SELECT COUNT(*) FROM (SELECT v FROM tst ORDER BY v <-> '[0,0,0]') t;
+		));
+		like($explain, qr/Index Scan/);
+
+		my ($rows) = $explain =~ /Index Scan.*actual rows=(\d+)/;
+		my ($hit, $read) = $explain =~ /Buffers: shared hit=(\d+)(?: read=(\d+))?/;
+		return ($rows, $hit + ($read // 0));
+	};
+
+	# Create table and index
+	$node->safe_psql("postgres", "DROP TABLE IF EXISTS tst;");
+	$node->safe_psql("postgres", "CREATE TABLE tst (i int4, v vector($dim));");
+	$node->safe_psql("postgres",
+		"INSERT INTO tst SELECT i, ARRAY[$array_sql] FROM generate_series(1, $n) i;"
+	);
+	$node->safe_psql("postgres", "CREATE INDEX ON tst USING $type (v vector_l2_ops) $options;");
+
+	# Delete without vacuum so scans mark tuples as dead
+	$node->safe_psql("postgres", "DELETE FROM tst WHERE i % 2 = 0;");
+
+	# First scan marks dead tuples after fetching them from the heap
+	my ($count, $buffers) = $index_scan->();
+	is($count, $n / 2);
+
+	# Second scan skips them without heap fetches
+	my ($count2, $buffers2) = $index_scan->();
+	is($count2, $n / 2);
+	cmp_ok($buffers2, "<", $buffers, "$type skipped dead tuples");
+
+	# Vacuum and reuse space
+	$node->safe_psql("postgres", "VACUUM tst;");
+	$node->safe_psql("postgres",
+		"INSERT INTO tst SELECT i, ARRAY[$array_sql] FROM generate_series(1, $n / 2) i;"
+	);
+	($count, $buffers) = $index_scan->();
+	is($count, $n);
+	($count2, $buffers2) = $index_scan->();
+	is($count2, $n);
+	is($buffers2, $buffers, "$type nothing to skip after vacuum");
+
+	# Updates
+	$node->safe_psql("postgres", "UPDATE tst SET v = ARRAY[$array_sql]::vector WHERE i % 5 = 0;");
+	($count, $buffers) = $index_scan->();
+	is($count, $n);
+	($count2, $buffers2) = $index_scan->();
+	is($count2, $n);
+	cmp_ok($buffers2, "<", $buffers, "$type skipped dead tuples after updates");
+}
+
+done_testing();
@@ -0,0 +1,88 @@
+use strict;
+use warnings;
+use PostgresNode;
+use TestLib;
+use Test::More;
+
+my $dim = 3;
+
+my $array_sql = join(",", ('random()') x $dim);
+
+# Initialize node
+my $node = get_new_node('node');
+$node->init;
+$node->append_conf('postgresql.conf', qq(
+shared_preload_libraries = 'vector'
+vector.scan_cache_size = 1MB
+));
+$node->start;
+
+# Create table
+$node->safe_psql("postgres", "CREATE EXTENSION vector;");
+$node->safe_psql("postgres", "CREATE TABLE tst (i serial, v vector($dim));");
+$node->safe_psql("postgres",
+	"INSERT INTO tst (v) SELECT ARRAY[$array_sql] FROM generate_series(1, 10000) i;"
+);
+
+sub query
+{
+	my ($limit) = @_;
+	return $node->safe_psql("postgres", qq(
+		SET enable_seqscan = off;
+		SELECT i FROM tst ORDER BY v <-> '[0.5,0.5,0.5]' LIMIT $limit;
+	));
+}
+
+sub stats
+{
+	return $node->safe_psql("postgres", "SELECT hits, misses FROM vector_scan_cache_stats();");
+}
+
+for my $method ("hnsw", "ivfflat")
+{
+	my $options = $method eq "ivfflat" ? " WITH (lists = 10)" : "";
+	$node->safe_psql("postgres", "CREATE INDEX idx ON tst USING $method (v vector_l2_ops)$options;");
+	$node->safe_psql("postgres", "SELECT vector_scan_cache_reset();");
+
+	# Check repeated query uses cache
+	my $expected = query(10);
+	my $actual = query(10);
+	is($actual, $expected, "$method replays results");
+	is(stats(), "1|1", "$method hits cache");
+
+	# Check more results than cached
+	my $more = query(20);
+	like($more, qr/^\Q$expected\E\n/, "$method continues after cached results");
+
+	# Check insert invalidates cache
+	$node->safe_psql("postgres", "INSERT INTO tst (v) VALUES ('[0.5,0.5,0.5]');");
+	my $id = $node->safe_psql("postgres", "SELECT MAX(i) FROM tst;");
+	my @ids = split("\n", query(10));
+	is($ids[0], $id, "$method invalidates on insert");
+
+	# Check vacuum invalidates cache
+	$node->safe_psql("postgres", "DELETE FROM tst WHERE i = $id;");
+	$node->safe_psql("postgres", "VACUUM (INDEX_CLEANUP on) tst;");
+	query(10);
+	my $invalidations = $node->safe_psql("postgres", "SELECT invalidations FROM vector_scan_cache_stats();");
+	is($invalidations, 2, "$method invalidates on vacuum");
+
+	$node->safe_psql("postgres", "DROP INDEX idx;");
+}
+
+# Check values too large to store are not cached
+$node->safe_psql("postgres", "CREATE TABLE tst2 (v sparsevec(2000));");
+$node->safe_psql("postgres", "INSERT INTO tst2 SELECT '{1:1,2:2}/2000' FROM generate_series(1, 10) i;");
+$node->safe_psql("postgres", "CREATE INDEX ON tst2 USING hnsw (v sparsevec_l2_ops);");
+$node->safe_psql("postgres", "SELECT vector_scan_cache_reset();");
+for (1 .. 2)
+{
+	my $count = $node->safe_psql("postgres", qq(
+		SET enable_seqscan = off;
+		SELECT COUNT(*) FROM (SELECT v FROM tst2 ORDER BY v <-> array_fill(1, ARRAY[2000])::vector::sparsevec LIMIT 5) t;
+	));
+	is($count, 5);
+}
+is(stats(), "0|0", "large values are not cached");
+
+done_testing();
@@ -0,0 +1,90 @@
+use strict;
+use warnings;
+use PostgresNode;
+use TestLib;
+use Test::More;
+
+my $dim = 3;
+
+my $array_sql = join(",", ('random()') x $dim);
+
+# Initialize node
+my $node = get_new_node('node');
+$node->init;
+$node->append_conf('postgresql.conf', qq(
+shared_preload_libraries = 'vector'
+vector.recall_database = 'postgres'
+vector.recall_sample_rate = 1
+));
+$node->start;
+
+# Wait for worker
+$node->poll_query_until("postgres", "SELECT COUNT(*) > 0 FROM pg_stat_activity WHERE backend_type = 'pgvector recall worker';");
+
+# Create table
+$node->safe_psql("postgres", "CREATE EXTENSION vector;");
+$node->safe_psql("postgres", "CREATE TABLE tst (i serial, v vector($dim));");
+$node->safe_psql("postgres",
+	"INSERT INTO tst (v) SELECT ARRAY[$array_sql] FROM generate_series(1, 10000) i;"
+);
+
+for my $method ("hnsw", "ivfflat")
+{
+	my $options = $method eq "ivfflat" ? " WITH (lists = 10)" : "";
+	my $set = $method eq "ivfflat" ? "SET ivfflat.probes = 10;" : "";
+	$node->safe_psql("postgres", "CREATE INDEX idx ON tst USING $method (v vector_l2_ops)$options;");
+
+	# Run queries to sample
+	for (1 .. 5)
+	{
+		$node->safe_psql("postgres", qq(
+			SET enable_seqscan = off;
+			$set
+			SELECT i FROM tst ORDER BY v <-> (SELECT v FROM tst ORDER BY random() LIMIT 1) LIMIT 10;
+		));
+	}
+
+	# Wait for samples
+	my $ready = $node->poll_query_until("postgres", "SELECT COUNT(*) > 0 FROM vector_recall WHERE index = 'idx'::regclass;");
+	ok($ready, "$method has recall");
+
+	my $recall = $node->safe_psql("postgres", "SELECT recall FROM vector_recall WHERE index = 'idx'::regclass;");
+	cmp_ok($recall, ">=", 0.9, "$method recall");
+
+	$node->safe_psql("postgres", "DROP INDEX idx;");
+}
+
+# Test table owned by another role
+$node->safe_psql("postgres", "CREATE ROLE alice;");
+$node->safe_psql("postgres", qq(
+	CREATE FUNCTION log_user(v vector) RETURNS vector AS \$\$
+	BEGIN
+		RAISE LOG 'log_user: % %', current_user, pg_backend_pid();
+		RETURN v;
+	END
+	\$\$ LANGUAGE plpgsql IMMUTABLE;
+));
+$node->safe_psql("postgres", "CREATE TABLE tst2 (i int4, v vector($dim));");
+$node->safe_psql("postgres",
+	"INSERT INTO tst2 SELECT i, ARRAY[$array_sql] FROM generate_series(1, 100) i;"
+);
+$node->safe_psql("postgres", "ALTER TABLE tst2 OWNER TO alice;");
+$node->safe_psql("postgres", "CREATE INDEX idx ON tst2 USING hnsw (log_user(v) vector_l2_ops);");
+
+my $offset = -s $node->logfile;
+
+$node->safe_psql("postgres", qq(
+	SET enable_seqscan = off;
+	SELECT i FROM tst2 ORDER BY log_user(v) <-> '[0,0,0]' LIMIT 10;
+));
+
+my $ready = $node->poll_query_until("postgres", "SELECT COUNT(*) > 0 FROM vector_recall WHERE index = 'idx'::regclass;");
+ok($ready, "owner has recall");
+
+# Expressions are evaluated as the table owner
+my $pid = $node->safe_psql("postgres", "SELECT pid FROM pg_stat_activity WHERE backend_type = 'pgvector recall worker';");
+my $log = substr(slurp_file($node->logfile), $offset);
+like($log, qr/log_user: alice $pid\b/);
+unlike($log, qr/log_user: (?!alice )\S+ $pid\b/);
+
+done_testing();
@@ -0,0 +1,70 @@
+use strict;
+use warnings;
+use PostgresNode;
+use TestLib;
+use Test::More;
+
+my $dim = 3;
+
+my $array_sql = join(",", ('random()') x $dim);
+
+# Initialize node
+my $node = get_new_node('node');
+$node->init;
+$node->append_conf('postgresql.conf', qq(
+shared_preload_libraries = 'vector'
+));
+$node->start;
+
+# Create table
+$node->safe_psql("postgres", "CREATE EXTENSION vector;");
+$node->safe_psql("postgres", "CREATE TABLE tst (i serial, v vector($dim));");
+$node->safe_psql("postgres",
+	"INSERT INTO tst (v) SELECT ARRAY[$array_sql] FROM generate_series(1, 10000) i;"
+);
+
+sub lock_count
+{
+	my ($lock) = @_;
+	return $node->safe_psql("postgres", "SELECT COALESCE(SUM(acquisitions), 0) FROM vector_lock_stats() WHERE indexrelid = 'idx'::regclass AND lock = '$lock';");
+}
+
+# Build
+$node->safe_psql("postgres", qq(
+	SET max_parallel_maintenance_workers = 2;
+	CREATE INDEX idx ON tst USING hnsw (v vector_l2_ops);
+));
+cmp_ok(lock_count("hnsw element"), ">", 0, "hnsw element locks");
+cmp_ok(lock_count("hnsw entry"), ">", 0, "hnsw entry locks");
+
+# Inserts
+$node->safe_psql("postgres",
+	"INSERT INTO tst (v) SELECT ARRAY[$array_sql] FROM generate_series(1, 100) i;"
+);
+cmp_ok(lock_count("hnsw update"), ">=", 100, "hnsw update locks");
+
+my $waits = $node->safe_psql("postgres", "SELECT COUNT(*) FROM vector_lock_stats() WHERE waits > acquisitions OR wait_time < 0;");
+is($waits, 0, "waits");
+
+$node->safe_psql("postgres", "DROP INDEX idx;");
+
+$node->safe_psql("postgres", "CREATE INDEX idx ON tst USING ivfflat (v vector_l2_ops) WITH (lists = 10);");
+$node->safe_psql("postgres",
+	"INSERT INTO tst (v) SELECT ARRAY[$array_sql] FROM generate_series(1, 100) i;"
+);
+cmp_ok(lock_count("ivfflat insert page"), ">=", 100, "ivfflat insert page locks");
+
+# Reset
+$node->safe_psql("postgres", "SELECT vector_lock_stats_reset();");
+my $count = $node->safe_psql("postgres", "SELECT COUNT(*) FROM vector_lock_stats();");
+is($count, 0, "reset");
+
+# Check a backend that already found the entry counts after a reset
+$node->safe_psql("postgres", qq(
+	INSERT INTO tst (v) SELECT ARRAY[$array_sql] FROM generate_series(1, 100) i;
+	SELECT vector_lock_stats_reset();
+	INSERT INTO tst (v) SELECT ARRAY[$array_sql] FROM generate_series(1, 100) i;
+));
+cmp_ok(lock_count("ivfflat insert page"), ">=", 100, "counts after reset");
+
+done_testing();
@@ -0,0 +1,64 @@
+use strict;
+use warnings;
+use PostgresNode;
+use TestLib;
+use Test::More;
+
+my $dim = 32;
+
+my $array_sql = join(",", ('random()') x $dim);
+
+# Initialize node
+my $node = get_new_node('node');
+$node->init;
+$node->start;
+
+# Create table
+$node->safe_psql("postgres", "CREATE EXTENSION vector;");
+$node->safe_psql("postgres", "CREATE TABLE tst (i int4, v vector($dim));");
+$node->safe_psql("postgres",
+	"INSERT INTO tst SELECT i, ARRAY[$array_sql] FROM generate_series(1, 50000) i;"
+);
+
+# Build HNSW index in memory
+my ($ret, $stdout, $stderr) = $node->psql("postgres", qq(
+	SET client_min_messages = DEBUG;
+	SET max_parallel_maintenance_workers = 0;
+	CREATE INDEX idx ON tst USING hnsw (v vector_l2_ops);
+));
+is($ret, 0, $stderr);
+like($stderr, qr/hnsw loading tuples: [\d.]+ s, 50000 tuples, \d+ tuples\/s/);
+like($stderr, qr/hnsw writing pages: [\d.]+ s/);
+like($stderr, qr/hnsw writing neighbors: [\d.]+ s/);
+like($stderr, qr/hnsw logging pages: [\d.]+ s/);
+unlike($stderr, qr/hnsw loading tuples on disk/);
+
+$node->safe_psql("postgres", "DROP INDEX idx;");
+
+# Build HNSW index on disk
+($ret, $stdout, $stderr) = $node->psql("postgres", qq(
+	SET client_min_messages = DEBUG;
+	SET max_parallel_maintenance_workers = 0;
+	SET maintenance_work_mem = '1MB';
+	CREATE INDEX idx ON tst USING hnsw (v vector_l2_ops);
+));
+is($ret, 0, $stderr);
+like($stderr, qr/hnsw graph no longer fits into maintenance_work_mem/);
+like($stderr, qr/hnsw loading tuples on disk: [\d.]+ s, \d+ tuples/);
+
+$node->safe_psql("postgres", "DROP INDEX idx;");
+
+# Build IVFFlat index
+($ret, $stdout, $stderr) = $node->psql("postgres", qq(
+	SET client_min_messages = DEBUG;
+	SET max_parallel_maintenance_workers = 0;
+	CREATE INDEX idx ON tst USING ivfflat (v vector_l2_ops) WITH (lists = 10);
+));
+is($ret, 0, $stderr);
+like($stderr, qr/ivfflat sampling table: [\d.]+ s, 10000 tuples/);
+like($stderr, qr/k-means iteration 1: \d+ changes, inertia /);
+like($stderr, qr/ivfflat performing k-means: [\d.]+ s/);
+like($stderr, qr/ivfflat sorting tuples: [\d.]+ s/);
+like($stderr, qr/ivfflat loading tuples: [\d.]+ s, 50000 tuples/);
+
+done_testing();
@@ -0,0 +1,113 @@
+use strict;
+use warnings;
+use PostgresNode;
+use TestLib;
+use Test::More;
+
+my $dim = 32;
+my $k = 10;
+
+my $array_sql = join(",", ('random()') x $dim);
+
+# Initialize node
+my $node = get_new_node('node');
+$node->init;
+$node->start;
+
+# Create table
+$node->safe_psql("postgres", "CREATE EXTENSION vector;");
+$node->safe_psql("postgres", "CREATE TABLE tst (i int4 PRIMARY KEY, v vector($dim));");
+$node->safe_psql("postgres",
+	"INSERT INTO tst SELECT i, ARRAY[$array_sql] FROM generate_series(1, 10000) i;"
+);
+$node->safe_psql("postgres", "CREATE INDEX idx ON tst USING hnsw (v vector_l2_ops);");
+
+$node->safe_psql("postgres", qq(
+	CREATE TABLE graph AS SELECT a.i, b.i AS neighbor, g.distance
+		FROM hnsw_knn_graph('idx', $k) g
+		JOIN tst a ON a.ctid = g.tid
+		JOIN tst b ON b.ctid = g.neighbor;
+));
+
+# Check count
+my $count = $node->safe_psql("postgres", "SELECT COUNT(*) FROM graph;");
+is($count, 10000 * $k, "count");
+
+# Check rows are not their own neighbors
+$count = $node->safe_psql("postgres", "SELECT COUNT(*) FROM graph WHERE i = neighbor;");
+is($count, 0, "no self");
+
+# Check distances
+$count = $node->safe_psql("postgres", qq(
+	SELECT COUNT(*) FROM graph
+		JOIN tst a ON a.i = graph.i
+		JOIN tst b ON b.i = graph.neighbor
+		WHERE abs((a.v <-> b.v) - graph.distance) > 1e-5;
+));
+is($count, 0, "distances");
+
+# Check recall
+my $recall = $node->safe_psql("postgres", qq(
+	SET enable_indexscan = off;
+	SELECT AVG(CASE WHEN e.neighbor IS NOT NULL THEN 1 ELSE 0 END) FROM (
+		SELECT a.i, n.i AS neighbor FROM tst a
+			CROSS JOIN LATERAL (SELECT i FROM tst b WHERE b.i != a.i ORDER BY a.v <-> b.v LIMIT $k) n
+			WHERE a.i <= 100
+	) x LEFT JOIN graph e ON e.i = x.i AND e.neighbor = x.neighbor;
+));
+cmp_ok($recall, ">=", 0.8, "recall");
+
+# Check duplicates
+$node->safe_psql("postgres", "INSERT INTO tst SELECT i + 10000, v FROM tst WHERE i <= 10;");
+$count = $node->safe_psql("postgres", qq(
+	SELECT COUNT(*) FROM hnsw_knn_graph('idx', 1) g
+		JOIN tst a ON a.ctid = g.tid
+		JOIN tst b ON b.ctid = g.neighbor
+		WHERE a.i <= 10 AND b.i = a.i + 10000 AND g.distance = 0;
+));
+is($count, 10, "duplicates");
+
+# Check deleted and aborted rows
+$node->safe_psql("postgres", "DELETE FROM tst WHERE i > 100 AND i <= 200;");
+$node->safe_psql("postgres", qq(
+	BEGIN;
+	INSERT INTO tst SELECT i + 20000, ARRAY[$array_sql] FROM generate_series(1, 100) i;
+	ROLLBACK;
+));
+$count = $node->safe_psql("postgres", qq(
+	SELECT COUNT(*) FROM hnsw_knn_graph('idx', $k) g
+		WHERE g.tid NOT IN (SELECT ctid FROM tst) OR g.neighbor NOT IN (SELECT ctid FROM tst);
+));
+is($count, 0, "visible");
+
+$count = $node->safe_psql("postgres", "SELECT COUNT(*) FROM hnsw_knn_graph('idx', $k);");
+my $expected = $node->safe_psql("postgres", "SELECT COUNT(*) * $k FROM tst;");
+is($count, $expected, "visible count");
+
+# Check row-level security
+$node->safe_psql("postgres", qq(
+	CREATE ROLE reader;
+	GRANT SELECT ON tst TO reader;
+	CREATE POLICY tst_policy ON tst FOR SELECT USING (i <= 10);
+	ALTER TABLE tst ENABLE ROW LEVEL SECURITY;
+));
+my ($ret, $stdout, $stderr) = $node->psql("postgres", "SET ROLE reader; SELECT * FROM hnsw_knn_graph('idx', $k);");
+like($stderr, qr/hnsw_knn_graph does not support tables with row-level security/);
+
+$node->safe_psql("postgres", "ALTER ROLE reader BYPASSRLS;");
+$count = $node->safe_psql("postgres", "SET ROLE reader; SELECT COUNT(*) FROM hnsw_knn_graph('idx', $k);");
+is($count, $expected, "bypass row-level security");
+$node->safe_psql("postgres", "ALTER TABLE tst DISABLE ROW LEVEL SECURITY;");
+
+# Check errors
+($ret, $stdout, $stderr) = $node->psql("postgres", "SELECT * FROM hnsw_knn_graph('tst_pkey', $k);");
+like($stderr, qr/"tst_pkey" is not an hnsw index/);
+
+($ret, $stdout, $stderr) = $node->psql("postgres", "SELECT * FROM hnsw_knn_graph('idx', 0);");
+like($stderr, qr/k must be greater than zero/);
+
+$node->safe_psql("postgres", "CREATE INDEX prefix_idx ON tst USING hnsw (v vector_l2_ops) WITH (prefix_dimensions = 1);");
+($ret, $stdout, $stderr) = $node->psql("postgres", "SELECT * FROM hnsw_knn_graph('prefix_idx', $k);");
+like($stderr, qr/hnsw_knn_graph does not support indexes with prefix_dimensions/);
+
+done_testing();
@@ -0,0 +1,57 @@
+use strict;
+use warnings;
+use PostgresNode;
+use TestLib;
+use Test::More;
+
+my $dim = 3;
+
+# Initialize node
+my $node = get_new_node('node');
+$node->init;
+$node->start;
+
+# Create table with three clusters
+$node->safe_psql("postgres", "CREATE EXTENSION vector;");
+$node->safe_psql("postgres", "CREATE TABLE tst (i int4, v vector($dim));");
+$node->safe_psql("postgres", qq(
+	INSERT INTO tst SELECT i, ARRAY[(i % 3) * 10 + random(), (i % 3) * 10 + random(), random()] FROM generate_series(1, 100000) i;
+));
+
+sub check_centers
+{
+	my ($settings, $name) = @_;
+
+	my $centers = $node->safe_psql("postgres", qq(
+		$settings
+		SELECT floor((c::real[])[1]) || ',' || floor((c::real[])[2]) FROM unnest((SELECT kmeans(v, 3) FROM tst)) u (c) ORDER BY 1;
+	));
+	is($centers, "0,0\n10,10\n20,20", $name);
+}
+
+check_centers("SET max_parallel_workers_per_gather = 0;", "serial");
+
+# Check parallel aggregate
+my $explain = $node->safe_psql("postgres", qq(
+	SET parallel_setup_cost = 0;
+	SET parallel_tuple_cost = 0;
+	SET min_parallel_table_scan_size = 0;
+	SET max_parallel_workers_per_gather = 2;
+	EXPLAIN SELECT kmeans(v, 3) FROM tst;
+));
+like($explain, qr/Partial Aggregate/);
+
+check_centers(qq(
+	SET parallel_setup_cost = 0;
+	SET parallel_tuple_cost = 0;
+	SET min_parallel_table_scan_size = 0;
+	SET max_parallel_workers_per_gather = 2;
+), "parallel");
+
+# Check spherical k-means
+my $norms = $node->safe_psql("postgres", qq(
+	SELECT COUNT(*) FROM unnest((SELECT kmeans(v, 3, 'cosine') FROM tst)) u (c) WHERE abs(vector_norm(c) - 1) > 1e-5;
+));
+is($norms, 0, "cosine centers are normalized");
+
+done_testing();
@@ -0,0 +1,83 @@
+use strict;
+use warnings;
+use PostgresNode;
+use TestLib;
+use Test::More;
+
+my $dim = 3;
+
+my $array_sql = join(",", ('random()') x $dim);
+
+# Initialize node
+my $node = get_new_node('node');
+$node->init;
+$node->start;
+
+# Create table
+$node->safe_psql("postgres", "CREATE EXTENSION vector;");
+$node->safe_psql("postgres", "CREATE TABLE tst (i int4, v vector($dim));");
+$node->safe_psql("postgres",
+	"INSERT INTO tst SELECT i, ARRAY[$array_sql] FROM generate_series(1, 5000) i;"
+);
+$node->safe_psql("postgres", "ANALYZE tst;");
+
+# Run advisor
+my $result = $node->safe_psql("postgres", qq(
+	SELECT method, options, search, recall, build_time >= 0, query_time >= 0, pareto
+	FROM vector_index_advisor('tst', 'v', 'vector_l2_ops', 2000, 20, 5);
+));
+my @rows = split("\n", $result);
+
+# 6 HNSW options with 6 ef_search values and 3 IVFFlat options with up to 3 probes
+is(scalar(@rows), 36 + 6);
+is(scalar(grep { /^hnsw\|m = 16, ef_construction = 64\|ef_search = 40\|/ } @rows), 1);
+is(scalar(grep { /^ivfflat\|lists = 4\|probes = \d+\|/ } @rows), 3);
+
+# A single list is exact
+is(scalar(grep { /^ivfflat\|lists = 1\|probes = 1\|1\|t\|t\|/ } @rows), 1);
+
+for my $row (@rows)
+{
+	my @fields = split(/\|/, $row);
+	cmp_ok($fields[3], ">=", 0, $row);
+	cmp_ok($fields[3], "<=", 1, $row);
+	is($fields[4], "t", $row);
+	is($fields[5], "t", $row);
+}
+
+# Check some settings are on the Pareto frontier
+cmp_ok(scalar(grep { /\|t$/ } @rows), ">", 0);
+
+# Check temporary objects are removed
+$result = $node->safe_psql("postgres", qq(
+	SELECT vector_index_advisor('tst', 'v', 'vector_l2_ops', 2000, 20, 5) LIMIT 1;
+	SELECT COUNT(*) FROM pg_class WHERE relname LIKE 'vector_advisor%';
+));
+like($result, qr/\n0$/);
+
+# Check ef_search below k is skipped
+$result = $node->safe_psql("postgres", qq(
+	SELECT COUNT(*) FROM vector_index_advisor('tst', 'v', 'vector_l2_ops', 2000, 20, 50) WHERE method = 'hnsw';
+));
+is($result, 6 * 3);
+
+# Check operator class only for HNSW
+$result = $node->safe_psql("postgres", qq(
+	SELECT DISTINCT method FROM vector_index_advisor('tst', 'v', 'vector_l1_ops', 2000, 20, 5);
+));
+is($result, "hnsw");
+
+# Check errors
+my ($ret, $stdout, $stderr) = $node->psql("postgres",
+	"SELECT * FROM vector_index_advisor('tst', 'v', 'missing_ops');");
+like($stderr, qr/operator class "missing_ops" does not exist for hnsw or ivfflat/);
+
+($ret, $stdout, $stderr) = $node->psql("postgres",
+	"SELECT * FROM vector_index_advisor('tst', 'v', 'vector_l2_ops', 10, 20, 50);");
+like($stderr, qr/table has too few rows/);
+
+($ret, $stdout, $stderr) = $node->psql("postgres",
+	"SELECT * FROM vector_index_advisor('tst', 'v', 'vector_l2_ops', 2000, 20, 0);");
+like($stderr, qr/sample_rows, queries, and k must be greater than zero/);
+
+done_testing();
@@ -0,0 +1,138 @@
+use strict;
+use warnings;
+use PostgresNode;
+use TestLib;
+use Test::More;
+
+# Initialize node
+my $node = get_new_node('node');
+$node->init;
+$node->start;
+
+my $dir = $node->basedir;
+
+$node->safe_psql("postgres", "CREATE EXTENSION vector;");
+
+sub write_file
+{
+	my ($path, $data) = @_;
+
+	open(my $fh, '>:raw', $path) or die "could not open $path: $!";
+	print $fh $data;
+	close($fh);
+}
+
+sub npy
+{
+	my ($descr, $rows, $dim, $data) = @_;
+
+	my $header = "{'descr': '$descr', 'fortran_order': False, 'shape': ($rows, $dim), }";
+	$header .= ' ' x (63 - (10 + length($header)) % 64) . "\n";
+	return "\x93NUMPY\x01\x00" . pack('v', length($header)) . $header . $data;
+}
+
+# Read fvecs
+write_file("$dir/test.fvecs", pack('l<f<3l<f<3', 3, 1, 2, 3, 3, 4, 5, 6));
+my $result = $node->safe_psql("postgres", "SELECT * FROM vector_read_file('$dir/test.fvecs');");
+is($result, "[1,2,3]\n[4,5,6]");
+
+$result = $node->safe_psql("postgres", "SELECT * FROM halfvec_read_file('$dir/test.fvecs');");
+is($result, "[1,2,3]\n[4,5,6]");
+
+# Read bvecs
+write_file("$dir/test.bvecs", pack('l<C2l<C2', 2, 0, 255, 2, 7, 8));
+$result = $node->safe_psql("postgres", "SELECT * FROM vector_read_file('$dir/test.bvecs');");
+is($result, "[0,255]\n[7,8]");
+
+# Read npy
+write_file("$dir/f4.npy", npy('<f4', 2, 2, pack('f<4', 1.5, 2, 3, 4)));
+$result = $node->safe_psql("postgres", "SELECT * FROM vector_read_file('$dir/f4.npy');");
+is($result, "[1.5,2]\n[3,4]");
+
+write_file("$dir/f8.npy", npy('<f8', 1, 3, pack('d<3', 1, 2, 3)));
+$result = $node->safe_psql("postgres", "SELECT * FROM vector_read_file('$dir/f8.npy');");
+is($result, "[1,2,3]");
+
+# Read with format
+write_file("$dir/test.bin", pack('l<f<2', 2, 1, 2));
+$result = $node->safe_psql("postgres", "SELECT * FROM vector_read_file('$dir/test.bin', 'fvecs');");
+is($result, "[1,2]");
+
+# Write and read back
+$node->safe_psql("postgres", "CREATE TABLE tst (i int4, v vector(3));");
+$node->safe_psql("postgres",
+	"INSERT INTO tst SELECT i, ARRAY[random(), random(), random()] FROM generate_series(1, 10000) i;"
+);
+
+for my $file ("out.npy", "out.fvecs")
+{
+	$result = $node->safe_psql("postgres", "SELECT vector_write_file('$dir/$file', 'SELECT v FROM tst ORDER BY i');");
+	is($result, 10000);
+
+	$result = $node->safe_psql("postgres", qq(
+		SELECT COUNT(*) FROM (SELECT v, row_number() OVER () AS i FROM vector_read_file('$dir/$file')) f
+		INNER JOIN tst ON tst.i = f.i AND tst.v = f.v;
+	));
+	is($result, 10000);
+}
+
+$result = $node->safe_psql("postgres", "SELECT halfvec_write_file('$dir/half.npy', 'SELECT v FROM tst ORDER BY i');");
+is($result, 10000);
+
+# Check reading stops early
+$result = $node->safe_psql("postgres", "SELECT COUNT(*) FROM (SELECT * FROM vector_read_file('$dir/out.npy') LIMIT 5) f;");
+is($result, 5);
+
+$result = $node->safe_psql("postgres", qq(
+	SELECT COUNT(*) FROM (SELECT v, row_number() OVER () AS i FROM halfvec_read_file('$dir/half.npy')) f
+	INNER JOIN tst ON tst.i = f.i AND tst.v::halfvec = f.v;
+));
+is($result, 10000);
+
+# Check npy header is readable by the reader for an empty result
+$result = $node->safe_psql("postgres", "SELECT vector_write_file('$dir/empty.npy', 'SELECT v FROM tst WHERE false');");
+is($result, 0);
+$result = $node->safe_psql("postgres", "SELECT COUNT(*) FROM vector_read_file('$dir/empty.npy');");
+is($result, 0);
+
+# Check errors
+my ($ret, $stdout, $stderr) = $node->psql("postgres", "SELECT * FROM vector_read_file('$dir/test.txt');");
+like($stderr, qr/unsupported format "txt"/);
+
+write_file("$dir/short.fvecs", pack('l<f<2', 3, 1, 2));
+($ret, $stdout, $stderr) = $node->psql("postgres", "SELECT * FROM vector_read_file('$dir/short.fvecs');");
+like($stderr, qr/unexpected end of file/);
+
+write_file("$dir/nan.fvecs", pack('l<f<', 1, 'NaN'));
+($ret, $stdout, $stderr) = $node->psql("postgres", "SELECT * FROM vector_read_file('$dir/nan.fvecs');");
+like($stderr, qr/NaN not allowed in vector/);
+
+write_file("$dir/i4.npy", npy('<i4', 1, 1, pack('l<', 1)));
+($ret, $stdout, $stderr) = $node->psql("postgres", "SELECT * FROM vector_read_file('$dir/i4.npy');");
+like($stderr, qr/unsupported npy dtype/);
+
+($ret, $stdout, $stderr) = $node->psql("postgres", "SELECT vector_write_file('$dir/out.bvecs', 'SELECT v FROM tst');");
+like($stderr, qr/bvecs format is only supported for reading/);
+
+($ret, $stdout, $stderr) = $node->psql("postgres", "SELECT vector_write_file('$dir/out.npy', 'SELECT ''[1]''::vector UNION ALL SELECT ''[1,2]''::vector');");
+like($stderr, qr/npy files require the same dimensions for all rows/);
+
+# Check privileges
+$node->safe_psql("postgres", "CREATE ROLE tst_user;");
+($ret, $stdout, $stderr) = $node->psql("postgres", "SET ROLE tst_user; SELECT * FROM vector_read_file('$dir/test.fvecs');");
+like($stderr, qr/permission denied for function vector_read_file/);
+
+# Check server file roles are required after EXECUTE is granted
+$node->safe_psql("postgres", "GRANT EXECUTE ON FUNCTION vector_read_file(text), vector_write_file(text, text) TO tst_user;");
+($ret, $stdout, $stderr) = $node->psql("postgres", "SET ROLE tst_user; SELECT * FROM vector_read_file('$dir/test.fvecs');");
+like($stderr, qr/permission denied to read file/);
+($ret, $stdout, $stderr) = $node->psql("postgres", "SET ROLE tst_user; SELECT vector_write_file('$dir/user.fvecs', 'SELECT ''[1,2,3]''::vector');");
+like($stderr, qr/permission denied to write file/);
+
+$node->safe_psql("postgres", "GRANT pg_read_server_files, pg_write_server_files TO tst_user;");
+$result = $node->safe_psql("postgres", "SET ROLE tst_user; SELECT * FROM vector_read_file('$dir/test.fvecs');");
+is($result, "[1,2,3]\n[4,5,6]");
+$result = $node->safe_psql("postgres", "SET ROLE tst_user; SELECT vector_write_file('$dir/user.fvecs', 'SELECT ''[1,2,3]''::vector');");
+is($result, 1);
+
+done_testing();
@@ -0,0 +1,141 @@
+use strict;
+use warnings;
+use PostgresNode;
+use TestLib;
+use Test::More;
+
+my $dim = 3;
+my $groups = 500;
+
+my $array_sql = join(",", map { "c[$_] + random() * 0.01" } (1 .. $dim));
+my $query_sql = join(",", ('random()') x $dim);
+
+# Initialize node
+my $node = get_new_node('node');
+$node->init;
+$node->start;
+
+# Create table with chunks that are close to other chunks in the same group
+$node->safe_psql("postgres", "CREATE EXTENSION vector;");
+$node->safe_psql("postgres", "CREATE TABLE tst (i int4, g int4, v vector($dim));");
+$node->safe_psql("postgres", "CREATE TABLE centers AS SELECT g, ARRAY[$query_sql] AS c FROM generate_series(0, $groups - 1) g;");
+$node->safe_psql("postgres",
+	"INSERT INTO tst SELECT i, i % $groups, ARRAY[$array_sql] FROM generate_series(1, 10000) i INNER JOIN centers ON centers.g = i % $groups;"
+);
+$node->safe_psql("postgres", "ANALYZE tst;");
+
+sub exact_groups
+{
+	my ($query, $k) = @_;
+
+	return $node->safe_psql("postgres", qq(
+		SELECT string_agg(g::text, ',' ORDER BY d) FROM (
+			SELECT g, d FROM (SELECT DISTINCT ON (g) g, v <-> '$query' AS d FROM tst ORDER BY g, v <-> '$query') s ORDER BY d LIMIT $k
+		) s;
+	));
+}
+
+sub search_groups
+{
+	my ($query, $k) = @_;
+
+	return $node->safe_psql("postgres", qq(
+		SELECT string_agg(group_key, ',' ORDER BY distance) FROM vector_group_search('tst', 'v', 'g', '$query'::vector, $k);
+	));
+}
+
+my @queries = ();
+for (1 .. 20)
+{
+	push(@queries, "[" . join(",", map { rand() } (1 .. $dim)) . "]");
+}
+
+# Check exact without an index
+for my $query (@queries[0 .. 4])
+{
+	is(search_groups($query, 10), exact_groups($query, 10));
+}
+
+# Check recall with an index
+$node->safe_psql("postgres", "CREATE INDEX ON tst USING hnsw (v vector_l2_ops);");
+
+my $correct = 0;
+for my $query (@queries)
+{
+	my %expected = map { $_ => 1 } split(",", exact_groups($query, 10));
+	my @actual = split(",", search_groups($query, 10));
+
+	# Groups should be distinct
+	my %seen = map { $_ => 1 } @actual;
+	is(scalar(keys %seen), scalar(@actual));
+
+	$correct += scalar(grep { $expected{$_} } @actual);
+}
+cmp_ok($correct / (10 * scalar(@queries)), ">=", 0.9);
+
+# Check rows per group
+my $result = $node->safe_psql("postgres", qq(
+	SELECT COUNT(*), COUNT(DISTINCT group_key), MAX(c) FROM (
+		SELECT group_key, COUNT(*) OVER (PARTITION BY group_key) AS c FROM vector_group_search('tst', 'v', 'g', '$queries[0]'::vector, 10, per_group => 2)
+	) s;
+));
+is($result, "20|10|2");
+
+# Check tids point to rows in the group
+$result = $node->safe_psql("postgres", qq(
+	SELECT COUNT(*) FROM vector_group_search('tst', 'v', 'g', '$queries[0]'::vector, 10, op => '<=>') s
+	INNER JOIN tst ON tst.ctid = s.tid AND tst.g::text = s.group_key AND tst.v <=> '$queries[0]' = s.distance;
+));
+is($result, 10);
+
+# Check ef_search is restored
+$result = $node->safe_psql("postgres", qq(
+	SELECT COUNT(*) FROM vector_group_search('tst', 'v', 'g', '$queries[0]'::vector, 20);
+	SHOW hnsw.ef_search;
+));
+is($result, "20\n40");
+
+# Check fewer groups are reported when ef_search is capped
+my ($ret, $stdout, $stderr) = $node->psql("postgres", qq(
+	SELECT COUNT(*) FROM vector_group_search('tst', 'v', 'g', '$queries[0]'::vector, 200);
+));
+cmp_ok($stdout, "<", 200);
+like($stderr, qr/vector_group_search found \d+ of 200 groups/);
+like($stderr, qr/Use exact_fallback => true/);
+
+# Check an exact scan is used with exact_fallback
+for my $query (@queries[0 .. 2])
+{
+	is($node->safe_psql("postgres", qq(
+		SELECT string_agg(group_key, ',' ORDER BY distance) FROM vector_group_search('tst', 'v', 'g', '$query'::vector, 200, exact_fallback => true);
+	)), exact_groups($query, 200));
+}
+($ret, $stdout, $stderr) = $node->psql("postgres", qq(
+	SELECT COUNT(*) FROM vector_group_search('tst', 'v', 'g', '$queries[0]'::vector, 200, exact_fallback => true);
+	SHOW enable_indexscan;
+));
+is($stdout, "200\non");
+like($stderr, qr/repeating with an exact scan/);
+
+# Check an exact scan is used when probes limit the lists scanned
+$node->safe_psql("postgres", "DROP INDEX tst_v_idx;");
+$node->safe_psql("postgres", "CREATE INDEX ON tst USING ivfflat (v vector_l2_ops) WITH (lists = 100);");
+for my $query (@queries[0 .. 2])
+{
+	is($node->safe_psql("postgres", qq(
+		SET enable_seqscan = off;
+		SELECT string_agg(group_key, ',' ORDER BY distance) FROM vector_group_search('tst', 'v', 'g', '$query'::vector, 50, exact_fallback => true);
+	)), exact_groups($query, 50));
+}
+
+# Check errors
+($ret, $stdout, $stderr) = $node->psql("postgres", "SELECT * FROM vector_group_search('tst', 'v', 'g', '$queries[0]'::vector, 0);");
+like($stderr, qr/k and per_group must be greater than zero/);
+
+($ret, $stdout, $stderr) = $node->psql("postgres", "SELECT * FROM vector_group_search('tst', 'v', 'g', '$queries[0]'::vector, 10, op => '<!>');");
+like($stderr, qr/operator does not exist: vector <!> vector/);
+
+($ret, $stdout, $stderr) = $node->psql("postgres", "SELECT * FROM vector_group_search('tst', 'v', 'g', '$queries[0]'::vector, 10, op => '=');");
+like($stderr, qr/operator = must return double precision/);
+
+done_testing();
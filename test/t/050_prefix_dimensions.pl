@@ -0,0 +1,214 @@
+use strict;
+use warnings;
+use PostgresNode;
+use TestLib;
+use Test::More;
+
+my $node;
+my @queries = ();
+my @expected;
+my $dim = 16;
+my $limit = 20;
+
+# Leading dimensions have more variance, like Matryoshka embeddings
+my $array_sql = join(",", map { "random() / $_" } (1 .. $dim));
+
+sub test_recall
+{
+	my ($min, $settings) = @_;
+	my $correct = 0;
+	my $total = 0;
+
+	my $explain = $node->safe_psql("postgres", qq(
+		SET enable_seqscan = off;
+		$settings
+		EXPLAIN ANALYZE SELECT i FROM tst ORDER BY v <-> '$queries[0]' LIMIT $limit;
+	));
+	like($explain, qr/Index Scan/);
+
+	for my $i (0 .. $#queries)
+	{
+		my $actual = $node->safe_psql("postgres", qq(
+			SET enable_seqscan = off;
+			$settings
+			SELECT i, v <-> '$queries[$i]' FROM tst ORDER BY v <-> '$queries[$i]' LIMIT $limit;
+		));
+		my @rows = map { [split(/\|/, $_)] } split("\n", $actual);
+		my %actual_set = map { $_->[0] => 1 } @rows;
+
+		# Results must be ordered by the full distance
+		my $ordered = 1;
+		for my $j (1 .. $#rows)
+		{
+			$ordered = 0 if $rows[$j]->[1] < $rows[$j - 1]->[1];
+		}
+		ok($ordered);
+
+		my @expected_ids = split("\n", $expected[$i]);
+
+		foreach (@expected_ids)
+		{
+			if (exists($actual_set{$_}))
+			{
+				$correct++;
+			}
+			$total++;
+		}
+	}
+
+	cmp_ok($correct / $total, ">=", $min);
+}
+
+# Initialize node
+$node = get_new_node('node');
+$node->init;
+$node->start;
+
+# Create table
+$node->safe_psql("postgres", "CREATE EXTENSION vector;");
+$node->safe_psql("postgres", "CREATE TABLE tst (i int4, v vector($dim));");
+$node->safe_psql("postgres",
+	"INSERT INTO tst SELECT i, ARRAY[$array_sql] FROM generate_series(1, 5000) i;"
+);
+
+# Generate queries
+for (1 .. 20)
+{
+	push(@queries, "[" . join(",", map { rand() / $_ } (1 .. $dim)) . "]");
+}
+
+# Get exact results
+@expected = ();
+foreach (@queries)
+{
+	my $res = $node->safe_psql("postgres", "SELECT i FROM tst ORDER BY v <-> '$_' LIMIT $limit;");
+	push(@expected, $res);
+}
+
+# Test HNSW
+$node->safe_psql("postgres", "CREATE INDEX idx ON tst USING hnsw (v vector_l2_ops) WITH (prefix_dimensions = 8);");
+test_recall(0.9, "SET hnsw.ef_search = 100;");
+
+# Test with and without heap prefetching
+test_recall(0.9, "SET hnsw.ef_search = 100; SET effective_io_concurrency = 0;");
+test_recall(0.9, "SET hnsw.ef_search = 100; SET effective_io_concurrency = 1;");
+test_recall(0.9, "SET hnsw.ef_search = 100; SET effective_io_concurrency = 16;");
+$node->safe_psql("postgres", "DROP INDEX idx;");
+
+# Test IVFFlat (all lists are probed, so only refinement affects results)
+$node->safe_psql("postgres", "CREATE INDEX idx ON tst USING ivfflat (v vector_l2_ops) WITH (lists = 10, prefix_dimensions = 8);");
+test_recall(0.99, "SET ivfflat.probes = 10;");
+$node->safe_psql("postgres", "DROP INDEX idx;");
+
+# Test inserts after build
+$node->safe_psql("postgres", "CREATE TABLE tst2 (i int4, v vector($dim));");
+$node->safe_psql("postgres", "CREATE INDEX ON tst2 USING hnsw (v vector_l1_ops) WITH (prefix_dimensions = 8);");
+$node->safe_psql("postgres", "CREATE INDEX ON tst2 USING ivfflat (v vector_l2_ops) WITH (lists = 1, prefix_dimensions = 8);");
+$node->safe_psql("postgres", "INSERT INTO tst2 SELECT i, ARRAY[$array_sql] FROM generate_series(1, 100) i;");
+for my $operator ("<+>", "<->")
+{
+	my $count = $node->safe_psql("postgres", qq(
+		SET enable_seqscan = off;
+		SET hnsw.ef_search = 100;
+		SELECT COUNT(*) FROM (SELECT i FROM tst2 ORDER BY v $operator '$queries[0]') t;
+	));
+	is($count, 100, $operator);
+}
+
+# Test queries during concurrent inserts in other regions
+$node->safe_psql("postgres", "CREATE TABLE tst4 (i int4, v vector($dim));");
+$node->safe_psql("postgres", "INSERT INTO tst4 SELECT i, ARRAY[$array_sql] FROM generate_series(1, 2000) i;");
+for my $method ("hnsw", "ivfflat")
+{
+	my $with = $method eq "hnsw" ? "prefix_dimensions = 8" : "lists = 10, prefix_dimensions = 8";
+	$node->safe_psql("postgres", "CREATE INDEX idx ON tst4 USING $method (v vector_l2_ops) WITH ($with);");
+
+	# Inserted vectors are far from the query, so they land in other lists and graph regions
+	my $far_sql = join(",", map { "10 + random() / $_" } (1 .. $dim));
+
+	$node->pgbench(
+		"--no-vacuum --client=4 --transactions=50",
+		0,
+		[qr{actually processed}],
+		[qr{^$}],
+		"concurrent queries with $method",
+		{
+			"050_prefix_inserts" => "INSERT INTO tst4 SELECT -i, ARRAY[$far_sql] FROM generate_series(1, 10) i;",
+			"050_prefix_queries" => qq(
+				SET enable_seqscan = off;
+				SET hnsw.ef_search = 100;
+				SET ivfflat.probes = 10;
+				SELECT i FROM tst4 ORDER BY v <-> '$queries[0]' LIMIT $limit;
+			)
+		}
+	);
+
+	my $actual = $node->safe_psql("postgres", qq(
+		SET enable_seqscan = off;
+		SET hnsw.ef_search = 100;
+		SET ivfflat.probes = 10;
+		SELECT string_agg(i::text, ',' ORDER BY d) FROM (SELECT i, v <-> '$queries[0]' AS d FROM tst4 ORDER BY v <-> '$queries[0]' LIMIT 5) t;
+	));
+	my $exact = $node->safe_psql("postgres", qq(
+		SET enable_indexscan = off;
+		SELECT string_agg(i::text, ',' ORDER BY d) FROM (SELECT i, v <-> '$queries[0]' AS d FROM tst4 ORDER BY v <-> '$queries[0]' LIMIT 5) t;
+	));
+	if ($method eq "ivfflat")
+	{
+		# All lists are probed, so results must be exact
+		is($actual, $exact, "$method after concurrent inserts");
+	}
+	else
+	{
+		# Inserted rows must not displace nearer rows
+		unlike($actual, qr/-/, "$method after concurrent inserts");
+	}
+
+	$node->safe_psql("postgres", "DROP INDEX idx;");
+	$node->safe_psql("postgres", "DELETE FROM tst4 WHERE i < 0;");
+}
+
+# Test the lower bound margin when the prefix distance equals the full distance
+# (the last dimension is zero, so only the summation order differs)
+$node->safe_psql("postgres", "CREATE TABLE tst5 (i int4, v halfvec(4000));");
+$node->safe_psql("postgres", qq(
+	INSERT INTO tst5 SELECT i, (SELECT array_agg(CASE WHEN j < 4000 THEN random() * 100 ELSE 0 END) FROM generate_series(1, 4000) j WHERE i > 0)::halfvec
+	FROM generate_series(1, 200) i;
+));
+for my $method ("hnsw", "ivfflat")
+{
+	for my $opclass ("halfvec_l2_ops", "halfvec_l1_ops")
+	{
+		next if $method eq "ivfflat" && $opclass eq "halfvec_l1_ops";
+
+		my $with = $method eq "hnsw" ? "prefix_dimensions = 3999" : "lists = 1, prefix_dimensions = 3999";
+		my $operator = $opclass eq "halfvec_l2_ops" ? "<->" : "<+>";
+		$node->safe_psql("postgres", "CREATE INDEX idx ON tst5 USING $method (v $opclass) WITH ($with);");
+
+		# The executor errors if a lower bound is greater than the full distance
+		my $actual = $node->safe_psql("postgres", qq(
+			SET enable_seqscan = off;
+			SET hnsw.ef_search = 200;
+			SELECT i, v $operator (SELECT v FROM tst5 WHERE i = 1) FROM tst5 ORDER BY v $operator (SELECT v FROM tst5 WHERE i = 1);
+		));
+		my @rows = map { [split(/\|/, $_)] } split("\n", $actual);
+		is(scalar(@rows), 200, "$method $opclass");
+		is($rows[0]->[0], 1, "$method $opclass");
+
+		my $ordered = 1;
+		for my $j (1 .. $#rows)
+		{
+			$ordered = 0 if $rows[$j]->[1] < $rows[$j - 1]->[1];
+		}
+		ok($ordered, "$method $opclass");
+
+		$node->safe_psql("postgres", "DROP INDEX idx;");
+	}
+}
+
+# Test types without prefixes
+$node->safe_psql("postgres", "CREATE TABLE tst3 (v bit(8));");
+my ($ret, $stdout, $stderr) = $node->psql("postgres", "CREATE INDEX ON tst3 USING hnsw (v bit_hamming_ops) WITH (prefix_dimensions = 4);");
+like($stderr, qr/prefix_dimensions not supported for this type/);
+
+done_testing();